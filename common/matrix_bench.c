@@ -0,0 +1,208 @@
+#include "matrix_bench.h"
+#include <stdio.h>
+#include <string.h>
+
+// Private engine, so the driver's queues and statistics stay untouched
+static MatrixEngine bench_engine;
+
+typedef struct {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+} BenchSamples;
+
+static void samples_reset(BenchSamples *s) {
+    s->count = 0;
+    s->min = UINT32_MAX;
+    s->max = 0;
+    s->sum = 0;
+}
+
+static void samples_add(BenchSamples *s, uint32_t value) {
+    s->count++;
+    s->sum += value;
+    if (value < s->min) {
+        s->min = value;
+    }
+    if (value > s->max) {
+        s->max = value;
+    }
+}
+
+// Cost of reading the counter twice, taken off every sample
+static uint32_t clock_overhead(const MatrixBench *b) {
+    uint32_t best = UINT32_MAX;
+    for (int i = 0; i < 64; i++) {
+        uint32_t start = b->read();
+        uint32_t d = (b->read() - start) & b->mask;
+        if (d < best) {
+            best = d;
+        }
+    }
+    return best;
+}
+
+static uint32_t elapsed(const MatrixBench *b, uint32_t start, uint32_t overhead) {
+    uint32_t d = (b->read() - start) & b->mask;
+    return (d > overhead) ? d - overhead : 0;
+}
+
+static uint32_t to_ns(const MatrixBench *b, uint64_t counts) {
+    return (uint32_t)(counts * 1000000000ull / b->hz);
+}
+
+static const char *strategy_name(ScanStrategy strategy) {
+    return (strategy == SCAN_STRATEGY_BURST) ? "burst" : "interleaved";
+}
+
+static void print_samples(const MatrixBench *b, const char *bench, const char *strategy,
+                          const char *load, uint32_t per, const BenchSamples *s) {
+    uint64_t mean = s->count ? s->sum / s->count : 0;
+    printf("{\"bench\":\"%s\",\"platform\":\"%s\",\"strategy\":\"%s\",\"load\":\"%s\","
+           "\"rows\":%d,\"cols\":%d,\"iterations\":%lu,\"per\":%lu,"
+           "\"min\":%lu,\"mean\":%lu,\"max\":%lu,\"unit\":\"cycles\",\"mean_ns\":%lu}\n",
+           bench, b->platform, strategy, load, MATRIX_ROWS, MATRIX_COLS,
+           (unsigned long)s->count, (unsigned long)per,
+           (unsigned long)(s->count ? s->min : 0), (unsigned long)mean, (unsigned long)s->max,
+           (unsigned long)to_ns(b, mean));
+}
+
+static void bench_engine_setup(ScanStrategy strategy, uint32_t press_ms, uint32_t release_ms,
+                               uint32_t sample_period_us) {
+    matrix_engine_init(&bench_engine);
+    bench_engine.strategy = strategy;
+    matrix_engine_configure_debounce(&bench_engine, DEBOUNCE_DEFER_PRESS_EAGER_RELEASE,
+                                     press_ms, release_ms, sample_period_us);
+    matrix_engine_restart(&bench_engine);
+}
+
+static void bench_drain(void) {
+    KeyEvent events[EVENT_QUEUE_SIZE];
+    ErrorEvent error;
+    while (matrix_engine_get_events(&bench_engine, events, EVENT_QUEUE_SIZE) > 0) {
+    }
+    while (matrix_engine_get_error(&bench_engine, &error)) {
+    }
+}
+
+void matrix_bench_scan_idle(const MatrixBench *b, ScanStrategy strategy, uint32_t iterations) {
+    BenchSamples s;
+    uint32_t overhead = clock_overhead(b);
+
+    // 1 us sample period: ticks run back to back, and every one of them
+    // must still take a full debounce sample
+    bench_engine_setup(strategy, DEBOUNCE_PRESS_MS, DEBOUNCE_RELEASE_MS, 1);
+    samples_reset(&s);
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint32_t start = b->read();
+        matrix_engine_scan(&bench_engine, UINT32_MAX / 2);
+        samples_add(&s, elapsed(b, start, overhead));
+    }
+    bench_drain();
+
+    print_samples(b, "scan", strategy_name(strategy), "idle", 1, &s);
+}
+
+// One tick's engine work for a synthetic sample (pins are not read)
+static void feed_tick(ScanStrategy strategy, matrix_row_t sample, uint32_t now_us, uint8_t *row) {
+    if (strategy == SCAN_STRATEGY_BURST) {
+        for (int r = 0; r < MATRIX_ROWS; r++) {
+            matrix_engine_process_row(&bench_engine, r, sample, 0, now_us);
+        }
+    } else {
+        matrix_engine_process_row(&bench_engine, *row, sample, 0, now_us);
+        *row = (*row + 1) % MATRIX_ROWS;
+    }
+}
+
+void matrix_bench_scan_loaded(const MatrixBench *b, ScanStrategy strategy, uint32_t iterations) {
+    BenchSamples s;
+    uint32_t overhead = clock_overhead(b);
+    uint32_t period = 1000;
+    uint32_t ticks_per_pass = (strategy == SCAN_STRATEGY_BURST) ? 1 : MATRIX_ROWS;
+    uint32_t now_us = 0;
+    uint8_t row = 0;
+
+    // all_held: press everything (no ghost suppression), then time ticks
+    // that only re-confirm the held keys and check them for stuck
+    bench_engine_setup(strategy, DEBOUNCE_PRESS_MS, DEBOUNCE_RELEASE_MS, period * ticks_per_pass);
+    bench_engine.ghost_detection_enabled = false;
+    bench_engine.stuck_key_timeout = UINT32_MAX;
+    for (uint32_t i = 0; i < (DEBOUNCE_MAX_SAMPLES + 1) * ticks_per_pass; i++) {
+        feed_tick(strategy, MATRIX_COL_MASK, now_us, &row);
+        now_us += period;
+        bench_drain();
+    }
+
+    samples_reset(&s);
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint32_t start = b->read();
+        feed_tick(strategy, MATRIX_COL_MASK, now_us, &row);
+        samples_add(&s, elapsed(b, start, overhead));
+        now_us += period;
+    }
+    print_samples(b, "scan", strategy_name(strategy), "all_held", 1, &s);
+
+    // all_change: no debounce, every key flips on every sample of its row
+    bench_engine_setup(strategy, 0, 0, period * ticks_per_pass);
+    bench_engine.ghost_detection_enabled = false;
+    now_us = 0;
+    row = 0;
+
+    samples_reset(&s);
+    for (uint32_t i = 0; i < iterations; i++) {
+        matrix_row_t sample = ((i / ticks_per_pass) & 1) ? 0 : MATRIX_COL_MASK;
+        uint32_t start = b->read();
+        feed_tick(strategy, sample, now_us, &row);
+        samples_add(&s, elapsed(b, start, overhead));
+        now_us += period;
+        bench_drain();
+    }
+    print_samples(b, "scan", strategy_name(strategy), "all_change", 1, &s);
+}
+
+void matrix_bench_queue(const MatrixBench *b, uint32_t iterations) {
+    BenchSamples push, pop;
+    uint32_t overhead = clock_overhead(b);
+    KeyEvent events[EVENT_QUEUE_SIZE];
+    KeyEvent event;
+
+    bench_engine_setup(SCAN_STRATEGY_INTERLEAVED, DEBOUNCE_PRESS_MS, DEBOUNCE_RELEASE_MS, 1000);
+    memset(&event, 0, sizeof(event));
+    event.state = KEY_PRESSED;
+    samples_reset(&push);
+    samples_reset(&pop);
+
+    // Fill the ring, then empty it in one batch; costs are per event
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint32_t start = b->read();
+        for (uint32_t n = 0; n < EVENT_QUEUE_SIZE; n++) {
+            matrix_ring_push(&bench_engine.event_queue, &event);
+        }
+        samples_add(&push, elapsed(b, start, overhead) / EVENT_QUEUE_SIZE);
+
+        start = b->read();
+        matrix_engine_get_events(&bench_engine, events, EVENT_QUEUE_SIZE);
+        samples_add(&pop, elapsed(b, start, overhead) / EVENT_QUEUE_SIZE);
+    }
+
+    print_samples(b, "queue", "-", "push", EVENT_QUEUE_SIZE, &push);
+    print_samples(b, "queue", "-", "get_events", EVENT_QUEUE_SIZE, &pop);
+}
+
+void matrix_bench_print_stats(const MatrixBench *b, const char *backend, const ScanStatistics *s) {
+    printf("{\"bench\":\"driver\",\"platform\":\"%s\",\"backend\":\"%s\",\"rows\":%d,\"cols\":%d,"
+           "\"scans\":%lu,\"isr_mean_us\":%lu,\"isr_p99_us\":%lu,\"isr_max_us\":%lu,"
+           "\"jitter_p99_us\":%lu,\"jitter_max_us\":%lu,\"missed_scans\":%lu,\"scan_overruns\":%lu}\n",
+           b->platform, backend, MATRIX_ROWS, MATRIX_COLS,
+           (unsigned long)s->total_scans,
+           (unsigned long)latency_hist_mean(&s->isr_time_us),
+           (unsigned long)latency_hist_percentile(&s->isr_time_us, 99),
+           (unsigned long)s->isr_time_us.max,
+           (unsigned long)latency_hist_percentile(&s->scan_jitter_us, 99),
+           (unsigned long)s->scan_jitter_us.max,
+           (unsigned long)s->missed_scans,
+           (unsigned long)s->scan_overruns);
+}
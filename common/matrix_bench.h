@@ -0,0 +1,44 @@
+#ifndef MATRIX_BENCH_H
+#define MATRIX_BENCH_H
+
+#include <stdint.h>
+#include "matrix_engine.h"
+
+// Scan path benchmarks shared by the firmware and host bench targets
+//
+// Each benchmark runs on a private MatrixEngine (the driver's own engine is
+// untouched) and prints one JSON object per line on stdout, so results can
+// be collected and compared across commits with tools/bench_compare.py.
+// Rows are read through matrix_hal_read_row(): real pins on target, the
+// simulated keypad on the host. Stop the driver's scanning first.
+
+// Cycle counter of the platform: DWT CYCCNT (STM32), SysTick (RP2350),
+// a nanosecond clock on the host. mask covers narrow counters (SysTick is
+// 24 bits); hz converts counts to nanoseconds.
+typedef struct {
+    const char *platform;      // "platform" field of every record
+    uint32_t (*read)(void);    // Counts up
+    uint32_t mask;
+    uint32_t hz;
+} MatrixBench;
+
+// One full scan tick (matrix_engine_scan) with every key released:
+// the cost of a tick that finds nothing, per strategy
+void matrix_bench_scan_idle(const MatrixBench *b, ScanStrategy strategy, uint32_t iterations);
+
+// Scan ticks under a synthetic full load, fed through
+// matrix_engine_process_row() instead of the pins:
+//   all_held:   every key pressed and held (stuck key check on every key)
+//   all_change: every key flips on every tick (a press or release event
+//               per key per tick, debounce off, ghost detection off)
+void matrix_bench_scan_loaded(const MatrixBench *b, ScanStrategy strategy, uint32_t iterations);
+
+// Event ring throughput: cost per event to enqueue from a tick and to drain
+// with matrix_engine_get_events()
+void matrix_bench_queue(const MatrixBench *b, uint32_t iterations);
+
+// Driver statistics after a timed run of one backend (ISR time and jitter
+// histograms, in us)
+void matrix_bench_print_stats(const MatrixBench *b, const char *backend, const ScanStatistics *stats);
+
+#endif // MATRIX_BENCH_H
@@ -0,0 +1,43 @@
+#ifndef MATRIX_CONFIG_H
+#define MATRIX_CONFIG_H
+
+#include <stdint.h>
+
+// Keypad geometry shared by every driver (Pico, STM32, simple and robust)
+// Override at build time for other panels, e.g. -DMATRIX_ROWS=8 -DMATRIX_COLS=8
+// (the Pico CMake build exposes both as cache variables)
+#ifndef MATRIX_ROWS
+#define MATRIX_ROWS 4
+#endif
+
+#ifndef MATRIX_COLS
+#define MATRIX_COLS 4
+#endif
+
+#if MATRIX_ROWS < 1 || MATRIX_ROWS > 32
+#error "MATRIX_ROWS must be 1..32"
+#endif
+
+#if MATRIX_COLS < 1 || MATRIX_COLS > 32
+#error "MATRIX_COLS must be 1..32"
+#endif
+
+// Key codes are uint8_t, so every position needs a distinct default code
+#if MATRIX_ROWS * MATRIX_COLS > 256
+#error "MATRIX_ROWS * MATRIX_COLS must not exceed 256"
+#endif
+
+// One row of the matrix as a bitmask: bit c = column c
+// (smallest type that holds MATRIX_COLS bits)
+#if MATRIX_COLS <= 8
+typedef uint8_t matrix_row_t;
+#elif MATRIX_COLS <= 16
+typedef uint16_t matrix_row_t;
+#else
+typedef uint32_t matrix_row_t;
+#endif
+
+// All columns of a row
+#define MATRIX_COL_MASK ((matrix_row_t)((1ull << MATRIX_COLS) - 1))
+
+#endif // MATRIX_CONFIG_H
@@ -0,0 +1,115 @@
+#include "matrix_debounce.h"
+#include <string.h>
+
+void debounce_row_reset(DebounceRow *row) {
+    memset(row, 0, sizeof(*row));
+}
+
+void debounce_row_restart(DebounceRow *row) {
+    row->active = 0;
+    row->locked = 0;
+    memset(row->count, 0, sizeof(row->count));
+}
+
+matrix_row_t debounce_row_update(DebounceRow *row, matrix_row_t raw, const DebounceConfig *config) {
+    matrix_row_t diff = (raw ^ row->stable) & MATRIX_COL_MASK;
+    matrix_row_t locked = row->locked;
+
+    // Keys that settled back to their debounced state restart from zero
+    // (locked keys ignore their input and keep counting the lockout)
+    matrix_row_t settled = row->active & ~diff & ~locked;
+    if (settled) {
+        for (int i = 0; i < DEBOUNCE_COUNTER_BITS; i++) {
+            row->count[i] &= ~settled;
+        }
+    }
+
+    matrix_row_t counting = diff | locked;
+    row->active = counting;
+    if (!counting) {
+        return 0;
+    }
+
+    // Increment the counters of every disagreeing or locked key (ripple carry)
+    matrix_row_t carry = counting;
+    for (int i = 0; i < DEBOUNCE_COUNTER_BITS && carry; i++) {
+        matrix_row_t next = row->count[i] & carry;
+        row->count[i] ^= carry;
+        carry = next;
+    }
+
+    // Compare each counter with its threshold: lockout for locked keys,
+    // release threshold for keys currently pressed, press threshold for
+    // keys currently released
+    matrix_row_t done = counting;
+    for (int i = 0; i < DEBOUNCE_COUNTER_BITS; i++) {
+        matrix_row_t press_bit = ((config->press_samples >> i) & 1) ? (matrix_row_t)(~row->stable & ~locked) : 0;
+        matrix_row_t release_bit = ((config->release_samples >> i) & 1) ? (matrix_row_t)(row->stable & ~locked) : 0;
+        matrix_row_t lockout_bit = ((config->press_lockout_samples >> i) & 1) ? locked : 0;
+        done &= ~(row->count[i] ^ (press_bit | release_bit | lockout_bit));
+    }
+
+    if (!done) {
+        return 0;
+    }
+
+    row->active &= ~done;
+    for (int i = 0; i < DEBOUNCE_COUNTER_BITS; i++) {
+        row->count[i] &= ~done;
+    }
+
+    // Finished lockouts free the key again (input is looked at next sample),
+    // finished debounces flip it
+    row->locked &= ~done;
+    matrix_row_t flipped = done & ~locked;
+    row->stable ^= flipped;
+
+    // Eager presses start their lockout right away
+    if (config->press_lockout_samples) {
+        matrix_row_t lock = flipped & row->stable;
+        row->locked |= lock;
+        row->active |= lock;
+    }
+
+    return flipped;
+}
+
+uint16_t debounce_samples_for(uint32_t debounce_ms, uint32_t sample_period_us) {
+    if (sample_period_us == 0) {
+        sample_period_us = 1;
+    }
+
+    uint32_t samples = (debounce_ms * 1000 + sample_period_us - 1) / sample_period_us + 1;
+    if (debounce_ms == 0) {
+        samples = 1;
+    }
+    if (samples > DEBOUNCE_MAX_SAMPLES) {
+        samples = DEBOUNCE_MAX_SAMPLES;
+    }
+
+    return (uint16_t)samples;
+}
+
+void debounce_config_for(DebounceConfig *config, DebounceMode mode,
+                         uint32_t press_ms, uint32_t release_ms, uint32_t sample_period_us) {
+    switch (mode) {
+    case DEBOUNCE_EAGER_PRESS_LOCKOUT:
+        config->press_samples = 1;
+        config->press_lockout_samples = debounce_samples_for(press_ms, sample_period_us);
+        config->release_samples = debounce_samples_for(release_ms, sample_period_us);
+        break;
+
+    case DEBOUNCE_SYMMETRIC_DEFER:
+        config->press_samples = debounce_samples_for(press_ms, sample_period_us);
+        config->press_lockout_samples = 0;
+        config->release_samples = debounce_samples_for(release_ms, sample_period_us);
+        break;
+
+    case DEBOUNCE_DEFER_PRESS_EAGER_RELEASE:
+    default:
+        config->press_samples = debounce_samples_for(press_ms, sample_period_us);
+        config->press_lockout_samples = 0;
+        config->release_samples = 1;
+        break;
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef MATRIX_DEBOUNCE_H
+#define MATRIX_DEBOUNCE_H
+
+#include <stdint.h>
+#include "matrix_config.h"
+
+// Bit-parallel debouncer (vertical counter)
+//
+// Each row keeps its debounced state as a bitmask plus one counter per key,
+// stored "vertically": bit plane i holds bit i of every key's counter. A key
+// whose raw reading disagrees with its debounced state counts consecutive
+// samples; a sample that agrees resets it. When the count reaches the
+// threshold the key flips. All keys of a row are updated with a handful of
+// bitwise operations, and a row with nothing in flight costs one compare.
+//
+// With a press lockout (eager press), a key is accepted on its first pressed
+// sample and then ignores its input for the lockout, reusing the same
+// counter planes; only keys in flight or locked ever touch the counters.
+
+// Counter width: thresholds up to 2^bits - 1 samples
+#ifndef DEBOUNCE_COUNTER_BITS
+#define DEBOUNCE_COUNTER_BITS 8
+#endif
+
+#define DEBOUNCE_MAX_SAMPLES ((1u << DEBOUNCE_COUNTER_BITS) - 1)
+
+// Debounce algorithms
+typedef enum {
+    DEBOUNCE_DEFER_PRESS_EAGER_RELEASE,  // Press once stable for the press time, release at once (default)
+    DEBOUNCE_EAGER_PRESS_LOCKOUT,        // Press on first contact, then lock the key for the press time;
+                                         // release once stable for the release time
+    DEBOUNCE_SYMMETRIC_DEFER             // Press and release each wait until stable for their time
+} DebounceMode;
+
+typedef struct {
+    matrix_row_t stable;                        // Debounced state (1 = pressed)
+    matrix_row_t active;                        // Keys with a change in flight (or locked)
+    matrix_row_t locked;                        // Keys ignoring input after an eager press
+    matrix_row_t count[DEBOUNCE_COUNTER_BITS];  // Vertical counter bit planes
+} DebounceRow;
+
+typedef struct {
+    uint16_t press_samples;          // Consecutive pressed samples to accept a press
+    uint16_t release_samples;        // Consecutive released samples to accept a release
+    uint16_t press_lockout_samples;  // Samples ignored after a press (0 = no lockout)
+} DebounceConfig;
+
+// Clear state and counters (all keys released)
+void debounce_row_reset(DebounceRow *row);
+
+// Drop changes in flight and lockouts but keep the debounced state (e.g.
+// after the thresholds or the sample period changed)
+void debounce_row_restart(DebounceRow *row);
+
+// Feed one raw sample (1 = pressed) for a row
+// Returns the mask of keys whose debounced state changed; read the new
+// state from row->stable
+matrix_row_t debounce_row_update(DebounceRow *row, matrix_row_t raw, const DebounceConfig *config);
+
+// Number of consecutive samples that span debounce_ms at one sample every
+// sample_period_us (the first sample counts as time zero), clamped to
+// 1..DEBOUNCE_MAX_SAMPLES. 0 ms gives 1 sample (no debounce).
+uint16_t debounce_samples_for(uint32_t debounce_ms, uint32_t sample_period_us);
+
+// Fill config for a debounce algorithm, its press/release times and the
+// time between two samples of the same row
+void debounce_config_for(DebounceConfig *config, DebounceMode mode,
+                         uint32_t press_ms, uint32_t release_ms, uint32_t sample_period_us);
+
+#endif // MATRIX_DEBOUNCE_H
@@ -0,0 +1,680 @@
+#include "matrix_engine.h"
+#include "matrix_hal.h"
+#include "matrix_keymap.h"
+#include <string.h>
+
+_Static_assert(MATRIX_RING_IS_POW2(EVENT_QUEUE_SIZE), "EVENT_QUEUE_SIZE must be a power of two");
+_Static_assert(MATRIX_RING_IS_POW2(ERROR_QUEUE_SIZE), "ERROR_QUEUE_SIZE must be a power of two");
+
+static uint32_t row_samples_due(MatrixEngine *e, uint8_t row, uint32_t now_us);
+static void report_changes(MatrixEngine *e, uint8_t row, matrix_row_t changed, uint32_t now, uint32_t now_us);
+static void key_pressed(MatrixEngine *e, uint8_t row, uint8_t col, uint32_t now, uint32_t now_us);
+static void key_released(MatrixEngine *e, uint8_t row, uint8_t col, uint32_t now, uint32_t now_us);
+static void deliver_key(MatrixEngine *e, uint8_t row, uint8_t col, bool pressed, uint32_t now, uint32_t now_us);
+static void emit_gestures(MatrixEngine *e, const GestureOutput *out, uint8_t count, uint32_t now_us);
+static void emit_key_event(MatrixEngine *e, uint8_t row, uint8_t col, uint8_t key, uint8_t state,
+                           uint8_t gesture, uint32_t now, uint32_t now_us);
+static void repeat_tick(MatrixEngine *e, uint32_t now);
+static void adaptive_rate_tick(MatrixEngine *e, uint32_t tick_start_us, uint32_t now);
+static void dispatch_event(MatrixEngine *e, KeyEvent *event);
+static void mark_dequeued(MatrixEngine *e, KeyEvent *event, uint32_t now_us);
+static void report_scan_error(MatrixEngine *e, uint8_t error_code, uint32_t count);
+static bool enqueue_event(MatrixEngine *e, KeyEvent *event);
+static bool enqueue_error(MatrixEngine *e, ErrorEvent *error);
+static bool detect_ghost_key(const MatrixEngine *e, uint8_t row, uint8_t col);
+static bool detect_stuck_key(const MatrixEngine *e, uint8_t row, uint8_t col, uint32_t now);
+
+void matrix_engine_init(MatrixEngine *e) {
+    memset(e, 0, sizeof(*e));
+
+    matrix_default_keymap(e->keymap);
+    e->strategy = SCAN_STRATEGY_INTERLEAVED;
+
+    matrix_ring_init(&e->event_queue, e->event_buffer, sizeof(KeyEvent), EVENT_QUEUE_SIZE);
+    matrix_ring_init(&e->error_queue, e->error_buffer, sizeof(ErrorEvent), ERROR_QUEUE_SIZE);
+
+    for (int row = 0; row < MATRIX_ROWS; row++) {
+        debounce_row_reset(&e->debounce_rows[row]);
+    }
+
+    e->ghost_detection_enabled = true;
+    e->stuck_detection_enabled = true;
+    e->stuck_key_timeout = STUCK_KEY_TIMEOUT_MS;
+
+    matrix_engine_configure_debounce(e, DEBOUNCE_DEFER_PRESS_EAGER_RELEASE,
+                                     DEBOUNCE_PRESS_MS, DEBOUNCE_RELEASE_MS, 1000 * MATRIX_ROWS);
+}
+
+void matrix_engine_configure_debounce(MatrixEngine *e, DebounceMode mode,
+                                      uint32_t press_ms, uint32_t release_ms,
+                                      uint32_t sample_period_us) {
+    e->sample_period = sample_period_us ? sample_period_us : 1;
+    debounce_config_for(&e->debounce_config, mode, press_ms, release_ms, e->sample_period);
+
+    // Counters in flight were counting towards the old thresholds
+    for (int row = 0; row < MATRIX_ROWS; row++) {
+        debounce_row_restart(&e->debounce_rows[row]);
+    }
+}
+
+void matrix_engine_configure_repeat(MatrixEngine *e, const RepeatConfig *config) {
+    e->repeat_config = *config;
+    if (e->repeat_config.interval_ms == 0) {
+        e->repeat_config.interval_ms = 1;
+    }
+    if (e->repeat_config.min_interval_ms == 0 ||
+        e->repeat_config.min_interval_ms > e->repeat_config.interval_ms) {
+        e->repeat_config.min_interval_ms = e->repeat_config.interval_ms;
+    }
+    e->repeat_active = false;
+}
+
+void matrix_engine_configure_adaptive_rate(MatrixEngine *e, const AdaptiveRateConfig *config) {
+    e->rate_config = *config;
+    e->rate_slow = false;
+    e->tick_interval = config->fast_us;
+}
+
+void matrix_engine_restart(MatrixEngine *e) {
+    e->last_scan_valid = false;
+    e->rows_credited = 0;
+
+    // Scanning (re)starts fast; stopped time is not time at either rate
+    e->rate_slow = false;
+    e->tick_interval = e->rate_config.fast_us;
+    e->rate_active_ms = matrix_hal_time_ms();
+    e->rate_mark_ms = e->rate_active_ms;
+}
+
+void matrix_engine_scan(MatrixEngine *e, uint32_t nominal_us) {
+    uint32_t scan_start = matrix_hal_time_us();
+    matrix_engine_tick_begin(e, scan_start, nominal_us);
+    e->stats.total_scans++;
+
+    // Set all rows HIGH first
+    matrix_hal_rows_idle();
+
+    if (e->strategy == SCAN_STRATEGY_BURST) {
+        // Sample every row first so the whole matrix is one coherent
+        // snapshot, then run the state machine over it
+        matrix_row_t pressed_cols[MATRIX_ROWS];
+        for (int row = 0; row < MATRIX_ROWS; row++) {
+            pressed_cols[row] = matrix_hal_read_row(row);
+        }
+
+        uint32_t now = matrix_hal_time_ms();
+        for (int row = 0; row < MATRIX_ROWS; row++) {
+            matrix_engine_process_row(e, row, pressed_cols[row], now, scan_start);
+        }
+    } else {
+        uint8_t row = e->current_row;
+        matrix_row_t pressed_cols = matrix_hal_read_row(row);
+        uint32_t now = matrix_hal_time_ms();
+
+        matrix_engine_process_row(e, row, pressed_cols, now, scan_start);
+
+        // Move to next row
+        e->current_row = (row + 1) % MATRIX_ROWS;
+    }
+
+    matrix_engine_tick_end(e, scan_start, nominal_us);
+}
+
+// Statistics seqlock, writer side: a tick makes stats_seq odd while it
+// updates statistics, so a reader that overlaps it retries instead of
+// masking interrupts. A reset requested by the consumer is applied here,
+// keeping the scan tick the only writer.
+static void stats_write_begin(MatrixEngine *e) {
+    __atomic_store_n(&e->stats_seq, e->stats_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    uint32_t reset = matrix_ring_load_acquire(&e->stats_reset_request);
+    if (reset != e->stats_reset_done) {
+        memset((void *)&e->stats, 0, sizeof(e->stats));
+        e->stats_reset_done = reset;
+    }
+}
+
+static void stats_write_end(MatrixEngine *e) {
+    matrix_ring_store_release(&e->stats_seq, e->stats_seq + 1);
+}
+
+// Track jitter against the nominal interval and the tick schedule
+// A tick that starts a whole period (or more) behind schedule means the
+// ticks in between never ran on time: they are counted as missed and
+// reported once as ERROR_SCAN_TIMEOUT. A timer that runs them as a
+// catch-up burst (Pico SDK) is recognised by starting early and not
+// re-counted; one that drops them (STM32 update interrupt) just resumes.
+void matrix_engine_tick_begin(MatrixEngine *e, uint32_t tick_start_us, uint32_t nominal_us) {
+    stats_write_begin(e);
+
+    if (e->last_scan_valid) {
+        uint32_t interval = tick_start_us - e->last_scan_start;
+        uint32_t jitter = (interval > nominal_us) ? interval - nominal_us : nominal_us - interval;
+        latency_hist_add(&e->stats.scan_jitter_us, jitter);
+
+        int32_t late = (int32_t)(tick_start_us - e->next_deadline);
+        if (late >= (int32_t)nominal_us) {
+            uint32_t missed = (uint32_t)late / nominal_us;
+            e->stats.missed_scans += missed;
+            e->next_deadline += (missed + 1) * nominal_us;
+            report_scan_error(e, ERROR_SCAN_TIMEOUT, missed);
+        } else if (late > -(int32_t)(nominal_us / 2)) {
+            e->next_deadline += nominal_us;
+        }
+    } else {
+        e->next_deadline = tick_start_us + nominal_us;
+    }
+    e->last_scan_start = tick_start_us;
+    e->last_scan_valid = true;
+}
+
+// Update scan time statistics (the average is derived on read) and report
+// a tick that ran longer than its own period
+void matrix_engine_tick_end(MatrixEngine *e, uint32_t tick_start_us, uint32_t nominal_us) {
+    // Combo and tap-hold timeouts run on the scan tick
+    MatrixGestures *gestures = e->gestures;
+    if (gestures) {
+        GestureOutput out[GESTURE_OUTPUT_MAX];
+        uint8_t count = matrix_gestures_tick(gestures, matrix_hal_time_ms(), out);
+        emit_gestures(e, out, count, matrix_hal_time_us());
+    }
+
+    if (e->repeat_active) {
+        repeat_tick(e, matrix_hal_time_ms());
+    }
+
+    // Raw trace: flush requests and the quiet close
+    MatrixTrace *trace = e->trace;
+    if (trace) {
+        matrix_trace_tick(trace, matrix_hal_time_ms());
+    }
+
+    // The key that woke the matrix let go before debounce took it
+    if (e->wake_pending && matrix_engine_quiet(e)) {
+        e->wake_pending = false;
+    }
+
+    if (e->rate_config.slow_us) {
+        adaptive_rate_tick(e, tick_start_us, matrix_hal_time_ms());
+        e->stats.scan_interval_us = e->tick_interval;
+    } else {
+        e->stats.scan_interval_us = nominal_us;
+    }
+
+    uint32_t scan_time = matrix_hal_time_us() - tick_start_us;
+    if (scan_time > e->stats.max_scan_time_us) {
+        e->stats.max_scan_time_us = scan_time;
+    }
+    latency_hist_add(&e->stats.isr_time_us, scan_time);
+
+    if (scan_time > nominal_us) {
+        e->stats.scan_overruns++;
+        report_scan_error(e, ERROR_SCAN_OVERRUN, scan_time);
+    }
+
+    stats_write_end(e);
+}
+
+void matrix_engine_count_idle(MatrixEngine *e) {
+    stats_write_begin(e);
+    e->stats.idle_entries++;
+    stats_write_end(e);
+}
+
+void matrix_engine_wake(MatrixEngine *e, uint32_t wake_us) {
+    stats_write_begin(e);
+    e->stats.deep_sleeps++;
+    stats_write_end(e);
+
+    e->wake_us = wake_us;
+    e->wake_pending = true;
+}
+
+void matrix_engine_scan_all(MatrixEngine *e, uint32_t nominal_us) {
+    uint32_t scan_start = matrix_hal_time_us();
+    matrix_row_t pressed_cols[MATRIX_ROWS];
+
+    matrix_engine_tick_begin(e, scan_start, nominal_us);
+    e->stats.total_scans++;
+
+    matrix_hal_rows_idle();
+    for (int row = 0; row < MATRIX_ROWS; row++) {
+        pressed_cols[row] = matrix_hal_read_row(row);
+    }
+
+    uint32_t now = matrix_hal_time_ms();
+    for (int row = 0; row < MATRIX_ROWS; row++) {
+        matrix_engine_process_row(e, row, pressed_cols[row], now, scan_start);
+    }
+
+    matrix_engine_tick_end(e, scan_start, nominal_us);
+}
+
+// Run debounce over one row sample and turn state changes into events
+// A sample normally stands for one sample period; after missed ticks it
+// stands for every period since the row was last sampled, and keys already
+// in flight are assumed to have kept their last reading through the gap
+void matrix_engine_process_row(MatrixEngine *e, uint8_t row, matrix_row_t pressed_cols,
+                               uint32_t now, uint32_t now_us) {
+    DebounceRow *db = &e->debounce_rows[row];
+    uint32_t samples = row_samples_due(e, row, now_us);
+
+    MatrixTrace *trace = e->trace;
+    if (trace) {
+        matrix_trace_record(trace, row, pressed_cols, now, now_us);
+    }
+
+    // Catch-up tick right after the previous sample: nothing has elapsed
+    if (samples == 0) {
+        return;
+    }
+
+    for (uint32_t i = 1; i < samples && db->active; i++) {
+        matrix_row_t last_reading = db->stable ^ (db->active & ~db->locked);
+        report_changes(e, row, debounce_row_update(db, last_reading, &e->debounce_config), now, now_us);
+    }
+
+    matrix_row_t was_active = db->active;
+    matrix_row_t changed = debounce_row_update(db, pressed_cols, &e->debounce_config);
+
+    // Keys that started a change this sample (or flipped on it) were first
+    // touched now, or at the wake-up edge if they ended a deep sleep
+    matrix_row_t started = (db->active | changed) & ~was_active;
+    uint32_t contact_us = e->wake_pending ? e->wake_us : now_us;
+    while (started) {
+        uint8_t col = __builtin_ctz(started);
+        started &= started - 1;
+        e->contact_us[row][col] = contact_us;
+    }
+
+    // Stuck key detection (only keys that are held and not yet reported)
+    if (e->stuck_detection_enabled) {
+        matrix_row_t held = e->reported_keys[row] & ~e->stuck_keys[row];
+        while (held) {
+            uint8_t col = __builtin_ctz(held);
+            held &= held - 1;
+
+            if (detect_stuck_key(e, row, col, now)) {
+                e->stuck_keys[row] |= (matrix_row_t)(1u << col);
+                ErrorEvent error = {
+                    .error_code = ERROR_STUCK_KEY,
+                    .row = row,
+                    .col = col,
+                    .count = 1,
+                    .timestamp = now
+                };
+                enqueue_error(e, &error);
+            }
+        }
+    }
+
+    report_changes(e, row, changed, now, now_us);
+}
+
+// Sampling hardware (PIO, timer-triggered DMA) reads a row many times per
+// sample period, so a batch is folded into one sample: keys that read the
+// same in every snapshot take that value, keys that bounced count as
+// unchanged and restart their counter (with an eager press, a released key
+// that bounced counts as first contact)
+void matrix_engine_process_batch(MatrixEngine *e, uint8_t row, matrix_row_t any_pressed,
+                                 matrix_row_t all_pressed, uint32_t now, uint32_t now_us) {
+    matrix_row_t bounced = any_pressed & ~all_pressed;
+    matrix_row_t keep = e->debounce_config.press_lockout_samples ? bounced : (e->debounce_rows[row].stable & bounced);
+    matrix_engine_process_row(e, row, all_pressed | keep, now, now_us);
+}
+
+// Sample periods elapsed since this row's last credited sample (rounded,
+// the remainder carries over so the long-run total matches real time)
+static uint32_t row_samples_due(MatrixEngine *e, uint8_t row, uint32_t now_us) {
+    uint32_t bit = 1u << row;
+
+    if (!(e->rows_credited & bit)) {
+        e->rows_credited |= bit;
+        e->row_credit_us[row] = now_us;
+        return 1;
+    }
+
+    uint32_t elapsed = now_us - e->row_credit_us[row];
+    uint32_t samples = (elapsed + e->sample_period / 2) / e->sample_period;
+    if (samples > DEBOUNCE_MAX_SAMPLES) {
+        // Long stall: every counter has run out anyway, start afresh
+        e->row_credit_us[row] = now_us;
+        return DEBOUNCE_MAX_SAMPLES;
+    }
+    e->row_credit_us[row] += samples * e->sample_period;
+    return samples;
+}
+
+// Per-key work only for keys whose debounced state changed
+static void report_changes(MatrixEngine *e, uint8_t row, matrix_row_t changed, uint32_t now, uint32_t now_us) {
+    while (changed) {
+        uint8_t col = __builtin_ctz(changed);
+        changed &= changed - 1;
+
+        if (e->debounce_rows[row].stable & (1u << col)) {
+            key_pressed(e, row, col, now, now_us);
+        } else {
+            key_released(e, row, col, now, now_us);
+        }
+    }
+}
+
+static void key_pressed(MatrixEngine *e, uint8_t row, uint8_t col, uint32_t now, uint32_t now_us) {
+    matrix_row_t bit = (matrix_row_t)(1u << col);
+
+    // Ghost key detection
+    if (e->ghost_detection_enabled && detect_ghost_key(e, row, col)) {
+        e->blocked_keys[row] |= bit;
+        ErrorEvent error = {
+            .error_code = ERROR_GHOST_KEY,
+            .row = row,
+            .col = col,
+            .count = 1,
+            .timestamp = now
+        };
+        enqueue_error(e, &error);
+        return;
+    }
+
+    e->reported_keys[row] |= bit;
+    e->pressed_count++;
+    e->press_time[row][col] = now;
+
+    deliver_key(e, row, col, true, now, now_us);
+}
+
+static void key_released(MatrixEngine *e, uint8_t row, uint8_t col, uint32_t now, uint32_t now_us) {
+    matrix_row_t bit = (matrix_row_t)(1u << col);
+
+    // A suppressed ghost never produced a press, so it has no release either
+    if (e->blocked_keys[row] & bit) {
+        e->blocked_keys[row] &= ~bit;
+        return;
+    }
+
+    e->reported_keys[row] &= ~bit;
+    e->stuck_keys[row] &= ~bit;
+    e->pressed_count--;
+
+    deliver_key(e, row, col, false, now, now_us);
+}
+
+// Latency is taken at the debounced change, so time a combo or tap-hold
+// key is held back on purpose does not count as latency
+static void deliver_key(MatrixEngine *e, uint8_t row, uint8_t col, bool pressed, uint32_t now, uint32_t now_us) {
+    latency_hist_add(&e->stats.contact_to_event_us, now_us - e->contact_us[row][col]);
+
+    if (pressed && e->wake_pending) {
+        latency_hist_add(&e->stats.wake_to_event_us, now_us - e->wake_us);
+        e->wake_pending = false;
+    }
+
+    MatrixGestures *gestures = e->gestures;
+    if (!gestures) {
+        emit_key_event(e, row, col, e->keymap[row][col], pressed ? KEY_PRESSED : KEY_RELEASED,
+                       KEY_GESTURE_NONE, now, now_us);
+        return;
+    }
+
+    GestureOutput out[GESTURE_OUTPUT_MAX];
+    uint8_t count = matrix_gestures_key(gestures, row, col, pressed, now, out);
+    emit_gestures(e, out, count, now_us);
+}
+
+static void emit_gestures(MatrixEngine *e, const GestureOutput *out, uint8_t count, uint32_t now_us) {
+    for (uint8_t i = 0; i < count; i++) {
+        const GestureOutput *o = &out[i];
+        uint8_t key = (o->gesture == KEY_GESTURE_NONE) ? e->keymap[o->row][o->col] : o->key;
+        emit_key_event(e, o->row, o->col, key, o->pressed ? KEY_PRESSED : KEY_RELEASED,
+                       o->gesture, o->timestamp, now_us);
+    }
+}
+
+static void emit_key_event(MatrixEngine *e, uint8_t row, uint8_t col, uint8_t key, uint8_t state,
+                           uint8_t gesture, uint32_t now, uint32_t now_us) {
+    KeyEvent event = {
+        .key = key,
+        .state = state,
+        .row = row,
+        .col = col,
+        .gesture = gesture,
+        .timestamp = now,
+        .contact_us = e->contact_us[row][col],
+        .confirm_us = now_us,
+        .dequeue_us = 0
+    };
+
+    // The newest press repeats; its release (not another key's) stops it
+    if (e->repeat_config.delay_ms) {
+        if (state == KEY_PRESSED) {
+            e->repeat_event = event;
+            e->repeat_event.state = KEY_HELD;
+            e->repeat_due = now + e->repeat_config.delay_ms;
+            e->repeat_interval = e->repeat_config.interval_ms;
+            e->repeat_active = true;
+        } else if (state == KEY_RELEASED && e->repeat_active &&
+                   e->repeat_event.row == row && e->repeat_event.col == col &&
+                   e->repeat_event.key == key) {
+            e->repeat_active = false;
+        }
+    }
+
+    dispatch_event(e, &event);
+}
+
+// Enqueue or call callback (a callback is handed the event inside the scan
+// tick, so its queueing delay goes into the seqlocked statistics)
+static void dispatch_event(MatrixEngine *e, KeyEvent *event) {
+    KeyEventCallback callback = e->key_callback;
+    if (callback) {
+        event->dequeue_us = matrix_hal_time_us();
+        latency_hist_add(&e->stats.event_to_dequeue_us, event->dequeue_us - event->confirm_us);
+        callback(event);
+    } else {
+        enqueue_event(e, event);
+    }
+
+    e->stats.total_events++;
+}
+
+// One KEY_HELD per tick at most: a late tick does not send a burst
+static void repeat_tick(MatrixEngine *e, uint32_t now) {
+    if ((int32_t)(now - e->repeat_due) < 0) {
+        return;
+    }
+
+    uint32_t now_us = matrix_hal_time_us();
+    KeyEvent event = e->repeat_event;
+    event.timestamp = now;
+    event.contact_us = now_us;
+    event.confirm_us = now_us;
+
+    e->repeat_due = now + e->repeat_interval;
+    if (e->repeat_interval > e->repeat_config.min_interval_ms + e->repeat_config.accel_ms) {
+        e->repeat_interval -= e->repeat_config.accel_ms;
+    } else {
+        e->repeat_interval = e->repeat_config.min_interval_ms;
+    }
+
+    dispatch_event(e, &event);
+}
+
+// Account the time at the current rate, then pick the next one: fast as
+// soon as anything is pressed or in debounce, slow after decay_ms of quiet
+static void adaptive_rate_tick(MatrixEngine *e, uint32_t tick_start_us, uint32_t now) {
+    uint32_t elapsed = now - e->rate_mark_ms;
+    e->rate_mark_ms = now;
+    if (e->rate_slow) {
+        e->stats.slow_rate_ms += elapsed;
+    } else {
+        e->stats.fast_rate_ms += elapsed;
+    }
+
+    if (!matrix_engine_quiet(e)) {
+        e->rate_active_ms = now;
+    }
+    bool slow = (now - e->rate_active_ms) >= e->rate_config.decay_ms;
+    if (slow == e->rate_slow) {
+        return;
+    }
+
+    // The driver reprograms its timer after this tick, so the next one is
+    // due a new interval from this one's start
+    e->rate_slow = slow;
+    e->tick_interval = slow ? e->rate_config.slow_us : e->rate_config.fast_us;
+    e->next_deadline = tick_start_us + e->tick_interval;
+    e->stats.rate_changes++;
+}
+
+bool matrix_engine_quiet(const MatrixEngine *e) {
+    for (int row = 0; row < MATRIX_ROWS; row++) {
+        if (e->debounce_rows[row].stable | e->debounce_rows[row].active) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void report_scan_error(MatrixEngine *e, uint8_t error_code, uint32_t count) {
+    ErrorEvent error = {
+        .error_code = error_code,
+        .row = ERROR_NO_KEY,
+        .col = ERROR_NO_KEY,
+        .count = count,
+        .timestamp = matrix_hal_time_ms()
+    };
+    enqueue_error(e, &error);
+}
+
+// Stamp an event as handed to the consumer and record its queueing delay
+// (consumer side only, dequeue_latency is the consumer's own)
+static void mark_dequeued(MatrixEngine *e, KeyEvent *event, uint32_t now_us) {
+    event->dequeue_us = now_us;
+    latency_hist_add(&e->dequeue_latency, now_us - event->confirm_us);
+}
+
+static bool enqueue_event(MatrixEngine *e, KeyEvent *event) {
+    if (!matrix_ring_push(&e->event_queue, event)) {
+        // Queue full
+        e->stats.queue_overflows++;
+        return false;
+    }
+
+    return true;
+}
+
+static bool enqueue_error(MatrixEngine *e, ErrorEvent *error) {
+    if (!matrix_ring_push(&e->error_queue, error)) {
+        return false;
+    }
+
+    e->stats.total_errors++;
+
+    ErrorCallback callback = e->error_callback;
+    if (callback) {
+        callback(error);
+    }
+
+    return true;
+}
+
+// Without diodes, three pressed corners of a rectangle make the fourth read
+// as pressed too, so a key is ambiguous when another row shares its column
+// and at least one more: both rows then read the same pair of columns.
+// Debounced bitmaps include blocked keys, which still carry current.
+static bool detect_ghost_key(const MatrixEngine *e, uint8_t row, uint8_t col) {
+    matrix_row_t bit = (matrix_row_t)(1u << col);
+    matrix_row_t mine = e->debounce_rows[row].stable;
+
+    // Alone in its row: no rectangle can have a corner here
+    if (!(mine & ~bit)) {
+        return false;
+    }
+
+    for (int other = 0; other < MATRIX_ROWS; other++) {
+        matrix_row_t shared = e->debounce_rows[other].stable & mine;
+        if (other != row && (shared & bit) && (shared & (shared - 1))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool detect_stuck_key(const MatrixEngine *e, uint8_t row, uint8_t col, uint32_t now) {
+    return ((now - e->press_time[row][col]) > e->stuck_key_timeout);
+}
+
+bool matrix_engine_get_event(MatrixEngine *e, KeyEvent *event) {
+    if (!matrix_ring_pop(&e->event_queue, event)) {
+        return false;
+    }
+    mark_dequeued(e, event, matrix_hal_time_us());
+    return true;
+}
+
+size_t matrix_engine_get_events(MatrixEngine *e, KeyEvent *events, size_t max) {
+    size_t count = matrix_ring_pop_many(&e->event_queue, events, max);
+    uint32_t now_us = matrix_hal_time_us();
+    for (size_t i = 0; i < count; i++) {
+        mark_dequeued(e, &events[i], now_us);
+    }
+    return count;
+}
+
+size_t matrix_engine_peek_events(MatrixEngine *e, const KeyEvent **span) {
+    void *slots;
+    size_t count = matrix_ring_peek_span(&e->event_queue, &slots);
+
+    // Peeked slots belong to the consumer until committed; stamp each once
+    KeyEvent *events = (KeyEvent *)slots;
+    uint32_t now_us = matrix_hal_time_us();
+    for (size_t i = 0; i < count; i++) {
+        if (events[i].dequeue_us == 0) {
+            mark_dequeued(e, &events[i], now_us);
+        }
+    }
+
+    *span = events;
+    return count;
+}
+
+void matrix_engine_commit_events(MatrixEngine *e, size_t count) {
+    matrix_ring_commit(&e->event_queue, count);
+}
+
+bool matrix_engine_get_error(MatrixEngine *e, ErrorEvent *error) {
+    return matrix_ring_pop(&e->error_queue, error);
+}
+
+void matrix_engine_get_matrix(const MatrixEngine *e, matrix_row_t matrix[MATRIX_ROWS]) {
+    for (int row = 0; row < MATRIX_ROWS; row++) {
+        matrix[row] = e->reported_keys[row];
+    }
+}
+
+// Seqlock reader: copy until no tick ran in between (never masks interrupts,
+// and the scan tick never waits for the reader)
+void matrix_engine_get_statistics(const MatrixEngine *e, ScanStatistics *stats) {
+    uint32_t seq;
+    bool reset_pending;
+
+    do {
+        seq = matrix_ring_load_acquire(&e->stats_seq);
+        reset_pending = e->stats_reset_request != e->stats_reset_done;
+        *stats = e->stats;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || __atomic_load_n(&e->stats_seq, __ATOMIC_RELAXED) != seq);
+
+    if (reset_pending) {
+        // Requested but no tick has run since: nothing counted yet
+        memset(stats, 0, sizeof(*stats));
+    }
+    latency_hist_merge(&stats->event_to_dequeue_us, &e->dequeue_latency);
+    stats->avg_scan_time_us = latency_hist_mean(&stats->isr_time_us);
+}
+
+void matrix_engine_reset_statistics(MatrixEngine *e) {
+    memset(&e->dequeue_latency, 0, sizeof(e->dequeue_latency));
+    matrix_ring_store_release(&e->stats_reset_request, e->stats_reset_request + 1);
+}
@@ -0,0 +1,286 @@
+#ifndef MATRIX_ENGINE_H
+#define MATRIX_ENGINE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "matrix_config.h"
+#include "matrix_debounce.h"
+#include "matrix_gesture.h"
+#include "matrix_ring.h"
+#include "matrix_stats.h"
+#include "matrix_trace.h"
+
+// Platform-independent key engine shared by the Pico, STM32 and host builds
+//
+// The engine owns everything between a raw row sample and a queued event:
+// debounce, ghost and stuck key detection, the event and error rings, scan
+// schedule tracking and statistics. The platform driver owns pins, timers
+// and power, calls matrix_engine_scan() (or feeds rows itself) from its
+// scan tick and wraps the consumer API. The engine reaches hardware only
+// through matrix_hal.h.
+
+// Key states
+#define KEY_IDLE       0
+#define KEY_PRESSED    1
+#define KEY_HELD       2
+#define KEY_RELEASED   3
+
+// Error states
+#define ERROR_NONE          0
+#define ERROR_STUCK_KEY     1
+#define ERROR_GHOST_KEY     2
+#define ERROR_SCAN_TIMEOUT  3  // Scan ticks missed their deadline (count = ticks missed)
+#define ERROR_SCAN_OVERRUN  4  // A scan ran longer than its period (count = scan time in us)
+
+// row/col of errors that are not about one key
+#define ERROR_NO_KEY 0xFF
+
+// Debounce settings (in milliseconds)
+#define DEBOUNCE_PRESS_MS   5    // 5ms debounce for press (faster response)
+#define DEBOUNCE_RELEASE_MS 5    // 5ms debounce for release (faster response)
+#define STUCK_KEY_TIMEOUT_MS 5000  // 5 seconds = stuck key
+
+// Event queue configuration (must be powers of two)
+#ifndef EVENT_QUEUE_SIZE
+#define EVENT_QUEUE_SIZE 32
+#endif
+#ifndef ERROR_QUEUE_SIZE
+#define ERROR_QUEUE_SIZE 8
+#endif
+
+// How a scan tick walks the rows
+typedef enum {
+    SCAN_STRATEGY_INTERLEAVED,  // One row per tick (default); full pass = MATRIX_ROWS ticks
+    SCAN_STRATEGY_BURST         // All rows in one tick; full pass every tick
+} ScanStrategy;
+
+// Typematic repeat: the most recently pressed key (or combo / hold key)
+// repeats as KEY_HELD events from the scan tick while it stays down. The
+// first repeat comes delay_ms after the press, then every interval_ms,
+// shortened by accel_ms per repeat down to min_interval_ms.
+#define REPEAT_DELAY_MS_DEFAULT    500
+#define REPEAT_INTERVAL_MS_DEFAULT 100   // 10 per second
+#define REPEAT_MIN_INTERVAL_MS_DEFAULT 33  // ~30 per second
+
+typedef struct {
+    uint32_t delay_ms;         // 0 = repeat off (default)
+    uint32_t interval_ms;
+    uint32_t min_interval_ms;  // Acceleration stops here
+    uint32_t accel_ms;         // 0 = constant rate
+} RepeatConfig;
+
+// Adaptive scan rate: the driver ticks every fast_us while any key is
+// pressed or in debounce, and every slow_us once none has been for
+// decay_ms. Activity switches to fast at once, going slow takes the whole
+// quiet spell, so typing never waits on the slow rate after the first
+// contact. Debounce keeps counting in fast-rate samples: a slow tick is
+// credited as the fast samples it spans.
+typedef struct {
+    uint32_t fast_us;   // Tick interval while active (the driver's scan interval)
+    uint32_t slow_us;   // Tick interval while quiet; 0 = adaptive rate off
+    uint32_t decay_ms;  // Quiet time before dropping to slow_us
+} AdaptiveRateConfig;
+
+// Key event structure
+typedef struct {
+    uint8_t key;         // Key value (0x0-0xF for hex keypad)
+    uint8_t state;       // KEY_PRESSED, KEY_HELD (repeat), or KEY_RELEASED
+    uint8_t row;         // Physical row (0 to MATRIX_ROWS-1)
+    uint8_t col;         // Physical column (0 to MATRIX_COLS-1)
+    uint8_t gesture;     // KEY_GESTURE_* (matrix_gesture.h), NONE without gestures
+    uint32_t timestamp;  // Timestamp in milliseconds
+    uint32_t contact_us; // First scan that saw the change (matrix_hal_time_us)
+    uint32_t confirm_us; // Debounce confirmed the change
+    uint32_t dequeue_us; // Handed to the consumer (get/peek or callback)
+} KeyEvent;
+
+// Error event structure
+typedef struct {
+    uint8_t error_code;
+    uint8_t row;
+    uint8_t col;
+    uint32_t count;      // 1 for key errors, see ERROR_SCAN_* for scan errors
+    uint32_t timestamp;
+} ErrorEvent;
+
+// Callback function types
+typedef void (*KeyEventCallback)(KeyEvent *event);
+typedef void (*ErrorCallback)(ErrorEvent *error);
+
+// Statistics
+// avg_scan_time_us is isr_time_us' mean. Timestamps wrap every ~71 minutes;
+// differences between them are wrap-safe. contact_us is the first scan of
+// the uninterrupted run that debounce accepted, so chatter before it counts
+// as bounce, not latency.
+typedef struct {
+    uint32_t total_scans;
+    uint32_t total_events;
+    uint32_t total_errors;
+    uint32_t queue_overflows;
+    uint32_t max_scan_time_us;
+    uint32_t avg_scan_time_us;
+    uint32_t idle_entries;  // Times auto idle stopped scanning
+    uint32_t missed_scans;  // Scheduled ticks that did not start on time
+    uint32_t scan_overruns; // Scans that ran longer than their period
+    uint32_t scan_interval_us;  // Tick interval in use (follows the adaptive rate)
+    uint32_t fast_rate_ms;      // Time scanned at the fast / slow adaptive rate
+    uint32_t slow_rate_ms;
+    uint32_t rate_changes;      // Adaptive rate switches
+    uint32_t deep_sleeps;       // Wake-ups from deep sleep (dormant / STOP)
+    LatencyHistogram isr_time_us;          // Scan tick duration
+    LatencyHistogram scan_jitter_us;       // |start-to-start interval - nominal interval|
+    LatencyHistogram contact_to_event_us;  // contact_us -> confirm_us (debounce + scan delay)
+    LatencyHistogram event_to_dequeue_us;  // confirm_us -> dequeue_us (queueing delay)
+    LatencyHistogram wake_to_event_us;     // Deep sleep wake-up -> the waking press confirmed
+} ScanStatistics;
+
+// Engine state (written by the scan tick, read by the consumer API)
+typedef struct {
+    // Key mapping and scan walk
+    uint8_t keymap[MATRIX_ROWS][MATRIX_COLS];
+    ScanStrategy strategy;
+    uint8_t current_row;  // Next row for SCAN_STRATEGY_INTERLEAVED
+
+    // Bit-packed key state, one bitmask per row (bit c = column c)
+    DebounceRow debounce_rows[MATRIX_ROWS];   // Debounced state + vertical counters
+    DebounceConfig debounce_config;
+    matrix_row_t reported_keys[MATRIX_ROWS];  // Presses delivered as events
+    matrix_row_t blocked_keys[MATRIX_ROWS];   // Presses suppressed as ghosts
+    matrix_row_t stuck_keys[MATRIX_ROWS];     // Stuck errors already reported
+    volatile uint16_t pressed_count;          // Reported keys in total
+    uint32_t press_time[MATRIX_ROWS][MATRIX_COLS];  // Only written on press
+    uint32_t contact_us[MATRIX_ROWS][MATRIX_COLS];  // First contact of the change in flight
+
+    // Debounce sample period and the time up to which each row's samples
+    // have been credited (rows_credited: rows with a valid credit since the
+    // last restart)
+    uint32_t sample_period;
+    uint32_t row_credit_us[MATRIX_ROWS];
+    uint32_t rows_credited;
+
+    // Event queues (lock-free SPSC rings: scan tick produces, one consumer)
+    KeyEvent event_buffer[EVENT_QUEUE_SIZE];
+    MatrixRing event_queue;
+    ErrorEvent error_buffer[ERROR_QUEUE_SIZE];
+    MatrixRing error_queue;
+
+    // Callbacks (run in scan tick context)
+    volatile KeyEventCallback key_callback;
+    volatile ErrorCallback error_callback;
+
+    // Feature flags
+    volatile bool ghost_detection_enabled;
+    volatile bool stuck_detection_enabled;
+    volatile uint32_t stuck_key_timeout;
+
+    // Raw sample trace (NULL = off), fed before debounce
+    MatrixTrace *volatile trace;
+
+    // Combos and tap-hold keys (NULL = off), between debounce and the queue
+    MatrixGestures *volatile gestures;
+
+    // Typematic repeat of the last delivered press
+    RepeatConfig repeat_config;
+    bool repeat_active;
+    KeyEvent repeat_event;     // The press being repeated
+    uint32_t repeat_due;       // ms of the next repeat
+    uint32_t repeat_interval;  // Current interval (accelerating)
+
+    // Adaptive scan rate
+    AdaptiveRateConfig rate_config;
+    bool rate_slow;            // Ticking at slow_us
+    uint32_t tick_interval;    // fast_us or slow_us
+    uint32_t rate_active_ms;   // Last tick that was not quiet
+    uint32_t rate_mark_ms;     // Time at rate accounted up to here
+
+    // Deep sleep wake-up whose press has not been delivered yet
+    bool wake_pending;
+    uint32_t wake_us;
+
+    // Statistics and tick schedule
+    volatile ScanStatistics stats;
+    uint32_t stats_seq;            // Odd while a tick updates stats (seqlock)
+    uint32_t stats_reset_request;  // Bumped by the consumer to reset stats
+    uint32_t stats_reset_done;     // Last request the scan tick applied
+    LatencyHistogram dequeue_latency;  // Consumer's part of stats.event_to_dequeue_us (get/peek; callbacks count in stats)
+    uint32_t last_scan_start;
+    bool last_scan_valid;    // Cleared on every restart so idle gaps are not jitter
+    uint32_t next_deadline;  // When the next scheduled tick is due
+} MatrixEngine;
+
+// Reset to defaults: default keymap, interleaved walk, both detections on,
+// empty queues, statistics cleared, every key released
+void matrix_engine_init(MatrixEngine *e);
+
+// Set the debounce algorithm, its times and the time between two samples
+// of the same row (drops changes in flight, keeps the debounced state)
+void matrix_engine_configure_debounce(MatrixEngine *e, DebounceMode mode,
+                                      uint32_t press_ms, uint32_t release_ms,
+                                      uint32_t sample_period_us);
+
+// Set typematic repeat (delay_ms = 0 turns it off and stops a repeat)
+void matrix_engine_configure_repeat(MatrixEngine *e, const RepeatConfig *config);
+
+// Set the adaptive scan rate (slow_us = 0 turns it off); call while not
+// scanning, before matrix_engine_restart()
+void matrix_engine_configure_adaptive_rate(MatrixEngine *e, const AdaptiveRateConfig *config);
+
+// Interval the driver should tick at from now on (fast_us after a restart,
+// then as the adaptive rate decides at the end of each tick); pass it as
+// the tick's nominal_us
+static inline uint32_t matrix_engine_tick_interval(const MatrixEngine *e) {
+    return e->tick_interval;
+}
+
+// Forget tick timing, call whenever scanning (re)starts (at the fast rate)
+void matrix_engine_restart(MatrixEngine *e);
+
+// One scan tick: sample rows through matrix_hal_read_row() as the scan
+// strategy says, debounce them and account the tick against nominal_us
+void matrix_engine_scan(MatrixEngine *e, uint32_t nominal_us);
+
+// Building blocks for backends that sample rows themselves (PIO, DMA): open a
+// tick, process any number of row samples, close it
+void matrix_engine_tick_begin(MatrixEngine *e, uint32_t tick_start_us, uint32_t nominal_us);
+void matrix_engine_process_row(MatrixEngine *e, uint8_t row, matrix_row_t pressed_cols,
+                               uint32_t now, uint32_t now_us);
+void matrix_engine_tick_end(MatrixEngine *e, uint32_t tick_start_us, uint32_t nominal_us);
+
+// Count an auto idle entry (scan tick context, outside a tick)
+void matrix_engine_count_idle(MatrixEngine *e);
+
+// Record a wake-up from deep sleep at wake_us (while not scanning): keys
+// that start changing before the next press is delivered are stamped as
+// touched at wake_us, and that press goes into stats.wake_to_event_us.
+// Cleared without a sample if the matrix is found quiet (a glitch woke it).
+void matrix_engine_wake(MatrixEngine *e, uint32_t wake_us);
+
+// Sample every row once through matrix_hal_read_row(), whatever the scan
+// strategy, as one tick outside the schedule (e.g. the key that ended a
+// deep sleep, right away instead of on the first timer tick)
+void matrix_engine_scan_all(MatrixEngine *e, uint32_t nominal_us);
+
+// Process a batch of snapshots of one row as a single sample, given the
+// columns pressed in any snapshot and those pressed in all of them
+void matrix_engine_process_batch(MatrixEngine *e, uint8_t row, matrix_row_t any_pressed,
+                                 matrix_row_t all_pressed, uint32_t now, uint32_t now_us);
+
+// True if no key is pressed, suppressed or in debounce
+bool matrix_engine_quiet(const MatrixEngine *e);
+
+// Consumer side (single consumer, see matrix_robust_get_event())
+bool matrix_engine_get_event(MatrixEngine *e, KeyEvent *event);
+size_t matrix_engine_get_events(MatrixEngine *e, KeyEvent *events, size_t max);
+size_t matrix_engine_peek_events(MatrixEngine *e, const KeyEvent **span);
+void matrix_engine_commit_events(MatrixEngine *e, size_t count);
+bool matrix_engine_get_error(MatrixEngine *e, ErrorEvent *error);
+void matrix_engine_get_matrix(const MatrixEngine *e, matrix_row_t matrix[MATRIX_ROWS]);
+// Statistics: the scan tick is their only writer and readers retry around
+// it (seqlock), so neither side masks interrupts. Call from the consumer,
+// never from an interrupt that can preempt the scan tick. A reset takes
+// effect at the next tick; until then reads return zeros.
+void matrix_engine_get_statistics(const MatrixEngine *e, ScanStatistics *stats);
+void matrix_engine_reset_statistics(MatrixEngine *e);
+
+#endif // MATRIX_ENGINE_H
@@ -0,0 +1,96 @@
+#include "matrix_gather.h"
+#include <stddef.h>
+#include <string.h>
+
+#if MATRIX_GATHER_POOL_LANES > 0
+static matrix_row_t pool[MATRIX_GATHER_POOL_LANES][256];
+static const MatrixGather *pool_owner[MATRIX_GATHER_POOL_LANES];
+
+// First of count free lanes in a row, or -1
+static int claim_lanes(const MatrixGather *gather, uint8_t count) {
+    for (int first = 0; first + count <= MATRIX_GATHER_POOL_LANES; first++) {
+        int lane = first;
+        while (lane < first + count && !pool_owner[lane]) {
+            lane++;
+        }
+        if (lane == first + count) {
+            for (lane = first; lane < first + count; lane++) {
+                pool_owner[lane] = gather;
+            }
+            return first;
+        }
+    }
+    return -1;
+}
+#endif
+
+void matrix_gather_release(MatrixGather *gather) {
+#if MATRIX_GATHER_POOL_LANES > 0
+    for (int lane = 0; lane < MATRIX_GATHER_POOL_LANES; lane++) {
+        if (pool_owner[lane] == gather) {
+            pool_owner[lane] = NULL;
+        }
+    }
+#endif
+    gather->table = NULL;
+    gather->contiguous = false;
+    gather->port_mask = 0;
+}
+
+bool matrix_gather_init(MatrixGather *gather, const uint8_t bits[MATRIX_COLS]) {
+    matrix_gather_release(gather);
+    memset(gather, 0, sizeof(*gather));
+    
+    for (int col = 0; col < MATRIX_COLS; col++) {
+        if (bits[col] >= 32) {
+            return false;
+        }
+    }
+    
+    gather->contiguous = true;
+    gather->shift = bits[0];
+    uint8_t low = bits[0], high = bits[0];
+    for (int col = 0; col < MATRIX_COLS; col++) {
+        gather->bits[col] = bits[col];
+        gather->port_mask |= (1u << bits[col]);
+        if (bits[col] != bits[0] + col) {
+            gather->contiguous = false;
+        }
+        low = (bits[col] < low) ? bits[col] : low;
+        high = (bits[col] > high) ? bits[col] : high;
+    }
+    if (gather->contiguous) {
+        return true;
+    }
+    
+#if MATRIX_GATHER_POOL_LANES > 0
+    // Tables only for the byte lanes the columns span
+    uint8_t first_lane = low / 8;
+    uint8_t lanes = high / 8 - first_lane + 1;
+    int first = claim_lanes(gather, lanes);
+    if (first < 0) {
+        return true;  // Pool full: bit-by-bit
+    }
+    
+    // For every spanned lane and byte value, collect the columns whose bit is set
+    matrix_row_t (*table)[256] = &pool[first];
+    memset(table, 0, lanes * sizeof(pool[0]));
+    for (int col = 0; col < MATRIX_COLS; col++) {
+        uint8_t lane = bits[col] / 8 - first_lane;
+        uint8_t bit = bits[col] % 8;
+        
+        for (int value = 0; value < 256; value++) {
+            if (value & (1 << bit)) {
+                table[lane][value] |= (matrix_row_t)(1u << col);
+            }
+        }
+    }
+    gather->table = (const matrix_row_t (*)[256])table;
+    gather->shift = first_lane * 8;
+    gather->lanes = lanes;
+#else
+    (void)low;
+    (void)high;
+#endif
+    return true;
+}
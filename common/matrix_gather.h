@@ -0,0 +1,63 @@
+#ifndef MATRIX_GATHER_H
+#define MATRIX_GATHER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix_config.h"
+
+// Column gather: turn one raw port read into a column bitmask
+//
+// Column pins can sit anywhere in a 32-bit port word (Pico SIO, STM32 IDR).
+// When they are consecutive and in column order the row is a single shift
+// and mask. Otherwise each byte of the port word the columns span indexes a
+// precomputed table holding the column bits found in that byte, and the
+// lookups are OR'd. Tables come from one shared pool in matrix_gather.c,
+// so a contiguous gather carries none; if the pool is full the columns are
+// picked out one bit at a time.
+
+// Byte lanes of table shared by every non-contiguous gather (one lane is
+// 256 column masks; 0 leaves only the shift and the bit-by-bit paths)
+#ifndef MATRIX_GATHER_POOL_LANES
+#define MATRIX_GATHER_POOL_LANES 4
+#endif
+
+typedef struct {
+    uint32_t port_mask;                 // All column bits in the port word
+    const matrix_row_t (*table)[256];   // Pool lanes, one per byte spanned (NULL = none)
+    uint8_t shift;                      // Lowest column bit, or first spanned lane * 8 with a table
+    uint8_t lanes;                      // Byte lanes in table
+    bool contiguous;                    // Columns on consecutive bits, in order
+    uint8_t bits[MATRIX_COLS];          // Port bit of each column
+} MatrixGather;
+
+// Build the gather for columns on port bits bits[0..MATRIX_COLS-1]; a
+// gather built before gives its pool lanes back first
+// Returns false if a bit is 32 or above (the gather then reads no columns)
+bool matrix_gather_init(MatrixGather *gather, const uint8_t bits[MATRIX_COLS]);
+
+// Give a gather's pool lanes back (it reads no columns until built again)
+void matrix_gather_release(MatrixGather *gather);
+
+// Column bitmask (bit c = column c) of the bits set in port
+static inline matrix_row_t matrix_gather(const MatrixGather *gather, uint32_t port) {
+    if (gather->contiguous) {
+        return (matrix_row_t)((port >> gather->shift) & MATRIX_COL_MASK);
+    }
+    
+    port &= gather->port_mask;
+    matrix_row_t cols = 0;
+    if (gather->table) {
+        port >>= gather->shift;
+        for (uint8_t lane = 0; lane < gather->lanes; lane++) {
+            cols |= gather->table[lane][(port >> (8 * lane)) & 0xFF];
+        }
+        return cols;
+    }
+    
+    for (int col = 0; col < MATRIX_COLS; col++) {
+        cols |= (matrix_row_t)(((port >> gather->bits[col]) & 1u) << col);
+    }
+    return cols;
+}
+
+#endif // MATRIX_GATHER_H
@@ -0,0 +1,278 @@
+#include "matrix_gesture.h"
+#include <string.h>
+
+static bool key_in(const matrix_row_t mask[MATRIX_ROWS], uint8_t row, uint8_t col) {
+    return (mask[row] >> col) & 1u;
+}
+
+static void push(GestureOutput *out, uint8_t *count, uint8_t row, uint8_t col,
+                 uint8_t key, uint8_t gesture, bool pressed, uint32_t now) {
+    GestureOutput *o = &out[(*count)++];
+    o->row = row;
+    o->col = col;
+    o->key = key;
+    o->gesture = gesture;
+    o->pressed = pressed;
+    o->timestamp = now;
+}
+
+// Index of (row, col) in a combo, or -1
+static int combo_member(const MatrixCombo *combo, uint8_t row, uint8_t col) {
+    for (int i = 0; i < combo->key_count; i++) {
+        if (combo->keys[i].row == row && combo->keys[i].col == col) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int tap_hold_index(const MatrixGestures *g, uint8_t row, uint8_t col) {
+    for (int i = 0; i < g->config.tap_hold_count; i++) {
+        if (g->config.tap_holds[i].pos.row == row && g->config.tap_holds[i].pos.col == col) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static uint8_t combo_all(const MatrixGestures *g, int c) {
+    return (uint8_t)((1u << g->config.combos[c].key_count) - 1);
+}
+
+static bool combo_complete(const MatrixGestures *g, int c) {
+    return g->seen[c] == combo_all(g, c);
+}
+
+// The complete candidate with the most keys (lowest index on a tie), or -1
+static int best_complete(const MatrixGestures *g) {
+    int best = -1;
+    uint32_t candidates = g->candidates;
+    while (candidates) {
+        int c = __builtin_ctz(candidates);
+        candidates &= candidates - 1;
+        if (combo_complete(g, c) &&
+            (best < 0 || g->config.combos[c].key_count > g->config.combos[best].key_count)) {
+            best = c;
+        }
+    }
+    return best;
+}
+
+static void fire_combo(MatrixGestures *g, int c, uint32_t now, GestureOutput *out, uint8_t *count) {
+    const MatrixCombo *combo = &g->config.combos[c];
+    for (int i = 0; i < combo->key_count; i++) {
+        g->consumed[combo->keys[i].row] |= (matrix_row_t)(1u << combo->keys[i].col);
+    }
+    g->active |= 1u << c;
+    g->held[c] = combo_all(g, c);
+    g->pending_count = 0;
+    g->candidates = 0;
+    push(out, count, combo->keys[0].row, combo->keys[0].col, combo->key, KEY_GESTURE_COMBO, true, now);
+}
+
+// Settle the held-back presses: fire the combo they complete, or deliver
+// them as they came
+static void resolve_pending(MatrixGestures *g, uint32_t now, GestureOutput *out, uint8_t *count) {
+    if (!g->pending_count) {
+        return;
+    }
+
+    int c = best_complete(g);
+    if (c >= 0) {
+        fire_combo(g, c, now, out, count);
+        return;
+    }
+
+    for (int i = 0; i < g->pending_count; i++) {
+        push(out, count, g->pending[i].row, g->pending[i].col, 0, KEY_GESTURE_NONE, true,
+             g->pending_time[i]);
+    }
+    g->pending_count = 0;
+    g->candidates = 0;
+}
+
+static void combo_press(MatrixGestures *g, uint8_t row, uint8_t col, uint32_t now,
+                        GestureOutput *out, uint8_t *count) {
+    uint32_t containing = 0;
+    for (int c = 0; c < g->config.combo_count; c++) {
+        if (combo_member(&g->config.combos[c], row, col) >= 0) {
+            containing |= 1u << c;
+        }
+    }
+
+    // No combo holds this key together with the pending ones: they are done
+    if (g->pending_count && !(g->candidates & containing)) {
+        resolve_pending(g, now, out, count);
+    }
+
+    if (!g->pending_count) {
+        g->candidates = containing;
+        memset(g->seen, 0, sizeof(g->seen));
+    } else {
+        g->candidates &= containing;
+    }
+    g->pending[g->pending_count] = (MatrixKeyPos){ row, col };
+    g->pending_time[g->pending_count] = now;
+    g->pending_count++;
+
+    // Mark the key in every remaining candidate; any still waiting for keys?
+    bool waiting = false;
+    uint32_t candidates = g->candidates;
+    while (candidates) {
+        int c = __builtin_ctz(candidates);
+        candidates &= candidates - 1;
+        g->seen[c] |= (uint8_t)(1u << combo_member(&g->config.combos[c], row, col));
+        if (!combo_complete(g, c)) {
+            waiting = true;
+        }
+    }
+    if (!waiting) {
+        resolve_pending(g, now, out, count);
+    }
+}
+
+// Release of a key that went into a fired combo: the first one releases
+// the combo, the rest are swallowed
+static void combo_release(MatrixGestures *g, uint8_t row, uint8_t col, uint32_t now,
+                          GestureOutput *out, uint8_t *count) {
+    g->consumed[row] &= (matrix_row_t)~(1u << col);
+
+    uint32_t active = g->active;
+    while (active) {
+        int c = __builtin_ctz(active);
+        active &= active - 1;
+        const MatrixCombo *combo = &g->config.combos[c];
+        int i = combo_member(combo, row, col);
+        if (i < 0 || !(g->held[c] & (1u << i))) {
+            continue;
+        }
+
+        if (g->held[c] == combo_all(g, c)) {
+            push(out, count, combo->keys[0].row, combo->keys[0].col, combo->key,
+                 KEY_GESTURE_COMBO, false, now);
+        }
+        g->held[c] &= (uint8_t)~(1u << i);
+        if (!g->held[c]) {
+            g->active &= ~(1u << c);
+        }
+        return;
+    }
+}
+
+bool matrix_gestures_init(MatrixGestures *g, const MatrixGestureConfig *config) {
+    memset(g, 0, sizeof(*g));
+    g->config = *config;
+    if (g->config.combo_count > MATRIX_COMBOS_MAX) {
+        g->config.combo_count = MATRIX_COMBOS_MAX;
+    }
+    if (g->config.tap_hold_count > MATRIX_TAP_HOLD_MAX) {
+        g->config.tap_hold_count = MATRIX_TAP_HOLD_MAX;
+    }
+    if (!g->config.combo_term_ms) {
+        g->config.combo_term_ms = COMBO_TERM_MS_DEFAULT;
+    }
+    if (!g->config.hold_ms) {
+        g->config.hold_ms = HOLD_MS_DEFAULT;
+    }
+
+    for (int c = 0; c < g->config.combo_count; c++) {
+        const MatrixCombo *combo = &g->config.combos[c];
+        if (combo->key_count < 2 || combo->key_count > MATRIX_COMBO_KEYS) {
+            return false;
+        }
+        for (int i = 0; i < combo->key_count; i++) {
+            if (combo->keys[i].row >= MATRIX_ROWS || combo->keys[i].col >= MATRIX_COLS) {
+                return false;
+            }
+            g->combo_keys[combo->keys[i].row] |= (matrix_row_t)(1u << combo->keys[i].col);
+        }
+    }
+
+    for (int t = 0; t < g->config.tap_hold_count; t++) {
+        MatrixKeyPos pos = g->config.tap_holds[t].pos;
+        if (pos.row >= MATRIX_ROWS || pos.col >= MATRIX_COLS || key_in(g->tap_hold_keys, pos.row, pos.col)) {
+            return false;
+        }
+        g->tap_hold_keys[pos.row] |= (matrix_row_t)(1u << pos.col);
+    }
+    return true;
+}
+
+uint8_t matrix_gestures_key(MatrixGestures *g, uint8_t row, uint8_t col, bool pressed,
+                            uint32_t now, GestureOutput out[GESTURE_OUTPUT_MAX]) {
+    uint8_t count = 0;
+
+    if (pressed) {
+        if (key_in(g->combo_keys, row, col)) {
+            combo_press(g, row, col, now, out, &count);
+            return count;
+        }
+
+        // Any other key ends the combo window
+        resolve_pending(g, now, out, &count);
+
+        if (key_in(g->tap_hold_keys, row, col)) {
+            int t = tap_hold_index(g, row, col);
+            g->tap_hold_down |= 1u << t;
+            g->tap_hold_since[t] = now;
+        } else {
+            push(out, &count, row, col, 0, KEY_GESTURE_NONE, true, now);
+        }
+        return count;
+    }
+
+    // A held-back key goes out before its own release
+    for (int i = 0; i < g->pending_count; i++) {
+        if (g->pending[i].row == row && g->pending[i].col == col) {
+            resolve_pending(g, now, out, &count);
+            break;
+        }
+    }
+
+    if (key_in(g->consumed, row, col)) {
+        combo_release(g, row, col, now, out, &count);
+        return count;
+    }
+
+    if (key_in(g->tap_hold_keys, row, col) && !key_in(g->combo_keys, row, col)) {
+        int t = tap_hold_index(g, row, col);
+        uint32_t bit = 1u << t;
+        if (!(g->tap_hold_down & bit)) {
+            // Pressed before the gestures were installed
+            return count;
+        }
+        const MatrixTapHold *th = &g->config.tap_holds[t];
+        if (g->tap_hold_held & bit) {
+            push(out, &count, row, col, th->hold_key, KEY_GESTURE_HOLD, false, now);
+        } else {
+            push(out, &count, row, col, th->tap_key, KEY_GESTURE_TAP, true, now);
+            push(out, &count, row, col, th->tap_key, KEY_GESTURE_TAP, false, now);
+        }
+        g->tap_hold_down &= ~bit;
+        g->tap_hold_held &= ~bit;
+        return count;
+    }
+
+    push(out, &count, row, col, 0, KEY_GESTURE_NONE, false, now);
+    return count;
+}
+
+uint8_t matrix_gestures_tick(MatrixGestures *g, uint32_t now, GestureOutput out[GESTURE_OUTPUT_MAX]) {
+    uint8_t count = 0;
+
+    if (g->pending_count && now - g->pending_time[0] >= g->config.combo_term_ms) {
+        resolve_pending(g, now, out, &count);
+    }
+
+    uint32_t waiting = g->tap_hold_down & ~g->tap_hold_held;
+    while (waiting) {
+        int t = __builtin_ctz(waiting);
+        waiting &= waiting - 1;
+        if (now - g->tap_hold_since[t] >= g->config.hold_ms) {
+            const MatrixTapHold *th = &g->config.tap_holds[t];
+            g->tap_hold_held |= 1u << t;
+            push(out, &count, th->pos.row, th->pos.col, th->hold_key, KEY_GESTURE_HOLD, true, now);
+        }
+    }
+    return count;
+}
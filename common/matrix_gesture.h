@@ -0,0 +1,137 @@
+#ifndef MATRIX_GESTURE_H
+#define MATRIX_GESTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix_config.h"
+
+// Combos and tap-hold keys
+//
+// An incremental state machine between debounce and the event queue. It
+// sees every debounced press and release once, as it happens, and the scan
+// tick calls it once per tick for its timeouts, so no timer of its own and
+// no search through past events: each key change and each tick costs a few
+// mask tests plus a walk over the configured combos or tap-hold keys.
+//
+// Combo: keys pressed together (within combo_term_ms of the first) send
+// the combo's key code instead of their own, pressed until the first of
+// them is released. Presses of combo keys are held back until the combo
+// either completes or can no longer complete (timeout, another key, a
+// release), then delivered in order as normal presses. When a combo is
+// part of a longer one (A+B and A+B+C), A+B fires on timeout or the next
+// event, not as soon as B is down.
+//
+// Tap-hold: released within hold_ms, the key sends tap_key (press and
+// release together); held for hold_ms, hold_key is pressed at that tick and
+// released with the key. Decided by time only, other keys do not force it.
+// A key that is in a combo is never treated as tap-hold.
+//
+// Owned by the scan tick once installed (matrix_robust_set_gestures());
+// the config and its tables must stay valid while installed.
+
+#ifndef MATRIX_COMBOS_MAX
+#define MATRIX_COMBOS_MAX 8
+#endif
+#ifndef MATRIX_COMBO_KEYS
+#define MATRIX_COMBO_KEYS 4    // Keys per combo
+#endif
+#ifndef MATRIX_TAP_HOLD_MAX
+#define MATRIX_TAP_HOLD_MAX 8
+#endif
+
+#if MATRIX_COMBOS_MAX > 32
+#error "MATRIX_COMBOS_MAX must be at most 32"
+#endif
+#if MATRIX_COMBO_KEYS < 2 || MATRIX_COMBO_KEYS > 8
+#error "MATRIX_COMBO_KEYS must be 2..8"
+#endif
+#if MATRIX_TAP_HOLD_MAX > 32
+#error "MATRIX_TAP_HOLD_MAX must be at most 32"
+#endif
+
+// What produced a key event (KeyEvent.gesture)
+#define KEY_GESTURE_NONE   0  // The key itself (maybe delayed by a combo that did not complete)
+#define KEY_GESTURE_TAP    1  // tap_key of a tap-hold key
+#define KEY_GESTURE_HOLD   2  // hold_key of a tap-hold key
+#define KEY_GESTURE_COMBO  3  // A combo's key; row/col are its first key
+
+#define COMBO_TERM_MS_DEFAULT 50
+#define HOLD_MS_DEFAULT       200
+
+typedef struct {
+    uint8_t row;
+    uint8_t col;
+} MatrixKeyPos;
+
+typedef struct {
+    uint8_t key_count;                     // 2 to MATRIX_COMBO_KEYS
+    MatrixKeyPos keys[MATRIX_COMBO_KEYS];
+    uint8_t key;                           // Key code sent for the combo
+} MatrixCombo;
+
+typedef struct {
+    MatrixKeyPos pos;
+    uint8_t tap_key;
+    uint8_t hold_key;
+} MatrixTapHold;
+
+typedef struct {
+    const MatrixCombo *combos;
+    uint8_t combo_count;       // Beyond MATRIX_COMBOS_MAX are ignored
+    uint32_t combo_term_ms;    // 0 = COMBO_TERM_MS_DEFAULT
+    const MatrixTapHold *tap_holds;
+    uint8_t tap_hold_count;    // Beyond MATRIX_TAP_HOLD_MAX are ignored
+    uint32_t hold_ms;          // 0 = HOLD_MS_DEFAULT
+} MatrixGestureConfig;
+
+// One resolved key event. For KEY_GESTURE_NONE, key is unused (the caller
+// looks up its own keymap).
+typedef struct {
+    uint8_t row;
+    uint8_t col;
+    uint8_t key;
+    uint8_t gesture;     // KEY_GESTURE_*
+    bool pressed;
+    uint32_t timestamp;  // ms
+} GestureOutput;
+
+// Most outputs of one matrix_gestures_key() or matrix_gestures_tick() call
+#define GESTURE_OUTPUT_MAX (MATRIX_COMBO_KEYS + MATRIX_TAP_HOLD_MAX + 2)
+
+typedef struct {
+    MatrixGestureConfig config;
+    matrix_row_t combo_keys[MATRIX_ROWS];     // Keys in any combo
+    matrix_row_t tap_hold_keys[MATRIX_ROWS];  // Keys with a tap-hold entry
+    matrix_row_t consumed[MATRIX_ROWS];       // Held keys that went into a fired combo
+
+    // Combo presses held back, in press order
+    MatrixKeyPos pending[MATRIX_COMBO_KEYS];
+    uint32_t pending_time[MATRIX_COMBO_KEYS];
+    uint8_t pending_count;
+    uint32_t candidates;                  // Combos that contain every pending key
+    uint8_t seen[MATRIX_COMBOS_MAX];      // Keys of each combo among the pending ones
+
+    uint32_t active;                      // Fired combos still pressed
+    uint8_t held[MATRIX_COMBOS_MAX];      // Keys of each fired combo still down
+
+    // Tap-hold keys down, and those already sending hold_key
+    uint32_t tap_hold_down;
+    uint32_t tap_hold_held;
+    uint32_t tap_hold_since[MATRIX_TAP_HOLD_MAX];
+} MatrixGestures;
+
+// Take a config (copied; the tables it points at are not), nothing held.
+// Returns false for an entry with a key outside the matrix, a combo with
+// fewer than 2 or more than MATRIX_COMBO_KEYS keys, or a key in two
+// tap-hold entries.
+bool matrix_gestures_init(MatrixGestures *g, const MatrixGestureConfig *config);
+
+// Feed one debounced press or release; fills out with the events to
+// deliver, in order, and returns how many
+uint8_t matrix_gestures_key(MatrixGestures *g, uint8_t row, uint8_t col, bool pressed,
+                            uint32_t now, GestureOutput out[GESTURE_OUTPUT_MAX]);
+
+// Once per scan tick: expire the combo term and start holds
+uint8_t matrix_gestures_tick(MatrixGestures *g, uint32_t now, GestureOutput out[GESTURE_OUTPUT_MAX]);
+
+#endif // MATRIX_GESTURE_H
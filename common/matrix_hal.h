@@ -0,0 +1,26 @@
+#ifndef MATRIX_HAL_H
+#define MATRIX_HAL_H
+
+#include <stdint.h>
+#include "matrix_config.h"
+
+// Hardware hooks used by the shared key engine (matrix_engine.c)
+//
+// Every build links exactly one implementation: matrix_robust.c on the
+// Pico, stm32/matrix_robust_stm32.c on STM32 and host/sim_matrix.c for the
+// host simulation. Nothing else in common/ touches hardware.
+
+// Free-running microsecond clock, wraps at 2^32 (differences are wrap-safe)
+uint32_t matrix_hal_time_us(void);
+
+// Millisecond clock for event timestamps
+uint32_t matrix_hal_time_ms(void);
+
+// Drive every row inactive (HIGH)
+void matrix_hal_rows_idle(void);
+
+// Strobe one row and return its pressed columns (bit c = column c)
+// Rows are all inactive on entry and must be again on return
+matrix_row_t matrix_hal_read_row(uint8_t row);
+
+#endif // MATRIX_HAL_H
@@ -0,0 +1,29 @@
+#ifndef MATRIX_KEYMAP_H
+#define MATRIX_KEYMAP_H
+
+#include <stdint.h>
+#include <string.h>
+#include "matrix_config.h"
+
+// Fill keymap with the default layout for the configured matrix size
+// 4x4 gets the hex keypad layout; other sizes get row-major key indices
+// (row * MATRIX_COLS + col)
+static inline void matrix_default_keymap(uint8_t keymap[MATRIX_ROWS][MATRIX_COLS]) {
+#if MATRIX_ROWS == 4 && MATRIX_COLS == 4
+    static const uint8_t hex_keymap[4][4] = {
+        {0x1, 0x2, 0x3, 0xA},
+        {0x4, 0x5, 0x6, 0xB},
+        {0x7, 0x8, 0x9, 0xC},
+        {0x0, 0xF, 0xE, 0xD}
+    };
+    memcpy(keymap, hex_keymap, sizeof(hex_keymap));
+#else
+    for (int row = 0; row < MATRIX_ROWS; row++) {
+        for (int col = 0; col < MATRIX_COLS; col++) {
+            keymap[row][col] = (uint8_t)(row * MATRIX_COLS + col);
+        }
+    }
+#endif
+}
+
+#endif // MATRIX_KEYMAP_H
@@ -0,0 +1,89 @@
+#include "matrix_layers.h"
+#include <string.h>
+
+// Redo the per-key lookup for the current active mask
+static void resolve_layers(MatrixLayers *l) {
+    for (int row = 0; row < MATRIX_ROWS; row++) {
+        for (int col = 0; col < MATRIX_COLS; col++) {
+            LayerAction action = LA_TRNS;
+            uint32_t active = l->active;
+
+            // Highest active layer first
+            while (active) {
+                uint8_t layer = 31 - (uint8_t)__builtin_clz(active);
+                action = l->layers[layer][row][col];
+                if (LAYER_ACTION_KIND(action) != LAYER_KIND_TRANSPARENT) {
+                    break;
+                }
+                active &= ~(1u << layer);
+            }
+            l->resolved[row][col] = action;
+        }
+    }
+}
+
+static void update_active(MatrixLayers *l) {
+    uint32_t active = 1u | l->toggled | l->momentary;
+    if (active != l->active) {
+        l->active = active;
+        l->changes++;
+        resolve_layers(l);
+    }
+}
+
+void matrix_layers_init(MatrixLayers *l, const LayerTable *layers, uint8_t layer_count) {
+    memset(l, 0, sizeof(*l));
+    l->layers = layers;
+    l->layer_count = (layer_count > MATRIX_LAYERS_MAX) ? MATRIX_LAYERS_MAX : layer_count;
+    l->active = 1;
+    resolve_layers(l);
+}
+
+LayerAction matrix_layers_process(MatrixLayers *l, uint8_t row, uint8_t col, bool pressed) {
+    if (row >= MATRIX_ROWS || col >= MATRIX_COLS) {
+        return LA_NONE;
+    }
+
+    LayerAction action;
+    if (pressed) {
+        action = l->resolved[row][col];
+        l->pressed[row][col] = action;
+    } else {
+        // A release without a press seen (before init) does nothing
+        action = l->pressed[row][col];
+        l->pressed[row][col] = LA_NONE;
+    }
+
+    uint8_t layer = LAYER_ACTION_ARG(action);
+    switch (LAYER_ACTION_KIND(action)) {
+    case LAYER_KIND_MOMENTARY:
+        if (layer < l->layer_count) {
+            if (pressed) {
+                l->holds[layer]++;
+                l->momentary |= 1u << layer;
+            } else if (l->holds[layer] && --l->holds[layer] == 0) {
+                l->momentary &= ~(1u << layer);
+            }
+            update_active(l);
+        }
+        break;
+
+    case LAYER_KIND_TOGGLE:
+        if (pressed) {
+            matrix_layers_toggle(l, layer);
+        }
+        break;
+
+    default:
+        break;
+    }
+    return action;
+}
+
+void matrix_layers_toggle(MatrixLayers *l, uint8_t layer) {
+    // The base layer stays on
+    if (layer > 0 && layer < l->layer_count) {
+        l->toggled ^= 1u << layer;
+        update_active(l);
+    }
+}
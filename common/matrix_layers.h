@@ -0,0 +1,81 @@
+#ifndef MATRIX_LAYERS_H
+#define MATRIX_LAYERS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix_config.h"
+
+// Layered keymap
+//
+// Shared by the Pico and STM32 keymap code. A keymap is a stack of up to
+// MATRIX_LAYERS_MAX const tables (in flash), one action per key. Layer 0 is
+// always on; higher layers are switched on while a momentary key is held or
+// flipped by a toggle key. A key takes the action of the highest active
+// layer that is not transparent. The lookup through the layers is only
+// done when the active-layer mask changes, into a resolved table, so a key
+// event costs one table index. The action a key was pressed with is kept
+// until its release, so releases still reach it after a layer change.
+//
+// Not thread-safe: feed events from one context (main loop or one task).
+
+#ifndef MATRIX_LAYERS_MAX
+#define MATRIX_LAYERS_MAX 8
+#endif
+
+#if MATRIX_LAYERS_MAX < 1 || MATRIX_LAYERS_MAX > 32
+#error "MATRIX_LAYERS_MAX must be 1..32"
+#endif
+
+// Action: kind in the high byte, argument in the low byte
+typedef uint16_t LayerAction;
+
+#define LAYER_KIND_TRANSPARENT 0x00  // Next active layer down decides (bottom: pass the key on)
+#define LAYER_KIND_NONE        0x01  // Swallow the key
+#define LAYER_KIND_KEY         0x02  // Pass the key on as key code (argument)
+#define LAYER_KIND_FUNCTION    0x03  // Run function (argument) on press
+#define LAYER_KIND_MOMENTARY   0x04  // Layer (argument) on while held
+#define LAYER_KIND_TOGGLE      0x05  // Flip layer (argument) on press
+
+#define LAYER_ACTION(kind, arg) ((LayerAction)(((kind) << 8) | ((arg) & 0xFF)))
+#define LAYER_ACTION_KIND(a)    ((uint8_t)((a) >> 8))
+#define LAYER_ACTION_ARG(a)     ((uint8_t)((a) & 0xFF))
+
+// Table shorthands (a zero-initialized entry is LA_TRNS)
+#define LA_TRNS      LAYER_ACTION(LAYER_KIND_TRANSPARENT, 0)
+#define LA_NONE      LAYER_ACTION(LAYER_KIND_NONE, 0)
+#define LA_KEY(code) LAYER_ACTION(LAYER_KIND_KEY, code)
+#define LA_FN(n)     LAYER_ACTION(LAYER_KIND_FUNCTION, n)
+#define LA_MO(layer) LAYER_ACTION(LAYER_KIND_MOMENTARY, layer)
+#define LA_TG(layer) LAYER_ACTION(LAYER_KIND_TOGGLE, layer)
+
+typedef LayerAction LayerTable[MATRIX_ROWS][MATRIX_COLS];
+
+typedef struct {
+    const LayerTable *layers;  // layer_count tables, 0 = base
+    uint8_t layer_count;
+    uint32_t toggled;          // Layers flipped on by toggle keys
+    uint32_t momentary;        // Layers with a momentary key held
+    uint8_t holds[MATRIX_LAYERS_MAX];  // Momentary keys held per layer
+    uint32_t active;           // Bit n = layer n on (bit 0 always set)
+    uint32_t changes;          // Bumped on every change of active
+    LayerAction resolved[MATRIX_ROWS][MATRIX_COLS];  // Action per key for active
+    LayerAction pressed[MATRIX_ROWS][MATRIX_COLS];   // Action each held key was pressed with
+} MatrixLayers;
+
+// Use layer_count tables (extra ones beyond MATRIX_LAYERS_MAX are ignored),
+// all layers but the base off, no key held
+void matrix_layers_init(MatrixLayers *l, const LayerTable *layers, uint8_t layer_count);
+
+// Feed one press or release. Momentary and toggle keys switch layers here;
+// the returned action is what the caller has to carry out (for a release,
+// the action of its press). LA_TRNS means pass the key on unchanged.
+LayerAction matrix_layers_process(MatrixLayers *l, uint8_t row, uint8_t col, bool pressed);
+
+// Flip a layer from code (e.g. a host command), like a toggle key
+void matrix_layers_toggle(MatrixLayers *l, uint8_t layer);
+
+static inline uint32_t matrix_layers_active(const MatrixLayers *l) {
+    return l->active;
+}
+
+#endif // MATRIX_LAYERS_H
@@ -0,0 +1,67 @@
+#include "matrix_log.h"
+#include "matrix_ring.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#define LOG_MASK (MATRIX_LOG_BYTES - 1)
+
+void matrix_log_init(MatrixLog *log) {
+    log->head = 0;
+    log->tail = 0;
+    log->dropped = 0;
+}
+
+bool matrix_log_printf(MatrixLog *log, const char *format, ...) {
+    char line[MATRIX_LOG_LINE_MAX];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(line, sizeof(line), format, args);
+    va_end(args);
+    if (n <= 0) {
+        return n == 0;
+    }
+    uint32_t len = (uint32_t)n < sizeof(line) ? (uint32_t)n : sizeof(line) - 1;
+
+    uint32_t head = log->head;
+    uint32_t tail = matrix_ring_load_acquire(&log->tail);
+    if (MATRIX_LOG_BYTES - (head - tail) < len) {
+        log->dropped++;
+        return false;
+    }
+
+    // At most two copies: up to the end of the buffer, then from its start
+    uint32_t start = head & LOG_MASK;
+    uint32_t first = MATRIX_LOG_BYTES - start;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(&log->buffer[start], line, first);
+    memcpy(log->buffer, line + first, len - first);
+    matrix_ring_store_release(&log->head, head + len);
+    return true;
+}
+
+size_t matrix_log_flush(MatrixLog *log, MatrixStreamWrite write, void *ctx) {
+    uint32_t tail = log->tail;
+    uint32_t head = matrix_ring_load_acquire(&log->head);
+
+    while (head != tail) {
+        uint32_t start = tail & LOG_MASK;
+        uint32_t span = head - tail;
+        if (span > MATRIX_LOG_BYTES - start) {
+            span = MATRIX_LOG_BYTES - start;
+        }
+        size_t taken = write(&log->buffer[start], span, ctx);
+        if (taken > span) {
+            taken = span;
+        }
+        tail += (uint32_t)taken;
+        if (taken < span) {
+            break;  // Console full or not there: the rest waits
+        }
+    }
+
+    matrix_ring_store_release(&log->tail, tail);
+    return head - tail;
+}
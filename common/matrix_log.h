@@ -0,0 +1,51 @@
+#ifndef MATRIX_LOG_H
+#define MATRIX_LOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "matrix_stream.h"  // MatrixStreamWrite
+
+// Non-blocking text log
+//
+// Diagnostics are formatted into a RAM ring and written out later, as much
+// as the console takes, instead of printf blocking on a console that is
+// not there yet (USB CDC before enumeration, a UART TX FIFO). Boot
+// messages wait in the ring until the host opens the port, so the keypad
+// can be scanning before any console exists.
+//
+// One producer (matrix_log_printf()) and one consumer (matrix_log_flush()),
+// which may be the same main loop. A line that does not fit whole is
+// dropped and counted; lines are never cut.
+
+#ifndef MATRIX_LOG_BYTES
+#define MATRIX_LOG_BYTES 2048
+#endif
+
+// Longest line, longer ones are truncated
+#ifndef MATRIX_LOG_LINE_MAX
+#define MATRIX_LOG_LINE_MAX 128
+#endif
+
+_Static_assert(MATRIX_LOG_BYTES != 0 && (MATRIX_LOG_BYTES & (MATRIX_LOG_BYTES - 1)) == 0,
+               "MATRIX_LOG_BYTES must be a power of two");
+
+typedef struct {
+    uint8_t buffer[MATRIX_LOG_BYTES];
+    uint32_t head;      // Bytes written (producer only)
+    uint32_t tail;      // Bytes sent (consumer only)
+    uint32_t dropped;   // Lines that did not fit
+} MatrixLog;
+
+void matrix_log_init(MatrixLog *log);
+
+// Producer: format one message into the ring (printf format)
+// Returns false (and counts it as dropped) if it does not fit
+bool matrix_log_printf(MatrixLog *log, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+// Consumer: hand queued text to write, as much as it takes right now
+// (call once per main loop pass). Returns the bytes still queued.
+size_t matrix_log_flush(MatrixLog *log, MatrixStreamWrite write, void *ctx);
+
+#endif // MATRIX_LOG_H
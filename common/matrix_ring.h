@@ -0,0 +1,137 @@
+#ifndef MATRIX_RING_H
+#define MATRIX_RING_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Lock-free single-producer / single-consumer ring buffer
+//
+// Shared by the Pico and STM32 drivers for the event and error queues.
+// The producer (scan ISR) only writes head, the consumer (main loop or one
+// RTOS task) only writes tail, so neither side ever takes a lock or masks
+// interrupts. Indices run freely and are masked on access, which needs a
+// power-of-two capacity and lets every slot be used.
+//
+// Acquire/release ordering makes the slot contents visible before the index
+// that publishes them, on one core or across cores (RP2350 core 1 -> core 0).
+
+typedef struct {
+    uint8_t *buffer;      // capacity * elem_size bytes
+    uint32_t elem_size;
+    uint32_t mask;        // capacity - 1
+    uint32_t head;        // next slot to write (producer only)
+    uint32_t tail;        // next slot to read (consumer only)
+} MatrixRing;
+
+#define MATRIX_RING_IS_POW2(n) ((n) != 0 && (((n) & ((n) - 1)) == 0))
+
+static inline uint32_t matrix_ring_load_acquire(const uint32_t *p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void matrix_ring_store_release(uint32_t *p, uint32_t v) {
+    __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+// capacity must be a power of two
+static inline void matrix_ring_init(MatrixRing *r, void *buffer, uint32_t elem_size, uint32_t capacity) {
+    r->buffer = (uint8_t *)buffer;
+    r->elem_size = elem_size;
+    r->mask = capacity - 1;
+    r->head = 0;
+    r->tail = 0;
+}
+
+static inline uint32_t matrix_ring_capacity(const MatrixRing *r) {
+    return r->mask + 1;
+}
+
+// Producer: copy one element in. Returns false if the ring is full.
+static inline bool matrix_ring_push(MatrixRing *r, const void *elem) {
+    uint32_t head = r->head;
+    uint32_t tail = matrix_ring_load_acquire(&r->tail);
+
+    if (head - tail > r->mask) {
+        return false;
+    }
+
+    memcpy(r->buffer + (head & r->mask) * r->elem_size, elem, r->elem_size);
+    matrix_ring_store_release(&r->head, head + 1);
+    return true;
+}
+
+// Consumer: copy one element out. Returns false if the ring is empty.
+static inline bool matrix_ring_pop(MatrixRing *r, void *elem) {
+    uint32_t tail = r->tail;
+    uint32_t head = matrix_ring_load_acquire(&r->head);
+
+    if (head == tail) {
+        return false;
+    }
+
+    memcpy(elem, r->buffer + (tail & r->mask) * r->elem_size, r->elem_size);
+    matrix_ring_store_release(&r->tail, tail + 1);
+    return true;
+}
+
+// Consumer: copy up to max elements out (at most two memcpy calls)
+// Returns the number of elements copied
+static inline uint32_t matrix_ring_pop_many(MatrixRing *r, void *out, uint32_t max) {
+    uint32_t tail = r->tail;
+    uint32_t head = matrix_ring_load_acquire(&r->head);
+    uint32_t count = head - tail;
+
+    if (count > max) {
+        count = max;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    uint32_t start = tail & r->mask;
+    uint32_t first = matrix_ring_capacity(r) - start;
+    if (first > count) {
+        first = count;
+    }
+
+    memcpy(out, r->buffer + start * r->elem_size, first * r->elem_size);
+    memcpy((uint8_t *)out + first * r->elem_size, r->buffer, (count - first) * r->elem_size);
+
+    matrix_ring_store_release(&r->tail, tail + count);
+    return count;
+}
+
+// Consumer: zero-copy view of the queued elements that are contiguous in
+// memory, starting at the oldest. Call again after committing to get the
+// part that wrapped to the start of the buffer.
+// Returns the number of elements in the span (0 if empty)
+static inline uint32_t matrix_ring_peek_span(const MatrixRing *r, void **span) {
+    uint32_t tail = r->tail;
+    uint32_t head = matrix_ring_load_acquire(&r->head);
+    uint32_t count = head - tail;
+    uint32_t start = tail & r->mask;
+    uint32_t contiguous = matrix_ring_capacity(r) - start;
+
+    *span = r->buffer + start * r->elem_size;
+    return (count < contiguous) ? count : contiguous;
+}
+
+// Consumer: release n elements previously returned by matrix_ring_peek_span
+static inline void matrix_ring_commit(MatrixRing *r, uint32_t n) {
+    matrix_ring_store_release(&r->tail, r->tail + n);
+}
+
+// Either side: number of queued elements (a snapshot, may be stale)
+static inline uint32_t matrix_ring_count(const MatrixRing *r) {
+    uint32_t tail = matrix_ring_load_acquire(&r->tail);
+    uint32_t head = matrix_ring_load_acquire(&r->head);
+    return head - tail;
+}
+
+// Consumer: drop everything queued so far
+static inline void matrix_ring_clear(MatrixRing *r) {
+    matrix_ring_store_release(&r->tail, matrix_ring_load_acquire(&r->head));
+}
+
+#endif // MATRIX_RING_H
@@ -0,0 +1,82 @@
+#include "matrix_settings.h"
+#include "matrix_engine.h"  // Default debounce and stuck-key times
+#include "matrix_keymap.h"
+#include <string.h>
+
+// CRC-32 (reflected poly 0xEDB88320), bitwise: the block is checked once
+// at boot and once per save, so a table is not worth its 1 KB of flash
+uint32_t matrix_settings_crc32(const void *data, size_t len) {
+    const uint8_t *p = (const uint8_t *)data;
+    uint32_t crc = 0xFFFFFFFFu;
+
+    for (size_t i = 0; i < len; i++) {
+        crc ^= p[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 1u) ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+void matrix_settings_defaults(MatrixSettings *s) {
+    // Padding too, so the CRC only depends on the fields
+    memset(s, 0, sizeof(*s));
+
+    s->debounce_mode = DEBOUNCE_DEFER_PRESS_EAGER_RELEASE;
+    s->debounce_press_ms = DEBOUNCE_PRESS_MS;
+    s->debounce_release_ms = DEBOUNCE_RELEASE_MS;
+    s->stuck_timeout_ms = STUCK_KEY_TIMEOUT_MS;
+    s->flags = MATRIX_SETTINGS_GHOST_DETECTION | MATRIX_SETTINGS_STUCK_DETECTION;
+    matrix_default_keymap(s->keymap);
+}
+
+void matrix_settings_seal(MatrixSettings *s, uint32_t sequence) {
+    s->magic = MATRIX_SETTINGS_MAGIC;
+    s->version = MATRIX_SETTINGS_VERSION;
+    s->size = (uint16_t)sizeof(MatrixSettings);
+    s->sequence = sequence;
+    s->rows = MATRIX_ROWS;
+    s->cols = MATRIX_COLS;
+    if (s->layer_count > MATRIX_SETTINGS_LAYERS) {
+        s->layer_count = MATRIX_SETTINGS_LAYERS;
+    }
+    s->crc = matrix_settings_crc32(s, offsetof(MatrixSettings, crc));
+}
+
+bool matrix_settings_valid(const MatrixSettings *s) {
+    // Header first: erased flash (all 0xFF) fails here without a CRC pass
+    if (s->magic != MATRIX_SETTINGS_MAGIC || s->version != MATRIX_SETTINGS_VERSION ||
+        s->size != sizeof(MatrixSettings) || s->rows != MATRIX_ROWS || s->cols != MATRIX_COLS ||
+        s->layer_count > MATRIX_SETTINGS_LAYERS) {
+        return false;
+    }
+    return s->crc == matrix_settings_crc32(s, offsetof(MatrixSettings, crc));
+}
+
+const MatrixSettings *matrix_settings_newest(const MatrixSettings *a, const MatrixSettings *b) {
+    bool a_ok = a != NULL && matrix_settings_valid(a);
+    bool b_ok = b != NULL && matrix_settings_valid(b);
+
+    if (a_ok && b_ok) {
+        // Wrap-safe: the sequence only ever moves forward by one
+        return (int32_t)(b->sequence - a->sequence) > 0 ? b : a;
+    }
+    if (a_ok) {
+        return a;
+    }
+    return b_ok ? b : NULL;
+}
+
+void matrix_settings_debounce(const MatrixSettings *s, uint32_t *press_ms, uint32_t *release_ms) {
+    uint32_t bounce = 0;
+    for (int row = 0; row < MATRIX_ROWS; row++) {
+        for (int col = 0; col < MATRIX_COLS; col++) {
+            if (s->bounce_ms[row][col] > bounce) {
+                bounce = s->bounce_ms[row][col];
+            }
+        }
+    }
+
+    *press_ms = s->debounce_press_ms > bounce ? s->debounce_press_ms : bounce;
+    *release_ms = s->debounce_release_ms > bounce ? s->debounce_release_ms : bounce;
+}
@@ -0,0 +1,96 @@
+#ifndef MATRIX_SETTINGS_H
+#define MATRIX_SETTINGS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "matrix_config.h"
+#include "matrix_debounce.h"  // DebounceMode
+#include "matrix_layers.h"    // LayerTable
+
+// Persistent settings block
+//
+// Everything a unit is tuned with (key codes, layer tables, debounce,
+// ghost and stuck-key detection, per-key bounce calibration) in one
+// versioned, CRC-checked record. The drivers keep two copies in flash and
+// read the newest valid one in place (XIP on the Pico, memory-mapped on
+// STM32), so boot needs no copying and nothing is parsed: the layer
+// tables are used straight from flash.
+//
+// Updates are double-buffered: a save erases and writes the older copy
+// with the next sequence number, CRC last, so power lost mid-write leaves
+// a copy that fails its check and the previous one keeps being used.
+//
+// The record is only valid for the matrix size and version it was written
+// with. A firmware with another size or version ignores it and runs on its
+// built-in defaults until settings are saved again.
+
+#define MATRIX_SETTINGS_MAGIC   0x5453584Du  // "MXST"
+#define MATRIX_SETTINGS_VERSION 1
+
+// Layer tables stored (layer_count may be lower)
+#ifndef MATRIX_SETTINGS_LAYERS
+#define MATRIX_SETTINGS_LAYERS 4
+#endif
+
+#if MATRIX_SETTINGS_LAYERS < 1 || MATRIX_SETTINGS_LAYERS > MATRIX_LAYERS_MAX
+#error "MATRIX_SETTINGS_LAYERS must be 1..MATRIX_LAYERS_MAX"
+#endif
+
+// flags
+#define MATRIX_SETTINGS_GHOST_DETECTION 0x01
+#define MATRIX_SETTINGS_STUCK_DETECTION 0x02
+
+typedef struct {
+    // Header
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;               // sizeof(MatrixSettings) of the writer
+    uint32_t sequence;           // Bumped by every save, the newer copy wins
+    uint8_t rows;
+    uint8_t cols;
+    uint8_t layer_count;         // Tables in layers[] in use (0 = keep the built-in ones)
+    uint8_t flags;
+
+    // Scan settings
+    uint8_t debounce_mode;       // DebounceMode
+    uint8_t reserved[3];
+    uint16_t debounce_press_ms;
+    uint16_t debounce_release_ms;
+    uint32_t stuck_timeout_ms;
+
+    // Key codes and layers
+    uint8_t keymap[MATRIX_ROWS][MATRIX_COLS];
+    LayerTable layers[MATRIX_SETTINGS_LAYERS];
+
+    // Calibration: longest bounce seen per key (ms, e.g. the p99 burst that
+    // host/matrix_replay measures in a trace of this unit; 0 = unknown)
+    uint8_t bounce_ms[MATRIX_ROWS][MATRIX_COLS];
+
+    uint32_t crc;                // CRC-32 of every byte before it
+} MatrixSettings;
+
+// Built-in defaults: default keymap, no stored layers, default debounce,
+// ghost and stuck detection on, no calibration, not sealed
+void matrix_settings_defaults(MatrixSettings *s);
+
+// Fill in the header for sequence and compute the CRC (call after the last
+// change and before writing)
+void matrix_settings_seal(MatrixSettings *s, uint32_t sequence);
+
+// Magic, version, size, matrix size and CRC all match this build
+bool matrix_settings_valid(const MatrixSettings *s);
+
+// The valid copy with the higher sequence number, or NULL if neither is
+// valid (either pointer may be NULL)
+const MatrixSettings *matrix_settings_newest(const MatrixSettings *a, const MatrixSettings *b);
+
+// Debounce times with the calibration applied: the debouncer has one set of
+// thresholds for all keys, so the longest calibrated bounce raises the
+// configured times where it is longer
+void matrix_settings_debounce(const MatrixSettings *s, uint32_t *press_ms, uint32_t *release_ms);
+
+// CRC-32 (IEEE, as zlib), e.g. for host tools checking an image
+uint32_t matrix_settings_crc32(const void *data, size_t len);
+
+#endif // MATRIX_SETTINGS_H
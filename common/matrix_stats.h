@@ -0,0 +1,97 @@
+#ifndef MATRIX_STATS_H
+#define MATRIX_STATS_H
+
+#include <stdint.h>
+
+// Log-scale latency histogram
+//
+// Shared by the Pico and STM32 drivers for the timing statistics. Bucket 0
+// counts 0us, bucket b (1..LATENCY_HIST_BUCKETS-2) counts [2^(b-1), 2^b) us
+// and the last bucket everything from 2^(LATENCY_HIST_BUCKETS-2) us up, so
+// 16 buckets resolve 1us steps at the low end and still catch 16ms+ outliers.
+// The running sum is 64-bit and the count only saturates, so the mean stays
+// exact for any realistic uptime (no avg * (n-1) overflow).
+//
+// Each histogram has one writer (the scan ISR or the event consumer); a
+// reader copying it mid-update may see a count one ahead of its buckets.
+
+#define LATENCY_HIST_BUCKETS 16
+
+typedef struct {
+    uint32_t buckets[LATENCY_HIST_BUCKETS];
+    uint32_t count;  // Samples recorded
+    uint32_t min;    // Smallest sample (0 until the first one)
+    uint32_t max;    // Largest sample
+    uint64_t sum;    // Sum of all samples, for the mean
+} LatencyHistogram;
+
+static inline uint32_t latency_hist_bucket(uint32_t value_us) {
+    if (value_us == 0) {
+        return 0;
+    }
+    uint32_t bucket = 32 - (uint32_t)__builtin_clz(value_us);
+    return (bucket < LATENCY_HIST_BUCKETS) ? bucket : LATENCY_HIST_BUCKETS - 1;
+}
+
+// Lowest value counted by a bucket (the upper bound is the next bucket's)
+static inline uint32_t latency_hist_bucket_floor(uint32_t bucket) {
+    return bucket ? (1u << (bucket - 1)) : 0;
+}
+
+static inline void latency_hist_add(volatile LatencyHistogram *h, uint32_t value_us) {
+    if (h->count == UINT32_MAX) {
+        return;
+    }
+    h->buckets[latency_hist_bucket(value_us)]++;
+    if (h->count == 0 || value_us < h->min) {
+        h->min = value_us;
+    }
+    if (value_us > h->max) {
+        h->max = value_us;
+    }
+    h->sum += value_us;
+    h->count++;
+}
+
+// Fold the samples of from into into
+static inline void latency_hist_merge(LatencyHistogram *into, const LatencyHistogram *from) {
+    if (from->count == 0) {
+        return;
+    }
+    for (uint32_t b = 0; b < LATENCY_HIST_BUCKETS; b++) {
+        into->buckets[b] += from->buckets[b];
+    }
+    if (into->count == 0 || from->min < into->min) {
+        into->min = from->min;
+    }
+    if (from->max > into->max) {
+        into->max = from->max;
+    }
+    into->sum += from->sum;
+    into->count = (into->count > UINT32_MAX - from->count) ? UINT32_MAX : into->count + from->count;
+}
+
+static inline uint32_t latency_hist_mean(const LatencyHistogram *h) {
+    return h->count ? (uint32_t)(h->sum / h->count) : 0;
+}
+
+// Upper bound (us) of the bucket holding the given percentile (0-100),
+// i.e. "pct% of samples were below this", never above the largest sample
+// (the open top bucket reports max)
+static inline uint32_t latency_hist_percentile(const LatencyHistogram *h, uint32_t pct) {
+    if (h->count == 0) {
+        return 0;
+    }
+    uint64_t target = ((uint64_t)h->count * pct + 99) / 100;
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b < LATENCY_HIST_BUCKETS - 1; b++) {
+        seen += h->buckets[b];
+        if (seen >= target && seen > 0) {
+            uint32_t bound = b ? (1u << b) : 1;
+            return (bound < h->max) ? bound : h->max;
+        }
+    }
+    return h->max;
+}
+
+#endif // MATRIX_STATS_H
@@ -0,0 +1,89 @@
+#include "matrix_stream.h"
+#include <string.h>
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), bitwise: records are a few
+// dozen bytes, so a table is not worth its 512 bytes of flash
+static uint16_t crc16_update(uint16_t crc, const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+// COBS-encode len bytes (len < 254) into out, followed by the 0x00
+// delimiter. Returns the number of bytes written (len + 2).
+static size_t cobs_encode(const uint8_t *in, size_t len, uint8_t *out) {
+    size_t code_pos = 0;
+    size_t out_pos = 1;
+    uint8_t code = 1;
+
+    for (size_t i = 0; i < len; i++) {
+        if (in[i] == 0) {
+            out[code_pos] = code;
+            code_pos = out_pos++;
+            code = 1;
+        } else {
+            out[out_pos++] = in[i];
+            code++;
+        }
+    }
+    out[code_pos] = code;
+    out[out_pos++] = 0x00;
+
+    return out_pos;
+}
+
+void matrix_stream_init(MatrixStream *s, MatrixStreamWrite write, void *ctx) {
+    s->write = write;
+    s->ctx = ctx;
+    s->seq = 0;
+    s->dropped = 0;
+    s->len = 0;
+}
+
+bool matrix_stream_put(MatrixStream *s, uint8_t type, const uint8_t *payload, size_t len) {
+    if (len > MATRIX_STREAM_MAX_PAYLOAD) {
+        return false;
+    }
+
+    uint8_t raw[2 + MATRIX_STREAM_MAX_PAYLOAD + 2];
+    raw[0] = type;
+    raw[1] = s->seq;
+    memcpy(&raw[2], payload, len);
+    uint16_t crc = crc16_update(0xFFFF, raw, 2 + len);
+    raw[2 + len] = (uint8_t)crc;
+    raw[3 + len] = (uint8_t)(crc >> 8);
+
+    // The sequence number advances even for dropped records, so the host
+    // sees the gap
+    s->seq++;
+
+    size_t frame_max = 4 + len + 2;
+    if (s->len + frame_max > sizeof(s->batch)) {
+        matrix_stream_flush(s);
+        if (s->len + frame_max > sizeof(s->batch)) {
+            s->dropped++;
+            return false;
+        }
+    }
+
+    s->len += cobs_encode(raw, 4 + len, &s->batch[s->len]);
+    return true;
+}
+
+void matrix_stream_flush(MatrixStream *s) {
+    if (s->len == 0 || s->write == NULL) {
+        return;
+    }
+
+    size_t sent = s->write(s->batch, s->len, s->ctx);
+    if (sent >= s->len) {
+        s->len = 0;
+    } else if (sent > 0) {
+        memmove(s->batch, &s->batch[sent], s->len - sent);
+        s->len -= sent;
+    }
+}
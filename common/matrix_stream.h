@@ -0,0 +1,97 @@
+#ifndef MATRIX_STREAM_H
+#define MATRIX_STREAM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Framed binary record stream
+//
+// Shared by the Pico and STM32 drivers to report events to host software
+// without printf. Records are batched into one transport write per flush
+// (size the batch to one USB packet and flush once per USB frame), and a
+// full transport never blocks: records that do not fit are dropped and
+// counted, and the sequence number shows the host where.
+//
+// Wire format, every frame:
+//   COBS( type:u8 | seq:u8 | payload | crc16:u16 ) 0x00
+// COBS removes every zero byte from the frame, so 0x00 only ever marks a
+// frame end and a host can resync on the next one after any loss. crc16 is
+// CRC-16/CCITT-FALSE over type, seq and payload. All fields little-endian.
+// tools/matrix_stream_decode.py is the host-side decoder.
+
+#define MATRIX_STREAM_VERSION 2  // 2: gesture byte in STREAM_REC_KEY
+
+// Record types and payloads
+#define STREAM_REC_HELLO  0x01  // version:u8 rows:u8 cols:u8
+#define STREAM_REC_KEY    0x02  // key:u8 state:u8 row:u8 col:u8 gesture:u8 timestamp_ms:u32
+                                // contact_us:u32 confirm_us:u32 (gesture: KEY_GESTURE_*,
+                                // a combo's row/col are its first key; version 1
+                                // had no gesture byte)
+#define STREAM_REC_ERROR  0x03  // code:u8 row:u8 col:u8 count:u32 timestamp_ms:u32
+#define STREAM_REC_STATS  0x04  // total_scans total_events total_errors queue_overflows
+                                // max_scan_time_us avg_scan_time_us missed_scans
+                                // scan_overruns p99_latency_us max_latency_us (all u32)
+#define STREAM_REC_MODE   0x05  // mode:u8 timestamp_ms:u32 (application mode change, older firmware)
+#define STREAM_REC_TRACE  0x06  // block:u32 block_len:u16 offset:u16 data (one chunk of a
+                                // raw scan trace block, see matrix_trace.h)
+#define STREAM_REC_LAYERS 0x07  // active:u32 timestamp_ms:u32 (keymap layers, bit n = layer n)
+
+// Largest payload a record may carry
+#define MATRIX_STREAM_MAX_PAYLOAD 48
+
+// Worst-case encoded frame: header, payload and crc, one COBS overhead byte
+// (frames stay under 254 bytes) and the delimiter
+#define MATRIX_STREAM_MAX_FRAME (2 + MATRIX_STREAM_MAX_PAYLOAD + 2 + 1 + 1)
+
+// Batch buffer size (one full-speed USB bulk packet)
+#ifndef MATRIX_STREAM_BATCH_BYTES
+#define MATRIX_STREAM_BATCH_BYTES 64
+#endif
+
+_Static_assert(MATRIX_STREAM_BATCH_BYTES >= MATRIX_STREAM_MAX_FRAME,
+               "MATRIX_STREAM_BATCH_BYTES must hold the largest frame");
+
+// Transport write: send up to len bytes without blocking and return how
+// many were taken (0 when the transport is busy or disconnected)
+typedef size_t (*MatrixStreamWrite)(const uint8_t *data, size_t len, void *ctx);
+
+typedef struct {
+    MatrixStreamWrite write;
+    void *ctx;
+    uint8_t seq;        // Sequence number of the next record
+    uint32_t dropped;   // Records dropped because the batch was full
+    size_t len;         // Bytes waiting in batch
+    uint8_t batch[MATRIX_STREAM_BATCH_BYTES];
+} MatrixStream;
+
+void matrix_stream_init(MatrixStream *s, MatrixStreamWrite write, void *ctx);
+
+// Frame one record into the batch, flushing first if it does not fit
+// Returns false (and counts the record as dropped) if there is still no room
+bool matrix_stream_put(MatrixStream *s, uint8_t type, const uint8_t *payload, size_t len);
+
+// Hand the batch to the transport; whatever it does not take stays queued
+void matrix_stream_flush(MatrixStream *s);
+
+// Payload packing helpers (little-endian)
+static inline uint8_t *matrix_stream_u8(uint8_t *p, uint8_t v) {
+    *p++ = v;
+    return p;
+}
+
+static inline uint8_t *matrix_stream_u16(uint8_t *p, uint16_t v) {
+    *p++ = (uint8_t)v;
+    *p++ = (uint8_t)(v >> 8);
+    return p;
+}
+
+static inline uint8_t *matrix_stream_u32(uint8_t *p, uint32_t v) {
+    *p++ = (uint8_t)v;
+    *p++ = (uint8_t)(v >> 8);
+    *p++ = (uint8_t)(v >> 16);
+    *p++ = (uint8_t)(v >> 24);
+    return p;
+}
+
+#endif // MATRIX_STREAM_H
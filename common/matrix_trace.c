@@ -0,0 +1,232 @@
+#include "matrix_trace.h"
+#include "matrix_ring.h"
+#include <string.h>
+
+// Largest chunk a STREAM_REC_TRACE record carries after its 8-byte header
+#define TRACE_CHUNK_BYTES (MATRIX_STREAM_MAX_PAYLOAD - 8)
+
+static uint8_t *put_u32(uint8_t *p, uint32_t v) {
+    *p++ = (uint8_t)v;
+    *p++ = (uint8_t)(v >> 8);
+    *p++ = (uint8_t)(v >> 16);
+    *p++ = (uint8_t)(v >> 24);
+    return p;
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint8_t *put_row(uint8_t *p, matrix_row_t v) {
+    for (size_t i = 0; i < sizeof(matrix_row_t); i++) {
+        *p++ = (uint8_t)(v >> (8 * i));
+    }
+    return p;
+}
+
+static matrix_row_t get_row(const uint8_t *p) {
+    uint32_t v = 0;
+    for (size_t i = 0; i < sizeof(matrix_row_t); i++) {
+        v |= (uint32_t)p[i] << (8 * i);
+    }
+    return (matrix_row_t)v;
+}
+
+static uint8_t *put_varint(uint8_t *p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static bool get_varint(const uint8_t **p, const uint8_t *end, uint64_t *v) {
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+        uint8_t byte = *(*p)++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *v = value;
+            return true;
+        }
+    }
+    return false;
+}
+
+void matrix_trace_init(MatrixTrace *t, uint32_t interval_us, uint8_t flags) {
+    memset(t, 0, sizeof(*t));
+    t->interval_us = interval_us;
+    t->flags = flags;
+}
+
+// Open block `head` with a keyframe of every row's current sample. This
+// overwrites block head - MATRIX_TRACE_BLOCKS if it was never read.
+static void open_block(MatrixTrace *t, uint32_t now_ms, uint32_t now_us) {
+    uint8_t *p = t->blocks[t->head % MATRIX_TRACE_BLOCKS];
+    *p++ = MATRIX_TRACE_MAGIC;
+    *p++ = MATRIX_TRACE_VERSION;
+    *p++ = MATRIX_ROWS;
+    *p++ = MATRIX_COLS;
+    *p++ = t->flags;
+    p = put_u32(p, t->interval_us);
+    p = put_u32(p, now_us);
+    p = put_u32(p, now_ms);
+    for (int row = 0; row < MATRIX_ROWS; row++) {
+        p = put_row(p, t->last[row]);
+    }
+    t->pos = (uint16_t)MATRIX_TRACE_HEADER_BYTES;
+    t->last_us = now_us;
+    t->last_ms = now_ms;
+    t->start_ms = now_ms;
+}
+
+// Any close covers the flush requests made so far
+void matrix_trace_close(MatrixTrace *t) {
+    t->flush_done = matrix_ring_load_acquire(&t->flush_request);
+    if (t->pos == 0) {
+        return;
+    }
+    t->block_len[t->head % MATRIX_TRACE_BLOCKS] = t->pos;
+    t->pos = 0;
+    matrix_ring_store_release(&t->head, t->head + 1);
+}
+
+void matrix_trace_record(MatrixTrace *t, uint8_t row, matrix_row_t raw, uint32_t now_ms, uint32_t now_us) {
+    matrix_row_t changed = raw ^ t->last[row];
+    if (changed == 0) {
+        return;
+    }
+
+    // New block when the record does not fit or the block is getting too
+    // long for 32-bit us differences
+    if (t->pos != 0 && (t->pos + MATRIX_TRACE_MAX_RECORD > MATRIX_TRACE_BLOCK_SIZE ||
+                        now_ms - t->start_ms >= MATRIX_TRACE_MAX_SPAN_MS)) {
+        matrix_trace_close(t);
+    }
+    if (t->pos == 0) {
+        open_block(t, now_ms, now_us);
+    }
+
+    uint8_t *block = t->blocks[t->head % MATRIX_TRACE_BLOCKS];
+    uint8_t *p = block + t->pos;
+    p = put_varint(p, ((uint64_t)(now_us - t->last_us) << 5) | row);
+    p = put_varint(p, changed);
+    t->pos = (uint16_t)(p - block);
+    t->last_us = now_us;
+    t->last_ms = now_ms;
+    t->last[row] = raw;
+}
+
+void matrix_trace_tick(MatrixTrace *t, uint32_t now_ms) {
+    if (matrix_ring_load_acquire(&t->flush_request) != t->flush_done ||
+        (t->pos != 0 && now_ms - t->last_ms >= MATRIX_TRACE_QUIET_MS)) {
+        matrix_trace_close(t);
+    }
+}
+
+void matrix_trace_request_flush(MatrixTrace *t) {
+    matrix_ring_store_release(&t->flush_request, t->flush_request + 1);
+}
+
+size_t matrix_trace_read_block(MatrixTrace *t, uint8_t out[MATRIX_TRACE_BLOCK_SIZE]) {
+    for (;;) {
+        uint32_t head = matrix_ring_load_acquire(&t->head);
+
+        // The open block reuses the slot of block head - MATRIX_TRACE_BLOCKS,
+        // so at most MATRIX_TRACE_BLOCKS - 1 completed blocks are intact
+        if (head - t->tail > MATRIX_TRACE_BLOCKS - 1) {
+            t->lost_blocks += head - t->tail - (MATRIX_TRACE_BLOCKS - 1);
+            t->tail = head - (MATRIX_TRACE_BLOCKS - 1);
+        }
+        if (t->tail == head) {
+            return 0;
+        }
+
+        uint32_t slot = t->tail % MATRIX_TRACE_BLOCKS;
+        size_t len = t->block_len[slot];
+        memcpy(out, t->blocks[slot], len);
+
+        // Overwritten while copying: drop it and try the next one
+        head = matrix_ring_load_acquire(&t->head);
+        if (head - t->tail > MATRIX_TRACE_BLOCKS - 1) {
+            t->lost_blocks++;
+            t->tail++;
+            continue;
+        }
+        t->tail++;
+        return len;
+    }
+}
+
+void matrix_trace_stream(MatrixTrace *t, MatrixStream *stream) {
+    for (;;) {
+        if (t->stream_pos == t->stream_len) {
+            t->stream_len = (uint16_t)matrix_trace_read_block(t, t->stream_buf);
+            t->stream_pos = 0;
+            if (t->stream_len == 0) {
+                return;
+            }
+            t->stream_block = t->tail - 1;
+        }
+
+        uint16_t chunk = t->stream_len - t->stream_pos;
+        if (chunk > TRACE_CHUNK_BYTES) {
+            chunk = TRACE_CHUNK_BYTES;
+        }
+
+        uint8_t payload[MATRIX_STREAM_MAX_PAYLOAD];
+        uint8_t *p = matrix_stream_u32(payload, t->stream_block);
+        p = matrix_stream_u16(p, t->stream_len);
+        p = matrix_stream_u16(p, t->stream_pos);
+        memcpy(p, t->stream_buf + t->stream_pos, chunk);
+
+        // Stream full: send the same chunk next time
+        if (!matrix_stream_put(stream, STREAM_REC_TRACE, payload, (size_t)(p - payload) + chunk)) {
+            return;
+        }
+        t->stream_pos += chunk;
+    }
+}
+
+bool matrix_trace_reader_init(MatrixTraceReader *r, MatrixTraceHeader *h, const uint8_t *block, size_t len) {
+    if (len < MATRIX_TRACE_HEADER_BYTES || block[0] != MATRIX_TRACE_MAGIC ||
+        block[1] != MATRIX_TRACE_VERSION || block[2] != MATRIX_ROWS || block[3] != MATRIX_COLS) {
+        return false;
+    }
+
+    h->rows = block[2];
+    h->cols = block[3];
+    h->flags = block[4];
+    h->interval_us = get_u32(block + 5);
+    h->start_us = get_u32(block + 9);
+    h->start_ms = get_u32(block + 13);
+    for (int row = 0; row < MATRIX_ROWS; row++) {
+        h->raw[row] = get_row(block + 17 + row * sizeof(matrix_row_t));
+        r->raw[row] = h->raw[row];
+    }
+
+    r->p = block + MATRIX_TRACE_HEADER_BYTES;
+    r->end = block + len;
+    r->time_us = h->start_us;
+    return true;
+}
+
+bool matrix_trace_reader_next(MatrixTraceReader *r, uint32_t *time_us, uint8_t *row, matrix_row_t *raw) {
+    uint64_t head, changed;
+    if (r->p >= r->end || !get_varint(&r->p, r->end, &head) || !get_varint(&r->p, r->end, &changed)) {
+        return false;
+    }
+
+    uint8_t record_row = (uint8_t)(head & 0x1F);
+    if (record_row >= MATRIX_ROWS) {
+        return false;
+    }
+
+    r->time_us += (uint32_t)(head >> 5);
+    r->raw[record_row] ^= (matrix_row_t)changed;
+    *time_us = r->time_us;
+    *row = record_row;
+    *raw = r->raw[record_row];
+    return true;
+}
@@ -0,0 +1,149 @@
+#ifndef MATRIX_TRACE_H
+#define MATRIX_TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "matrix_config.h"
+#include "matrix_stream.h"
+
+// Raw scan trace
+//
+// Records every raw row sample that differs from the previous sample of
+// the same row (before debounce), with its us timestamp, into a RAM ring
+// of fixed-size blocks. Idle scans cost one compare and no space, so the
+// ring holds hours of normal use; a field unit keeps the recent history
+// until someone reads it out. host/matrix_replay feeds a trace back through
+// the key engine with any debounce settings and measures the real bounce.
+//
+// The scan tick writes (matrix_trace_record()), one consumer reads
+// completed blocks (matrix_trace_read_block() or matrix_trace_stream()).
+// The open block is completed when it fills up, after
+// MATRIX_TRACE_QUIET_MS without a record (checked every tick by
+// matrix_trace_tick()), when scanning stops, or at the next tick after the
+// consumer asks for it (matrix_trace_request_flush()), so the samples just
+// before a reported fault can always be read out.
+// When the consumer falls behind, the oldest blocks are overwritten and
+// counted in lost_blocks. Every block decodes on its own, so losing blocks
+// only leaves gaps.
+//
+// Block format (little-endian):
+//   header:  magic:u8 ('T') version:u8 rows:u8 cols:u8 flags:u8
+//            interval_us:u32 start_us:u32 start_ms:u32
+//            rows x matrix_row_t: raw sample of every row at start_us
+//   records: varint((dt_us << 5) | row) varint(changed columns)
+// dt_us is the time since the previous record (or start_us), changed
+// columns is the XOR against the row's previous sample. A record is 2-4
+// bytes for a typical key change. Blocks never span more than
+// MATRIX_TRACE_MAX_SPAN_MS, so us time differences stay unambiguous.
+
+#define MATRIX_TRACE_MAGIC   0x54
+#define MATRIX_TRACE_VERSION 1
+
+// Header flags
+#define MATRIX_TRACE_FLAG_BURST 0x01  // Recorded with SCAN_STRATEGY_BURST
+
+#ifndef MATRIX_TRACE_BLOCK_SIZE
+#define MATRIX_TRACE_BLOCK_SIZE 256
+#endif
+#ifndef MATRIX_TRACE_BLOCKS
+#define MATRIX_TRACE_BLOCKS 16  // 4 KB of RAM with 256-byte blocks
+#endif
+
+#define MATRIX_TRACE_HEADER_BYTES (17 + MATRIX_ROWS * sizeof(matrix_row_t))
+#define MATRIX_TRACE_MAX_RECORD   11  // Two varints: 37 bits and 32 bits
+#define MATRIX_TRACE_MAX_SPAN_MS  (30u * 60u * 1000u)
+
+// Quiet time after the last record that completes the open block (shorter
+// makes recent samples readable sooner, but every pause then costs a
+// block header)
+#ifndef MATRIX_TRACE_QUIET_MS
+#define MATRIX_TRACE_QUIET_MS 10000
+#endif
+
+_Static_assert(MATRIX_TRACE_BLOCK_SIZE >= MATRIX_TRACE_HEADER_BYTES + MATRIX_TRACE_MAX_RECORD,
+               "MATRIX_TRACE_BLOCK_SIZE too small for the header and one record");
+_Static_assert(MATRIX_TRACE_BLOCK_SIZE <= 0xFFFF, "MATRIX_TRACE_BLOCK_SIZE must fit in 16 bits");
+_Static_assert(MATRIX_TRACE_BLOCKS >= 2, "MATRIX_TRACE_BLOCKS must be at least 2");
+
+typedef struct {
+    uint8_t blocks[MATRIX_TRACE_BLOCKS][MATRIX_TRACE_BLOCK_SIZE];
+    uint16_t block_len[MATRIX_TRACE_BLOCKS];
+
+    // Producer (scan tick)
+    uint32_t head;             // Blocks completed; the open one is block head
+    uint16_t pos;              // Write position in the open block (0 = none open)
+    matrix_row_t last[MATRIX_ROWS];  // Previous raw sample of every row
+    uint32_t last_us;          // Time of the last record (or block start)
+    uint32_t last_ms;          // Same, in ms (quiet close)
+    uint32_t start_ms;         // Start of the open block
+    uint32_t flush_done;       // Last flush request a close covered
+    uint32_t interval_us;
+    uint8_t flags;
+
+    // Consumer
+    uint32_t flush_request;    // Bumped to have the open block completed
+    uint32_t tail;             // Next block to read
+    uint32_t lost_blocks;      // Overwritten before they were read
+    uint32_t stream_block;     // Block being sent by matrix_trace_stream()
+    uint16_t stream_len;
+    uint16_t stream_pos;
+    uint8_t stream_buf[MATRIX_TRACE_BLOCK_SIZE];
+} MatrixTrace;
+
+// Reset to an empty trace; interval_us and flags go into every block
+// header (the scan tick and strategy, so a replay can default to them)
+void matrix_trace_init(MatrixTrace *t, uint32_t interval_us, uint8_t flags);
+
+// Producer: one raw row sample (pressed columns = 1)
+void matrix_trace_record(MatrixTrace *t, uint8_t row, matrix_row_t raw, uint32_t now_ms, uint32_t now_us);
+
+// Producer: complete the open block so the consumer can read it
+// (call from the scan context, or with scanning stopped)
+void matrix_trace_close(MatrixTrace *t);
+
+// Producer, once per scan tick: apply a pending flush request, or complete
+// the open block once it has been quiet for MATRIX_TRACE_QUIET_MS
+void matrix_trace_tick(MatrixTrace *t, uint32_t now_ms);
+
+// Consumer: ask for the open block to be completed; the next tick does it
+// (a stopped scan has none open), then matrix_trace_read_block() and
+// matrix_trace_stream() hand it out with the rest
+void matrix_trace_request_flush(MatrixTrace *t);
+
+// Consumer: copy out the oldest completed block
+// Returns its length, or 0 if no completed block is waiting
+size_t matrix_trace_read_block(MatrixTrace *t, uint8_t out[MATRIX_TRACE_BLOCK_SIZE]);
+
+// Consumer: send completed blocks as STREAM_REC_TRACE chunks, as many as
+// the stream takes right now (call once per main loop pass)
+void matrix_trace_stream(MatrixTrace *t, MatrixStream *stream);
+
+// Block decoding (host replay and tools)
+typedef struct {
+    uint8_t rows;
+    uint8_t cols;
+    uint8_t flags;
+    uint32_t interval_us;
+    uint32_t start_us;
+    uint32_t start_ms;
+    matrix_row_t raw[MATRIX_ROWS];
+} MatrixTraceHeader;
+
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+    uint32_t time_us;              // Of the last record returned
+    matrix_row_t raw[MATRIX_ROWS]; // Every row's sample as of time_us
+} MatrixTraceReader;
+
+// Start decoding a block. Returns false if it is not a trace block of
+// this build's matrix size.
+bool matrix_trace_reader_init(MatrixTraceReader *r, MatrixTraceHeader *h, const uint8_t *block, size_t len);
+
+// Next record: its time (start_us based, wraps like the us clock), row
+// and the row's new raw sample. Returns false at the end of the block or
+// on a malformed record.
+bool matrix_trace_reader_next(MatrixTraceReader *r, uint32_t *time_us, uint8_t *row, matrix_row_t *raw);
+
+#endif // MATRIX_TRACE_H
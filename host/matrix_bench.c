@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "matrix_bench.h"
+#include "matrix_engine.h"
+#include "sim_matrix.h"
+
+// Host benchmarks: the shared scan path benchmarks (common/matrix_bench.c)
+// on the simulated keypad, plus a debounce latency sweep over a set of
+// bounce profiles. Output is one JSON object per line, see
+// tools/bench_compare.py.
+//
+//   matrix_bench [--iterations N] [--strokes N] [--interval-us N] [--seed N]
+//
+// Host cycle counts are nanoseconds of a PC, only good for comparing two
+// builds on the same machine; the latency sweep is in simulated time and
+// is exact on any machine.
+
+typedef struct {
+    const char *name;
+    SimBounce press;
+    SimBounce release;
+} BounceProfile;
+
+// Typical figures: clean (reed/hall or ideal), a new tactile switch, a
+// membrane/rubber dome and a worn switch chattering past a 5 ms debounce
+static const BounceProfile profiles[] = {
+    { "clean",    { 0, 0 },      { 0, 0 } },
+    { "tactile",  { 1500, 4 },   { 800, 2 } },
+    { "membrane", { 4000, 10 },  { 3000, 8 } },
+    { "worn",     { 8000, 16 },  { 12000, 24 } },
+};
+
+static const struct {
+    const char *name;
+    DebounceMode mode;
+} modes[] = {
+    { "defer", DEBOUNCE_DEFER_PRESS_EAGER_RELEASE },
+    { "eager", DEBOUNCE_EAGER_PRESS_LOCKOUT },
+    { "symmetric", DEBOUNCE_SYMMETRIC_DEFER },
+};
+
+typedef struct {
+    uint32_t iterations;
+    uint32_t strokes;
+    uint32_t interval_us;
+    uint32_t seed;
+} BenchOptions;
+
+static MatrixEngine engine;
+static uint32_t rng_state;
+
+static uint32_t bench_rand(uint32_t bound) {
+    uint32_t x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rng_state = x;
+    return bound ? x % bound : 0;
+}
+
+static uint32_t clock_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec);
+}
+
+static const MatrixBench host_bench = {
+    .platform = "host",
+    .read = clock_ns,
+    .mask = 0xFFFFFFFF,
+    .hz = 1000000000
+};
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [--iterations N] [--strokes N] [--interval-us N] [--seed N]\n", prog);
+    exit(2);
+}
+
+static void parse_options(int argc, char **argv, BenchOptions *opt) {
+    *opt = (BenchOptions){
+        .iterations = 100000,
+        .strokes = 500,
+        .interval_us = 1000,
+        .seed = 1
+    };
+
+    for (int i = 1; i < argc; i += 2) {
+        if (i + 1 >= argc) {
+            usage(argv[0]);
+        }
+        uint32_t n = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+        if (strcmp(argv[i], "--iterations") == 0) {
+            opt->iterations = n ? n : 1;
+        } else if (strcmp(argv[i], "--strokes") == 0) {
+            opt->strokes = n ? n : 1;
+        } else if (strcmp(argv[i], "--interval-us") == 0) {
+            opt->interval_us = n ? n : 1;
+        } else if (strcmp(argv[i], "--seed") == 0) {
+            opt->seed = n;
+        } else {
+            usage(argv[0]);
+        }
+    }
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Exact percentile of a sorted sample set (nearest rank)
+static uint32_t percentile(const uint32_t *sorted, uint32_t n, uint32_t pct) {
+    if (n == 0) {
+        return 0;
+    }
+    uint32_t rank = (uint32_t)(((uint64_t)n * pct + 99) / 100);
+    return sorted[rank ? rank - 1 : 0];
+}
+
+// Events are stamped with their tick's start time, so a contact that closes
+// during the tick's own row strobes can come out a few us "early"
+static uint32_t latency(uint32_t confirm_us, uint64_t change_us) {
+    int32_t d = (int32_t)(confirm_us - (uint32_t)change_us);
+    return d > 0 ? (uint32_t)d : 0;
+}
+
+static uint32_t mean(const uint32_t *v, uint32_t n) {
+    uint64_t sum = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        sum += v[i];
+    }
+    return n ? (uint32_t)(sum / n) : 0;
+}
+
+// Single key strokes with the given bounce: latency from the physical
+// contact change to the debounced event, in simulated us
+static void latency_sweep(const BenchOptions *opt, ScanStrategy strategy, const BounceProfile *profile,
+                          const char *mode_name, DebounceMode mode) {
+    uint32_t *press_lat = calloc(opt->strokes, sizeof(uint32_t));
+    uint32_t *release_lat = calloc(opt->strokes, sizeof(uint32_t));
+    uint32_t pressed = 0, released = 0, extra = 0;
+
+    if (press_lat == NULL || release_lat == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+
+    sim_matrix_reset(opt->seed);
+    rng_state = opt->seed ? opt->seed : 1;
+
+    uint32_t sample_period = opt->interval_us;
+    if (strategy == SCAN_STRATEGY_INTERLEAVED) {
+        sample_period *= MATRIX_ROWS;
+    }
+    matrix_engine_init(&engine);
+    engine.strategy = strategy;
+    matrix_engine_configure_debounce(&engine, mode, DEBOUNCE_PRESS_MS, DEBOUNCE_RELEASE_MS, sample_period);
+    matrix_engine_restart(&engine);
+
+    // Hold and rest far exceed bounce plus debounce; random phase against
+    // the scan tick so the scan delay is sampled evenly
+    uint64_t next_tick = 0;
+    for (uint32_t s = 0; s < opt->strokes; s++) {
+        uint8_t row = (uint8_t)bench_rand(MATRIX_ROWS);
+        uint8_t col = (uint8_t)bench_rand(MATRIX_COLS);
+        uint64_t press_at = sim_matrix_now_us() + 20000 + bench_rand(opt->interval_us * MATRIX_ROWS);
+        uint64_t release_at = press_at + 60000;
+        uint64_t end = release_at + 60000;
+        bool got_press = false, got_release = false;
+
+        sim_matrix_press(row, col, press_at, &profile->press);
+        sim_matrix_release(row, col, release_at, &profile->release);
+
+        while (next_tick < end) {
+            uint64_t now = sim_matrix_now_us();
+            if (next_tick > now) {
+                sim_matrix_advance_us((uint32_t)(next_tick - now));
+            }
+            matrix_engine_scan(&engine, opt->interval_us);
+            next_tick += opt->interval_us;
+
+            KeyEvent event;
+            while (matrix_engine_get_event(&engine, &event)) {
+                if (event.row != row || event.col != col) {
+                    extra++;
+                } else if (event.state == KEY_PRESSED && !got_press) {
+                    press_lat[pressed++] = latency(event.confirm_us, press_at);
+                    got_press = true;
+                } else if (event.state == KEY_RELEASED && got_press && !got_release) {
+                    release_lat[released++] = latency(event.confirm_us, release_at);
+                    got_release = true;
+                } else {
+                    extra++;
+                }
+            }
+            ErrorEvent error;
+            while (matrix_engine_get_error(&engine, &error)) {
+            }
+        }
+    }
+
+    qsort(press_lat, pressed, sizeof(uint32_t), compare_u32);
+    qsort(release_lat, released, sizeof(uint32_t), compare_u32);
+
+    // "extra" counts chatter that got through debounce (spurious events)
+    printf("{\"bench\":\"latency\",\"platform\":\"sim\",\"strategy\":\"%s\",\"mode\":\"%s\","
+           "\"profile\":\"%s\",\"rows\":%d,\"cols\":%d,\"interval_us\":%u,\"strokes\":%u,"
+           "\"presses\":%u,\"releases\":%u,\"extra_events\":%u,"
+           "\"press_mean_us\":%u,\"press_p50_us\":%u,\"press_p99_us\":%u,\"press_max_us\":%u,"
+           "\"release_mean_us\":%u,\"release_p50_us\":%u,\"release_p99_us\":%u,\"release_max_us\":%u}\n",
+           strategy == SCAN_STRATEGY_BURST ? "burst" : "interleaved", mode_name, profile->name,
+           MATRIX_ROWS, MATRIX_COLS, opt->interval_us, opt->strokes, pressed, released, extra,
+           mean(press_lat, pressed), percentile(press_lat, pressed, 50),
+           percentile(press_lat, pressed, 99), pressed ? press_lat[pressed - 1] : 0,
+           mean(release_lat, released), percentile(release_lat, released, 50),
+           percentile(release_lat, released, 99), released ? release_lat[released - 1] : 0);
+
+    free(press_lat);
+    free(release_lat);
+}
+
+int main(int argc, char **argv) {
+    BenchOptions opt;
+    parse_options(argc, argv, &opt);
+
+    const ScanStrategy strategies[] = { SCAN_STRATEGY_INTERLEAVED, SCAN_STRATEGY_BURST };
+
+    sim_matrix_reset(opt.seed);
+    for (size_t i = 0; i < sizeof(strategies) / sizeof(strategies[0]); i++) {
+        matrix_bench_scan_idle(&host_bench, strategies[i], opt.iterations);
+        matrix_bench_scan_loaded(&host_bench, strategies[i], opt.iterations);
+    }
+    matrix_bench_queue(&host_bench, opt.iterations / EVENT_QUEUE_SIZE + 1);
+
+    for (size_t i = 0; i < sizeof(strategies) / sizeof(strategies[0]); i++) {
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+            for (size_t p = 0; p < sizeof(profiles) / sizeof(profiles[0]); p++) {
+                latency_sweep(&opt, strategies[i], &profiles[p], modes[m].name, modes[m].mode);
+            }
+        }
+    }
+    return 0;
+}
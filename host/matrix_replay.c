@@ -0,0 +1,523 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "matrix_engine.h"
+#include "matrix_trace.h"
+#include "sim_matrix.h"
+#include "trace_file.h"
+
+// Replay a recorded raw scan trace (matrix_trace.h) through the key engine
+//
+//   matrix_replay TRACE [--interval-us N] [--burst | --interleaved]
+//                 [--mode defer|eager|symmetric] [--press-ms N] [--release-ms N]
+//                 [--no-ghost] [--gap-ms N] [--events] [--check]
+//
+// First measures the bounce in the trace: every run of contact edges on a
+// key with less than --gap-ms (default 10) between them is one burst; its
+// duration and longest quiet stretch show how much debounce the keypad
+// needs. Then replays the samples on the simulated keypad with the given
+// scan and debounce settings (default: those of the recording and the
+// engine defaults) and compares the events with the bursts, so settings
+// can be tuned against real switches offline.
+//
+// --check: exit status 1 if any key's presses differ from its bursts (for
+// regression tests of recorded or simulated traces).
+//
+// Bounce is only as fine as the recording's row sample period: record in
+// burst mode, or with a short scan interval, for bounce measurements.
+
+#define US_GAP_LIMIT 3600000000ull  // 32-bit us differences wrap after ~71 min
+
+typedef struct {
+    uint32_t interval_us;
+    bool interval_set;
+    int strategy;       // -1 = as recorded
+    DebounceMode mode;
+    uint32_t press_ms;
+    uint32_t release_ms;
+    bool ghost_detection;
+    uint32_t gap_ms;
+    bool events;
+    bool check;
+    const char *path;
+} ReplayOptions;
+
+typedef struct {
+    uint8_t (*blocks)[MATRIX_TRACE_BLOCK_SIZE];
+    size_t *lens;
+    size_t count;
+} TraceData;
+
+// Walks every block in order and yields row samples with 64-bit times
+// (0 = start of the first block). A block's keyframe yields the rows that
+// differ from the state so far (after lost blocks).
+typedef struct {
+    const TraceData *data;
+    size_t next_block;
+    bool open;
+    uint8_t keyframe_row;
+    MatrixTraceReader reader;
+    MatrixTraceHeader header;
+    uint64_t block_start;
+    bool have_prev;
+    uint32_t bad_blocks;
+    matrix_row_t state[MATRIX_ROWS];
+} SampleIter;
+
+// Contact bursts of one key
+typedef struct {
+    bool in_burst;
+    bool closed;          // Contact level now
+    bool burst_closes;    // Level the burst started towards
+    uint64_t start;
+    uint64_t last_edge;
+    uint32_t longest_gap; // Longest quiet stretch inside the burst
+    uint32_t changes;
+} KeyBursts;
+
+typedef struct {
+    uint32_t *v;
+    size_t n;
+    size_t cap;
+} Samples;
+
+static KeyBursts bursts[MATRIX_ROWS][MATRIX_COLS];
+static Samples press_duration, release_duration, press_gap, release_gap, burst_changes;
+static uint32_t glitches;
+static uint32_t strokes[MATRIX_ROWS][MATRIX_COLS];
+static uint32_t presses[MATRIX_ROWS][MATRIX_COLS];
+static uint32_t releases[MATRIX_ROWS][MATRIX_COLS];
+static uint32_t ghost_errors, stuck_errors;
+static MatrixEngine engine;
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s TRACE [--interval-us N] [--burst | --interleaved]\n"
+                    "          [--mode defer|eager|symmetric] [--press-ms N] [--release-ms N]\n"
+                    "          [--no-ghost] [--gap-ms N] [--events] [--check]\n", prog);
+    exit(2);
+}
+
+static void parse_options(int argc, char **argv, ReplayOptions *opt) {
+    *opt = (ReplayOptions){
+        .strategy = -1,
+        .mode = DEBOUNCE_DEFER_PRESS_EAGER_RELEASE,
+        .press_ms = DEBOUNCE_PRESS_MS,
+        .release_ms = DEBOUNCE_RELEASE_MS,
+        .ghost_detection = true,
+        .gap_ms = 10
+    };
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (arg[0] != '-') {
+            if (opt->path) {
+                usage(argv[0]);
+            }
+            opt->path = arg;
+            continue;
+        }
+        if (strcmp(arg, "--burst") == 0) {
+            opt->strategy = SCAN_STRATEGY_BURST;
+            continue;
+        }
+        if (strcmp(arg, "--interleaved") == 0) {
+            opt->strategy = SCAN_STRATEGY_INTERLEAVED;
+            continue;
+        }
+        if (strcmp(arg, "--no-ghost") == 0) {
+            opt->ghost_detection = false;
+            continue;
+        }
+        if (strcmp(arg, "--events") == 0) {
+            opt->events = true;
+            continue;
+        }
+        if (strcmp(arg, "--check") == 0) {
+            opt->check = true;
+            continue;
+        }
+        if (val == NULL) {
+            usage(argv[0]);
+        }
+        i++;
+
+        if (strcmp(arg, "--mode") == 0) {
+            if (strcmp(val, "defer") == 0) {
+                opt->mode = DEBOUNCE_DEFER_PRESS_EAGER_RELEASE;
+            } else if (strcmp(val, "eager") == 0) {
+                opt->mode = DEBOUNCE_EAGER_PRESS_LOCKOUT;
+            } else if (strcmp(val, "symmetric") == 0) {
+                opt->mode = DEBOUNCE_SYMMETRIC_DEFER;
+            } else {
+                usage(argv[0]);
+            }
+            continue;
+        }
+
+        uint32_t n = (uint32_t)strtoul(val, NULL, 0);
+        if (strcmp(arg, "--interval-us") == 0) {
+            opt->interval_us = n ? n : 1;
+            opt->interval_set = true;
+        } else if (strcmp(arg, "--press-ms") == 0) {
+            opt->press_ms = n;
+        } else if (strcmp(arg, "--release-ms") == 0) {
+            opt->release_ms = n;
+        } else if (strcmp(arg, "--gap-ms") == 0) {
+            opt->gap_ms = n ? n : 1;
+        } else {
+            usage(argv[0]);
+        }
+    }
+
+    if (opt->path == NULL) {
+        usage(argv[0]);
+    }
+}
+
+static void *xrealloc(void *p, size_t size) {
+    p = realloc(p, size);
+    if (p == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(2);
+    }
+    return p;
+}
+
+static void samples_add(Samples *s, uint32_t value) {
+    if (s->n == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 256;
+        s->v = xrealloc(s->v, s->cap * sizeof(uint32_t));
+    }
+    s->v[s->n++] = value;
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Sorts in place; nearest rank percentile
+static uint32_t percentile(Samples *s, uint32_t pct) {
+    if (s->n == 0) {
+        return 0;
+    }
+    qsort(s->v, s->n, sizeof(uint32_t), compare_u32);
+    size_t rank = (size_t)(((uint64_t)s->n * pct + 99) / 100);
+    return s->v[rank ? rank - 1 : 0];
+}
+
+static void load_trace(const char *path, TraceData *data) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        exit(2);
+    }
+
+    memset(data, 0, sizeof(*data));
+    uint8_t block[MATRIX_TRACE_BLOCK_SIZE];
+    int len;
+    while ((len = trace_file_read_block(f, block)) > 0) {
+        data->blocks = xrealloc(data->blocks, (data->count + 1) * sizeof(*data->blocks));
+        data->lens = xrealloc(data->lens, (data->count + 1) * sizeof(size_t));
+        memcpy(data->blocks[data->count], block, (size_t)len);
+        data->lens[data->count] = (size_t)len;
+        data->count++;
+    }
+    if (len < 0) {
+        fprintf(stderr, "%s: truncated block after %zu blocks, ignoring the rest\n", path, data->count);
+    }
+    fclose(f);
+}
+
+static void iter_init(SampleIter *it, const TraceData *data) {
+    memset(it, 0, sizeof(*it));
+    it->data = data;
+}
+
+static bool iter_next(SampleIter *it, uint64_t *t, uint8_t *row, matrix_row_t *raw) {
+    for (;;) {
+        if (!it->open) {
+            if (it->next_block >= it->data->count) {
+                return false;
+            }
+
+            MatrixTraceHeader prev = it->header;
+            size_t b = it->next_block++;
+            if (!matrix_trace_reader_init(&it->reader, &it->header, it->data->blocks[b], it->data->lens[b])) {
+                it->bad_blocks++;
+                it->header = prev;
+                continue;
+            }
+
+            // Blocks are placed by their us start while that cannot have
+            // wrapped, by their ms start after long idle gaps
+            if (it->have_prev) {
+                uint64_t gap_ms = (uint32_t)(it->header.start_ms - prev.start_ms);
+                if (gap_ms * 1000 < US_GAP_LIMIT) {
+                    it->block_start += (uint32_t)(it->header.start_us - prev.start_us);
+                } else {
+                    it->block_start += gap_ms * 1000;
+                }
+            }
+            it->have_prev = true;
+            it->open = true;
+            it->keyframe_row = 0;
+        }
+
+        while (it->keyframe_row < MATRIX_ROWS) {
+            uint8_t r = it->keyframe_row++;
+            if (it->header.raw[r] != it->state[r]) {
+                it->state[r] = it->header.raw[r];
+                *t = it->block_start;
+                *row = r;
+                *raw = it->state[r];
+                return true;
+            }
+        }
+
+        uint32_t time_us;
+        if (matrix_trace_reader_next(&it->reader, &time_us, row, raw)) {
+            *t = it->block_start + (uint32_t)(time_us - it->header.start_us);
+            it->state[*row] = *raw;
+            return true;
+        }
+        it->open = false;
+    }
+}
+
+static void close_burst(KeyBursts *k, uint8_t row, uint8_t col) {
+    if (!k->in_burst) {
+        return;
+    }
+    k->in_burst = false;
+
+    // Chatter that ended where it began is no press or release
+    if (k->closed != k->burst_closes) {
+        glitches++;
+        return;
+    }
+
+    uint32_t duration = (uint32_t)(k->last_edge - k->start);
+    if (k->burst_closes) {
+        samples_add(&press_duration, duration);
+        samples_add(&press_gap, k->longest_gap);
+        strokes[row][col]++;
+    } else {
+        samples_add(&release_duration, duration);
+        samples_add(&release_gap, k->longest_gap);
+    }
+    samples_add(&burst_changes, k->changes);
+}
+
+static void measure_edge(uint8_t row, uint8_t col, bool closed, uint64_t t, uint64_t gap_us) {
+    KeyBursts *k = &bursts[row][col];
+
+    if (k->in_burst && t - k->last_edge > gap_us) {
+        close_burst(k, row, col);
+    }
+    if (!k->in_burst) {
+        k->in_burst = true;
+        k->burst_closes = closed;
+        k->start = t;
+        k->longest_gap = 0;
+        k->changes = 0;
+    } else if (t - k->last_edge > k->longest_gap) {
+        k->longest_gap = (uint32_t)(t - k->last_edge);
+    }
+    k->last_edge = t;
+    k->closed = closed;
+    k->changes++;
+}
+
+static void drain(const ReplayOptions *opt) {
+    KeyEvent event;
+    ErrorEvent error;
+
+    while (matrix_engine_get_event(&engine, &event)) {
+        if (event.state == KEY_PRESSED) {
+            presses[event.row][event.col]++;
+        } else {
+            releases[event.row][event.col]++;
+        }
+        if (opt->events) {
+            printf("%10u us  key 0x%02X (%d,%d) %s  latency %u us\n", event.confirm_us, event.key,
+                   event.row, event.col, event.state == KEY_PRESSED ? "pressed " : "released",
+                   event.confirm_us - event.contact_us);
+        }
+    }
+    while (matrix_engine_get_error(&engine, &error)) {
+        if (error.error_code == ERROR_GHOST_KEY) {
+            ghost_errors++;
+        } else if (error.error_code == ERROR_STUCK_KEY) {
+            stuck_errors++;
+        }
+    }
+}
+
+// Bounce in the raw samples, independent of any debounce settings
+static uint64_t measure_bounce(const TraceData *data, const ReplayOptions *opt, SampleIter *it) {
+    uint64_t t = 0;
+    uint8_t row;
+    matrix_row_t raw;
+    matrix_row_t state[MATRIX_ROWS] = {0};
+    uint64_t samples = 0;
+
+    iter_init(it, data);
+    while (iter_next(it, &t, &row, &raw)) {
+        matrix_row_t changed = raw ^ state[row];
+        state[row] = raw;
+        samples++;
+        while (changed) {
+            uint8_t col = __builtin_ctz(changed);
+            changed &= changed - 1;
+            measure_edge(row, col, (raw >> col) & 1, t, (uint64_t)opt->gap_ms * 1000);
+        }
+    }
+    for (int r = 0; r < MATRIX_ROWS; r++) {
+        for (int c = 0; c < MATRIX_COLS; c++) {
+            close_burst(&bursts[r][c], r, c);
+        }
+    }
+
+    printf("trace %s: %zu blocks (%u unreadable), %llu samples, %.1f s\n", opt->path, data->count,
+           it->bad_blocks, (unsigned long long)samples, t / 1e6);
+    return t;
+}
+
+static bool contacts_open(void) {
+    matrix_row_t contacts[MATRIX_ROWS];
+    sim_matrix_contacts(contacts);
+    for (int r = 0; r < MATRIX_ROWS; r++) {
+        if (contacts[r]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Feed the samples to the simulated keypad and scan it like the firmware
+static void replay(const TraceData *data, const ReplayOptions *opt, ScanStrategy strategy,
+                   uint32_t interval_us, uint64_t trace_end) {
+    SampleIter it;
+    matrix_row_t state[MATRIX_ROWS] = {0};
+    uint64_t t = 0;
+    uint8_t row = 0;
+    matrix_row_t raw = 0;
+    uint32_t sample_period = interval_us * (strategy == SCAN_STRATEGY_INTERLEAVED ? MATRIX_ROWS : 1);
+
+    sim_matrix_reset(1);
+    matrix_engine_init(&engine);
+    engine.strategy = strategy;
+    engine.ghost_detection_enabled = opt->ghost_detection;
+    matrix_engine_configure_debounce(&engine, opt->mode, opt->press_ms, opt->release_ms, sample_period);
+    matrix_engine_restart(&engine);
+
+    // Trace time 0 lands one tick after the simulation starts; one second
+    // after the last sample lets every key settle
+    uint64_t lead = interval_us;
+    uint64_t end = trace_end + lead + 1000000;
+    uint64_t next_tick = 0;
+
+    iter_init(&it, data);
+    bool pending = iter_next(&it, &t, &row, &raw);
+
+    while (next_tick < end) {
+        // Skip idle stretches: every key open and settled, so nothing can
+        // happen before the next sample (restart, like the firmware after idle)
+        if (pending && t + lead > next_tick + 2 * (uint64_t)sample_period &&
+            contacts_open() && matrix_engine_quiet(&engine)) {
+            next_tick += (t + lead - next_tick - sample_period) / interval_us * interval_us;
+            matrix_engine_restart(&engine);
+        }
+
+        // Edges due by this tick
+        while (pending && t + lead <= next_tick) {
+            matrix_row_t changed = raw ^ state[row];
+            state[row] = raw;
+            while (changed) {
+                uint8_t col = __builtin_ctz(changed);
+                changed &= changed - 1;
+                if (!sim_matrix_edge(row, col, t + lead, (raw >> col) & 1)) {
+                    fprintf(stderr, "edge queue full at %llu us\n", (unsigned long long)t);
+                    exit(2);
+                }
+            }
+            pending = iter_next(&it, &t, &row, &raw);
+        }
+
+        uint64_t now = sim_matrix_now_us();
+        if (next_tick > now) {
+            sim_matrix_advance_us((uint32_t)(next_tick - now));
+        }
+        matrix_engine_scan(&engine, interval_us);
+        next_tick += interval_us;
+        drain(opt);
+    }
+    drain(opt);
+}
+
+int main(int argc, char **argv) {
+    ReplayOptions opt;
+    TraceData data;
+    SampleIter it;
+
+    parse_options(argc, argv, &opt);
+    load_trace(opt.path, &data);
+
+    uint64_t trace_end = measure_bounce(&data, &opt, &it);
+    if (!it.have_prev) {
+        fprintf(stderr, "%s: no trace blocks for a %dx%d matrix\n", opt.path, MATRIX_ROWS, MATRIX_COLS);
+        return 1;
+    }
+
+    bool recorded_burst = it.header.flags & MATRIX_TRACE_FLAG_BURST;
+    uint32_t recorded_period = it.header.interval_us * (recorded_burst ? 1 : MATRIX_ROWS);
+    printf("recorded: %s, tick %u us, row sampled every %u us (bounce resolution)\n",
+           recorded_burst ? "burst" : "interleaved", it.header.interval_us, recorded_period);
+
+    uint32_t press_p99 = percentile(&press_duration, 99);
+    uint32_t release_p99 = percentile(&release_duration, 99);
+    printf("press bounce:   %zu bursts, duration p50 %u p99 %u max %u us, longest quiet p99 %u us\n",
+           press_duration.n, percentile(&press_duration, 50), press_p99,
+           press_duration.n ? press_duration.v[press_duration.n - 1] : 0, percentile(&press_gap, 99));
+    printf("release bounce: %zu bursts, duration p50 %u p99 %u max %u us, longest quiet p99 %u us\n",
+           release_duration.n, percentile(&release_duration, 50), release_p99,
+           release_duration.n ? release_duration.v[release_duration.n - 1] : 0, percentile(&release_gap, 99));
+    printf("edges per burst p99 %u, glitches (chatter with no net change) %u\n",
+           percentile(&burst_changes, 99), glitches);
+    printf("suggested: DEBOUNCE_PRESS_MS >= %u, DEBOUNCE_RELEASE_MS >= %u (p99 burst + one sample)\n",
+           (press_p99 + recorded_period + 999) / 1000, (release_p99 + recorded_period + 999) / 1000);
+
+    ScanStrategy strategy = (opt.strategy >= 0) ? (ScanStrategy)opt.strategy
+                            : (recorded_burst ? SCAN_STRATEGY_BURST : SCAN_STRATEGY_INTERLEAVED);
+    uint32_t interval_us = opt.interval_set ? opt.interval_us : it.header.interval_us;
+    if (interval_us == 0) {
+        interval_us = 1000;
+    }
+    static const char *mode_names[] = { "defer", "eager", "symmetric" };
+    printf("replay: %s, tick %u us, %s debounce, press %u ms, release %u ms, ghost detection %s\n",
+           strategy == SCAN_STRATEGY_BURST ? "burst" : "interleaved", interval_us,
+           mode_names[opt.mode], opt.press_ms, opt.release_ms, opt.ghost_detection ? "on" : "off");
+
+    replay(&data, &opt, strategy, interval_us, trace_end);
+
+    // Every press burst should come out as one press (or one suppressed ghost)
+    uint32_t total_strokes = 0, total_presses = 0, total_releases = 0, keys_off = 0;
+    for (int r = 0; r < MATRIX_ROWS; r++) {
+        for (int c = 0; c < MATRIX_COLS; c++) {
+            total_strokes += strokes[r][c];
+            total_presses += presses[r][c];
+            total_releases += releases[r][c];
+            if (presses[r][c] != strokes[r][c]) {
+                keys_off++;
+                printf("  key (%d,%d): %u strokes, %u presses, %u releases\n",
+                       r, c, strokes[r][c], presses[r][c], releases[r][c]);
+            }
+        }
+    }
+    printf("strokes %u, presses %u, releases %u, ghosts %u, stuck %u, keys with mismatches %u\n",
+           total_strokes, total_presses, total_releases, ghost_errors, stuck_errors, keys_off);
+    return (opt.check && keys_off) ? 1 : 0;
+}
@@ -0,0 +1,330 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "matrix_engine.h"
+#include "sim_matrix.h"
+#include "trace_file.h"
+
+// Host simulation: types on the simulated keypad through the same engine
+// the firmware uses, checks that every keystroke came out exactly once and
+// reports how fast the engine ran.
+//
+//   matrix_sim [--seconds N] [--interval-us N] [--burst] [--mode defer|eager|symmetric]
+//              [--press-ms N] [--release-ms N] [--bounce-us N] [--bounce-edges N]
+//              [--rollover N] [--no-diodes] [--seed N] [--trace FILE]
+//
+// --trace records the raw samples of the run to FILE (see matrix_replay).
+//
+// Exit status 1 if keystrokes were lost or duplicated (only checked with
+// diodes fitted; without them phantom keys are expected).
+
+#define MAX_ROLLOVER 8
+
+typedef struct {
+    uint32_t seconds;
+    uint32_t interval_us;
+    ScanStrategy strategy;
+    DebounceMode mode;
+    uint32_t press_ms;
+    uint32_t release_ms;
+    SimBounce bounce;
+    uint32_t rollover;
+    bool diodes;
+    uint32_t seed;
+    const char *trace_path;
+} SimOptions;
+
+// One finger: presses a key, holds it, lets go, waits, picks another
+typedef struct {
+    bool busy;
+    uint8_t row;
+    uint8_t col;
+    uint64_t next_us;  // When this finger strikes again
+} Finger;
+
+static MatrixEngine engine;
+static uint32_t strokes[MATRIX_ROWS][MATRIX_COLS];
+static uint32_t presses[MATRIX_ROWS][MATRIX_COLS];
+static uint32_t releases[MATRIX_ROWS][MATRIX_COLS];
+static uint32_t ghost_errors[MATRIX_ROWS][MATRIX_COLS];
+static uint32_t rng_state;
+static MatrixTrace trace;
+static FILE *trace_file;
+
+static uint32_t sim_rand(uint32_t bound) {
+    uint32_t x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rng_state = x;
+    return bound ? x % bound : 0;
+}
+
+static double wall_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [--seconds N] [--interval-us N] [--burst] [--mode defer|eager|symmetric]\n"
+                    "          [--press-ms N] [--release-ms N] [--bounce-us N] [--bounce-edges N]\n"
+                    "          [--rollover N] [--no-diodes] [--seed N] [--trace FILE]\n", prog);
+    exit(2);
+}
+
+static void parse_options(int argc, char **argv, SimOptions *opt) {
+    *opt = (SimOptions){
+        .seconds = 60,
+        .interval_us = 1000,
+        .strategy = SCAN_STRATEGY_INTERLEAVED,
+        .mode = DEBOUNCE_DEFER_PRESS_EAGER_RELEASE,
+        .press_ms = DEBOUNCE_PRESS_MS,
+        .release_ms = DEBOUNCE_RELEASE_MS,
+        .bounce = { .duration_us = 2000, .edges = 6 },
+        .rollover = 1,
+        .diodes = true,
+        .seed = 1
+    };
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *val = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+        if (strcmp(arg, "--burst") == 0) {
+            opt->strategy = SCAN_STRATEGY_BURST;
+            continue;
+        }
+        if (strcmp(arg, "--no-diodes") == 0) {
+            opt->diodes = false;
+            continue;
+        }
+        if (val == NULL) {
+            usage(argv[0]);
+        }
+        i++;
+
+        if (strcmp(arg, "--trace") == 0) {
+            opt->trace_path = val;
+            continue;
+        }
+        if (strcmp(arg, "--mode") == 0) {
+            if (strcmp(val, "defer") == 0) {
+                opt->mode = DEBOUNCE_DEFER_PRESS_EAGER_RELEASE;
+            } else if (strcmp(val, "eager") == 0) {
+                opt->mode = DEBOUNCE_EAGER_PRESS_LOCKOUT;
+            } else if (strcmp(val, "symmetric") == 0) {
+                opt->mode = DEBOUNCE_SYMMETRIC_DEFER;
+            } else {
+                usage(argv[0]);
+            }
+            continue;
+        }
+
+        uint32_t n = (uint32_t)strtoul(val, NULL, 0);
+        if (strcmp(arg, "--seconds") == 0) {
+            opt->seconds = n;
+        } else if (strcmp(arg, "--interval-us") == 0) {
+            opt->interval_us = n ? n : 1;
+        } else if (strcmp(arg, "--press-ms") == 0) {
+            opt->press_ms = n;
+        } else if (strcmp(arg, "--release-ms") == 0) {
+            opt->release_ms = n;
+        } else if (strcmp(arg, "--bounce-us") == 0) {
+            opt->bounce.duration_us = n;
+        } else if (strcmp(arg, "--bounce-edges") == 0) {
+            opt->bounce.edges = (uint16_t)n;
+        } else if (strcmp(arg, "--rollover") == 0) {
+            opt->rollover = (n < 1) ? 1 : (n > MAX_ROLLOVER ? MAX_ROLLOVER : n);
+        } else if (strcmp(arg, "--seed") == 0) {
+            opt->seed = n;
+        } else {
+            usage(argv[0]);
+        }
+    }
+}
+
+// Strike a key no other finger is on: hold 30-150 ms, then rest 20-200 ms
+// (both well above debounce plus bounce, so every stroke must register)
+static void strike(Finger *finger, Finger fingers[], uint32_t count, const SimOptions *opt) {
+    uint64_t now = sim_matrix_now_us();
+    uint8_t row, col;
+    bool taken;
+
+    do {
+        row = (uint8_t)sim_rand(MATRIX_ROWS);
+        col = (uint8_t)sim_rand(MATRIX_COLS);
+        taken = false;
+        for (uint32_t i = 0; i < count; i++) {
+            if (&fingers[i] != finger && fingers[i].busy && fingers[i].row == row && fingers[i].col == col) {
+                taken = true;
+            }
+        }
+    } while (taken);
+
+    uint64_t hold = 30000 + sim_rand(120000);
+    uint64_t rest = 20000 + sim_rand(180000);
+    sim_matrix_press(row, col, now, &opt->bounce);
+    sim_matrix_release(row, col, now + hold, &opt->bounce);
+
+    finger->busy = true;
+    finger->row = row;
+    finger->col = col;
+    finger->next_us = now + hold + rest;
+    strokes[row][col]++;
+}
+
+static void drain(void) {
+    KeyEvent events[EVENT_QUEUE_SIZE];
+    size_t count;
+    ErrorEvent error;
+
+    while ((count = matrix_engine_get_events(&engine, events, EVENT_QUEUE_SIZE)) > 0) {
+        for (size_t i = 0; i < count; i++) {
+            if (events[i].state == KEY_PRESSED) {
+                presses[events[i].row][events[i].col]++;
+            } else {
+                releases[events[i].row][events[i].col]++;
+            }
+        }
+    }
+    while (matrix_engine_get_error(&engine, &error)) {
+        if (error.error_code == ERROR_GHOST_KEY) {
+            ghost_errors[error.row][error.col]++;
+        }
+    }
+}
+
+// Move completed trace blocks from the ring to the file
+static void save_trace(void) {
+    uint8_t block[MATRIX_TRACE_BLOCK_SIZE];
+    size_t len;
+
+    while ((len = matrix_trace_read_block(&trace, block)) > 0) {
+        if (!trace_file_write_block(trace_file, block, len)) {
+            fprintf(stderr, "trace write failed\n");
+            exit(2);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    SimOptions opt;
+    parse_options(argc, argv, &opt);
+
+    rng_state = opt.seed ? opt.seed : 1;
+    sim_matrix_reset(opt.seed);
+    sim_matrix_set_diodes(opt.diodes);
+
+    uint32_t sample_period = opt.interval_us;
+    if (opt.strategy == SCAN_STRATEGY_INTERLEAVED) {
+        sample_period *= MATRIX_ROWS;
+    }
+    matrix_engine_init(&engine);
+    engine.strategy = opt.strategy;
+    matrix_engine_configure_debounce(&engine, opt.mode, opt.press_ms, opt.release_ms, sample_period);
+    matrix_engine_restart(&engine);
+
+    if (opt.trace_path) {
+        trace_file = fopen(opt.trace_path, "wb");
+        if (trace_file == NULL) {
+            perror(opt.trace_path);
+            return 2;
+        }
+        matrix_trace_init(&trace, opt.interval_us,
+                          opt.strategy == SCAN_STRATEGY_BURST ? MATRIX_TRACE_FLAG_BURST : 0);
+        engine.trace = &trace;
+    }
+
+    Finger fingers[MAX_ROLLOVER] = {0};
+    for (uint32_t i = 0; i < opt.rollover; i++) {
+        fingers[i].next_us = sim_rand(100000);
+    }
+
+    // Typing phase, then one idle second so every key settles released
+    uint64_t typing_end = (uint64_t)opt.seconds * 1000000;
+    uint64_t end = typing_end + 1000000;
+    uint64_t next_tick = 0;
+    uint64_t ticks = 0;
+    double wall_start = wall_seconds();
+
+    while (next_tick < end) {
+        uint64_t now = sim_matrix_now_us();
+        if (next_tick > now) {
+            sim_matrix_advance_us((uint32_t)(next_tick - now));
+            now = next_tick;
+        }
+
+        for (uint32_t i = 0; i < opt.rollover; i++) {
+            if (now >= fingers[i].next_us && now < typing_end) {
+                strike(&fingers[i], fingers, opt.rollover, &opt);
+            }
+        }
+
+        matrix_engine_scan(&engine, opt.interval_us);
+        ticks++;
+        next_tick += opt.interval_us;
+
+        if (matrix_ring_count(&engine.event_queue) >= EVENT_QUEUE_SIZE / 2 ||
+            matrix_ring_count(&engine.error_queue) > 0) {
+            drain();
+        }
+        if (trace_file) {
+            save_trace();
+        }
+    }
+    drain();
+    if (trace_file) {
+        matrix_trace_close(&trace);
+        save_trace();
+        fclose(trace_file);
+    }
+    double wall = wall_seconds() - wall_start;
+
+    // Every stroke must come out as one press and one release, or as one
+    // suppressed ghost (which has neither)
+    uint32_t total_strokes = 0, total_presses = 0, total_releases = 0, total_ghosts = 0, bad_keys = 0;
+    for (int row = 0; row < MATRIX_ROWS; row++) {
+        for (int col = 0; col < MATRIX_COLS; col++) {
+            total_strokes += strokes[row][col];
+            total_presses += presses[row][col];
+            total_releases += releases[row][col];
+            total_ghosts += ghost_errors[row][col];
+            if (presses[row][col] != releases[row][col] ||
+                (opt.diodes && presses[row][col] + ghost_errors[row][col] != strokes[row][col])) {
+                bad_keys++;
+                fprintf(stderr, "key (%d,%d): %u strokes, %u presses, %u releases, %u ghosts\n",
+                        row, col, strokes[row][col], presses[row][col], releases[row][col],
+                        ghost_errors[row][col]);
+            }
+        }
+    }
+
+    ScanStatistics stats;
+    matrix_engine_get_statistics(&engine, &stats);
+
+    printf("matrix %dx%d, %s, tick %u us, %u s simulated\n", MATRIX_ROWS, MATRIX_COLS,
+           opt.strategy == SCAN_STRATEGY_BURST ? "burst" : "interleaved",
+           opt.interval_us, opt.seconds);
+    printf("strokes %u, presses %u, releases %u, ghosts %u, queue overflows %u\n",
+           total_strokes, total_presses, total_releases, total_ghosts, stats.queue_overflows);
+    printf("latency us: mean %u, p50 %u, p99 %u, max %u\n",
+           latency_hist_mean(&stats.contact_to_event_us),
+           latency_hist_percentile(&stats.contact_to_event_us, 50),
+           latency_hist_percentile(&stats.contact_to_event_us, 99),
+           stats.contact_to_event_us.max);
+    if (opt.trace_path) {
+        printf("trace: %u blocks written to %s, %u lost\n", trace.tail - trace.lost_blocks,
+               opt.trace_path, trace.lost_blocks);
+    }
+    printf("%llu ticks in %.3f s wall: %.2f M ticks/s\n",
+           (unsigned long long)ticks, wall, wall > 0 ? ticks / wall / 1e6 : 0.0);
+
+    if (bad_keys) {
+        printf("FAIL: %u key(s) lost or duplicated strokes\n", bad_keys);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}
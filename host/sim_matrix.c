@@ -0,0 +1,191 @@
+#include "sim_matrix.h"
+#include "matrix_hal.h"
+#include <string.h>
+
+typedef struct {
+    uint64_t at_us;
+    bool closed;
+} SimEdge;
+
+// Queued edges of one key, oldest first (ring of SIM_MAX_EDGES)
+typedef struct {
+    SimEdge edges[SIM_MAX_EDGES];
+    uint16_t head;
+    uint16_t count;
+} SimKey;
+
+static SimKey keys[MATRIX_ROWS][MATRIX_COLS];
+static matrix_row_t contacts[MATRIX_ROWS];  // Closed contacts, bit = column
+static uint64_t now_us = 0;
+static uint64_t next_edge_us = UINT64_MAX;  // Earliest queued edge of any key
+static uint32_t strobe_us = 1;
+static bool diodes = true;
+static uint32_t rng_state = 1;
+
+// xorshift32: cheap and repeatable for a given seed
+static uint32_t sim_random(void) {
+    uint32_t x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    rng_state = x;
+    return x;
+}
+
+void sim_matrix_reset(uint32_t seed) {
+    memset(keys, 0, sizeof(keys));
+    memset(contacts, 0, sizeof(contacts));
+    now_us = 0;
+    next_edge_us = UINT64_MAX;
+    strobe_us = 1;
+    diodes = true;
+    rng_state = seed ? seed : 1;
+}
+
+uint64_t sim_matrix_now_us(void) {
+    return now_us;
+}
+
+void sim_matrix_set_strobe_us(uint32_t us) {
+    strobe_us = us;
+}
+
+void sim_matrix_set_diodes(bool fitted) {
+    diodes = fitted;
+}
+
+// Apply every edge that is due (nothing to do until the earliest one)
+static void apply_due_edges(void) {
+    if (now_us < next_edge_us) {
+        return;
+    }
+
+    uint64_t next = UINT64_MAX;
+    for (int row = 0; row < MATRIX_ROWS; row++) {
+        for (int col = 0; col < MATRIX_COLS; col++) {
+            SimKey *key = &keys[row][col];
+            while (key->count && key->edges[key->head].at_us <= now_us) {
+                if (key->edges[key->head].closed) {
+                    contacts[row] |= (matrix_row_t)(1u << col);
+                } else {
+                    contacts[row] &= (matrix_row_t)~(1u << col);
+                }
+                key->head = (key->head + 1) % SIM_MAX_EDGES;
+                key->count--;
+            }
+            if (key->count && key->edges[key->head].at_us < next) {
+                next = key->edges[key->head].at_us;
+            }
+        }
+    }
+    next_edge_us = next;
+}
+
+void sim_matrix_advance_us(uint32_t us) {
+    now_us += us;
+    apply_due_edges();
+}
+
+bool sim_matrix_edge(uint8_t row, uint8_t col, uint64_t at_us, bool closed) {
+    SimKey *key = &keys[row][col];
+    if (key->count == SIM_MAX_EDGES) {
+        return false;
+    }
+
+    // Keep the queue sorted: shift later edges up by one
+    uint16_t pos = key->count;
+    while (pos > 0) {
+        SimEdge *prev = &key->edges[(key->head + pos - 1) % SIM_MAX_EDGES];
+        if (prev->at_us <= at_us) {
+            break;
+        }
+        key->edges[(key->head + pos) % SIM_MAX_EDGES] = *prev;
+        pos--;
+    }
+    key->edges[(key->head + pos) % SIM_MAX_EDGES] = (SimEdge){ .at_us = at_us, .closed = closed };
+    key->count++;
+
+    if (at_us < next_edge_us) {
+        next_edge_us = at_us;
+    }
+    return true;
+}
+
+// First contact at at_us, then pairs of flips spread over the bounce time
+static bool schedule_transition(uint8_t row, uint8_t col, uint64_t at_us, const SimBounce *bounce, bool closed) {
+    if (!sim_matrix_edge(row, col, at_us, closed)) {
+        return false;
+    }
+    if (bounce == NULL || bounce->edges == 0 || bounce->duration_us == 0) {
+        return true;
+    }
+
+    uint32_t flips = (bounce->edges + 1u) & ~1u;
+    uint32_t slot = bounce->duration_us / flips;
+    if (slot == 0) {
+        slot = 1;
+    }
+    for (uint32_t i = 0; i < flips; i++) {
+        uint64_t t = at_us + 1 + (uint64_t)i * slot + sim_random() % slot;
+        bool level = (i % 2 == 0) ? !closed : closed;
+        if (!sim_matrix_edge(row, col, t, level)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool sim_matrix_press(uint8_t row, uint8_t col, uint64_t at_us, const SimBounce *bounce) {
+    return schedule_transition(row, col, at_us, bounce, true);
+}
+
+bool sim_matrix_release(uint8_t row, uint8_t col, uint64_t at_us, const SimBounce *bounce) {
+    return schedule_transition(row, col, at_us, bounce, false);
+}
+
+void sim_matrix_contacts(matrix_row_t out[MATRIX_ROWS]) {
+    memcpy(out, contacts, sizeof(contacts));
+}
+
+// ============================================================================
+// matrix_hal.h
+// ============================================================================
+
+uint32_t matrix_hal_time_us(void) {
+    return (uint32_t)now_us;
+}
+
+uint32_t matrix_hal_time_ms(void) {
+    return (uint32_t)(now_us / 1000);
+}
+
+void matrix_hal_rows_idle(void) {
+}
+
+matrix_row_t matrix_hal_read_row(uint8_t row) {
+    // Settling delay like the firmware's busy wait
+    if (strobe_us) {
+        sim_matrix_advance_us(strobe_us);
+    }
+
+    matrix_row_t cols = contacts[row];
+    if (diodes || cols == 0) {
+        return cols;
+    }
+
+    // No diodes: current also flows back through any other row that shares
+    // a closed column, pulling that row's other columns down as well
+    uint32_t rows_done = 1u << row;
+    bool grew = true;
+    while (grew) {
+        grew = false;
+        for (int r = 0; r < MATRIX_ROWS; r++) {
+            if (!(rows_done & (1u << r)) && (contacts[r] & cols)) {
+                rows_done |= 1u << r;
+                cols |= contacts[r];
+                grew = true;
+            }
+        }
+    }
+    return cols;
+}
@@ -0,0 +1,56 @@
+#ifndef SIM_MATRIX_H
+#define SIM_MATRIX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix_config.h"
+
+// Simulated keypad for the host build
+//
+// Implements matrix_hal.h over a virtual clock, so the shared key engine
+// runs unchanged on a PC. Every key has its own queue of contact edges;
+// presses and releases are scheduled with a bounce waveform (or as raw
+// edges, e.g. from a recorded trace) and take effect once the clock
+// passes them. Time only moves when the caller advances it, which makes
+// runs deterministic and lets them go as fast as the engine allows.
+
+// Edges a key can have queued at once
+#ifndef SIM_MAX_EDGES
+#define SIM_MAX_EDGES 64
+#endif
+
+// Contact bounce of one transition: the contact first changes at the
+// scheduled time, then chatters with `edges` extra flips spread over
+// duration_us (rounded up to an even count, so it settles in the new
+// state). Flip times are pseudo-random but repeat for the same seed.
+typedef struct {
+    uint32_t duration_us;
+    uint16_t edges;
+} SimBounce;
+
+// Reset: clock at zero, every key open, no edges queued, diodes fitted
+void sim_matrix_reset(uint32_t seed);
+
+// Virtual clock (us since reset; matrix_hal_time_us() is its low 32 bits)
+uint64_t sim_matrix_now_us(void);
+void sim_matrix_advance_us(uint32_t us);
+
+// Time each row strobe takes (settling delay, default 1 us)
+void sim_matrix_set_strobe_us(uint32_t us);
+
+// Without diodes a closed rectangle of three keys also closes the fourth
+// corner electrically (ghosting), as on a bare matrix
+void sim_matrix_set_diodes(bool fitted);
+
+// Schedule a press or release at at_us (bounce may be NULL: clean edge)
+// Returns false if the key's edge queue is full
+bool sim_matrix_press(uint8_t row, uint8_t col, uint64_t at_us, const SimBounce *bounce);
+bool sim_matrix_release(uint8_t row, uint8_t col, uint64_t at_us, const SimBounce *bounce);
+
+// Schedule one raw contact edge (true = closed)
+bool sim_matrix_edge(uint8_t row, uint8_t col, uint64_t at_us, bool closed);
+
+// Contacts closed right now (before ghosting), one bitmask per row
+void sim_matrix_contacts(matrix_row_t contacts[MATRIX_ROWS]);
+
+#endif // SIM_MATRIX_H
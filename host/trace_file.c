@@ -0,0 +1,23 @@
+#include "trace_file.h"
+
+bool trace_file_write_block(FILE *f, const uint8_t *block, size_t len) {
+    uint8_t prefix[2] = { (uint8_t)len, (uint8_t)(len >> 8) };
+    return fwrite(prefix, 1, 2, f) == 2 && fwrite(block, 1, len, f) == len;
+}
+
+int trace_file_read_block(FILE *f, uint8_t block[MATRIX_TRACE_BLOCK_SIZE]) {
+    uint8_t prefix[2];
+    size_t got = fread(prefix, 1, 2, f);
+    if (got == 0) {
+        return 0;
+    }
+    if (got != 2) {
+        return -1;
+    }
+
+    size_t len = prefix[0] | ((size_t)prefix[1] << 8);
+    if (len == 0 || len > MATRIX_TRACE_BLOCK_SIZE || fread(block, 1, len, f) != len) {
+        return -1;
+    }
+    return (int)len;
+}
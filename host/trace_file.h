@@ -0,0 +1,21 @@
+#ifndef TRACE_FILE_H
+#define TRACE_FILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "matrix_trace.h"
+
+// Trace files: the blocks of a raw scan trace (matrix_trace.h) in the
+// order they were read out, each as len:u16 (little-endian) then the block.
+// Written by matrix_sim --trace and tools/matrix_stream_decode.py --trace,
+// read by matrix_replay.
+
+bool trace_file_write_block(FILE *f, const uint8_t *block, size_t len);
+
+// Returns the block length, 0 at end of file, -1 on a truncated or
+// oversized block
+int trace_file_read_block(FILE *f, uint8_t block[MATRIX_TRACE_BLOCK_SIZE]);
+
+#endif // TRACE_FILE_H
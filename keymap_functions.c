@@ -1,17 +1,36 @@
 #include "keymap_functions.h"
-#include <stdio.h>
 #include <string.h>
 
-#define MAX_FUNCTION_KEYS 15  // 0x0-0xE (F=0xF is reserved)
-
-// Current operating mode
-static OperatingMode current_mode = MODE_NORMAL;
+// Default layers
+#if MATRIX_ROWS == 4 && MATRIX_COLS == 4
+static const LayerTable default_layers[] = {
+    // Layer 0: normal, F toggles the function layer
+    {
+        {LA_TRNS, LA_TRNS,  LA_TRNS, LA_TRNS},
+        {LA_TRNS, LA_TRNS,  LA_TRNS, LA_TRNS},
+        {LA_TRNS, LA_TRNS,  LA_TRNS, LA_TRNS},
+        {LA_TRNS, LA_TG(1), LA_TRNS, LA_TRNS}
+    },
+    // Layer 1: function, each hex key runs its function, F falls through
+    {
+        {LA_FN(0x1), LA_FN(0x2), LA_FN(0x3), LA_FN(0xA)},
+        {LA_FN(0x4), LA_FN(0x5), LA_FN(0x6), LA_FN(0xB)},
+        {LA_FN(0x7), LA_FN(0x8), LA_FN(0x9), LA_FN(0xC)},
+        {LA_FN(0x0), LA_TRNS,    LA_FN(0xE), LA_FN(0xD)}
+    }
+};
+#else
+static const LayerTable default_layers[] = {
+    {{LA_TRNS}}  // Every key passes through
+};
+#endif
 
-// Function lookup table - maps keys to functions in function mode
-static KeyActionFunc function_table[MAX_FUNCTION_KEYS];
+// Layer stack and the active layers last reported by keymap_poll_layers()
+static MatrixLayers layers;
+static uint32_t reported_changes = 0;
 
-// Mode toggle timeout (optional: auto-return to normal mode after inactivity)
-static bool mode_indication_enabled = true;
+// Function lookup table - LA_FN(n) runs function_table[n]
+static KeyActionFunc function_table[KEYMAP_MAX_FUNCTIONS];
 
 void keymap_init(void) {
     // Clear all function mappings
@@ -25,92 +44,98 @@ void keymap_init(void) {
     function_table[0x5] = function_key_5;
     // Add more default mappings as needed...
     
-    current_mode = MODE_NORMAL;
-    printf("Keymap function system initialized.\n");
-    printf("Press F to toggle function mode.\n");
+    keymap_set_layers(default_layers, sizeof(default_layers) / sizeof(default_layers[0]));
 }
 
-bool keymap_process_key(uint8_t key) {
-    // F key (0xF) toggles between normal and function mode
-    if (key == 0xF) {
-        if (current_mode == MODE_NORMAL) {
-            current_mode = MODE_FUNCTION;
-            printf("\n>>> FUNCTION MODE ACTIVATED <<<\n");
-            printf("Press 1-E to trigger functions, F to exit.\n\n");
-        } else {
-            current_mode = MODE_NORMAL;
-            printf("\n>>> NORMAL MODE <<<\n\n");
-        }
-        return true;  // Key consumed
-    }
+void keymap_set_layers(const LayerTable *tables, uint8_t layer_count) {
+    matrix_layers_init(&layers, tables, layer_count);
+    reported_changes = 0;
+}
+
+bool keymap_process_key(uint8_t row, uint8_t col, bool pressed, uint8_t *key) {
+    // One table index: the layer lookup was done when the layers changed
+    LayerAction action = matrix_layers_process(&layers, row, col, pressed);
+    uint8_t arg = LAYER_ACTION_ARG(action);
     
-    // In function mode, execute mapped functions
-    if (current_mode == MODE_FUNCTION) {
-        if (key < MAX_FUNCTION_KEYS && function_table[key] != NULL) {
-            printf("[Function Mode] Executing function for key 0x%X...\n", key);
-            function_table[key](key);
-            return true;  // Key consumed
-        } else {
-            printf("[Function Mode] No function mapped to key 0x%X\n", key);
-            return true;  // Still consume the key
+    switch (LAYER_ACTION_KIND(action)) {
+    case LAYER_KIND_TRANSPARENT:
+        return false;  // Pass the key through unchanged
+        
+    case LAYER_KIND_KEY:
+        *key = arg;
+        return false;  // Pass through as the layer's key code
+        
+    case LAYER_KIND_FUNCTION:
+        if (pressed && arg < KEYMAP_MAX_FUNCTIONS && function_table[arg] != NULL) {
+            function_table[arg](*key);
         }
+        return true;  // Consumed, mapped or not
+        
+    default:
+        return true;  // Layer keys and swallowed keys
     }
-    
-    // In normal mode, pass key through (return false = not consumed)
-    return false;
 }
 
-OperatingMode keymap_get_mode(void) {
-    return current_mode;
+uint32_t keymap_get_layers(void) {
+    return matrix_layers_active(&layers);
 }
 
-void keymap_set_function(uint8_t key, KeyActionFunc func) {
-    if (key < MAX_FUNCTION_KEYS) {
-        function_table[key] = func;
-        printf("Function mapped to key 0x%X\n", key);
+void keymap_toggle_layer(uint8_t layer) {
+    matrix_layers_toggle(&layers, layer);
+}
+
+bool keymap_poll_layers(uint32_t *active) {
+    if (layers.changes == reported_changes) {
+        return false;
     }
+    
+    reported_changes = layers.changes;
+    *active = matrix_layers_active(&layers);
+    return true;
 }
 
-void keymap_clear_function(uint8_t key) {
-    if (key < MAX_FUNCTION_KEYS) {
-        function_table[key] = NULL;
+void keymap_set_function(uint8_t n, KeyActionFunc func) {
+    if (n < KEYMAP_MAX_FUNCTIONS) {
+        function_table[n] = func;
+    }
+}
+
+void keymap_clear_function(uint8_t n) {
+    if (n < KEYMAP_MAX_FUNCTIONS) {
+        function_table[n] = NULL;
     }
 }
 
 // ============================================================================
 // Example function implementations - CUSTOMIZE THESE FOR YOUR APPLICATION
+// They run in the key path: keep them short and leave printing to the main
+// loop (keymap_process_key() returns true for them)
 // ============================================================================
 
 void function_key_1(uint8_t key) {
-    printf("  -> FUNCTION 1: Toggle LED / Output Pin\n");
-    // Example: gpio_put(LED_PIN, !gpio_get(LED_PIN));
-    // Add your code here
+    // Example: Toggle LED / Output Pin
+    // gpio_put(LED_PIN, !gpio_get(LED_PIN));
 }
 
 void function_key_2(uint8_t key) {
-    printf("  -> FUNCTION 2: Start Timer / Counter\n");
-    // Example: start_timer();
-    // Add your code here
+    // Example: Start Timer / Counter
+    // start_timer();
 }
 
 void function_key_3(uint8_t key) {
-    printf("  -> FUNCTION 3: Reset / Clear Data\n");
-    // Example: reset_system();
-    // Add your code here
+    // Example: Reset / Clear Data
+    // reset_system();
 }
 
 void function_key_4(uint8_t key) {
-    printf("  -> FUNCTION 4: Save Settings to Flash\n");
-    // Example: save_settings_to_flash();
-    // Add your code here
+    // Example: Save Settings to Flash
+    // save_settings_to_flash();
 }
 
 void function_key_5(uint8_t key) {
-    printf("  -> FUNCTION 5: Load Settings from Flash\n");
-    // Example: load_settings_from_flash();
-    // Add your code here
+    // Example: Load Settings from Flash
+    // load_settings_from_flash();
 }
 
 // Add more function implementations as needed...
 // function_key_6, function_key_7, etc.
-
@@ -6,6 +6,15 @@
 // Set to 1 to enable pin testing mode, 0 for normal operation
 #define PIN_TEST_MODE 0
 
+static void print_layers(uint32_t active) {
+    if (active & (1u << 1)) {
+        printf("\n>>> FUNCTION MODE ACTIVATED <<<\n");
+        printf("Press 0-E to trigger functions, F to exit.\n\n");
+    } else {
+        printf("\n>>> NORMAL MODE <<<\n\n");
+    }
+}
+
 int main() {
     // Initialize USB serial
     stdio_init_all();
@@ -29,6 +38,7 @@ int main() {
     
     // Initialize function mode system
     keymap_init();
+    printf("Press F to toggle function mode.\n");
     
 #if PIN_TEST_MODE
     // Pin testing mode - helps you map your keypad
@@ -50,21 +60,28 @@ int main() {
     while (true) {
         // Non-blocking scan - call this as often as possible
         if (matrix_scan(&event)) {
-            // Key event detected - only process PRESSED events
-            if (event.state == KEY_PRESSED) {
-                // Try to process as function mode key
-                bool handled = keymap_process_key(event.key);
+            // Key event detected - presses and releases go through the layers
+            if (event.state != KEY_HELD) {
+                uint8_t key = event.key;
+                bool handled = keymap_process_key(event.row, event.col,
+                                                  event.state == KEY_PRESSED, &key);
                 
-                if (!handled) {
+                if (!handled && event.state == KEY_PRESSED) {
                     // Normal mode - just display the key
                     printf("Key: 0x%X (row=%d, col=%d)\n", 
-                           event.key, event.row, event.col);
+                           key, event.row, event.col);
                 }
+                // Optionally show releases too (commented out to reduce clutter)
+                // else if (!handled) {
+                //     printf("Released: 0x%X\n", key);
+                // }
+            }
+            
+            // Layer changes are printed here, outside the key path
+            uint32_t layers;
+            if (keymap_poll_layers(&layers)) {
+                print_layers(layers);
             }
-            // Optionally show releases too (commented out to reduce clutter)
-            // else if (event.state == KEY_RELEASED) {
-            //     printf("Released: 0x%X\n", event.key);
-            // }
         }
         
         scan_count++;
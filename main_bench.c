@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#include "matrix_robust.h"
+#include "matrix_bench.h"
+
+// Benchmark firmware (target matrix_bench): runs the driver with each scan
+// backend for a few seconds and reports its ISR time and jitter, then
+// times the engine itself in cycles (common/matrix_bench.h). Prints one
+// JSON object per line on the USB console; capture it and compare runs
+// with tools/bench_compare.py. Hold keys down during the driver runs to
+// measure a loaded keypad.
+
+#define BENCH_RUN_MS      3000
+#define BENCH_ITERATIONS  10000
+
+// SysTick as a free running 24-bit cycle counter (counts down, so invert)
+static void systick_start(void) {
+    systick_hw->csr = 0;
+    systick_hw->rvr = 0x00FFFFFF;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0x5;  // Enable, processor clock, no interrupt
+}
+
+static uint32_t systick_read(void) {
+    return 0x00FFFFFF - systick_hw->cvr;
+}
+
+static void run_driver(const MatrixBench *bench, const char *name) {
+    KeyEvent events[EVENT_QUEUE_SIZE];
+    ErrorEvent error;
+    ScanStatistics stats;
+    
+    if (!matrix_robust_start()) {
+        printf("{\"bench\":\"driver\",\"backend\":\"%s\",\"error\":\"start failed\"}\n", name);
+        return;
+    }
+    matrix_robust_reset_statistics();
+    
+    absolute_time_t end = make_timeout_time_ms(BENCH_RUN_MS);
+    while (!time_reached(end)) {
+        matrix_robust_get_events(events, EVENT_QUEUE_SIZE);
+        while (matrix_robust_get_error(&error)) {
+        }
+        sleep_ms(1);
+    }
+    
+    matrix_robust_stop();
+    matrix_robust_get_statistics(&stats);
+    matrix_bench_print_stats(bench, name, &stats);
+}
+
+int main() {
+    stdio_init_all();
+    sleep_ms(2000);
+    
+    const uint8_t row_pins[4] = {2, 3, 4, 5};
+    const uint8_t col_pins[4] = {6, 7, 8, 9};
+    matrix_robust_init(row_pins, col_pins, 1000);
+    
+    systick_start();
+    const MatrixBench bench = {
+        .platform = "rp2350",
+        .read = systick_read,
+        .mask = 0x00FFFFFF,
+        .hz = clock_get_hz(clk_sys)
+    };
+    
+    // Driver: every backend at the default 1 kHz tick
+    matrix_robust_set_scan_strategy(SCAN_STRATEGY_INTERLEAVED);
+    run_driver(&bench, "timer_interleaved");
+    matrix_robust_set_scan_strategy(SCAN_STRATEGY_BURST);
+    run_driver(&bench, "timer_burst");
+    if (matrix_robust_set_scan_core(SCAN_CORE_1)) {
+        run_driver(&bench, "timer_burst_core1");
+        matrix_robust_set_scan_core(SCAN_CORE_0);
+    }
+    if (matrix_robust_set_backend(SCAN_BACKEND_PIO)) {
+        run_driver(&bench, "pio");
+        matrix_robust_set_backend(SCAN_BACKEND_TIMER);
+    }
+    
+    // Engine, with the driver stopped
+    matrix_bench_scan_idle(&bench, SCAN_STRATEGY_INTERLEAVED, BENCH_ITERATIONS);
+    matrix_bench_scan_idle(&bench, SCAN_STRATEGY_BURST, BENCH_ITERATIONS);
+    matrix_bench_scan_loaded(&bench, SCAN_STRATEGY_INTERLEAVED, BENCH_ITERATIONS);
+    matrix_bench_scan_loaded(&bench, SCAN_STRATEGY_BURST, BENCH_ITERATIONS);
+    matrix_bench_queue(&bench, BENCH_ITERATIONS / EVENT_QUEUE_SIZE);
+    
+    printf("{\"bench\":\"done\",\"platform\":\"rp2350\"}\n");
+    while (true) {
+        sleep_ms(1000);
+    }
+}
@@ -1,8 +1,146 @@
 #include <stdio.h>
 #include "pico/stdlib.h"
 #include "matrix_robust.h"
+#include "matrix_settings_flash.h"
 #include "keymap_functions.h"
 
+// Output format: 0 = human-readable text, 1 = framed binary records for host
+// software (decode with tools/matrix_stream_decode.py). Set from CMake with
+// -DMATRIX_STREAM_BINARY=ON.
+#ifndef MATRIX_STREAM_BINARY
+#define MATRIX_STREAM_BINARY 0
+#endif
+
+// USB HID keyboard output alongside the console (-DMATRIX_USB_HID=ON)
+#ifndef MATRIX_USB_HID
+#define MATRIX_USB_HID 0
+#endif
+
+#if MATRIX_USB_HID
+#include "usb_hid_keyboard.h"
+#endif
+
+// Raw scan trace sent along the binary stream (-DMATRIX_TRACE=ON); save it
+// with tools/matrix_stream_decode.py --trace and replay with host/matrix_replay
+#ifndef MATRIX_TRACE
+#define MATRIX_TRACE 0
+#endif
+
+#if MATRIX_TRACE && !MATRIX_STREAM_BINARY
+#error "MATRIX_TRACE is sent over the binary stream, enable MATRIX_STREAM_BINARY"
+#endif
+
+#if MATRIX_TRACE
+static MatrixTrace trace;
+#endif
+
+// Shift-register panel instead of direct pins (-DMATRIX_SHIFT_REGISTER=ON,
+// e.g. with -DMATRIX_ROWS=16 -DMATRIX_COLS=16), wiring in matrix_scan_shift.h
+#ifndef MATRIX_SHIFT_REGISTER
+#define MATRIX_SHIFT_REGISTER 0
+#endif
+
+// Combo and tap-hold example (-DMATRIX_GESTURES=ON, 4x4 hex layout):
+// 1+2 together send 0x10, 0 sends 0x0 on a tap and holds 0x11 after 200 ms
+#ifndef MATRIX_GESTURES
+#define MATRIX_GESTURES 0
+#endif
+
+// Dormant deep sleep instead of WFI after 30 s idle (-DMATRIX_DEEP_SLEEP=ON,
+// stdio on the UART since USB stops while dormant)
+#ifndef MATRIX_DEEP_SLEEP
+#define MATRIX_DEEP_SLEEP 0
+#endif
+
+#if MATRIX_DEEP_SLEEP && MATRIX_USB_HID
+#error "USB stops while dormant, MATRIX_DEEP_SLEEP cannot be used with MATRIX_USB_HID"
+#endif
+
+#if MATRIX_GESTURES
+static const MatrixCombo combos[] = {
+    { .key_count = 2, .keys = { {0, 0}, {0, 1} }, .key = 0x10 },
+};
+static const MatrixTapHold tap_holds[] = {
+    { .pos = {3, 0}, .tap_key = 0x0, .hold_key = 0x11 },
+};
+static const MatrixGestureConfig gesture_config = {
+    .combos = combos,
+    .combo_count = 1,
+    .combo_term_ms = 50,
+    .tap_holds = tap_holds,
+    .tap_hold_count = 1,
+    .hold_ms = 200,
+};
+static MatrixGestures gestures;
+#endif
+
+#if MATRIX_STREAM_BINARY
+#include "pico/stdio_usb.h"
+#include "tusb.h"
+
+// Binary records share the CDC port with stdio, so nothing else may print
+#define LOG(...) ((void)0)
+
+static MatrixStream stream;
+
+// Key events stay in the driver queue (EVENT_QUEUE_SIZE) until the host
+// opens the port, for at most this long after reset
+#define BOOT_HOLD_MS 2000
+
+// Non-blocking CDC write: hand stdio_usb only what fits the TX FIFO, drop
+// everything while no host is connected
+static size_t cdc_write(const uint8_t *data, size_t len, void *ctx) {
+    if (!stdio_usb_connected()) {
+        return len;
+    }
+    uint32_t room = tud_cdc_write_available();
+    if (len > room) {
+        len = room;
+    }
+    if (len > 0) {
+        stdio_usb.out_chars((const char *)data, (int)len);
+    }
+    return len;
+}
+#else
+#include "matrix_log.h"
+#if MATRIX_DEEP_SLEEP
+#include "hardware/uart.h"
+#else
+#include "pico/stdio_usb.h"
+#include "tusb.h"
+#endif
+
+// Console text goes through a RAM ring and out once per main loop pass,
+// so nothing waits for the console and boot messages survive enumeration
+static MatrixLog console_log;
+#define LOG(...) matrix_log_printf(&console_log, __VA_ARGS__)
+
+// Non-blocking console write: as much as the TX FIFO takes; nothing while
+// no host is connected, so the text waits for one
+static size_t console_write(const uint8_t *data, size_t len, void *ctx) {
+#if MATRIX_DEEP_SLEEP
+    size_t sent = 0;
+    while (sent < len && uart_is_writable(uart_default)) {
+        uart_putc_raw(uart_default, (char)data[sent++]);
+    }
+    return sent;
+#else
+    if (!stdio_usb_connected()) {
+        return 0;
+    }
+    uint32_t room = tud_cdc_write_available();
+    if (len > room) {
+        len = room;
+    }
+    if (len > 0) {
+        stdio_usb.out_chars((const char *)data, (int)len);
+    }
+    return len;
+#endif
+}
+#endif
+
 // Example: Key event callback (called from ISR!)
 void on_key_event(KeyEvent *event) {
     // Keep ISR handlers SHORT and FAST!
@@ -18,14 +156,123 @@ void on_error(ErrorEvent *error) {
     // This is called from ISR, keep it short!
 }
 
+// key: the code after the layers (may differ from event->key)
+static void report_key(const KeyEvent *event, uint8_t key, bool handled) {
+#if MATRIX_STREAM_BINARY
+    matrix_robust_stream_event(&stream, event);
+#else
+    if (event->state == KEY_PRESSED && !handled) {
+        LOG("[%lu ms] Key: 0x%X (row=%d, col=%d)\n",
+            event->timestamp, key, event->row, event->col);
+    } else if (event->state == KEY_PRESSED) {
+        LOG("[%lu ms] Function key: 0x%X\n", event->timestamp, key);
+    } else if (event->state == KEY_HELD && !handled) {
+        LOG("[%lu ms] Repeat: 0x%X\n", event->timestamp, key);
+    } else if (event->state == KEY_RELEASED) {
+        LOG("[%lu ms] Released: 0x%X\n", event->timestamp, key);
+    }
+#endif
+}
+
+static void report_error(const ErrorEvent *error) {
+#if MATRIX_STREAM_BINARY
+    matrix_robust_stream_error(&stream, error);
+#else
+    switch (error->error_code) {
+        case ERROR_STUCK_KEY:
+            LOG("⚠️  ERROR [%lu ms]: Stuck key detected (row=%d, col=%d)\n",
+                error->timestamp, error->row, error->col);
+            break;
+        case ERROR_GHOST_KEY:
+            LOG("⚠️  ERROR [%lu ms]: Ghost key detected (row=%d, col=%d)\n",
+                error->timestamp, error->row, error->col);
+            break;
+        case ERROR_SCAN_TIMEOUT:
+            LOG("⚠️  ERROR [%lu ms]: Scan fell behind (%lu ticks missed)\n",
+                error->timestamp, error->count);
+            break;
+        case ERROR_SCAN_OVERRUN:
+            LOG("⚠️  ERROR [%lu ms]: Scan overran its period (%lu us)\n",
+                error->timestamp, error->count);
+            break;
+        default:
+            LOG("⚠️  ERROR [%lu ms]: Unknown error\n", error->timestamp);
+    }
+#endif
+}
+
+static void report_statistics(void) {
+#if MATRIX_STREAM_BINARY
+    matrix_robust_stream_statistics(&stream);
+#else
+    ScanStatistics stats;
+    matrix_robust_get_statistics(&stats);
+    
+    LOG("\n--- Statistics ---\n");
+    LOG("Total scans:     %lu\n", stats.total_scans);
+    LOG("Total events:    %lu\n", stats.total_events);
+    LOG("Total errors:    %lu\n", stats.total_errors);
+    LOG("Queue overflows: %lu\n", stats.queue_overflows);
+    LOG("Max scan time:   %lu us\n", stats.max_scan_time_us);
+    LOG("Avg scan time:   %lu us\n", stats.avg_scan_time_us);
+    LOG("Scan jitter p99: < %lu us\n", latency_hist_percentile(&stats.scan_jitter_us, 99));
+    LOG("Scan interval:   %lu us (fast %lu ms, slow %lu ms, %lu switches)\n",
+        stats.scan_interval_us, stats.fast_rate_ms, stats.slow_rate_ms, stats.rate_changes);
+    LOG("Press latency:   mean %lu us, p99 <= %lu us, max %lu us\n",
+        latency_hist_mean(&stats.contact_to_event_us),
+        latency_hist_percentile(&stats.contact_to_event_us, 99),
+        stats.contact_to_event_us.max);
+    LOG("Queue latency:   p99 <= %lu us\n", latency_hist_percentile(&stats.event_to_dequeue_us, 99));
+    LOG("Deep sleeps:     %lu (wake to press p99 <= %lu us)\n", stats.deep_sleeps,
+        latency_hist_percentile(&stats.wake_to_event_us, 99));
+    LOG("------------------\n\n");
+#endif
+}
+
+static void report_layers(uint32_t active) {
+#if MATRIX_STREAM_BINARY
+    uint8_t payload[8];
+    uint8_t *p = matrix_stream_u32(payload, active);
+    p = matrix_stream_u32(p, to_ms_since_boot(get_absolute_time()));
+    matrix_stream_put(&stream, STREAM_REC_LAYERS, payload, p - payload);
+#else
+    if (active & (1u << 1)) {
+        LOG("\n>>> FUNCTION MODE ACTIVATED <<<\n");
+        LOG("Press 0-E to trigger functions, F to exit.\n\n");
+    } else {
+        LOG("\n>>> NORMAL MODE <<<\n\n");
+    }
+#endif
+}
+
 int main() {
-    // Initialize USB serial
+    // Initialize USB serial (returns at once, the host enumerates later)
     stdio_init_all();
-    sleep_ms(2000);
+#if MATRIX_USB_HID
+    // The application runs the USB stack, serviced from the main loop
+    usb_hid_keyboard_init();
+#endif
+
+    // Nothing below waits for the console: the keypad scans within
+    // milliseconds of reset, text and events queue until the host is there
+#if MATRIX_STREAM_BINARY
+    matrix_stream_init(&stream, cdc_write, NULL);
+#else
+    matrix_log_init(&console_log);
+#endif
+
+    LOG("\n\n=== ROBUST Matrix Keypad Driver ===\n");
+    LOG("Hardware timer + interrupts + error detection\n\n");
     
-    printf("\n\n=== ROBUST Matrix Keypad Driver ===\n");
-    printf("Hardware timer + interrupts + error detection\n\n");
+#if MATRIX_SHIFT_REGISTER
+    // 595 SER, 165 QH, shared clock, shared latch (clock + 1)
+    const MatrixShiftPins shift_pins = { .data_out = 2, .data_in = 3, .clock = 4, .latch = 5 };
     
+    // PIO scans every row each 20us; the CPU drains and debounces once per ms
+    if (!matrix_robust_init_shift_register(&shift_pins, 20)) {
+        LOG("\n❌ ERROR: Shift-register panel not supported!\n\n");
+    }
+#else
     // Define pin assignments
     const uint8_t row_pins[4] = {2, 3, 4, 5};
     const uint8_t col_pins[4] = {6, 7, 8, 9};
@@ -34,9 +281,31 @@ int main() {
     // Scan interval: 1000us = 1kHz = 1ms per scan
     matrix_robust_init(row_pins, col_pins, 1000);
     
+    // Scan the whole matrix on every tick (latency = 1 tick + debounce)
+    matrix_robust_set_scan_strategy(SCAN_STRATEGY_BURST);
+#endif
+    
+#if MATRIX_TRACE
+    // Record raw samples from the first scan on
+    matrix_robust_set_trace(&trace);
+#endif
+    
+#if MATRIX_GESTURES
+    matrix_gestures_init(&gestures, &gesture_config);
+    matrix_robust_set_gestures(&gestures);
+#endif
+    
     // Configure features
     matrix_robust_set_ghost_detection(true);      // Enable ghost key detection
     matrix_robust_set_stuck_detection(true, 5000); // 5 second stuck key timeout
+    matrix_robust_set_repeat(500, 100, 33, 5);    // Typematic: 500 ms delay, 10/s speeding up to 30/s
+    matrix_robust_set_adaptive_rate(4000, ADAPTIVE_DECAY_MS);  // 250 Hz while nobody types
+    
+    // Per-unit tuning saved in flash overrides the defaults above
+    const MatrixSettings *settings = matrix_settings_flash_load();
+    if (settings != NULL) {
+        matrix_robust_apply_settings(settings);
+    }
     
     // Optional: Register callbacks (for ISR-driven events)
     // matrix_robust_set_key_callback(on_key_event);
@@ -44,83 +313,128 @@ int main() {
     
     // Initialize function mode
     keymap_init();
+    if (settings != NULL && settings->layer_count > 0) {
+        keymap_set_layers(settings->layers, settings->layer_count);  // Read in place
+    }
+    LOG("Press F to toggle function mode.\n");
     
-    // TEST: Simple timer to verify timer system works
     // Start scanning
-    matrix_robust_start();
-    sleep_ms(100);  // Allow timer to stabilize
-    
-    printf("\n✅ Keypad ready! Press keys...\n\n");
-    
-    KeyEvent event;
+    if (matrix_robust_start()) {
+        LOG("\n✅ Keypad ready! Press keys...\n\n");
+    } else {
+        LOG("\n❌ ERROR: Failed to start scanning!\n\n");
+    }
+
+    const KeyEvent *events;
+    size_t event_count;
     ErrorEvent error;
     uint32_t last_stats_time = 0;
     uint32_t idle_count = 0;
+    uint8_t repeat_key = 0;        // Repeats take the outcome of their press
+    bool repeat_handled = false;
+#if MATRIX_STREAM_BINARY
+    bool hello_sent = false;
+#endif
     
     while (true) {
-        // Process key events from queue
-        while (matrix_robust_get_event(&event)) {
+#if MATRIX_STREAM_BINARY
+        // Hold events in the driver queue until the host can take them
+        bool console_ready = stdio_usb_connected() ||
+                             to_ms_since_boot(get_absolute_time()) >= BOOT_HOLD_MS;
+        if (console_ready && !hello_sent) {
+            matrix_robust_stream_hello(&stream);
+            hello_sent = true;
+        }
+#else
+        bool console_ready = true;  // The log ring holds the text instead
+#endif
+        
+        // Process key events in bursts, straight out of the queue
+        while (console_ready && (event_count = matrix_robust_peek_events(&events)) > 0) {
             idle_count = 0;  // Reset idle counter
             
-            if (event.state == KEY_PRESSED) {
-                // Process with function mode
-                bool handled = keymap_process_key(event.key);
+            for (size_t i = 0; i < event_count; i++) {
+                const KeyEvent *event = &events[i];
+                uint8_t key = event->key;
+                bool handled = false;
                 
-                if (!handled) {
-                    printf("[%lu ms] Key: 0x%X (row=%d, col=%d)\n",
-                           event.timestamp, event.key, event.row, event.col);
+                // Combo and tap-hold events already carry their key code
+                if (event->state != KEY_HELD && event->gesture == KEY_GESTURE_NONE) {
+                    // Layers see presses and releases (momentary keys)
+                    handled = keymap_process_key(event->row, event->col,
+                                                 event->state == KEY_PRESSED, &key);
+                }
+                if (event->state == KEY_PRESSED) {
+                    repeat_key = key;
+                    repeat_handled = handled;
+                } else if (event->state == KEY_HELD) {
+                    key = repeat_key;
+                    handled = repeat_handled;
                 }
-            } else if (event.state == KEY_RELEASED) {
-                printf("[%lu ms] Released: 0x%X\n", event.timestamp, event.key);
+                report_key(event, key, handled);
             }
+            
+            matrix_robust_commit_events(event_count);
+        }
+        
+        // Layer changes are reported here, outside the key path
+        uint32_t layers;
+        if (keymap_poll_layers(&layers)) {
+            report_layers(layers);
         }
         
         // Process error events
         while (matrix_robust_get_error(&error)) {
-            printf("⚠️  ERROR [%lu ms]: ", error.timestamp);
-            switch (error.error_code) {
-                case ERROR_STUCK_KEY:
-                    printf("Stuck key detected (row=%d, col=%d)\n", 
-                           error.row, error.col);
-                    break;
-                case ERROR_GHOST_KEY:
-                    printf("Ghost key detected (row=%d, col=%d)\n", 
-                           error.row, error.col);
-                    break;
-                default:
-                    printf("Unknown error\n");
-            }
+            report_error(&error);
+#if MATRIX_TRACE
+            // Send the samples leading up to it without waiting for the block to fill
+            matrix_robust_trace_flush();
+#endif
         }
         
-        // Print statistics every 60 seconds
+        // Report statistics every 60 seconds
         uint32_t now = to_ms_since_boot(get_absolute_time());
         if (now - last_stats_time > 60000) {
-            ScanStatistics stats;
-            matrix_robust_get_statistics(&stats);
-            
-            printf("\n--- Statistics ---\n");
-            printf("Total scans:     %lu\n", stats.total_scans);
-            printf("Total events:    %lu\n", stats.total_events);
-            printf("Total errors:    %lu\n", stats.total_errors);
-            printf("Queue overflows: %lu\n", stats.queue_overflows);
-            printf("Max scan time:   %lu us\n", stats.max_scan_time_us);
-            printf("Avg scan time:   %lu us\n", stats.avg_scan_time_us);
-            printf("------------------\n\n");
-            
+            report_statistics();
             last_stats_time = now;
         }
-        
+
+#if MATRIX_STREAM_BINARY
+#if MATRIX_TRACE
+        // Trace chunks fill whatever room the events left in the batch
+        matrix_trace_stream(&trace, &stream);
+#endif
+        // One batch per pass, i.e. at most one write per USB frame
+        matrix_stream_flush(&stream);
+#else
+        // Whatever the console takes right now, the rest waits in the ring
+        matrix_log_flush(&console_log, console_write, NULL);
+#endif
+
+#if MATRIX_USB_HID
+        // Once per pass (1 ms): matches the host's keyboard polling interval
+        usb_hid_keyboard_task();
+#endif
+
         // Optional: Enter low power mode after 30 seconds of inactivity
         idle_count++;
         if (idle_count > 30000) {  // ~30 seconds (assuming 1ms sleep)
-            printf("Entering low power mode...\n");
+#if MATRIX_DEEP_SLEEP
+            // Dormant until a key is pressed; scanning is back on return
+            // and the waking press comes out as the next event
+            if (matrix_robust_deep_sleep()) {
+                LOG("Woke up from deep sleep\n");
+            }
+#else
+            LOG("Entering low power mode...\n");
             matrix_robust_enter_low_power();
             
             // Sleep until key press wakes us
             __wfi();  // Wait for interrupt
             
-            printf("Woke up from key press!\n");
+            LOG("Woke up from key press!\n");
             matrix_robust_exit_low_power();
+#endif
             idle_count = 0;
         }
         
@@ -130,4 +444,3 @@ int main() {
     
     return 0;
 }
-
@@ -1,40 +1,50 @@
 #include "matrix.h"
+#include "matrix_debounce.h"
+#include "matrix_keymap.h"
+#include "matrix_gather.h"
 #include "pico/stdlib.h"
 #include <stdio.h>
 #include <string.h>
 
-// Default keymap for 4x4 hex keypad
-static const uint8_t DEFAULT_KEYMAP[4][4] = {
-    {0x1, 0x2, 0x3, 0xA},
-    {0x4, 0x5, 0x6, 0xB},
-    {0x7, 0x8, 0x9, 0xC},
-    {0x0, 0xF, 0xE, 0xD}
-};
-
 // Pin configuration
 static uint8_t row_gpios[MATRIX_ROWS];
 static uint8_t col_gpios[MATRIX_COLS];
 
+// Precomputed SIO masks for single-register row drive and column read
+static uint32_t row_mask = 0;
+static uint32_t row_bits[MATRIX_ROWS];
+static MatrixGather col_gather;
+
 // Current keymap
 static uint8_t keymap[MATRIX_ROWS][MATRIX_COLS];
 
 // Scanning state
 static uint8_t current_row = 0;
-static uint8_t last_key_state[MATRIX_ROWS][MATRIX_COLS];
-static uint8_t debounce_counter[MATRIX_ROWS][MATRIX_COLS];
-static uint8_t current_key_state[MATRIX_ROWS][MATRIX_COLS];
+static DebounceRow debounce_rows[MATRIX_ROWS];     // Debounced state, bit c = column c
+static matrix_row_t reported_state[MATRIX_ROWS];  // State last handed out by matrix_scan()
+static const DebounceConfig debounce_config = {
+    .press_samples = DEBOUNCE_PRESS,
+    .release_samples = DEBOUNCE_RELEASE
+};
 
 // Last detected key for tracking
 static uint8_t last_pressed_row = 0xFF;
 static uint8_t last_pressed_col = 0xFF;
 
-void matrix_init(const uint8_t row_pins[4], const uint8_t col_pins[4]) {
+bool matrix_init(const uint8_t row_pins[MATRIX_ROWS], const uint8_t col_pins[MATRIX_COLS]) {
+    // One SIO word holds every pin
+    for (int i = 0; i < MATRIX_ROWS + MATRIX_COLS; i++) {
+        if (((i < MATRIX_ROWS) ? row_pins[i] : col_pins[i - MATRIX_ROWS]) >= 32) {
+            return false;
+        }
+    }
+    
     // Copy pin assignments
     memcpy(row_gpios, row_pins, MATRIX_ROWS);
     memcpy(col_gpios, col_pins, MATRIX_COLS);
     
     // Copy default keymap
-    memcpy(keymap, DEFAULT_KEYMAP, sizeof(keymap));
+    matrix_default_keymap(keymap);
     
     // Initialize GPIO pins
     // Rows: outputs, start HIGH (inactive)
@@ -51,90 +61,77 @@ void matrix_init(const uint8_t row_pins[4], const uint8_t col_pins[4]) {
         gpio_pull_up(col_gpios[i]);  // Pull-up to avoid floating
     }
     
+    // Precompute port masks for matrix_scan()
+    row_mask = 0;
+    for (int i = 0; i < MATRIX_ROWS; i++) {
+        row_bits[i] = 1u << row_gpios[i];
+        row_mask |= row_bits[i];
+    }
+    matrix_gather_init(&col_gather, col_gpios);
+    
     // Clear state arrays
-    memset(last_key_state, KEY_IDLE, sizeof(last_key_state));
-    memset(current_key_state, KEY_IDLE, sizeof(current_key_state));
-    memset(debounce_counter, 0, sizeof(debounce_counter));
+    for (int row = 0; row < MATRIX_ROWS; row++) {
+        debounce_row_reset(&debounce_rows[row]);
+    }
+    memset(reported_state, 0, sizeof(reported_state));
+    return true;
 }
 
-void matrix_set_keymap(const uint8_t custom_keymap[4][4]) {
+void matrix_set_keymap(const uint8_t custom_keymap[MATRIX_ROWS][MATRIX_COLS]) {
     memcpy(keymap, custom_keymap, sizeof(keymap));
 }
 
-bool matrix_scan(KeyEvent *event) {
-    bool event_detected = false;
+// Hand out one debounced change that has not been reported yet
+// Changes are kept until reported, so several keys changing in one scan
+// come out of consecutive matrix_scan() calls instead of being dropped
+static bool next_event(KeyEvent *event) {
+    if (!event) {
+        return false;
+    }
     
-    // Set all rows HIGH first
-    for (int i = 0; i < MATRIX_ROWS; i++) {
-        gpio_put(row_gpios[i], 1);
+    for (int row = 0; row < MATRIX_ROWS; row++) {
+        matrix_row_t pending = debounce_rows[row].stable ^ reported_state[row];
+        if (pending) {
+            uint8_t col = __builtin_ctz(pending);
+            matrix_row_t bit = (matrix_row_t)(1u << col);
+            
+            reported_state[row] ^= bit;
+            event->key = keymap[row][col];
+            event->state = (debounce_rows[row].stable & bit) ? KEY_PRESSED : KEY_RELEASED;
+            event->row = row;
+            event->col = col;
+            
+            if (event->state == KEY_PRESSED) {
+                last_pressed_row = row;
+                last_pressed_col = col;
+            }
+            return true;
+        }
     }
     
-    // Activate current row (set LOW)
-    gpio_put(row_gpios[current_row], 0);
+    return false;
+}
+
+bool matrix_scan(KeyEvent *event) {
+    // Activate current row (set LOW) with all other rows HIGH, in one write
+    gpio_put_masked(row_mask, row_mask & ~row_bits[current_row]);
     
     // Small delay for signal to settle (critical for fast scanning)
     sleep_us(1);
     
-    // Read all columns for this row
-    for (int col = 0; col < MATRIX_COLS; col++) {
-        bool pressed = !gpio_get(col_gpios[col]);  // LOW = pressed (pulled down by keypress)
-        
-        // Debouncing logic
-        if (pressed) {
-            if (debounce_counter[current_row][col] < DEBOUNCE_PRESS) {
-                debounce_counter[current_row][col]++;
-            }
-        } else {
-            if (debounce_counter[current_row][col] > 0) {
-                debounce_counter[current_row][col]--;
-            }
-        }
-        
-        // Determine current state based on debounce counter
-        uint8_t new_state = KEY_IDLE;
-        if (debounce_counter[current_row][col] >= DEBOUNCE_PRESS) {
-            new_state = KEY_PRESSED;
-        }
-        
-        // Detect state changes
-        if (new_state != last_key_state[current_row][col]) {
-            if (new_state == KEY_PRESSED && last_key_state[current_row][col] == KEY_IDLE) {
-                // Key press detected
-                if (event && !event_detected) {
-                    event->key = keymap[current_row][col];
-                    event->state = KEY_PRESSED;
-                    event->row = current_row;
-                    event->col = col;
-                    event_detected = true;
-                    last_pressed_row = current_row;
-                    last_pressed_col = col;
-                }
-                current_key_state[current_row][col] = KEY_PRESSED;
-            } else if (new_state == KEY_IDLE && last_key_state[current_row][col] == KEY_PRESSED) {
-                // Key release detected
-                if (event && !event_detected) {
-                    event->key = keymap[current_row][col];
-                    event->state = KEY_RELEASED;
-                    event->row = current_row;
-                    event->col = col;
-                    event_detected = true;
-                }
-                current_key_state[current_row][col] = KEY_IDLE;
-            }
-            last_key_state[current_row][col] = new_state;
-        } else if (new_state == KEY_PRESSED && last_key_state[current_row][col] == KEY_PRESSED) {
-            // Key held
-            current_key_state[current_row][col] = KEY_HELD;
-        }
-    }
+    // Read all columns for this row in one read (LOW = pressed)
+    matrix_row_t pressed_cols = matrix_gather(&col_gather, ~gpio_get_all());
+    
+    // Debounce every key of the row at once
+    debounce_row_update(&debounce_rows[current_row], pressed_cols, &debounce_config);
     
     // Deactivate current row
-    gpio_put(row_gpios[current_row], 1);
+    gpio_set_mask(row_bits[current_row]);
     
     // Move to next row
     current_row = (current_row + 1) % MATRIX_ROWS;
     
-    return event_detected;
+    return next_event(event);
 }
 
 uint8_t matrix_get_key(void) {
@@ -165,10 +162,8 @@ uint8_t matrix_get_key(void) {
 
 bool matrix_any_key_pressed(void) {
     for (int row = 0; row < MATRIX_ROWS; row++) {
-        for (int col = 0; col < MATRIX_COLS; col++) {
-            if (current_key_state[row][col] != KEY_IDLE) {
-                return true;
-            }
+        if (debounce_rows[row].stable) {
+            return true;
         }
     }
     return false;
@@ -176,10 +171,15 @@ bool matrix_any_key_pressed(void) {
 
 void matrix_test_pins(void) {
     printf("\n=== Matrix Keypad Pin Tester ===\n");
-    printf("Row pins: GPIO %d, %d, %d, %d\n", 
-           row_gpios[0], row_gpios[1], row_gpios[2], row_gpios[3]);
-    printf("Col pins: GPIO %d, %d, %d, %d\n", 
-           col_gpios[0], col_gpios[1], col_gpios[2], col_gpios[3]);
+    printf("Row pins: GPIO");
+    for (int i = 0; i < MATRIX_ROWS; i++) {
+        printf("%s %d", i ? "," : "", row_gpios[i]);
+    }
+    printf("\nCol pins: GPIO");
+    for (int i = 0; i < MATRIX_COLS; i++) {
+        printf("%s %d", i ? "," : "", col_gpios[i]);
+    }
+    printf("\n");
     printf("\nPress keys on the keypad...\n\n");
     
     while (true) {
@@ -0,0 +1,282 @@
+#include "matrix_pads.h"
+#include "matrix_robust.h"    // SCAN_INTERVAL_US, SCAN_INTERVAL_MIN_US
+#include "hardware/gpio.h"
+#include <string.h>
+
+// Registered pads, in tick order
+static MatrixPad *pads[MATRIX_PADS_MAX];
+static uint8_t pad_count = 0;
+static uint32_t pads_pin_mask = 0;  // GPIOs taken by registered pads
+
+// Row strobes of the batched pass: row r of every pad at once
+static uint32_t all_row_mask = 0;
+static uint32_t all_row_bits[MATRIX_ROWS];
+
+// Shared timer
+static repeating_timer_t pads_timer;
+static volatile bool pads_running = false;
+static uint32_t pads_interval = SCAN_INTERVAL_US;
+
+static bool pads_timer_callback(repeating_timer_t *rt);
+
+static void configure_pad_debounce(MatrixPad *pad) {
+    matrix_engine_configure_debounce(&pad->engine, pad->debounce_mode, pad->debounce_press_ms,
+                                     pad->debounce_release_ms, pads_interval);
+}
+
+bool matrix_pad_init(MatrixPad *pad, const uint8_t row_pins[MATRIX_ROWS],
+                     const uint8_t col_pins[MATRIX_COLS]) {
+    if (pads_running || pad_count >= MATRIX_PADS_MAX) {
+        return false;
+    }
+    
+    // Every pin in SIO bank 0, used once, and by no other pad
+    uint32_t pad_mask = 0;
+    for (int i = 0; i < MATRIX_ROWS + MATRIX_COLS; i++) {
+        uint8_t pin = (i < MATRIX_ROWS) ? row_pins[i] : col_pins[i - MATRIX_ROWS];
+        if (pin >= 32 || (pad_mask & (1u << pin))) {
+            return false;
+        }
+        pad_mask |= 1u << pin;
+    }
+    if (pad_mask & pads_pin_mask) {
+        return false;
+    }
+    
+    memcpy(pad->row_gpios, row_pins, MATRIX_ROWS);
+    memcpy(pad->col_gpios, col_pins, MATRIX_COLS);
+    
+    // Default keymap, empty queues, every key released; burst walk, the
+    // shared tick always samples whole pads
+    matrix_engine_init(&pad->engine);
+    pad->engine.strategy = SCAN_STRATEGY_BURST;
+    pad->debounce_mode = DEBOUNCE_DEFER_PRESS_EAGER_RELEASE;
+    pad->debounce_press_ms = DEBOUNCE_PRESS_MS;
+    pad->debounce_release_ms = DEBOUNCE_RELEASE_MS;
+    configure_pad_debounce(pad);
+    
+    // Rows: outputs, start HIGH (inactive)
+    for (int i = 0; i < MATRIX_ROWS; i++) {
+        gpio_init(pad->row_gpios[i]);
+        gpio_set_dir(pad->row_gpios[i], GPIO_OUT);
+        gpio_put(pad->row_gpios[i], 1);
+    }
+    
+    // Columns: inputs with pull-up resistors
+    for (int i = 0; i < MATRIX_COLS; i++) {
+        gpio_init(pad->col_gpios[i]);
+        gpio_set_dir(pad->col_gpios[i], GPIO_IN);
+        gpio_pull_up(pad->col_gpios[i]);
+    }
+    
+    // Precompute port masks, and merge the rows into the batched strobes
+    pad->row_mask = 0;
+    for (int i = 0; i < MATRIX_ROWS; i++) {
+        pad->row_bits[i] = 1u << pad->row_gpios[i];
+        pad->row_mask |= pad->row_bits[i];
+        all_row_bits[i] |= pad->row_bits[i];
+    }
+    all_row_mask |= pad->row_mask;
+    matrix_gather_init(&pad->col_gather, pad->col_gpios);
+    
+    pad->index = pad_count;
+    pads[pad_count++] = pad;
+    pads_pin_mask |= pad_mask;
+    return true;
+}
+
+void matrix_pads_clear(void) {
+    if (pads_running) {
+        return;
+    }
+    
+    for (int p = 0; p < pad_count; p++) {
+        matrix_gather_release(&pads[p]->col_gather);
+    }
+    pad_count = 0;
+    pads_pin_mask = 0;
+    all_row_mask = 0;
+    memset(all_row_bits, 0, sizeof(all_row_bits));
+}
+
+uint8_t matrix_pads_count(void) {
+    return pad_count;
+}
+
+bool matrix_pads_start(uint32_t scan_interval_us) {
+    if (pads_running) {
+        return true;
+    }
+    
+    if (scan_interval_us < SCAN_INTERVAL_MIN_US) {
+        scan_interval_us = SCAN_INTERVAL_MIN_US;
+    }
+    pads_interval = scan_interval_us;
+    
+    for (uint8_t p = 0; p < pad_count; p++) {
+        configure_pad_debounce(pads[p]);
+        matrix_engine_restart(&pads[p]->engine);
+    }
+    
+    // Negative delay = fixed rate (start to start)
+    pads_running = add_repeating_timer_us(-(int64_t)pads_interval, pads_timer_callback,
+                                          NULL, &pads_timer);
+    return pads_running;
+}
+
+void matrix_pads_stop(void) {
+    if (!pads_running) {
+        return;
+    }
+    
+    cancel_repeating_timer(&pads_timer);
+    gpio_set_mask(all_row_mask);
+    pads_running = false;
+}
+
+// One shared tick: sample every pad in one pass over the rows, then run
+// each pad's engine over its snapshot
+static bool pads_timer_callback(repeating_timer_t *rt) {
+    uint32_t scan_start = time_us_32();
+    matrix_row_t pressed_cols[MATRIX_PADS_MAX][MATRIX_ROWS];
+    
+    gpio_set_mask(all_row_mask);
+    for (int row = 0; row < MATRIX_ROWS; row++) {
+        // Row LOW on every pad, all other rows HIGH, in one write
+        gpio_put_masked(all_row_mask, all_row_mask & ~all_row_bits[row]);
+        busy_wait_us(1);
+        
+        // One read holds every pad's columns (LOW = pressed)
+        uint32_t port = ~gpio_get_all();
+        gpio_set_mask(all_row_bits[row]);
+        
+        for (uint8_t p = 0; p < pad_count; p++) {
+            pressed_cols[p][row] = matrix_gather(&pads[p]->col_gather, port);
+        }
+    }
+    
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+    for (uint8_t p = 0; p < pad_count; p++) {
+        MatrixEngine *e = &pads[p]->engine;
+        matrix_engine_tick_begin(e, scan_start, pads_interval);
+        e->stats.total_scans++;
+        for (int row = 0; row < MATRIX_ROWS; row++) {
+            matrix_engine_process_row(e, row, pressed_cols[p][row], now, scan_start);
+        }
+        matrix_engine_tick_end(e, scan_start, pads_interval);
+    }
+    
+    return true;  // Keep repeating
+}
+
+bool matrix_pads_get_event(KeyEvent *event, uint8_t *pad_index) {
+    MatrixPad *oldest = NULL;
+    uint32_t oldest_us = 0;
+    
+    // Compare the head of every ring without taking it
+    for (uint8_t p = 0; p < pad_count; p++) {
+        void *span;
+        if (!matrix_ring_peek_span(&pads[p]->engine.event_queue, &span)) {
+            continue;
+        }
+        uint32_t confirm_us = ((const KeyEvent *)span)->confirm_us;
+        if (!oldest || (int32_t)(confirm_us - oldest_us) < 0) {
+            oldest = pads[p];
+            oldest_us = confirm_us;
+        }
+    }
+    
+    if (!oldest || !matrix_engine_get_event(&oldest->engine, event)) {
+        return false;
+    }
+    if (pad_index) {
+        *pad_index = oldest->index;
+    }
+    return true;
+}
+
+void matrix_pad_set_keymap(MatrixPad *pad, const uint8_t keymap[MATRIX_ROWS][MATRIX_COLS]) {
+    memcpy(pad->engine.keymap, keymap, sizeof(pad->engine.keymap));
+}
+
+bool matrix_pad_set_debounce(MatrixPad *pad, DebounceMode mode, uint32_t press_ms, uint32_t release_ms) {
+    if (pads_running) {
+        return false;
+    }
+    
+    pad->debounce_mode = mode;
+    pad->debounce_press_ms = press_ms;
+    pad->debounce_release_ms = release_ms;
+    configure_pad_debounce(pad);
+    return true;
+}
+
+bool matrix_pad_set_repeat(MatrixPad *pad, uint32_t delay_ms, uint32_t interval_ms,
+                           uint32_t min_interval_ms, uint32_t accel_ms) {
+    if (pads_running) {
+        return false;
+    }
+    
+    RepeatConfig config = {
+        .delay_ms = delay_ms,
+        .interval_ms = interval_ms,
+        .min_interval_ms = min_interval_ms,
+        .accel_ms = accel_ms
+    };
+    matrix_engine_configure_repeat(&pad->engine, &config);
+    return true;
+}
+
+bool matrix_pad_set_gestures(MatrixPad *pad, MatrixGestures *gestures) {
+    if (pads_running) {
+        return false;
+    }
+    
+    pad->engine.gestures = gestures;
+    return true;
+}
+
+void matrix_pad_set_key_callback(MatrixPad *pad, KeyEventCallback callback) {
+    pad->engine.key_callback = callback;
+}
+
+void matrix_pad_set_error_callback(MatrixPad *pad, ErrorCallback callback) {
+    pad->engine.error_callback = callback;
+}
+
+void matrix_pad_set_ghost_detection(MatrixPad *pad, bool enable) {
+    pad->engine.ghost_detection_enabled = enable;
+}
+
+void matrix_pad_set_stuck_detection(MatrixPad *pad, bool enable, uint32_t timeout_ms) {
+    pad->engine.stuck_detection_enabled = enable;
+    pad->engine.stuck_key_timeout = timeout_ms;
+}
+
+bool matrix_pad_get_event(MatrixPad *pad, KeyEvent *event) {
+    return matrix_engine_get_event(&pad->engine, event);
+}
+
+size_t matrix_pad_get_events(MatrixPad *pad, KeyEvent *events, size_t max) {
+    return matrix_engine_get_events(&pad->engine, events, max);
+}
+
+bool matrix_pad_get_error(MatrixPad *pad, ErrorEvent *error) {
+    return matrix_engine_get_error(&pad->engine, error);
+}
+
+bool matrix_pad_any_key_pressed(const MatrixPad *pad) {
+    return pad->engine.pressed_count != 0;
+}
+
+void matrix_pad_get_matrix(const MatrixPad *pad, matrix_row_t matrix[MATRIX_ROWS]) {
+    matrix_engine_get_matrix(&pad->engine, matrix);
+}
+
+void matrix_pad_get_statistics(const MatrixPad *pad, ScanStatistics *stats) {
+    matrix_engine_get_statistics(&pad->engine, stats);
+}
+
+void matrix_pad_reset_statistics(MatrixPad *pad) {
+    matrix_engine_reset_statistics(&pad->engine);
+}
@@ -1,86 +1,100 @@
 #include "matrix_robust.h"
+#include "matrix_scan_pio.h"
+#include "matrix_scan_shift.h"
+#include "matrix_hal.h"
+#include "matrix_gather.h"
 #include "hardware/gpio.h"
 #include "hardware/sync.h"
-#include <stdio.h>
+#include "hardware/clocks.h"
+#include "hardware/pll.h"
+#include "hardware/xosc.h"
+#include "hardware/structs/rosc.h"
+#include "pico/multicore.h"
+#include "pico/runtime_init.h"
 #include <string.h>
 
-// Event queue configuration
-#define EVENT_QUEUE_SIZE 32
-#define ERROR_QUEUE_SIZE 8
-
-// Default keymap
-static const uint8_t DEFAULT_KEYMAP[4][4] = {
-    {0x1, 0x2, 0x3, 0xA},
-    {0x4, 0x5, 0x6, 0xB},
-    {0x7, 0x8, 0x9, 0xC},
-    {0x0, 0xF, 0xE, 0xD}
-};
-
 // Pin configuration
 static uint8_t row_gpios[MATRIX_ROWS];
 static uint8_t col_gpios[MATRIX_COLS];
 
-// Current keymap
-static uint8_t keymap[MATRIX_ROWS][MATRIX_COLS];
+// Precomputed SIO masks: rows are driven with one masked write and the
+// columns sampled with one gpio_get_all() read
+static uint32_t row_mask = 0;
+static uint32_t row_bits[MATRIX_ROWS];
+static MatrixGather col_gather;
+
+// Key engine: debounce, detection, event queues, statistics
+static MatrixEngine engine;
 
-// Scanning state (accessed in ISR)
-static volatile uint8_t current_row = 0;
-static volatile uint8_t key_state[MATRIX_ROWS][MATRIX_COLS];
-static volatile uint32_t key_timestamp[MATRIX_ROWS][MATRIX_COLS];
+// Debounce settings (the sample period follows the scan setup)
 static volatile uint32_t debounce_time_press = DEBOUNCE_PRESS_MS;
 static volatile uint32_t debounce_time_release = DEBOUNCE_RELEASE_MS;
-
-// Event queues (circular buffers)
-static KeyEvent event_queue[EVENT_QUEUE_SIZE];
-static volatile uint32_t event_queue_head = 0;
-static volatile uint32_t event_queue_tail = 0;
-static mutex_t event_mutex;
-
-static ErrorEvent error_queue[ERROR_QUEUE_SIZE];
-static volatile uint32_t error_queue_head = 0;
-static volatile uint32_t error_queue_tail = 0;
-static mutex_t error_mutex;
-
-// Callbacks
-static volatile KeyEventCallback key_callback = NULL;
-static volatile ErrorCallback error_callback = NULL;
+static DebounceMode debounce_mode = DEBOUNCE_DEFER_PRESS_EAGER_RELEASE;
 
 // Timer
 static repeating_timer_t scan_timer;
 static volatile bool scanning_active = false;
 static uint32_t scan_interval = SCAN_INTERVAL_US;
-
-// Feature flags
-static volatile bool ghost_detection_enabled = true;
-static volatile bool stuck_detection_enabled = true;
-static volatile uint32_t stuck_key_timeout = STUCK_KEY_TIMEOUT_MS;
-
-// Statistics
-static volatile ScanStatistics stats = {0};
-static volatile uint32_t last_scan_start = 0;
-
-// Ghost key detection buffer
-static volatile uint8_t pressed_keys[MATRIX_ROWS][MATRIX_COLS];
+static ScanBackend scan_backend = SCAN_BACKEND_TIMER;
+
+// Adaptive scan rate (timer backend; slow interval 0 = off)
+static uint32_t adaptive_slow_interval = 0;
+static uint32_t adaptive_decay_ms = ADAPTIVE_DECAY_MS;
+
+// Scan core (core 1 gets its own alarm pool and takes commands through a
+// shared mailbox, woken by __sev(); the inter-core FIFO is left to
+// multicore lockout, which pauses core 1 for flash writes)
+#define SCAN_CORE_CMD_NONE  0
+#define SCAN_CORE_CMD_START 1
+#define SCAN_CORE_CMD_STOP  2
+static volatile ScanCore scan_core = SCAN_CORE_0;
+static bool core1_launched = false;
+static alarm_pool_t *core1_alarm_pool = NULL;
+static volatile bool core1_ready = false;
+static volatile uint32_t core1_cmd = SCAN_CORE_CMD_NONE;  // Cleared by core 1 once done
+static volatile uint32_t core1_result = 0;
+
+// Auto idle (scanning stopped until a column edge)
+static volatile bool auto_idle_enabled = false;
+static volatile uint32_t auto_idle_timeout = AUTO_IDLE_TIMEOUT_MS;
+static volatile bool idle_sleeping = false;
+static uint32_t last_activity = 0;
+
+// Deep sleep: the first start after a wake-up samples the matrix at once
+static volatile bool wake_sample_pending = false;
 
 // Forward declarations
 static bool scan_timer_callback(repeating_timer_t *rt);
+static bool pio_drain_callback(repeating_timer_t *rt);
+static uint32_t timer_interval(void);
+static void update_debounce_config(void);
+static bool start_scanning(void);
+static void stop_scanning(void);
+static void start_pio_backend(void);
+static void stop_pio_backend(void);
+static bool resume_scanning(void);
+static void halt_scanning(void);
+static bool run_on_scan_core(uint32_t cmd);
+static void core1_scan_entry(void);
+static bool auto_idle_due(uint32_t now);
+static bool enter_auto_idle(void);
 static void gpio_interrupt_callback(uint gpio, uint32_t events);
-static bool enqueue_event(KeyEvent *event);
-static bool enqueue_error(ErrorEvent *error);
-static bool detect_ghost_key(uint8_t row, uint8_t col);
-static bool detect_stuck_key(uint8_t row, uint8_t col, uint32_t now);
+static uint32_t dormant_until_column_low(void);
 
-void matrix_robust_init(const uint8_t row_pins[4], const uint8_t col_pins[4], uint32_t scan_interval_us) {
+bool matrix_robust_init(const uint8_t row_pins[MATRIX_ROWS], const uint8_t col_pins[MATRIX_COLS], uint32_t scan_interval_us) {
+    // One SIO word holds every pin
+    for (int i = 0; i < MATRIX_ROWS + MATRIX_COLS; i++) {
+        if (((i < MATRIX_ROWS) ? row_pins[i] : col_pins[i - MATRIX_ROWS]) >= 32) {
+            return false;
+        }
+    }
+    
     // Copy pin assignments
     memcpy(row_gpios, row_pins, MATRIX_ROWS);
     memcpy(col_gpios, col_pins, MATRIX_COLS);
     
-    // Copy default keymap
-    memcpy(keymap, DEFAULT_KEYMAP, sizeof(keymap));
-    
-    // Initialize mutexes
-    mutex_init(&event_mutex);
-    mutex_init(&error_mutex);
+    // Default keymap, empty queues, every key released
+    matrix_engine_init(&engine);
     
     // Initialize GPIO pins
     // Rows: outputs, start HIGH (inactive)
@@ -97,54 +111,336 @@ void matrix_robust_init(const uint8_t row_pins[4], const uint8_t col_pins[4], ui
         gpio_pull_up(col_gpios[i]);
     }
     
-    // Clear state arrays
-    memset((void*)key_state, KEY_IDLE, sizeof(key_state));
-    memset((void*)key_timestamp, 0, sizeof(key_timestamp));
-    memset((void*)pressed_keys, 0, sizeof(pressed_keys));
+    // Precompute port masks for the scan path
+    row_mask = 0;
+    for (int i = 0; i < MATRIX_ROWS; i++) {
+        row_bits[i] = 1u << row_gpios[i];
+        row_mask |= row_bits[i];
+    }
+    matrix_gather_init(&col_gather, col_gpios);
     
-    // Store scan interval
+    // Store scan interval (the PIO row period as given, the timer tick
+    // clamped when it is used)
     scan_interval = scan_interval_us;
+    update_debounce_config();
+    return true;
+}
+
+bool matrix_robust_init_shift_register(const MatrixShiftPins *pins, uint32_t row_period_us) {
+    matrix_engine_init(&engine);
+    
+    // No row or column GPIOs: the scan path and the wake edges are unused
+    row_mask = 0;
+    
+    if (!matrix_scan_shift_init(pins, row_period_us)) {
+        return false;
+    }
     
-    printf("Robust matrix keypad initialized (scan rate: %d Hz)\n", 
-           1000000 / scan_interval_us);
+    scan_interval = row_period_us;
+    scan_backend = SCAN_BACKEND_SHIFT_REG;
+    update_debounce_config();
+    return true;
 }
 
-void matrix_robust_set_keymap(const uint8_t custom_keymap[4][4]) {
-    memcpy(keymap, custom_keymap, sizeof(keymap));
+void matrix_robust_set_keymap(const uint8_t custom_keymap[MATRIX_ROWS][MATRIX_COLS]) {
+    memcpy(engine.keymap, custom_keymap, sizeof(engine.keymap));
 }
 
-void matrix_robust_start(void) {
-    if (!scanning_active) {
-        // Start repeating timer for scanning
-        // Convert microseconds to milliseconds (1000us = 1ms)
-        int32_t interval_ms = scan_interval / 1000;
-        printf("Attempting to start timer with interval: %d ms\n", interval_ms);
-        bool timer_ok = add_repeating_timer_ms(interval_ms, scan_timer_callback, NULL, &scan_timer);
-        if (timer_ok) {
-            scanning_active = true;
-            printf("✅ Scanning started successfully!\n");
-        } else {
-            printf("❌ ERROR: Failed to start timer!\n");
+bool matrix_robust_set_backend(ScanBackend backend) {
+    if (scanning_active) {
+        return false;
+    }
+    
+    // A shift-register panel has no row and column pins to fall back on
+    if ((backend == SCAN_BACKEND_SHIFT_REG) != (scan_backend == SCAN_BACKEND_SHIFT_REG)) {
+        return false;
+    }
+    
+    if (backend == SCAN_BACKEND_PIO &&
+        !matrix_scan_pio_init(row_gpios, col_gpios, scan_interval)) {
+        return false;
+    }
+    
+    scan_backend = backend;
+    update_debounce_config();
+    return true;
+}
+
+bool matrix_robust_set_scan_strategy(ScanStrategy strategy) {
+    if (scanning_active) {
+        return false;
+    }
+    
+    engine.strategy = strategy;
+    update_debounce_config();
+    return true;
+}
+
+bool matrix_robust_set_debounce(DebounceMode mode, uint32_t press_ms, uint32_t release_ms) {
+    if (scanning_active) {
+        return false;
+    }
+    
+    debounce_mode = mode;
+    debounce_time_press = press_ms;
+    debounce_time_release = release_ms;
+    update_debounce_config();
+    return true;
+}
+
+bool matrix_robust_set_adaptive_rate(uint32_t slow_interval_us, uint32_t decay_ms) {
+    if (scanning_active) {
+        return false;
+    }
+    
+    // A slow rate that is not slower than the scan interval is no rate change
+    adaptive_slow_interval = (slow_interval_us > timer_interval()) ? slow_interval_us : 0;
+    adaptive_decay_ms = decay_ms;
+    return true;
+}
+
+bool matrix_robust_set_repeat(uint32_t delay_ms, uint32_t interval_ms,
+                              uint32_t min_interval_ms, uint32_t accel_ms) {
+    if (scanning_active) {
+        return false;
+    }
+    
+    RepeatConfig config = {
+        .delay_ms = delay_ms,
+        .interval_ms = interval_ms,
+        .min_interval_ms = min_interval_ms,
+        .accel_ms = accel_ms
+    };
+    matrix_engine_configure_repeat(&engine, &config);
+    return true;
+}
+
+// Timer tick interval (the PIO backends use scan_interval as their row
+// period, which may be far shorter than a timer callback can run)
+static uint32_t timer_interval(void) {
+    return (scan_interval < SCAN_INTERVAL_MIN_US) ? SCAN_INTERVAL_MIN_US : scan_interval;
+}
+
+// Convert the debounce times into sample counts for the current scan setup
+static void update_debounce_config(void) {
+    uint32_t sample_period_us;
+    
+    if (scan_backend != SCAN_BACKEND_TIMER) {
+        sample_period_us = PIO_DRAIN_INTERVAL_US;  // One combined sample per drain
+    } else if (engine.strategy == SCAN_STRATEGY_BURST) {
+        sample_period_us = timer_interval();
+    } else {
+        sample_period_us = timer_interval() * MATRIX_ROWS;
+    }
+    
+    matrix_engine_configure_debounce(&engine, debounce_mode,
+                                     debounce_time_press, debounce_time_release, sample_period_us);
+}
+
+// Start the active backend (no logging, safe from interrupt context)
+static bool start_scanning(void) {
+    alarm_pool_t *pool = (scan_core == SCAN_CORE_1) ? core1_alarm_pool : alarm_pool_get_default();
+    bool timer_ok;
+    
+    last_activity = to_ms_since_boot(get_absolute_time());
+    
+    // The PIO backends scan without the CPU, only the timer tick adapts
+    AdaptiveRateConfig rate = {
+        .fast_us = timer_interval(),
+        .slow_us = (scan_backend == SCAN_BACKEND_TIMER) ? adaptive_slow_interval : 0,
+        .decay_ms = adaptive_decay_ms
+    };
+    matrix_engine_configure_adaptive_rate(&engine, &rate);
+    matrix_engine_restart(&engine);
+    
+    // The key that ended a deep sleep is read now, not one tick later
+    // (the PIO backends capture it in their first drain)
+    if (wake_sample_pending) {
+        wake_sample_pending = false;
+        if (scan_backend == SCAN_BACKEND_TIMER) {
+            matrix_engine_scan_all(&engine, matrix_engine_tick_interval(&engine));
+        }
+    }
+    
+    if (scan_backend != SCAN_BACKEND_TIMER) {
+        // PIO does the scanning, the timer only drains snapshots
+        start_pio_backend();
+        timer_ok = alarm_pool_add_repeating_timer_us(pool, -(int64_t)PIO_DRAIN_INTERVAL_US,
+                                                     pio_drain_callback, NULL, &scan_timer);
+        if (!timer_ok) {
+            stop_pio_backend();
         }
     } else {
-        printf("Already scanning\n");
+        // Start repeating timer for scanning
+        // Negative delay = fixed rate (start to start), so ISR time
+        // does not stretch the scan period
+        timer_ok = alarm_pool_add_repeating_timer_us(pool, -(int64_t)timer_interval(),
+                                                     scan_timer_callback, NULL, &scan_timer);
     }
+    
+    scanning_active = timer_ok;
+    return timer_ok;
 }
 
-void matrix_robust_stop(void) {
+static void stop_scanning(void) {
+    cancel_repeating_timer(&scan_timer);
+    stop_pio_backend();
+    scanning_active = false;
+    
+    // Nothing ticks now, so hand out what the trace holds
+    if (engine.trace) {
+        matrix_trace_close(engine.trace);
+    }
+}
+
+// The two PIO backends (each ignores start/stop when not set up)
+static void start_pio_backend(void) {
+    if (scan_backend == SCAN_BACKEND_SHIFT_REG) {
+        matrix_scan_shift_start();
+    } else if (scan_backend == SCAN_BACKEND_PIO) {
+        matrix_scan_pio_start();
+    }
+}
+
+static void stop_pio_backend(void) {
+    if (scan_backend == SCAN_BACKEND_SHIFT_REG) {
+        matrix_scan_shift_stop();
+    } else if (scan_backend == SCAN_BACKEND_PIO) {
+        matrix_scan_pio_stop();
+    }
+}
+
+// Start scanning, or wake from auto idle (runs on the scan core)
+static bool resume_scanning(void) {
+    if (idle_sleeping) {
+        // Stopped by auto idle: the timer is already gone
+        matrix_robust_disable_wake_interrupt();
+        idle_sleeping = false;
+    }
+    
+    if (scanning_active) {
+        return true;
+    }
+    return start_scanning();
+}
+
+// Stop scanning, including an auto idle wait (runs on the scan core)
+static void halt_scanning(void) {
+    if (idle_sleeping) {
+        matrix_robust_disable_wake_interrupt();
+        idle_sleeping = false;
+    } else if (scanning_active) {
+        stop_scanning();
+    }
+}
+
+// Core 1 main loop: own alarm pool (its timer IRQs fire on core 1), then
+// serve start/stop requests from core 0. It sleeps in __wfe() between
+// requests, so the lockout handler on its FIFO interrupt can still pause it.
+static void core1_scan_entry(void) {
+    // Let flash writes (matrix_settings_flash_save()) pause this core
+    multicore_lockout_victim_init();
+    core1_alarm_pool = alarm_pool_create_with_unused_hardware_alarm(SCAN_CORE1_MAX_TIMERS);
+    __dmb();
+    core1_ready = true;
+    __sev();
+    
+    while (true) {
+        uint32_t cmd;
+        while ((cmd = core1_cmd) == SCAN_CORE_CMD_NONE) {
+            __wfe();
+        }
+        uint32_t result = 1;
+        
+        if (cmd == SCAN_CORE_CMD_START) {
+            result = resume_scanning();
+        } else if (cmd == SCAN_CORE_CMD_STOP) {
+            halt_scanning();
+        }
+        
+        core1_result = result;
+        __dmb();
+        core1_cmd = SCAN_CORE_CMD_NONE;
+        __sev();
+    }
+}
+
+// Run a start/stop request on the core that owns the scan timer
+static bool run_on_scan_core(uint32_t cmd) {
+    if (scan_core == SCAN_CORE_1) {
+        core1_cmd = cmd;
+        __sev();
+        while (core1_cmd != SCAN_CORE_CMD_NONE) {
+            __wfe();
+        }
+        __dmb();
+        return core1_result != 0;
+    }
+    
+    if (cmd == SCAN_CORE_CMD_START) {
+        return resume_scanning();
+    }
+    halt_scanning();
+    return true;
+}
+
+bool matrix_robust_set_scan_core(ScanCore core) {
+    if (scanning_active || idle_sleeping) {
+        return false;
+    }
+    
+    if (core == SCAN_CORE_1) {
+        if (!core1_launched) {
+            multicore_launch_core1(core1_scan_entry);
+            while (!core1_ready) {
+                __wfe();  // Alarm pool set up (or failed)
+            }
+            __dmb();
+            core1_launched = true;
+        }
+        if (core1_alarm_pool == NULL) {
+            return false;  // No free hardware alarm for core 1
+        }
+    }
+    
+    scan_core = core;
+    return true;
+}
+
+bool matrix_robust_start(void) {
     if (scanning_active) {
-        cancel_repeating_timer(&scan_timer);
-        scanning_active = false;
-        printf("Scanning stopped\n");
+        return true;
+    }
+    
+    return run_on_scan_core(SCAN_CORE_CMD_START);
+}
+
+void matrix_robust_stop(void) {
+    if (scanning_active || idle_sleeping) {
+        run_on_scan_core(SCAN_CORE_CMD_STOP);
     }
 }
 
+void matrix_robust_set_auto_idle(bool enable, uint32_t idle_timeout_ms) {
+    auto_idle_timeout = idle_timeout_ms;
+    auto_idle_enabled = enable;
+    
+    if (!enable && idle_sleeping) {
+        // Nobody would wake us any more without a keypress, resume now
+        matrix_robust_start();
+    }
+}
+
+bool matrix_robust_is_idle(void) {
+    return idle_sleeping;
+}
+
 void matrix_robust_set_key_callback(KeyEventCallback callback) {
-    key_callback = callback;
+    engine.key_callback = callback;
 }
 
 void matrix_robust_set_error_callback(ErrorCallback callback) {
-    error_callback = callback;
+    engine.error_callback = callback;
 }
 
 // Debug counter to verify callback is being called
@@ -153,258 +449,245 @@ static volatile uint32_t debug_callback_count = 0;
 static bool scan_timer_callback(repeating_timer_t *rt) {
     debug_callback_count++;  // Increment every time ISR fires
     
-    uint32_t scan_start = time_us_32();
-    stats.total_scans++;
+    uint32_t interval = matrix_engine_tick_interval(&engine);
+    matrix_engine_scan(&engine, interval);
     
-    // Set all rows HIGH first
-    for (int i = 0; i < MATRIX_ROWS; i++) {
-        gpio_put(row_gpios[i], 1);
+    // Adaptive rate: the SDK takes the next delay from rt after the callback
+    uint32_t next_interval = matrix_engine_tick_interval(&engine);
+    if (next_interval != interval) {
+        rt->delay_us = -(int64_t)next_interval;
     }
     
-    // Activate current row (set LOW)
-    gpio_put(row_gpios[current_row], 0);
+    // Returning false cancels this repeating timer
+    if (auto_idle_due(to_ms_since_boot(get_absolute_time())) && enter_auto_idle()) {
+        return false;
+    }
+    
+    return true;  // Keep repeating
+}
+
+// Hardware hooks for the key engine (matrix_hal.h)
+uint32_t matrix_hal_time_us(void) {
+    return time_us_32();
+}
+
+uint32_t matrix_hal_time_ms(void) {
+    return to_ms_since_boot(get_absolute_time());
+}
+
+void matrix_hal_rows_idle(void) {
+    gpio_set_mask(row_mask);
+}
+
+// Strobe one row and sample its columns (rows must all be HIGH on entry)
+matrix_row_t matrix_hal_read_row(uint8_t row) {
+    // Activate row (set LOW), every other row HIGH, in one write
+    gpio_put_masked(row_mask, row_mask & ~row_bits[row]);
     
     // Small delay for signal settling
     busy_wait_us(1);
     
-    uint32_t now = to_ms_since_boot(get_absolute_time());
+    // Read all columns for this row in one read (LOW = pressed)
+    matrix_row_t pressed_cols = matrix_gather(&col_gather, ~gpio_get_all());
     
-    // Read all columns for this row
-    for (int col = 0; col < MATRIX_COLS; col++) {
-        bool pressed = !gpio_get(col_gpios[col]);  // LOW = pressed
-        uint8_t current_state = key_state[current_row][col];
-        uint32_t last_change = key_timestamp[current_row][col];
-        
-        // State machine with debouncing
-        if (pressed) {
-            if (current_state == KEY_IDLE && last_change == 0) {
-                // First detection of press - start debounce timer
-                key_timestamp[current_row][col] = now;
-                // Stay in IDLE state
-            } else if (current_state == KEY_IDLE && last_change != 0 && (now - last_change) >= debounce_time_press) {
-                // Debounced press confirmed
-                
-                // Ghost key detection
-                if (ghost_detection_enabled && detect_ghost_key(current_row, col)) {
-                    ErrorEvent error = {
-                        .error_code = ERROR_GHOST_KEY,
-                        .row = current_row,
-                        .col = col,
-                        .timestamp = now
-                    };
-                    enqueue_error(&error);
-                    continue;
-                }
-                
-                // Create press event
-                KeyEvent event = {
-                    .key = keymap[current_row][col],
-                    .state = KEY_PRESSED,
-                    .row = current_row,
-                    .col = col,
-                    .timestamp = now
-                };
-                
-                key_state[current_row][col] = KEY_PRESSED;
-                pressed_keys[current_row][col] = 1;
-                
-                // Enqueue or call callback
-                if (key_callback) {
-                    key_callback(&event);
-                } else {
-                    enqueue_event(&event);
-                }
-                
-                stats.total_events++;
-            } else if (current_state == KEY_PRESSED) {
-                // Key is held
-                key_state[current_row][col] = KEY_HELD;
-                
-                // Stuck key detection
-                if (stuck_detection_enabled && detect_stuck_key(current_row, col, now)) {
-                    ErrorEvent error = {
-                        .error_code = ERROR_STUCK_KEY,
-                        .row = current_row,
-                        .col = col,
-                        .timestamp = now
-                    };
-                    enqueue_error(&error);
-                }
-            }
-        } else {
-            // Key not pressed - immediate release (no debounce for now)
-            if (current_state == KEY_PRESSED || current_state == KEY_HELD) {
-                KeyEvent event = {
-                    .key = keymap[current_row][col],
-                    .state = KEY_RELEASED,
-                    .row = current_row,
-                    .col = col,
-                    .timestamp = now
-                };
-                
-                key_state[current_row][col] = KEY_IDLE;
-                pressed_keys[current_row][col] = 0;
-                key_timestamp[current_row][col] = 0;  // Reset timestamp
-                
-                // Enqueue or call callback
-                if (key_callback) {
-                    key_callback(&event);
-                } else {
-                    enqueue_event(&event);
-                }
-                
-                stats.total_events++;
+    // Deactivate row
+    gpio_set_mask(row_bits[row]);
+    
+    return pressed_cols;
+}
+
+// PIO backend: drain raw snapshots from the DMA ring and debounce them
+// The PIO samples far faster than debounce needs, so every row is folded
+// into one sample per drain (matrix_engine_process_batch)
+static bool pio_drain_callback(repeating_timer_t *rt) {
+    uint32_t scan_start = time_us_32();
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+    uint32_t snapshots[PIO_DRAIN_BATCH];
+    uint32_t count;
+    matrix_row_t any_pressed[MATRIX_ROWS] = {0};
+    matrix_row_t all_pressed[MATRIX_ROWS];
+    uint32_t rows_seen = 0;
+    
+    matrix_engine_tick_begin(&engine, scan_start, PIO_DRAIN_INTERVAL_US);
+    memset(all_pressed, 0xFF, sizeof(all_pressed));
+    
+    bool shift = (scan_backend == SCAN_BACKEND_SHIFT_REG);
+    while ((count = shift ? matrix_scan_shift_read(snapshots, PIO_DRAIN_BATCH)
+                          : matrix_scan_pio_read(snapshots, PIO_DRAIN_BATCH)) > 0) {
+        for (uint32_t i = 0; i < count; i++) {
+            uint8_t row = shift ? SHIFT_SNAPSHOT_ROW(snapshots[i]) : PIO_SNAPSHOT_ROW(snapshots[i]);
+            if (row >= MATRIX_ROWS) {
+                continue;
             }
+            
+            // Column inputs are active LOW
+            matrix_row_t pressed_cols = shift ? matrix_scan_shift_columns(snapshots[i])
+                                              : (~PIO_SNAPSHOT_COLS(snapshots[i]) & MATRIX_COL_MASK);
+            any_pressed[row] |= pressed_cols;
+            all_pressed[row] &= pressed_cols;
+            rows_seen |= (1u << row);
+            engine.stats.total_scans++;
         }
     }
     
-    // Deactivate current row
-    gpio_put(row_gpios[current_row], 1);
+    for (int row = 0; row < MATRIX_ROWS; row++) {
+        if (rows_seen & (1u << row)) {
+            matrix_engine_process_batch(&engine, row, any_pressed[row], all_pressed[row], now, scan_start);
+        }
+    }
     
-    // Move to next row
-    current_row = (current_row + 1) % MATRIX_ROWS;
+    matrix_engine_tick_end(&engine, scan_start, PIO_DRAIN_INTERVAL_US);
     
-    // Update scan time statistics
-    uint32_t scan_time = time_us_32() - scan_start;
-    if (scan_time > stats.max_scan_time_us) {
-        stats.max_scan_time_us = scan_time;
+    // Returning false cancels this repeating timer
+    if (auto_idle_due(now)) {
+        stop_pio_backend();
+        if (enter_auto_idle()) {
+            return false;
+        }
+        start_pio_backend();
     }
-    stats.avg_scan_time_us = ((stats.avg_scan_time_us * (stats.total_scans - 1)) + scan_time) / stats.total_scans;
     
     return true;  // Keep repeating
 }
 
-static bool enqueue_event(KeyEvent *event) {
-    uint32_t next_head = (event_queue_head + 1) % EVENT_QUEUE_SIZE;
-    
-    if (next_head == event_queue_tail) {
-        // Queue full
-        stats.queue_overflows++;
+// True once auto idle is on and every key has been released (nothing
+// pressed, blocked or in debounce) for auto_idle_timeout
+static bool auto_idle_due(uint32_t now) {
+    // Shift-register panels have no column edges to wake on
+    if (!auto_idle_enabled || scan_backend == SCAN_BACKEND_SHIFT_REG) {
         return false;
     }
     
-    event_queue[event_queue_head] = *event;
-    event_queue_head = next_head;
+    if (!matrix_engine_quiet(&engine)) {
+        last_activity = now;
+        return false;
+    }
     
-    return true;
+    return (now - last_activity) >= auto_idle_timeout;
 }
 
-static bool enqueue_error(ErrorEvent *error) {
-    uint32_t next_head = (error_queue_head + 1) % ERROR_QUEUE_SIZE;
+// Park the matrix for edge wake (called from the scan timer, which stops
+// itself when this returns true; the PIO backend must already be stopped)
+static bool enter_auto_idle(void) {
+    matrix_robust_enable_wake_interrupt();
     
-    if (next_head == error_queue_tail) {
+    // A key that went down before the edge interrupt was armed would never
+    // produce its edge, so keep scanning if any column is already LOW
+    busy_wait_us(1);
+    if ((gpio_get_all() & col_gather.port_mask) != col_gather.port_mask) {
+        matrix_robust_disable_wake_interrupt();
         return false;
     }
     
-    error_queue[error_queue_head] = *error;
-    error_queue_head = next_head;
-    stats.total_errors++;
-    
-    if (error_callback) {
-        error_callback(error);
+    scanning_active = false;
+    idle_sleeping = true;
+    matrix_engine_count_idle(&engine);
+    if (engine.trace) {
+        matrix_trace_close(engine.trace);
     }
-    
     return true;
 }
 
 bool matrix_robust_get_event(KeyEvent *event) {
-    mutex_enter_blocking(&event_mutex);
-    
-    if (event_queue_head == event_queue_tail) {
-        mutex_exit(&event_mutex);
-        return false;  // Queue empty
-    }
-    
-    *event = event_queue[event_queue_tail];
-    event_queue_tail = (event_queue_tail + 1) % EVENT_QUEUE_SIZE;
-    
-    mutex_exit(&event_mutex);
-    return true;
+    return matrix_engine_get_event(&engine, event);
+}
+
+size_t matrix_robust_get_events(KeyEvent *events, size_t max) {
+    return matrix_engine_get_events(&engine, events, max);
+}
+
+size_t matrix_robust_peek_events(const KeyEvent **span) {
+    return matrix_engine_peek_events(&engine, span);
+}
+
+void matrix_robust_commit_events(size_t count) {
+    matrix_engine_commit_events(&engine, count);
 }
 
 bool matrix_robust_get_error(ErrorEvent *error) {
-    mutex_enter_blocking(&error_mutex);
-    
-    if (error_queue_head == error_queue_tail) {
-        mutex_exit(&error_mutex);
-        return false;
-    }
-    
-    *error = error_queue[error_queue_tail];
-    error_queue_tail = (error_queue_tail + 1) % ERROR_QUEUE_SIZE;
-    
-    mutex_exit(&error_mutex);
-    return true;
+    return matrix_engine_get_error(&engine, error);
 }
 
 bool matrix_robust_any_key_pressed(void) {
-    for (int row = 0; row < MATRIX_ROWS; row++) {
-        for (int col = 0; col < MATRIX_COLS; col++) {
-            if (key_state[row][col] != KEY_IDLE) {
-                return true;
-            }
-        }
-    }
-    return false;
+    return engine.pressed_count != 0;
+}
+
+void matrix_robust_get_matrix(matrix_row_t matrix[MATRIX_ROWS]) {
+    matrix_engine_get_matrix(&engine, matrix);
 }
 
 uint32_t matrix_robust_get_event_count(void) {
-    uint32_t count;
-    mutex_enter_blocking(&event_mutex);
-    
-    if (event_queue_head >= event_queue_tail) {
-        count = event_queue_head - event_queue_tail;
-    } else {
-        count = EVENT_QUEUE_SIZE - event_queue_tail + event_queue_head;
-    }
-    
-    mutex_exit(&event_mutex);
-    return count;
+    return matrix_ring_count(&engine.event_queue);
 }
 
 void matrix_robust_clear_events(void) {
-    mutex_enter_blocking(&event_mutex);
-    event_queue_head = 0;
-    event_queue_tail = 0;
-    mutex_exit(&event_mutex);
+    matrix_ring_clear(&engine.event_queue);
 }
 
 void matrix_robust_set_ghost_detection(bool enable) {
-    ghost_detection_enabled = enable;
+    engine.ghost_detection_enabled = enable;
 }
 
 void matrix_robust_set_stuck_detection(bool enable, uint32_t timeout_ms) {
-    stuck_detection_enabled = enable;
-    stuck_key_timeout = timeout_ms;
+    engine.stuck_detection_enabled = enable;
+    engine.stuck_key_timeout = timeout_ms;
 }
 
-static bool detect_ghost_key(uint8_t row, uint8_t col) {
-    // Ghost keys occur when 3+ keys form a rectangle
-    // Check if pressing this key creates a ghost condition
-    
-    uint8_t keys_in_row = 0;
-    uint8_t keys_in_col = 0;
-    
-    // Count pressed keys in this row
-    for (int c = 0; c < MATRIX_COLS; c++) {
-        if (pressed_keys[row][c]) keys_in_row++;
+bool matrix_robust_apply_settings(const MatrixSettings *settings) {
+    if (scanning_active || !matrix_settings_valid(settings)) {
+        return false;
     }
     
-    // Count pressed keys in this column
-    for (int r = 0; r < MATRIX_ROWS; r++) {
-        if (pressed_keys[r][col]) keys_in_col++;
+    uint32_t press_ms, release_ms;
+    matrix_settings_debounce(settings, &press_ms, &release_ms);
+    matrix_robust_set_debounce((DebounceMode)settings->debounce_mode, press_ms, release_ms);
+    matrix_robust_set_keymap(settings->keymap);
+    matrix_robust_set_ghost_detection(settings->flags & MATRIX_SETTINGS_GHOST_DETECTION);
+    matrix_robust_set_stuck_detection(settings->flags & MATRIX_SETTINGS_STUCK_DETECTION,
+                                      settings->stuck_timeout_ms);
+    return true;
+}
+
+bool matrix_robust_set_trace(MatrixTrace *trace) {
+    if (scanning_active) {
+        return false;
     }
     
-    // Simple ghost detection: if 2+ keys in row AND 2+ keys in col, might be ghost
-    return (keys_in_row >= 2 && keys_in_col >= 2);
+    // The PIO backends hand over all rows once per drain, like a burst tick
+    if (trace && scan_backend != SCAN_BACKEND_TIMER) {
+        matrix_trace_init(trace, PIO_DRAIN_INTERVAL_US, MATRIX_TRACE_FLAG_BURST);
+    } else if (trace) {
+        matrix_trace_init(trace, timer_interval(),
+                          engine.strategy == SCAN_STRATEGY_BURST ? MATRIX_TRACE_FLAG_BURST : 0);
+    }
+    engine.trace = trace;
+    return true;
 }
 
-static bool detect_stuck_key(uint8_t row, uint8_t col, uint32_t now) {
-    uint32_t press_time = key_timestamp[row][col];
-    return ((now - press_time) > stuck_key_timeout);
+void matrix_robust_trace_flush(void) {
+    MatrixTrace *trace = engine.trace;
+    if (trace) {
+        matrix_trace_request_flush(trace);
+    }
+}
+
+bool matrix_robust_set_gestures(MatrixGestures *gestures) {
+    if (scanning_active) {
+        return false;
+    }
+    
+    engine.gestures = gestures;
+    return true;
 }
 
 void matrix_robust_enable_wake_interrupt(void) {
+    if (scan_backend == SCAN_BACKEND_SHIFT_REG) {
+        return;
+    }
+    
+    // All rows LOW, so any pressed key pulls its column down
+    gpio_clr_mask(row_mask);
+    
     // Enable falling-edge interrupts on all column pins
     for (int i = 0; i < MATRIX_COLS; i++) {
         gpio_set_irq_enabled_with_callback(col_gpios[i], GPIO_IRQ_EDGE_FALL, 
@@ -413,35 +696,168 @@ void matrix_robust_enable_wake_interrupt(void) {
 }
 
 void matrix_robust_disable_wake_interrupt(void) {
+    if (scan_backend == SCAN_BACKEND_SHIFT_REG) {
+        return;
+    }
+    
     for (int i = 0; i < MATRIX_COLS; i++) {
         gpio_set_irq_enabled(col_gpios[i], GPIO_IRQ_EDGE_FALL, false);
     }
+    
+    // Rows back to inactive
+    gpio_set_mask(row_mask);
 }
 
 static void gpio_interrupt_callback(uint gpio, uint32_t events) {
-    // Wake from low power - start scanning
+    // Wake from low power or auto idle - start scanning
+    // (scanning is stopped, so this is safe from whichever core armed the wake)
     if (!scanning_active) {
-        matrix_robust_start();
+        matrix_robust_disable_wake_interrupt();
+        idle_sleeping = false;
+        start_scanning();
     }
 }
 
 void matrix_robust_get_statistics(ScanStatistics *stats_out) {
-    *stats_out = stats;
+    matrix_engine_get_statistics(&engine, stats_out);
 }
 
 void matrix_robust_reset_statistics(void) {
-    memset((void*)&stats, 0, sizeof(stats));
+    matrix_engine_reset_statistics(&engine);
+}
+
+bool matrix_robust_stream_hello(MatrixStream *stream) {
+    uint8_t payload[3];
+    uint8_t *p = payload;
+    p = matrix_stream_u8(p, MATRIX_STREAM_VERSION);
+    p = matrix_stream_u8(p, MATRIX_ROWS);
+    p = matrix_stream_u8(p, MATRIX_COLS);
+    return matrix_stream_put(stream, STREAM_REC_HELLO, payload, p - payload);
+}
+
+bool matrix_robust_stream_event(MatrixStream *stream, const KeyEvent *event) {
+    uint8_t payload[17];
+    uint8_t *p = payload;
+    p = matrix_stream_u8(p, event->key);
+    p = matrix_stream_u8(p, event->state);
+    p = matrix_stream_u8(p, event->row);
+    p = matrix_stream_u8(p, event->col);
+    p = matrix_stream_u8(p, event->gesture);
+    p = matrix_stream_u32(p, event->timestamp);
+    p = matrix_stream_u32(p, event->contact_us);
+    p = matrix_stream_u32(p, event->confirm_us);
+    return matrix_stream_put(stream, STREAM_REC_KEY, payload, p - payload);
+}
+
+bool matrix_robust_stream_error(MatrixStream *stream, const ErrorEvent *error) {
+    uint8_t payload[11];
+    uint8_t *p = payload;
+    p = matrix_stream_u8(p, error->error_code);
+    p = matrix_stream_u8(p, error->row);
+    p = matrix_stream_u8(p, error->col);
+    p = matrix_stream_u32(p, error->count);
+    p = matrix_stream_u32(p, error->timestamp);
+    return matrix_stream_put(stream, STREAM_REC_ERROR, payload, p - payload);
+}
+
+bool matrix_robust_stream_statistics(MatrixStream *stream) {
+    ScanStatistics s;
+    matrix_robust_get_statistics(&s);
+    
+    uint8_t payload[40];
+    uint8_t *p = payload;
+    p = matrix_stream_u32(p, s.total_scans);
+    p = matrix_stream_u32(p, s.total_events);
+    p = matrix_stream_u32(p, s.total_errors);
+    p = matrix_stream_u32(p, s.queue_overflows);
+    p = matrix_stream_u32(p, s.max_scan_time_us);
+    p = matrix_stream_u32(p, s.avg_scan_time_us);
+    p = matrix_stream_u32(p, s.missed_scans);
+    p = matrix_stream_u32(p, s.scan_overruns);
+    p = matrix_stream_u32(p, latency_hist_percentile(&s.contact_to_event_us, 99));
+    p = matrix_stream_u32(p, s.contact_to_event_us.max);
+    return matrix_stream_put(stream, STREAM_REC_STATS, payload, p - payload);
 }
 
 void matrix_robust_enter_low_power(void) {
     matrix_robust_stop();
     matrix_robust_enable_wake_interrupt();
-    printf("Entered low power mode (wake on keypress)\n");
 }
 
 void matrix_robust_exit_low_power(void) {
     matrix_robust_disable_wake_interrupt();
     matrix_robust_start();
-    printf("Exited low power mode\n");
+}
+
+bool matrix_robust_deep_sleep(void) {
+    // Shift-register panels have no column edges to wake on
+    if (scan_backend == SCAN_BACKEND_SHIFT_REG) {
+        return false;
+    }
+    
+    bool was_scanning = scanning_active || idle_sleeping;
+    matrix_robust_stop();
+    
+    // All rows LOW so a press pulls its column down. A key already down
+    // would wake the chip at once, so carry on scanning instead; one that
+    // goes down from here on still wakes it (level, not edge, wake source)
+    gpio_clr_mask(row_mask);
+    busy_wait_us(1);
+    if ((gpio_get_all() & col_gather.port_mask) != col_gather.port_mask) {
+        gpio_set_mask(row_mask);
+        if (was_scanning) {
+            matrix_robust_start();
+        }
+        return false;
+    }
+    
+    uint32_t irq_state = save_and_disable_interrupts();
+    uint32_t wake_us = dormant_until_column_low();
+    restore_interrupts(irq_state);
+    
+    gpio_set_mask(row_mask);
+    matrix_engine_wake(&engine, wake_us);
+    wake_sample_pending = true;
+    matrix_robust_start();
+    return true;
+}
+
+// Run from the crystal alone, stop it while every column is high, then
+// bring the boot clock setup back. The columns wake on a LOW level: a key
+// pressed while the clocks are torn down, after the caller's check, keeps
+// its column low and the crystal never stops, where a falling edge in that
+// window would be missed. Returns time_us_32() at the wake-up: the timer
+// ticks from clk_ref, which stays on the crystal, so it resumes as soon as
+// the crystal does.
+static uint32_t dormant_until_column_low(void) {
+    // Everything on XOSC, PLLs and ROSC off: XOSC is the only clock left
+    clock_configure(clk_ref, CLOCKS_CLK_REF_CTRL_SRC_VALUE_XOSC_CLKSRC, 0, XOSC_HZ, XOSC_HZ);
+    clock_configure(clk_sys, CLOCKS_CLK_SYS_CTRL_SRC_VALUE_CLK_REF, 0, XOSC_HZ, XOSC_HZ);
+    clock_stop(clk_usb);
+    clock_stop(clk_adc);
+#if PICO_RP2350
+    clock_stop(clk_hstx);
+#endif
+    clock_configure(clk_peri, 0, CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLK_SYS, XOSC_HZ, XOSC_HZ);
+    pll_deinit(pll_sys);
+    pll_deinit(pll_usb);
+    hw_write_masked(&rosc_hw->ctrl, ROSC_CTRL_ENABLE_VALUE_DISABLE << ROSC_CTRL_ENABLE_LSB,
+                    ROSC_CTRL_ENABLE_BITS);
+    
+    for (int i = 0; i < MATRIX_COLS; i++) {
+        gpio_set_dormant_irq_enabled(col_gpios[i], GPIO_IRQ_LEVEL_LOW, true);
+    }
+    
+    xosc_dormant();  // Stops here until a column low restarts the crystal
+    uint32_t wake_us = time_us_32();
+    
+    for (int i = 0; i < MATRIX_COLS; i++) {
+        gpio_set_dormant_irq_enabled(col_gpios[i], GPIO_IRQ_LEVEL_LOW, false);
+    }
+    
+    hw_write_masked(&rosc_hw->ctrl, ROSC_CTRL_ENABLE_VALUE_ENABLE << ROSC_CTRL_ENABLE_LSB,
+                    ROSC_CTRL_ENABLE_BITS);
+    runtime_init_clocks();
+    return wake_us;
 }
 
@@ -3,68 +3,132 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include "pico/stdlib.h"
-#include "pico/mutex.h"
 #include "hardware/timer.h"
 #include "hardware/irq.h"
 
-// Keypad configuration
-#define MATRIX_ROWS 4
-#define MATRIX_COLS 4
+// Keypad configuration (MATRIX_ROWS, MATRIX_COLS, matrix_row_t)
+#include "matrix_config.h"
+#include "matrix_engine.h"    // KeyEvent, ErrorEvent, ScanStatistics, ScanStrategy
+#include "matrix_stream.h"    // MatrixStream
+#include "matrix_scan_shift.h" // MatrixShiftPins
+#include "matrix_settings.h"  // MatrixSettings
 
-// Key states
-#define KEY_IDLE       0
-#define KEY_PRESSED    1
-#define KEY_HELD       2
-#define KEY_RELEASED   3
-
-// Error states
-#define ERROR_NONE          0
-#define ERROR_STUCK_KEY     1
-#define ERROR_GHOST_KEY     2
-#define ERROR_SCAN_TIMEOUT  3
-
-// Debounce settings (in milliseconds)
-#define DEBOUNCE_PRESS_MS   5    // 5ms debounce for press (faster response)
-#define DEBOUNCE_RELEASE_MS 5    // 5ms debounce for release (faster response)
-#define STUCK_KEY_TIMEOUT_MS 5000  // 5 seconds = stuck key
+// Auto idle: time with every key released before scanning stops
+#define AUTO_IDLE_TIMEOUT_MS 100
 
 // Scanning configuration
 #define SCAN_INTERVAL_US 1000  // 1ms = 1kHz scan rate
+#define SCAN_INTERVAL_MIN_US 50  // Shortest timer tick accepted (20kHz)
+
+// Adaptive scan rate: quiet time before the tick drops to the slow interval
+#define ADAPTIVE_DECAY_MS 250
+
+// Scan backends
+typedef enum {
+    SCAN_BACKEND_TIMER,  // CPU strobes rows from a repeating timer ISR (default)
+    SCAN_BACKEND_PIO,      // PIO state machine scans, DMA fills a snapshot ring
+    SCAN_BACKEND_SHIFT_REG // PIO clocks 74HC595 rows / 74HC165 columns, same ring
+} ScanBackend;
 
-// Key event structure
-typedef struct {
-    uint8_t key;         // Key value (0x0-0xF for hex keypad)
-    uint8_t state;       // KEY_PRESSED, KEY_HELD, or KEY_RELEASED
-    uint8_t row;         // Physical row (0-3)
-    uint8_t col;         // Physical column (0-3)
-    uint32_t timestamp;  // Timestamp in milliseconds
-} KeyEvent;
-
-// Error event structure
-typedef struct {
-    uint8_t error_code;
-    uint8_t row;
-    uint8_t col;
-    uint32_t timestamp;
-} ErrorEvent;
-
-// Callback function types
-typedef void (*KeyEventCallback)(KeyEvent *event);
-typedef void (*ErrorCallback)(ErrorEvent *error);
+// Core that runs the scan timer (and with it debounce and event callbacks)
+typedef enum {
+    SCAN_CORE_0,  // Shares core 0 with the application (default)
+    SCAN_CORE_1   // Dedicated core 1, immune to core 0 load
+} ScanCore;
+
+// Repeating timers the core 1 alarm pool has to hold
+#define SCAN_CORE1_MAX_TIMERS 2
+
+// How often the CPU drains PIO snapshots and runs debounce over them
+#define PIO_DRAIN_INTERVAL_US 1000
+#define PIO_DRAIN_BATCH       32
 
 // Initialize the matrix keypad (robust version)
 // Uses hardware timer for scanning at precise intervals
-// row_pins: array of 4 GPIO pins for rows (outputs)
-// col_pins: array of 4 GPIO pins for columns (inputs with pull-ups + interrupts)
+// row_pins: array of MATRIX_ROWS GPIO pins for rows (outputs)
+// col_pins: array of MATRIX_COLS GPIO pins for columns (inputs with pull-ups + interrupts)
 // scan_interval_us: scanning interval in microseconds (default: 1000 = 1kHz)
-void matrix_robust_init(const uint8_t row_pins[4], const uint8_t col_pins[4], uint32_t scan_interval_us);
+//                   honoured to the microsecond; the timer tick is clamped to
+//                   SCAN_INTERVAL_MIN_US, the PIO backend takes it as its row
+//                   period unclamped
+// All pins must be in GPIO 0-31: rows are driven with one masked SIO write
+// and columns sampled with one gpio_get_all() read per row
+// Returns false (nothing set up) if a pin is GPIO 32 or above
+bool matrix_robust_init(const uint8_t row_pins[MATRIX_ROWS], const uint8_t col_pins[MATRIX_COLS], uint32_t scan_interval_us);
+
+// Initialize for a shift-register panel instead (see matrix_scan_shift.h
+// for the wiring): 74HC595s drive the rows and 74HC165s read the columns,
+// clocked by PIO with DMA, so the matrix costs four pins whatever its size
+// (up to SHIFT_SCAN_MAX_ROWS x SHIFT_SCAN_MAX_COLS). Selects
+// SCAN_BACKEND_SHIFT_REG; the other backends are not available afterwards.
+// row_period_us: time each row is driven, as for SCAN_BACKEND_PIO.
+// Without column pins there is no edge wake: auto idle never stops
+// scanning and low power only stops it.
+// Returns false if the size or pins are unsupported or no PIO/DMA is free
+bool matrix_robust_init_shift_register(const MatrixShiftPins *pins, uint32_t row_period_us);
+
+// Select the scan backend (call after init, while not scanning)
+// SCAN_BACKEND_PIO needs consecutive row pins and consecutive column pins.
+// scan_interval_us keeps its meaning (time per row) but can go down to a few
+// microseconds, since the PIO scans without any CPU involvement.
+// SCAN_BACKEND_SHIFT_REG is selected by matrix_robust_init_shift_register().
+// Returns false if the backend cannot be used (pins, PIO or DMA resources)
+bool matrix_robust_set_backend(ScanBackend backend);
+
+// Select how the timer backend walks the rows (call while not scanning)
+// INTERLEAVED: scan_interval_us is the time per row, press latency is up to
+//              MATRIX_ROWS ticks plus debounce
+// BURST:       scan_interval_us is the time per full pass, press latency is
+//              bounded by one tick plus debounce
+// Returns false if scanning is active
+bool matrix_robust_set_scan_strategy(ScanStrategy strategy);
+
+// Select the core that scans (call after init, while not scanning)
+// SCAN_CORE_1 launches core 1 on first use and gives it its own alarm pool,
+// so scan timing no longer depends on core 0 interrupts (USB, stdio, ...).
+// Events reach core 0 through the lock-free event ring; start/stop requests
+// go to core 1 through a shared mailbox word (the inter-core FIFO stays
+// free for multicore lockout, used by matrix_settings_flash_save()). Core 1
+// belongs to the driver from then on. Key/error callbacks run on core 1.
+// Returns false if scanning is active or core 1 could not be set up
+bool matrix_robust_set_scan_core(ScanCore core);
+
+// Select the debounce algorithm and its times (call while not scanning)
+// DEBOUNCE_DEFER_PRESS_EAGER_RELEASE: press after press_ms stable, release at once (default)
+// DEBOUNCE_EAGER_PRESS_LOCKOUT:       press on the first scan that sees it, then the key
+//                                     ignores chatter for press_ms; release after release_ms stable
+// DEBOUNCE_SYMMETRIC_DEFER:           press after press_ms stable, release after release_ms stable
+// Returns false if scanning is active
+bool matrix_robust_set_debounce(DebounceMode mode, uint32_t press_ms, uint32_t release_ms);
+
+// Adaptive scan rate (off by default, timer backend only): the tick runs
+// at scan_interval_us while any key is pressed or in debounce and drops to
+// slow_interval_us (same meaning: per row, or per pass in burst) once none
+// has been for decay_ms. The first contact switches back at once, so only
+// that contact can wait up to one slow pass; debounce times are kept. The
+// current interval and the time at each rate are in ScanStatistics.
+// slow_interval_us = 0 (or not above scan_interval_us) turns it off.
+// Returns false if scanning is active
+bool matrix_robust_set_adaptive_rate(uint32_t slow_interval_us, uint32_t decay_ms);
+
+// Typematic repeat (off by default): the last pressed key is re-sent as
+// KEY_HELD events from the scan tick, first after delay_ms, then every
+// interval_ms, shortened by accel_ms per repeat down to min_interval_ms
+// (accel_ms = 0: constant rate). delay_ms = 0 turns repeat off. The main
+// loop needs no polling for it and can sleep until an event arrives.
+// Returns false if scanning is active
+bool matrix_robust_set_repeat(uint32_t delay_ms, uint32_t interval_ms,
+                              uint32_t min_interval_ms, uint32_t accel_ms);
 
 // Set custom key mapping
-void matrix_robust_set_keymap(const uint8_t keymap[4][4]);
+void matrix_robust_set_keymap(const uint8_t keymap[MATRIX_ROWS][MATRIX_COLS]);
 
 // Start scanning (enables timer interrupt)
-void matrix_robust_start(void);
+// Never prints, so it is safe from interrupt context
+// Returns true if scanning is running (or already was)
+bool matrix_robust_start(void);
 
 // Stop scanning (disables timer interrupt, saves power)
 void matrix_robust_stop(void);
@@ -75,20 +139,39 @@ void matrix_robust_set_key_callback(KeyEventCallback callback);
 // Register callback for error events
 void matrix_robust_set_error_callback(ErrorCallback callback);
 
-// Get next event from queue (thread-safe, non-blocking)
+// Get next event from queue (lock-free, non-blocking)
+// The queue is single-consumer: call from one context (main loop or one task)
 // Returns true if event was available
 bool matrix_robust_get_event(KeyEvent *event);
 
-// Get error event from queue
+// Drain up to max events into a caller buffer in one call
+// Returns the number of events copied (0 if the queue was empty)
+size_t matrix_robust_get_events(KeyEvent *events, size_t max);
+
+// Zero-copy drain: point span at the oldest queued events that are
+// contiguous in the ring and return how many there are. The events stay
+// valid until matrix_robust_commit_events() releases them. A burst that
+// wraps around the end of the ring comes back as two spans.
+size_t matrix_robust_peek_events(const KeyEvent **span);
+
+// Release the first count events of the last peeked span
+void matrix_robust_commit_events(size_t count);
+
+// Get error event from queue (lock-free, single consumer like get_event)
 bool matrix_robust_get_error(ErrorEvent *error);
 
 // Check if any key is currently pressed (thread-safe)
 bool matrix_robust_any_key_pressed(void);
 
+// Copy the debounced matrix: one bitmask per row, bit = column, set for
+// every key reported as pressed (suppressed ghosts excluded). Each row is
+// read in one access, so a row is never torn.
+void matrix_robust_get_matrix(matrix_row_t matrix[MATRIX_ROWS]);
+
 // Get number of events in queue
 uint32_t matrix_robust_get_event_count(void);
 
-// Clear all events from queue
+// Clear all events from queue (consumer side, never blocks the ISR)
 void matrix_robust_clear_events(void);
 
 // Enable/disable ghost key detection
@@ -97,28 +180,88 @@ void matrix_robust_set_ghost_detection(bool enable);
 // Enable/disable stuck key detection
 void matrix_robust_set_stuck_detection(bool enable, uint32_t timeout_ms);
 
+// Take keymap, debounce (with the per-key calibration), ghost and stuck
+// detection from a settings block, e.g. matrix_settings_flash_load().
+// Layer tables are the application's: keymap_set_layers(settings->layers,
+// settings->layer_count) uses them in place.
+// Returns false if scanning is active or the block is not valid
+bool matrix_robust_apply_settings(const MatrixSettings *settings);
+
+// Record raw row samples (before debounce) into a caller-owned trace, see
+// matrix_trace.h; NULL stops recording. Call while not scanning, after
+// choosing the backend and scan strategy, so the trace header matches. Read it
+// out from the main loop with matrix_trace_read_block() or
+// matrix_trace_stream(), and replay it with host/matrix_replay. Read-out
+// includes the open block once it is closed: by matrix_robust_trace_flush(),
+// after MATRIX_TRACE_QUIET_MS without a record, or when scanning stops.
+// Returns false if scanning is active
+bool matrix_robust_set_trace(MatrixTrace *trace);
+
+// Have the next scan tick close the open trace block, so the samples just
+// before e.g. a reported fault can be read out right away. Safe to call from
+// the main loop while scanning; a stopped or idle scan has already closed it
+void matrix_robust_trace_flush(void);
+
+// Resolve combos and tap-hold keys in the scan tick, before events are
+// queued, with a caller-owned state set up by matrix_gestures_init() (see
+// matrix_gesture.h); NULL turns them off. Their timeouts run on the scan
+// tick. Events then carry KEY_GESTURE_* in gesture: for NONE look the key
+// up as usual (keymap_process_key()), the others already carry their
+// configured key code.
+// Returns false if scanning is active
+bool matrix_robust_set_gestures(MatrixGestures *gestures);
+
+// Automatic idle mode (off by default)
+// Once every key has been released for idle_timeout_ms, the scan timer (and
+// PIO backend) stops, all rows are driven LOW and the columns wait for a
+// falling edge. The first edge resumes scanning; the press that caused it
+// is then debounced and reported as usual.
+void matrix_robust_set_auto_idle(bool enable, uint32_t idle_timeout_ms);
+
+// True while auto idle has scanning stopped, waiting for a column edge
+bool matrix_robust_is_idle(void);
+
 // Enable interrupt-based wake (columns trigger interrupt on key press)
+// Drives all rows LOW so any key pulls its column down
 void matrix_robust_enable_wake_interrupt(void);
 
-// Disable interrupt-based wake
+// Disable interrupt-based wake (rows back HIGH)
 void matrix_robust_disable_wake_interrupt(void);
 
-// Get statistics
-typedef struct {
-    uint32_t total_scans;
-    uint32_t total_events;
-    uint32_t total_errors;
-    uint32_t queue_overflows;
-    uint32_t max_scan_time_us;
-    uint32_t avg_scan_time_us;
-} ScanStatistics;
-
+// Get statistics (ScanStatistics: see matrix_engine.h)
+// Timestamps are time_us_32() values and wrap every ~71 minutes; the PIO
+// backend accounts each drain as one tick in isr_time_us and scan_jitter_us.
 void matrix_robust_get_statistics(ScanStatistics *stats);
 void matrix_robust_reset_statistics(void);
 
+// Binary stream records (see matrix_stream.h), for host software instead
+// of printf. Each frames one record into the stream's batch; call
+// matrix_stream_flush() once per USB frame or main loop pass.
+// Return false if the record was dropped (batch full, transport busy)
+bool matrix_robust_stream_hello(MatrixStream *stream);
+bool matrix_robust_stream_event(MatrixStream *stream, const KeyEvent *event);
+bool matrix_robust_stream_error(MatrixStream *stream, const ErrorEvent *error);
+bool matrix_robust_stream_statistics(MatrixStream *stream);
+
 // Power management
 void matrix_robust_enter_low_power(void);  // Stop scanning, enable wake interrupt
 void matrix_robust_exit_low_power(void);   // Resume scanning
 
+// Deep sleep until a key is pressed (call from the main loop on core 0)
+// Stops scanning, drives all rows LOW, switches every clock to the crystal,
+// stops the PLLs and ROSC and puts the crystal dormant, so the whole chip
+// halts while every column is high (a LOW level wakes it, so a press
+// during the clock switch is not missed). The wake-up restores the boot clock setup
+// (runtime_init_clocks(): clocks set with set_sys_clock_*() must be set
+// again) and restarts scanning before returning; the timer backend reads
+// the matrix at once, so the waking press is debounced and reported like
+// any other (lost only if released before wake-up plus debounce). Contact
+// and wake-to-event latency run from the wake-up edge
+// (stats.wake_to_event_us, stats.deep_sleeps). USB stops while dormant:
+// the host sees the device drop, so use UART for stdio with it.
+// Returns false without sleeping if a key is held or the panel is a
+// shift-register one (no column edges); scanning then carries on as before
+bool matrix_robust_deep_sleep(void);
+
 #endif // MATRIX_KEYPAD_ROBUST_H
 
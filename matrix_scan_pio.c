@@ -0,0 +1,195 @@
+#include "matrix_scan_pio.h"
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/clocks.h"
+#include "hardware/gpio.h"
+#include "matrix_scan.pio.h"
+
+#define PIO_ROWS MATRIX_ROWS
+#define PIO_COLS MATRIX_COLS
+
+// Row drive patterns: one row LOW, the rest HIGH, row index in the upper half
+static uint32_t row_patterns[PIO_ROWS] __attribute__((aligned(16)));
+
+// Read address reloaded into the pattern channel after every full pass
+static const uint32_t *row_patterns_addr = row_patterns;
+
+// Snapshot ring, aligned to its size so the DMA write ring can wrap it
+static uint32_t snapshot_ring[PIO_SNAPSHOT_RING_WORDS]
+    __attribute__((aligned(PIO_SNAPSHOT_RING_WORDS * sizeof(uint32_t))));
+static uint32_t snapshot_tail = 0;
+
+// Claimed resources
+static PIO scan_pio;
+static uint scan_sm;
+static uint scan_offset;
+static int pattern_chan = -1;
+static int reload_chan = -1;
+static int capture_chan = -1;
+static bool pio_ready = false;
+static bool pio_running = false;
+
+static uint8_t row_base;
+static uint8_t col_base;
+static uint32_t settle_loops;
+
+bool matrix_scan_pio_pins_supported(const uint8_t row_pins[MATRIX_ROWS], const uint8_t col_pins[MATRIX_COLS]) {
+    if (PIO_ROWS > PIO_SCAN_MAX_ROWS || PIO_COLS > PIO_SCAN_MAX_COLS) {
+        return false;
+    }
+    for (int i = 1; i < PIO_ROWS; i++) {
+        if (row_pins[i] != row_pins[0] + i) return false;
+    }
+    for (int i = 1; i < PIO_COLS; i++) {
+        if (col_pins[i] != col_pins[0] + i) return false;
+    }
+    return true;
+}
+
+bool matrix_scan_pio_init(const uint8_t row_pins[MATRIX_ROWS], const uint8_t col_pins[MATRIX_COLS],
+                          uint32_t row_period_us) {
+    if (pio_ready) {
+        return true;
+    }
+    if (!matrix_scan_pio_pins_supported(row_pins, col_pins)) {
+        return false;
+    }
+
+    row_base = row_pins[0];
+    col_base = col_pins[0];
+
+    // Row period in PIO cycles, minus the fixed instructions of the loop
+    uint32_t cycles_per_us = PIO_SCAN_CLOCK_HZ / 1000000;
+    uint32_t min_cycles = PIO_SCAN_MIN_SETTLE_US * cycles_per_us + MATRIX_SCAN_FIXED_CYCLES;
+    uint32_t row_cycles = row_period_us * cycles_per_us;
+    if (row_cycles < min_cycles) {
+        row_cycles = min_cycles;
+    }
+    settle_loops = row_cycles - MATRIX_SCAN_FIXED_CYCLES;
+
+    // Build the pattern table (active LOW rows)
+    uint32_t all_rows = (uint32_t)((1ull << PIO_ROWS) - 1);
+    for (uint32_t r = 0; r < PIO_ROWS; r++) {
+        row_patterns[r] = (all_rows & ~(1u << r)) | (r << 16);
+    }
+
+    if (!pio_claim_free_sm_and_add_program(&matrix_scan_program, &scan_pio, &scan_sm, &scan_offset)) {
+        return false;
+    }
+
+    pattern_chan = dma_claim_unused_channel(false);
+    reload_chan = dma_claim_unused_channel(false);
+    capture_chan = dma_claim_unused_channel(false);
+    if (pattern_chan < 0 || reload_chan < 0 || capture_chan < 0) {
+        if (pattern_chan >= 0) dma_channel_unclaim(pattern_chan);
+        if (reload_chan >= 0) dma_channel_unclaim(reload_chan);
+        if (capture_chan >= 0) dma_channel_unclaim(capture_chan);
+        pio_remove_program_and_unclaim_sm(&matrix_scan_program, scan_pio, scan_sm, scan_offset);
+        return false;
+    }
+
+    float clkdiv = (float)clock_get_hz(clk_sys) / PIO_SCAN_CLOCK_HZ;
+    matrix_scan_program_init(scan_pio, scan_sm, scan_offset, row_base, PIO_ROWS, col_base, clkdiv);
+
+    pio_ready = true;
+    return true;
+}
+
+void matrix_scan_pio_start(void) {
+    if (!pio_ready || pio_running) {
+        return;
+    }
+
+    uint32_t row_mask = (uint32_t)((1ull << PIO_ROWS) - 1) << row_base;
+
+    // Rows back under PIO control, all inactive until the first pattern
+    for (int i = 0; i < PIO_ROWS; i++) {
+        pio_gpio_init(scan_pio, row_base + i);
+    }
+    pio_sm_set_pins_with_mask(scan_pio, scan_sm, row_mask, row_mask);
+    pio_sm_set_consecutive_pindirs(scan_pio, scan_sm, row_base, PIO_ROWS, true);
+
+    pio_sm_clear_fifos(scan_pio, scan_sm);
+    pio_sm_restart(scan_pio, scan_sm);
+
+    // Preload the settle loop count into Y
+    pio_sm_put_blocking(scan_pio, scan_sm, settle_loops);
+    pio_sm_exec(scan_pio, scan_sm, pio_encode_pull(false, false));
+    pio_sm_exec(scan_pio, scan_sm, pio_encode_mov(pio_y, pio_osr));
+
+    // Capture: RX FIFO -> snapshot ring, forever
+    dma_channel_config cap = dma_channel_get_default_config(capture_chan);
+    channel_config_set_transfer_data_size(&cap, DMA_SIZE_32);
+    channel_config_set_read_increment(&cap, false);
+    channel_config_set_write_increment(&cap, true);
+    channel_config_set_ring(&cap, true, __builtin_ctz(sizeof(snapshot_ring)));
+    channel_config_set_dreq(&cap, pio_get_dreq(scan_pio, scan_sm, false));
+    dma_channel_configure(capture_chan, &cap, snapshot_ring, &scan_pio->rxf[scan_sm],
+                          dma_encode_endless_transfer_count(), true);
+    snapshot_tail = 0;
+
+    // Reload: rewrite the pattern channel's read address and retrigger it
+    dma_channel_config rel = dma_channel_get_default_config(reload_chan);
+    channel_config_set_transfer_data_size(&rel, DMA_SIZE_32);
+    channel_config_set_read_increment(&rel, false);
+    channel_config_set_write_increment(&rel, false);
+    dma_channel_configure(reload_chan, &rel, &dma_hw->ch[pattern_chan].al3_read_addr_trig,
+                          &row_patterns_addr, 1, false);
+
+    // Patterns: one full pass into the TX FIFO, then chain to the reload
+    dma_channel_config pat = dma_channel_get_default_config(pattern_chan);
+    channel_config_set_transfer_data_size(&pat, DMA_SIZE_32);
+    channel_config_set_read_increment(&pat, true);
+    channel_config_set_write_increment(&pat, false);
+    channel_config_set_dreq(&pat, pio_get_dreq(scan_pio, scan_sm, true));
+    channel_config_set_chain_to(&pat, reload_chan);
+    dma_channel_configure(pattern_chan, &pat, &scan_pio->txf[scan_sm], row_patterns,
+                          PIO_ROWS, true);
+
+    pio_sm_set_enabled(scan_pio, scan_sm, true);
+    pio_running = true;
+}
+
+void matrix_scan_pio_stop(void) {
+    if (!pio_running) {
+        return;
+    }
+
+    pio_sm_set_enabled(scan_pio, scan_sm, false);
+
+    // The pattern and reload channels retrigger each other, so abort the
+    // pair twice in case one was mid-handoff
+    dma_channel_abort(reload_chan);
+    dma_channel_abort(pattern_chan);
+    dma_channel_abort(reload_chan);
+    dma_channel_abort(capture_chan);
+
+    // Hand the rows back to SIO, inactive
+    for (int i = 0; i < PIO_ROWS; i++) {
+        gpio_init(row_base + i);
+        gpio_set_dir(row_base + i, GPIO_OUT);
+        gpio_put(row_base + i, 1);
+    }
+
+    pio_running = false;
+}
+
+uint32_t matrix_scan_pio_read(uint32_t *out, uint32_t max) {
+    if (!pio_running) {
+        return 0;
+    }
+
+    // The capture channel's write pointer is the producer index
+    uint32_t write_addr = dma_channel_hw_addr(capture_chan)->write_addr;
+    uint32_t head = (write_addr - (uint32_t)(uintptr_t)snapshot_ring) / sizeof(uint32_t);
+    head &= PIO_SNAPSHOT_RING_WORDS - 1;
+
+    uint32_t count = 0;
+    while (snapshot_tail != head && count < max) {
+        out[count++] = snapshot_ring[snapshot_tail];
+        snapshot_tail = (snapshot_tail + 1) & (PIO_SNAPSHOT_RING_WORDS - 1);
+    }
+
+    return count;
+}
@@ -0,0 +1,54 @@
+#ifndef MATRIX_SCAN_PIO_H
+#define MATRIX_SCAN_PIO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix_config.h"
+
+// PIO + DMA scan engine for RP2350
+//
+// A PIO state machine strobes the rows and samples the columns on its own
+// clock. One DMA channel loops over the row pattern table into the TX FIFO,
+// another streams raw snapshots from the RX FIFO into a circular buffer.
+// The CPU only has to drain snapshots and run debounce over them.
+
+// Snapshot ring size (32-bit words, must be a power of two)
+// One word per row strobe: 256 words = 64 full passes of a 4-row keypad
+#define PIO_SNAPSHOT_RING_WORDS 256
+
+// PIO clock used for timing the row period (10 MHz = 0.1us resolution)
+#define PIO_SCAN_CLOCK_HZ 10000000
+
+// Minimum settle time between driving a row and sampling the columns
+#define PIO_SCAN_MIN_SETTLE_US 1
+
+// Extract fields from a raw snapshot word
+#define PIO_SNAPSHOT_ROW(s)   ((uint8_t)((s) & 0xFFFF))
+#define PIO_SNAPSHOT_COLS(s)  ((uint16_t)((s) >> 16))
+
+// Largest matrix the program can drive (16-bit row pattern and column sample)
+#define PIO_SCAN_MAX_ROWS 16
+#define PIO_SCAN_MAX_COLS 16
+
+// Check whether a pin assignment can be driven by the PIO engine
+// Rows and columns must each be on consecutive GPIOs (in order), and the
+// matrix must fit PIO_SCAN_MAX_ROWS x PIO_SCAN_MAX_COLS
+bool matrix_scan_pio_pins_supported(const uint8_t row_pins[MATRIX_ROWS], const uint8_t col_pins[MATRIX_COLS]);
+
+// Claim a PIO state machine and three DMA channels and load the program
+// row_period_us: time each row is driven (one full pass = MATRIX_ROWS * row_period_us)
+// Returns false if pins are unsupported or no PIO/DMA resources are free
+bool matrix_scan_pio_init(const uint8_t row_pins[MATRIX_ROWS], const uint8_t col_pins[MATRIX_COLS],
+                          uint32_t row_period_us);
+
+// Start the state machine and DMA (scanning runs with no CPU involvement)
+void matrix_scan_pio_start(void);
+
+// Stop the state machine and DMA, return row pins to SIO (driven HIGH)
+void matrix_scan_pio_stop(void);
+
+// Copy up to max snapshots written since the last call into out
+// Returns the number of snapshots copied (safe to call from any one context)
+uint32_t matrix_scan_pio_read(uint32_t *out, uint32_t max);
+
+#endif // MATRIX_SCAN_PIO_H
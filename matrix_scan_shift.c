@@ -0,0 +1,183 @@
+#include "matrix_scan_shift.h"
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/clocks.h"
+#include "hardware/gpio.h"
+#include "matrix_shift.pio.h"
+
+#define SHIFT_ROWS MATRIX_ROWS
+
+// Samples lag their pattern by two iterations (see matrix_shift.pio)
+#define SHIFT_SAMPLE_LAG 2
+
+// Row patterns: one row LOW, the rest HIGH, sample row tag above them
+static uint32_t row_patterns[SHIFT_ROWS] __attribute__((aligned(16)));
+
+// Read address reloaded into the pattern channel after every full pass
+static const uint32_t *row_patterns_addr = row_patterns;
+
+// Snapshot ring, aligned to its size so the DMA write ring can wrap it
+static uint32_t snapshot_ring[SHIFT_SNAPSHOT_RING_WORDS]
+    __attribute__((aligned(SHIFT_SNAPSHOT_RING_WORDS * sizeof(uint32_t))));
+static uint32_t snapshot_tail = 0;
+static uint32_t samples_to_skip = 0;  // Loaded before any row was driven
+
+// Claimed resources
+static PIO shift_pio;
+static uint shift_sm;
+static uint shift_offset;
+static int pattern_chan = -1;
+static int reload_chan = -1;
+static int capture_chan = -1;
+static bool shift_ready = false;
+static bool shift_running = false;
+
+bool matrix_scan_shift_pins_supported(const MatrixShiftPins *pins) {
+    if (MATRIX_ROWS > SHIFT_SCAN_MAX_ROWS || MATRIX_COLS > SHIFT_SCAN_MAX_COLS) {
+        return false;
+    }
+    // Clock and latch are the two side-set pins
+    return pins->latch == pins->clock + 1 &&
+           pins->data_out != pins->data_in &&
+           pins->data_out != pins->clock && pins->data_out != pins->latch &&
+           pins->data_in != pins->clock && pins->data_in != pins->latch;
+}
+
+bool matrix_scan_shift_init(const MatrixShiftPins *pins, uint32_t row_period_us) {
+    if (shift_ready) {
+        return true;
+    }
+    if (!matrix_scan_shift_pins_supported(pins)) {
+        return false;
+    }
+
+    // Pattern table: output N-1-r of the word (shifted last) lands on row r.
+    // The tag names the row whose columns are loaded in that iteration.
+    uint32_t chain_mask = (1u << SHIFT_CHAIN_BITS) - 1;
+    for (uint32_t r = 0; r < SHIFT_ROWS; r++) {
+        uint32_t tag = (r + SHIFT_ROWS * SHIFT_SAMPLE_LAG - SHIFT_SAMPLE_LAG) % SHIFT_ROWS;
+        row_patterns[r] = (chain_mask & ~(1u << (SHIFT_CHAIN_BITS - 1 - r))) |
+                          (tag << SHIFT_CHAIN_BITS);
+    }
+
+    if (!pio_claim_free_sm_and_add_program(&matrix_shift_program, &shift_pio, &shift_sm, &shift_offset)) {
+        return false;
+    }
+
+    pattern_chan = dma_claim_unused_channel(false);
+    reload_chan = dma_claim_unused_channel(false);
+    capture_chan = dma_claim_unused_channel(false);
+    if (pattern_chan < 0 || reload_chan < 0 || capture_chan < 0) {
+        if (pattern_chan >= 0) dma_channel_unclaim(pattern_chan);
+        if (reload_chan >= 0) dma_channel_unclaim(reload_chan);
+        if (capture_chan >= 0) dma_channel_unclaim(capture_chan);
+        pio_remove_program_and_unclaim_sm(&matrix_shift_program, shift_pio, shift_sm, shift_offset);
+        return false;
+    }
+
+    // The loop has a fixed length, so the clock divider sets the row period
+    uint32_t row_cycles = SHIFT_CHAIN_BITS * MATRIX_SHIFT_CYCLES_PER_BIT + MATRIX_SHIFT_FIXED_CYCLES;
+    float sys_hz = (float)clock_get_hz(clk_sys);
+    float clkdiv = sys_hz * (float)row_period_us / (1e6f * (float)row_cycles);
+    float min_clkdiv = sys_hz / SHIFT_SCAN_MAX_CLOCK_HZ;
+    if (clkdiv < min_clkdiv) {
+        clkdiv = min_clkdiv;
+    }
+    if (clkdiv > 65535.0f) {
+        clkdiv = 65535.0f;
+    }
+    matrix_shift_program_init(shift_pio, shift_sm, shift_offset,
+                              pins->data_out, pins->data_in, pins->clock, clkdiv);
+
+    shift_ready = true;
+    return true;
+}
+
+void matrix_scan_shift_start(void) {
+    if (!shift_ready || shift_running) {
+        return;
+    }
+
+    pio_sm_clear_fifos(shift_pio, shift_sm);
+    pio_sm_restart(shift_pio, shift_sm);
+    pio_sm_exec(shift_pio, shift_sm, pio_encode_jmp(shift_offset));
+
+    // Preload the bit loop count into Y
+    pio_sm_put_blocking(shift_pio, shift_sm, SHIFT_CHAIN_BITS - 1);
+    pio_sm_exec(shift_pio, shift_sm, pio_encode_pull(false, false));
+    pio_sm_exec(shift_pio, shift_sm, pio_encode_mov(pio_y, pio_osr));
+
+    // Capture: RX FIFO -> snapshot ring, forever
+    dma_channel_config cap = dma_channel_get_default_config(capture_chan);
+    channel_config_set_transfer_data_size(&cap, DMA_SIZE_32);
+    channel_config_set_read_increment(&cap, false);
+    channel_config_set_write_increment(&cap, true);
+    channel_config_set_ring(&cap, true, __builtin_ctz(sizeof(snapshot_ring)));
+    channel_config_set_dreq(&cap, pio_get_dreq(shift_pio, shift_sm, false));
+    dma_channel_configure(capture_chan, &cap, snapshot_ring, &shift_pio->rxf[shift_sm],
+                          dma_encode_endless_transfer_count(), true);
+    snapshot_tail = 0;
+    samples_to_skip = SHIFT_SAMPLE_LAG;
+
+    // Reload: rewrite the pattern channel's read address and retrigger it
+    dma_channel_config rel = dma_channel_get_default_config(reload_chan);
+    channel_config_set_transfer_data_size(&rel, DMA_SIZE_32);
+    channel_config_set_read_increment(&rel, false);
+    channel_config_set_write_increment(&rel, false);
+    dma_channel_configure(reload_chan, &rel, &dma_hw->ch[pattern_chan].al3_read_addr_trig,
+                          &row_patterns_addr, 1, false);
+
+    // Patterns: one full pass into the TX FIFO, then chain to the reload
+    dma_channel_config pat = dma_channel_get_default_config(pattern_chan);
+    channel_config_set_transfer_data_size(&pat, DMA_SIZE_32);
+    channel_config_set_read_increment(&pat, true);
+    channel_config_set_write_increment(&pat, false);
+    channel_config_set_dreq(&pat, pio_get_dreq(shift_pio, shift_sm, true));
+    channel_config_set_chain_to(&pat, reload_chan);
+    dma_channel_configure(pattern_chan, &pat, &shift_pio->txf[shift_sm], row_patterns,
+                          SHIFT_ROWS, true);
+
+    pio_sm_set_enabled(shift_pio, shift_sm, true);
+    shift_running = true;
+}
+
+void matrix_scan_shift_stop(void) {
+    if (!shift_running) {
+        return;
+    }
+
+    pio_sm_set_enabled(shift_pio, shift_sm, false);
+
+    // The pattern and reload channels retrigger each other, so abort the
+    // pair twice in case one was mid-handoff
+    dma_channel_abort(reload_chan);
+    dma_channel_abort(pattern_chan);
+    dma_channel_abort(reload_chan);
+    dma_channel_abort(capture_chan);
+
+    shift_running = false;
+}
+
+uint32_t matrix_scan_shift_read(uint32_t *out, uint32_t max) {
+    if (!shift_running) {
+        return 0;
+    }
+
+    // The capture channel's write pointer is the producer index
+    uint32_t write_addr = dma_channel_hw_addr(capture_chan)->write_addr;
+    uint32_t head = (write_addr - (uint32_t)(uintptr_t)snapshot_ring) / sizeof(uint32_t);
+    head &= SHIFT_SNAPSHOT_RING_WORDS - 1;
+
+    uint32_t count = 0;
+    while (snapshot_tail != head && count < max) {
+        if (samples_to_skip) {
+            samples_to_skip--;
+        } else {
+            out[count++] = snapshot_ring[snapshot_tail];
+        }
+        snapshot_tail = (snapshot_tail + 1) & (SHIFT_SNAPSHOT_RING_WORDS - 1);
+    }
+
+    return count;
+}
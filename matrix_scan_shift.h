@@ -0,0 +1,81 @@
+#ifndef MATRIX_SCAN_SHIFT_H
+#define MATRIX_SCAN_SHIFT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix_config.h"
+
+// PIO + DMA scan engine for shift-register panels (RP2350)
+//
+// Rows are driven by a chain of 74HC595s and columns read by a chain of
+// 74HC165s, so any matrix up to SHIFT_SCAN_MAX_ROWS x SHIFT_SCAN_MAX_COLS
+// takes four pins. A PIO state machine clocks both chains at once; one DMA
+// channel loops over the row pattern table into the TX FIFO, another
+// streams tagged row samples from the RX FIFO into a circular buffer. The
+// CPU only drains samples and runs debounce, like the direct PIO backend.
+//
+// Wiring (active LOW rows, columns pulled up, LOW = pressed):
+//   data_out  -> SER of the first 595; QH' of each 595 -> SER of the next
+//   data_in   <- QH of the first 165;  QH of each 165 -> SER of the one before
+//   clock     -> SRCLK of every 595 and CLK of every 165 (CLK INH to GND)
+//   latch     -> RCLK of every 595 and SH/LD of every 165 (must be clock + 1)
+// Row r is output r of the chain (first 595: QA..QH = rows 0..7, second:
+// 8..15, ...), column c is input c (first 165: A..H = columns 0..7, ...).
+// Unused outputs and inputs can stay unconnected (tie the SER pin of the
+// last 165 high).
+
+// Snapshot ring size (32-bit words, must be a power of two)
+#define SHIFT_SNAPSHOT_RING_WORDS 256
+
+// Fastest PIO clock: 3 cycles per bit, so the chains shift at a third of it
+#define SHIFT_SCAN_MAX_CLOCK_HZ 10000000
+
+// Largest matrix: both chains are clocked together, and a row sample plus
+// its 8-bit row tag have to fit one FIFO word
+#define SHIFT_SCAN_MAX_ROWS 24
+#define SHIFT_SCAN_MAX_COLS 24
+
+// Bits shifted per row (both chains padded to whole chips, the longer wins)
+#define SHIFT_CHIPS(n) (((n) + 7) / 8)
+#define SHIFT_CHAIN_BITS (8 * (SHIFT_CHIPS(MATRIX_ROWS) > SHIFT_CHIPS(MATRIX_COLS) ? \
+                               SHIFT_CHIPS(MATRIX_ROWS) : SHIFT_CHIPS(MATRIX_COLS)))
+
+// Extract fields from a raw snapshot word
+#define SHIFT_SNAPSHOT_ROW(s) ((uint8_t)((s) & 0xFF))
+
+typedef struct {
+    uint8_t data_out;  // 74HC595 SER
+    uint8_t data_in;   // 74HC165 QH
+    uint8_t clock;     // 595 SRCLK + 165 CLK
+    uint8_t latch;     // 595 RCLK + 165 SH/LD, clock + 1
+} MatrixShiftPins;
+
+// Check whether the matrix size and pins can be driven by the shift engine
+bool matrix_scan_shift_pins_supported(const MatrixShiftPins *pins);
+
+// Claim a PIO state machine and three DMA channels and load the program
+// row_period_us: time each row is driven (one full pass = MATRIX_ROWS * row_period_us),
+// raised to the shortest period the chain length allows at SHIFT_SCAN_MAX_CLOCK_HZ
+// Returns false if pins are unsupported or no PIO/DMA resources are free
+bool matrix_scan_shift_init(const MatrixShiftPins *pins, uint32_t row_period_us);
+
+// Start the state machine and DMA (scanning runs with no CPU involvement)
+void matrix_scan_shift_start(void);
+
+// Stop the state machine and DMA (the 595s keep their last pattern)
+void matrix_scan_shift_stop(void);
+
+// Copy up to max snapshots written since the last call into out
+// Returns the number of snapshots copied (safe to call from any one context)
+uint32_t matrix_scan_shift_read(uint32_t *out, uint32_t max);
+
+// Pressed columns of a snapshot (the 165 chain, reordered to column order)
+static inline matrix_row_t matrix_scan_shift_columns(uint32_t snapshot) {
+    uint32_t inputs = 0;
+    for (int chip = 0; chip < SHIFT_CHIPS(MATRIX_COLS); chip++) {
+        inputs |= ((snapshot >> (SHIFT_CHAIN_BITS - 8 * chip)) & 0xFFu) << (8 * chip);
+    }
+    return (matrix_row_t)~inputs & MATRIX_COL_MASK;
+}
+
+#endif // MATRIX_SCAN_SHIFT_H
@@ -0,0 +1,54 @@
+#include "matrix_settings_flash.h"
+#include "pico/flash.h"
+#include "hardware/regs/addressmap.h"
+#include <string.h>
+
+typedef struct {
+    uint32_t offset;
+    const MatrixSettings *settings;
+} SettingsWrite;
+
+static const MatrixSettings *slot(int index) {
+    return (const MatrixSettings *)(XIP_BASE + MATRIX_SETTINGS_FLASH_OFFSET +
+                                    index * MATRIX_SETTINGS_SLOT_BYTES);
+}
+
+// Runs through flash_safe_execute(): interrupts off, other core paused
+static void write_slot(void *param) {
+    const SettingsWrite *w = (const SettingsWrite *)param;
+    static uint8_t tail[FLASH_PAGE_SIZE];
+
+    flash_range_erase(w->offset, MATRIX_SETTINGS_SLOT_BYTES);
+
+    // Whole pages straight from RAM, the last one padded with erased bytes
+    size_t whole = sizeof(MatrixSettings) / FLASH_PAGE_SIZE * FLASH_PAGE_SIZE;
+    if (whole > 0) {
+        flash_range_program(w->offset, (const uint8_t *)w->settings, whole);
+    }
+    size_t rest = sizeof(MatrixSettings) - whole;
+    if (rest > 0) {
+        memset(tail, 0xFF, sizeof(tail));
+        memcpy(tail, (const uint8_t *)w->settings + whole, rest);
+        flash_range_program(w->offset + whole, tail, FLASH_PAGE_SIZE);
+    }
+}
+
+const MatrixSettings *matrix_settings_flash_load(void) {
+    return matrix_settings_newest(slot(0), slot(1));
+}
+
+bool matrix_settings_flash_save(MatrixSettings *s) {
+    const MatrixSettings *current = matrix_settings_flash_load();
+    int target = (current == slot(0)) ? 1 : 0;
+
+    matrix_settings_seal(s, current != NULL ? current->sequence + 1 : 1);
+
+    SettingsWrite w = {
+        .offset = MATRIX_SETTINGS_FLASH_OFFSET + target * MATRIX_SETTINGS_SLOT_BYTES,
+        .settings = s
+    };
+    if (flash_safe_execute(write_slot, &w, UINT32_MAX) != PICO_OK) {
+        return false;
+    }
+    return matrix_settings_valid(slot(target));
+}
@@ -0,0 +1,37 @@
+#ifndef MATRIX_SETTINGS_FLASH_H
+#define MATRIX_SETTINGS_FLASH_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "hardware/flash.h"
+#include "matrix_settings.h"
+
+// Settings block in the RP2350's flash
+//
+// Two copies, each in its own run of erase sectors, at the end of flash
+// by default (keep the linker's image below MATRIX_SETTINGS_FLASH_OFFSET).
+// Loading returns a pointer into the XIP window: nothing is copied, and
+// the layer tables can be handed to keymap_set_layers() as they are.
+
+// Bytes per copy (whole erase sectors)
+#define MATRIX_SETTINGS_SLOT_BYTES \
+    ((sizeof(MatrixSettings) + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE * FLASH_SECTOR_SIZE)
+
+// Flash offset of the first copy; the second follows it
+#ifndef MATRIX_SETTINGS_FLASH_OFFSET
+#define MATRIX_SETTINGS_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - 2 * MATRIX_SETTINGS_SLOT_BYTES)
+#endif
+
+// The newest valid copy, read in place, or NULL if there is none (first
+// boot, or written by a firmware with another matrix size or version)
+const MatrixSettings *matrix_settings_flash_load(void);
+
+// Seal s with the next sequence number and write it over the older copy,
+// leaving the current one intact until the new one checks out. Call with
+// scanning stopped (matrix_robust_stop()): XIP is off for the sector erase
+// (tens of ms) and the other core is paused through flash_safe_execute().
+// Returns false if the write could not run or does not read back valid;
+// the previous settings are still in place then
+bool matrix_settings_flash_save(MatrixSettings *s);
+
+#endif // MATRIX_SETTINGS_FLASH_H
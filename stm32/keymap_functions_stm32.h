@@ -3,33 +3,47 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "matrix_layers.h"  // LayerTable, LA_* actions
 
-// Operating modes
-typedef enum {
-    MODE_NORMAL,      // Normal key entry mode
-    MODE_FUNCTION     // Function/feature mode (triggered by F key)
-} OperatingMode;
-
-// Function pointer type for key actions
+// Function pointer type for key actions (gets the matrix key code)
 typedef void (*KeyActionFunc)(uint8_t key);
 
-// Initialize the keymap function system
+// Functions LA_FN(n) can run
+#define KEYMAP_MAX_FUNCTIONS 32
+
+// Initialize with the default layers. On the 4x4 hex pad:
+//   layer 0 (normal):   every key passes through, F toggles layer 1
+//   layer 1 (function): 0-E run functions 0x0-0xE, F toggles back
+// Other matrix sizes get a pass-through base layer; see keymap_set_layers()
 void keymap_init(void);
 
-// Process a key press (handles mode switching and function dispatch)
-// Returns true if key was handled (consumed), false if it should be passed through
-bool keymap_process_key(uint8_t key);
+// Use your own layer tables (const, they stay in flash), layer 0 = base
+// Resets the active layers to the base layer
+void keymap_set_layers(const LayerTable *layers, uint8_t layer_count);
+
+// Process a key press or release (skip KEY_HELD events)
+// Layer keys switch layers, LA_FN runs its function on press. Never prints.
+// key: in the matrix key code, out the code to pass on (LA_KEY remaps it)
+// Returns true if the key was consumed, false if it should be passed through
+bool keymap_process_key(uint8_t row, uint8_t col, bool pressed, uint8_t *key);
 
-// Get current operating mode
-OperatingMode keymap_get_mode(void);
+// Active layers (bit n = layer n)
+uint32_t keymap_get_layers(void);
 
-// Set a custom function for a specific key in function mode
-// key: 0x0-0xE (F is reserved for mode toggle)
-// func: function to call when that key is pressed in function mode
-void keymap_set_function(uint8_t key, KeyActionFunc func);
+// Flip a layer from code, like a toggle key (layer 0 stays on)
+void keymap_toggle_layer(uint8_t layer);
 
-// Clear a function mapping (key will do nothing in function mode)
-void keymap_clear_function(uint8_t key);
+// Deferred layer change report: true once after the active layers changed,
+// with the new mask in *active. Poll it from the main loop to print or
+// stream the change, outside the key path.
+bool keymap_poll_layers(uint32_t *active);
+
+// Set the function run by LA_FN(n) (n < KEYMAP_MAX_FUNCTIONS)
+// With the default layers, n is the hex key pressed in function layer
+void keymap_set_function(uint8_t n, KeyActionFunc func);
+
+// Clear a function (LA_FN(n) keys are still consumed, but do nothing)
+void keymap_clear_function(uint8_t n);
 
 // Example function implementations (you can customize these)
 void function_key_1(uint8_t key);  // Example: Toggle LED
@@ -39,4 +53,3 @@ void function_key_4(uint8_t key);  // Example: Save settings
 void function_key_5(uint8_t key);  // Example: Load settings
 
 #endif // KEYMAP_FUNCTIONS_STM32_H
-
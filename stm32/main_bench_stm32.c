@@ -0,0 +1,120 @@
+/**
+  ******************************************************************************
+  * @file           : main_bench_stm32.c
+  * @brief          : Scan ISR and engine benchmarks for Nucleo-F401RE
+  * @board          : STM32 Nucleo-F401RE
+  * @features       : DWT cycle counts, JSON lines on UART (bench_compare.py)
+  ******************************************************************************
+  */
+
+#include "main.h"
+#include "matrix_robust_stm32.h"
+#include "matrix_bench.h"
+#include <stdio.h>
+
+// Timer handle (configured in CubeMX)
+extern TIM_HandleTypeDef htim2;  // Use TIM2 for scanning
+
+// UART handle for printf
+extern UART_HandleTypeDef huart2;
+
+#define BENCH_RUN_MS      3000
+#define BENCH_ITERATIONS  10000
+
+// DWT CYCCNT, started by matrix_robust_init()
+static uint32_t dwt_read(void)
+{
+  return DWT->CYCCNT;
+}
+
+// Run the driver for BENCH_RUN_MS and report its scan statistics
+// (hold keys down to measure a loaded keypad)
+static void run_driver(const MatrixBench *bench, const char *name)
+{
+  KeyEvent events[EVENT_QUEUE_SIZE];
+  ErrorEvent error;
+  ScanStatistics stats;
+
+  matrix_robust_reset_statistics();
+  matrix_robust_start();
+
+  uint32_t start = HAL_GetTick();
+  while (HAL_GetTick() - start < BENCH_RUN_MS) {
+    matrix_robust_get_events(events, EVENT_QUEUE_SIZE);
+    while (matrix_robust_get_error(&error)) {
+    }
+    HAL_Delay(1);
+  }
+
+  matrix_robust_stop();
+  matrix_robust_get_statistics(&stats);
+  matrix_bench_print_stats(bench, name, &stats);
+}
+
+int main(void)
+{
+  // HAL Init
+  HAL_Init();
+  SystemClock_Config();
+
+  // Initialize peripherals (done by CubeMX)
+  // MX_GPIO_Init();
+  // MX_USART2_UART_Init();
+  // MX_TIM2_Init();  // Timer for scanning (1kHz)
+
+  const GPIO_Pin_t row_pins[4] = {
+      MAKE_PIN(GPIOA, 0),   // Row 0 -> PA0
+      MAKE_PIN(GPIOA, 1),   // Row 1 -> PA1
+      MAKE_PIN(GPIOA, 4),   // Row 2 -> PA4
+      MAKE_PIN(GPIOA, 5)    // Row 3 -> PA5
+  };
+
+  const GPIO_Pin_t col_pins[4] = {
+      MAKE_PIN(GPIOB, 0),   // Col 0 -> PB0
+      MAKE_PIN(GPIOB, 1),   // Col 1 -> PB1
+      MAKE_PIN(GPIOB, 4),   // Col 2 -> PB4
+      MAKE_PIN(GPIOB, 5)    // Col 3 -> PB5
+  };
+
+  matrix_robust_init(row_pins, col_pins, &htim2, 1000);
+
+  const MatrixBench bench = {
+      .platform = "stm32f401",
+      .read = dwt_read,
+      .mask = 0xFFFFFFFF,
+      .hz = SystemCoreClock
+  };
+
+  // Driver: both strategies at 1 kHz
+  matrix_robust_set_scan_strategy(SCAN_STRATEGY_INTERLEAVED);
+  run_driver(&bench, "timer_interleaved");
+  matrix_robust_set_scan_strategy(SCAN_STRATEGY_BURST);
+  run_driver(&bench, "timer_burst");
+
+  // Engine, with the driver stopped
+  matrix_bench_scan_idle(&bench, SCAN_STRATEGY_INTERLEAVED, BENCH_ITERATIONS);
+  matrix_bench_scan_idle(&bench, SCAN_STRATEGY_BURST, BENCH_ITERATIONS);
+  matrix_bench_scan_loaded(&bench, SCAN_STRATEGY_INTERLEAVED, BENCH_ITERATIONS);
+  matrix_bench_scan_loaded(&bench, SCAN_STRATEGY_BURST, BENCH_ITERATIONS);
+  matrix_bench_queue(&bench, BENCH_ITERATIONS / EVENT_QUEUE_SIZE);
+
+  printf("{\"bench\":\"done\",\"platform\":\"stm32f401\"}\n");
+  while (1)
+  {
+    HAL_Delay(1000);
+  }
+}
+
+// Timer interrupt callback - must be called from stm32xxxx_it.c
+void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
+{
+  matrix_robust_timer_callback(htim);
+}
+
+// Printf redirection to UART
+#ifdef __GNUC__
+int _write(int fd, char *ptr, int len) {
+  HAL_UART_Transmit(&huart2, (uint8_t*)ptr, len, HAL_MAX_DELAY);
+  return len;
+}
+#endif
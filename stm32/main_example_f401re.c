@@ -77,17 +77,29 @@ int main(void)
   {
     // Non-blocking scan - call this as often as possible
     if (matrix_scan(&event)) {
-      // Key event detected - only process PRESSED events
-      if (event.state == KEY_PRESSED) {
-        // Try to process as function mode key
-        bool handled = keymap_process_key(event.key);
+      // Key event detected - presses and releases go through the layers
+      if (event.state != KEY_HELD) {
+        uint8_t key = event.key;
+        bool handled = keymap_process_key(event.row, event.col,
+                                          event.state == KEY_PRESSED, &key);
         
-        if (!handled) {
+        if (!handled && event.state == KEY_PRESSED) {
           // Normal mode - just display the key
-          printf("Key: 0x%X\n", event.key);
+          printf("Key: 0x%X\n", key);
         }
       }
     }
+
+    // Layer changes are printed here, outside the key path
+    uint32_t layers;
+    if (keymap_poll_layers(&layers)) {
+      if (layers & (1u << 1)) {
+        printf("\n>>> FUNCTION MODE ACTIVATED <<<\n");
+        printf("Press 0-E to trigger functions, F to exit.\n\n");
+      } else {
+        printf("\n>>> NORMAL MODE <<<\n\n");
+      }
+    }
     
     // Optional: add a tiny delay to control scan rate
     // Comment out for maximum speed
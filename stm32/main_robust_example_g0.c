@@ -9,6 +9,7 @@
 
 #include "main.h"
 #include "matrix_robust_stm32.h"
+#include "matrix_settings_flash_stm32.h"
 #include "keymap_functions_stm32.h"
 #include <stdio.h>
 
@@ -34,10 +35,6 @@ int main(void)
   // MX_USART2_UART_Init();
   // MX_TIM3_Init();  // Timer for scanning (1kHz)
   
-  printf("\n\n=== ROBUST Matrix Keypad Driver for STM32 ===\n");
-  printf("Board: Nucleo-G0 Series\n");
-  printf("Features: Timer ISR + Queue + Error Detection + Power Mgmt\n\n");
-  
   // Define pin assignments (all on Port C)
   const GPIO_Pin_t row_pins[4] = {
       MAKE_PIN(GPIOC, 0),   // Row 0 -> PC0
@@ -61,12 +58,26 @@ int main(void)
   matrix_robust_set_ghost_detection(true);
   matrix_robust_set_stuck_detection(true, 5000);  // 5 second timeout
   
-  // Initialize function mode
+  // Per-unit tuning saved in flash overrides the defaults above
+  const MatrixSettings *settings = matrix_settings_flash_load();
+  if (settings != NULL) {
+    matrix_robust_apply_settings(settings);
+  }
+  
+  // Initialize function mode (F toggles it)
   keymap_init();
+  if (settings != NULL && settings->layer_count > 0) {
+    keymap_set_layers(settings->layers, settings->layer_count);  // Read in place
+  }
   
-  // Start scanning!
+  // Start scanning before any printf: blocking UART output would delay
+  // the first scan, and keys pressed meanwhile would be missed
   matrix_robust_start();
   
+  printf("\n\n=== ROBUST Matrix Keypad Driver for STM32 ===\n");
+  printf("Board: Nucleo-G0 Series\n");
+  printf("Features: Timer ISR + Queue + Error Detection + Power Mgmt\n\n");
+  
   printf("Robust scanning active!\n");
   printf("Features enabled:\n");
   printf("  - Hardware timer (TIM3) at 1kHz\n");
@@ -87,16 +98,33 @@ int main(void)
     while (matrix_robust_get_event(&event)) {
       idle_count = 0;  // Reset idle counter
       
-      if (event.state == KEY_PRESSED) {
-        // Process with function mode
-        bool handled = keymap_process_key(event.key);
-        
-        if (!handled) {
-          printf("[%lu ms] Key: 0x%X (row=%d, col=%d)\n",
-                 event.timestamp, event.key, event.row, event.col);
-        }
+      if (event.state == KEY_HELD) {
+        continue;
+      }
+      
+      // Layers see presses and releases (momentary keys)
+      uint8_t key = event.key;
+      bool handled = keymap_process_key(event.row, event.col,
+                                        event.state == KEY_PRESSED, &key);
+      
+      if (event.state == KEY_PRESSED && !handled) {
+        printf("[%lu ms] Key: 0x%X (row=%d, col=%d)\n",
+               event.timestamp, key, event.row, event.col);
+      } else if (event.state == KEY_PRESSED) {
+        printf("[%lu ms] Function key: 0x%X\n", event.timestamp, key);
       } else if (event.state == KEY_RELEASED) {
-        printf("[%lu ms] Released: 0x%X\n", event.timestamp, event.key);
+        printf("[%lu ms] Released: 0x%X\n", event.timestamp, key);
+      }
+    }
+
+    // Layer changes are printed here, outside the key path
+    uint32_t layers;
+    if (keymap_poll_layers(&layers)) {
+      if (layers & (1u << 1)) {
+        printf("\n>>> FUNCTION MODE ACTIVATED <<<\n");
+        printf("Press 0-E to trigger functions, F to exit.\n\n");
+      } else {
+        printf("\n>>> NORMAL MODE <<<\n\n");
       }
     }
     
@@ -112,6 +140,12 @@ int main(void)
           printf("Ghost key detected (row=%d, col=%d)\n", 
                  error.row, error.col);
           break;
+        case ERROR_SCAN_TIMEOUT:
+          printf("Scan fell behind (%lu ticks missed)\n", error.count);
+          break;
+        case ERROR_SCAN_OVERRUN:
+          printf("Scan overran its period (%lu us)\n", error.count);
+          break;
         default:
           printf("Unknown error\n");
       }
@@ -130,6 +164,9 @@ int main(void)
       printf("Queue overflows: %lu\n", stats.queue_overflows);
       printf("Max scan time:   %lu us\n", stats.max_scan_time_us);
       printf("Avg scan time:   %lu us\n", stats.avg_scan_time_us);
+      printf("Press latency:   p99 <= %lu us, max %lu us\n",
+             latency_hist_percentile(&stats.contact_to_event_us, 99),
+             stats.contact_to_event_us.max);
       printf("------------------\n\n");
       
       last_stats_time = now;
@@ -138,17 +175,13 @@ int main(void)
     // Optional: Enter low power mode after 30 seconds of inactivity
     idle_count++;
     if (idle_count > 30000) {  // ~30 seconds
-      printf("Entering low power mode...\n");
-      matrix_robust_enter_low_power();
-      
-      // Enter STOP mode (wake on EXTI) - G0 is very power efficient!
-      // HAL_PWREx_EnterSTOP1Mode(PWR_STOPENTRY_WFI);
-      // SystemClock_Config();  // Reconfigure clocks after wake
+      printf("Entering STOP mode...\n");
       
-      // Or just sleep lightly
-      HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
-      
-      printf("Woke up from keypress!\n");
+      // STOP until a key is pressed (wake on EXTI) - G0 is very power efficient!; clocks and
+      // scanning are back on return and the waking press is the next event
+      if (matrix_robust_deep_sleep(SystemClock_Config)) {
+        printf("Woke up from keypress!\n");
+      }
       idle_count = 0;
     }
     
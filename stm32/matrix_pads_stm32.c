@@ -0,0 +1,366 @@
+#include "matrix_pads_stm32.h"
+#include "matrix_hal.h"
+#include <string.h>
+
+// Registered pads, in tick order
+static MatrixPad *pads[MATRIX_PADS_MAX];
+static uint8_t pad_count = 0;
+
+// Pins taken by registered pads, per port
+static struct {
+    GPIO_TypeDef *port;
+    uint16_t mask;
+} used_pins[2 * MATRIX_PADS_MAX];
+static uint8_t used_port_count = 0;
+
+// Row strobes of the batched pass: per row port, every pad's rows (idle
+// HIGH) and row r of every pad (strobed LOW)
+static GPIO_TypeDef *row_ports[MATRIX_PADS_MAX];
+static uint16_t row_port_idle[MATRIX_PADS_MAX];
+static uint16_t row_port_low[MATRIX_PADS_MAX][MATRIX_ROWS];
+static uint8_t row_port_count = 0;
+
+// Column ports, one IDR read each per row
+static GPIO_TypeDef *col_ports[MATRIX_PADS_MAX];
+static uint8_t col_port_count = 0;
+
+// Shared timer
+static TIM_HandleTypeDef *pads_timer = NULL;
+static volatile bool pads_running = false;
+static uint32_t pads_interval = 1000;  // us
+
+static void pads_scan(void);
+
+static inline void delay_us(uint32_t us) {
+    uint32_t start = DWT->CYCCNT;
+    uint32_t cycles = us * (SystemCoreClock / 1000000);
+    while ((DWT->CYCCNT - start) < cycles);
+}
+
+static void configure_pad_debounce(MatrixPad *pad) {
+    matrix_engine_configure_debounce(&pad->engine, pad->debounce_mode, pad->debounce_press_ms,
+                                     pad->debounce_release_ms, pads_interval);
+}
+
+// True if none of mask on port is taken by a registered pad
+static bool pins_free(GPIO_TypeDef *port, uint16_t mask) {
+    for (uint8_t i = 0; i < used_port_count; i++) {
+        if (used_pins[i].port == port && (used_pins[i].mask & mask)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void take_pins(GPIO_TypeDef *port, uint16_t mask) {
+    for (uint8_t i = 0; i < used_port_count; i++) {
+        if (used_pins[i].port == port) {
+            used_pins[i].mask |= mask;
+            return;
+        }
+    }
+    used_pins[used_port_count].port = port;
+    used_pins[used_port_count].mask = mask;
+    used_port_count++;
+}
+
+// Slot of port in a port list, added if new
+static uint8_t port_slot(GPIO_TypeDef *ports[], uint8_t *count, GPIO_TypeDef *port) {
+    for (uint8_t i = 0; i < *count; i++) {
+        if (ports[i] == port) {
+            return i;
+        }
+    }
+    ports[*count] = port;
+    return (*count)++;
+}
+
+bool matrix_pad_init(MatrixPad *pad, const GPIO_Pin_t row_pins[MATRIX_ROWS],
+                     const GPIO_Pin_t col_pins[MATRIX_COLS]) {
+    if (pads_running || pad_count >= MATRIX_PADS_MAX) {
+        return false;
+    }
+    
+    // Rows on one port, columns on one port, every pin used once
+    uint16_t row_mask = 0;
+    uint16_t col_mask = 0;
+    for (int i = 0; i < MATRIX_ROWS; i++) {
+        if (row_pins[i].port != row_pins[0].port || (row_mask & row_pins[i].pin)) {
+            return false;
+        }
+        row_mask |= row_pins[i].pin;
+    }
+    for (int i = 0; i < MATRIX_COLS; i++) {
+        if (col_pins[i].port != col_pins[0].port || (col_mask & col_pins[i].pin)) {
+            return false;
+        }
+        col_mask |= col_pins[i].pin;
+    }
+    if (row_pins[0].port == col_pins[0].port && (row_mask & col_mask)) {
+        return false;
+    }
+    if (!pins_free(row_pins[0].port, row_mask) || !pins_free(col_pins[0].port, col_mask)) {
+        return false;
+    }
+    
+    pad->row_port = row_pins[0].port;
+    pad->col_port = col_pins[0].port;
+    pad->row_mask = row_mask;
+    
+    // Default keymap, empty queues, every key released; burst walk, the
+    // shared tick always samples whole pads
+    matrix_engine_init(&pad->engine);
+    pad->engine.strategy = SCAN_STRATEGY_BURST;
+    pad->debounce_mode = DEBOUNCE_DEFER_PRESS_EAGER_RELEASE;
+    pad->debounce_press_ms = DEBOUNCE_PRESS_MS;
+    pad->debounce_release_ms = DEBOUNCE_RELEASE_MS;
+    configure_pad_debounce(pad);
+    
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+    
+    // Rows: outputs, start HIGH (inactive)
+    pad->row_port->BSRR = row_mask;
+    GPIO_InitStruct.Pin = row_mask;
+    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+    GPIO_InitStruct.Pull = GPIO_NOPULL;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+    HAL_GPIO_Init(pad->row_port, &GPIO_InitStruct);
+    
+    // Columns: inputs with pull-up resistors
+    GPIO_InitStruct.Pin = col_mask;
+    GPIO_InitStruct.Mode = GPIO_MODE_INPUT;
+    GPIO_InitStruct.Pull = GPIO_PULLUP;
+    HAL_GPIO_Init(pad->col_port, &GPIO_InitStruct);
+    
+    uint8_t col_bits[MATRIX_COLS];
+    for (int i = 0; i < MATRIX_COLS; i++) {
+        col_bits[i] = __builtin_ctz(col_pins[i].pin);
+    }
+    matrix_gather_init(&pad->col_gather, col_bits);
+    
+    // Merge the rows into the batched strobes of their port
+    uint8_t slot = port_slot(row_ports, &row_port_count, pad->row_port);
+    row_port_idle[slot] |= row_mask;
+    for (int i = 0; i < MATRIX_ROWS; i++) {
+        row_port_low[slot][i] |= row_pins[i].pin;
+    }
+    pad->col_port_slot = port_slot(col_ports, &col_port_count, pad->col_port);
+    
+    take_pins(pad->row_port, row_mask);
+    take_pins(pad->col_port, col_mask);
+    pad->index = pad_count;
+    pads[pad_count++] = pad;
+    return true;
+}
+
+void matrix_pads_clear(void) {
+    if (pads_running) {
+        return;
+    }
+    
+    for (int p = 0; p < pad_count; p++) {
+        matrix_gather_release(&pads[p]->col_gather);
+    }
+    pad_count = 0;
+    used_port_count = 0;
+    row_port_count = 0;
+    col_port_count = 0;
+    memset(row_port_idle, 0, sizeof(row_port_idle));
+    memset(row_port_low, 0, sizeof(row_port_low));
+}
+
+uint8_t matrix_pads_count(void) {
+    return pad_count;
+}
+
+bool matrix_pads_start(TIM_HandleTypeDef *htim, uint32_t scan_frequency_hz) {
+    if (pads_running) {
+        return true;
+    }
+    
+    // Enable DWT cycle counter for microsecond delays
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    
+    pads_timer = htim;
+    pads_interval = 1000000 / (scan_frequency_hz ? scan_frequency_hz : 1);
+    
+    for (uint8_t p = 0; p < pad_count; p++) {
+        configure_pad_debounce(pads[p]);
+        matrix_engine_restart(&pads[p]->engine);
+    }
+    
+    pads_running = (pads_timer != NULL && HAL_TIM_Base_Start_IT(pads_timer) == HAL_OK);
+    return pads_running;
+}
+
+void matrix_pads_stop(void) {
+    if (!pads_running) {
+        return;
+    }
+    
+    HAL_TIM_Base_Stop_IT(pads_timer);
+    for (uint8_t s = 0; s < row_port_count; s++) {
+        row_ports[s]->BSRR = row_port_idle[s];
+    }
+    pads_running = false;
+}
+
+void matrix_pads_timer_callback(TIM_HandleTypeDef *htim) {
+    if (pads_running && htim == pads_timer) {
+        pads_scan();
+    }
+}
+
+// One shared tick: sample every pad in one pass over the rows, then run
+// each pad's engine over its snapshot
+static void pads_scan(void) {
+    uint32_t scan_start = matrix_hal_time_us();
+    matrix_row_t pressed_cols[MATRIX_PADS_MAX][MATRIX_ROWS];
+    uint32_t samples[MATRIX_PADS_MAX];
+    
+    for (int row = 0; row < MATRIX_ROWS; row++) {
+        // Row LOW on every pad, all other rows HIGH, one write per port
+        for (uint8_t s = 0; s < row_port_count; s++) {
+            uint16_t low = row_port_low[s][row];
+            row_ports[s]->BSRR = (row_port_idle[s] & ~low) | ((uint32_t)low << 16);
+        }
+        delay_us(1);
+        
+        // One read per column port (LOW = pressed)
+        for (uint8_t s = 0; s < col_port_count; s++) {
+            samples[s] = ~col_ports[s]->IDR;
+        }
+        
+        for (uint8_t p = 0; p < pad_count; p++) {
+            pressed_cols[p][row] = matrix_gather(&pads[p]->col_gather, samples[pads[p]->col_port_slot]);
+        }
+    }
+    
+    // Rows back to inactive
+    for (uint8_t s = 0; s < row_port_count; s++) {
+        row_ports[s]->BSRR = row_port_idle[s];
+    }
+    
+    uint32_t now = matrix_hal_time_ms();
+    for (uint8_t p = 0; p < pad_count; p++) {
+        MatrixEngine *e = &pads[p]->engine;
+        matrix_engine_tick_begin(e, scan_start, pads_interval);
+        e->stats.total_scans++;
+        for (int row = 0; row < MATRIX_ROWS; row++) {
+            matrix_engine_process_row(e, row, pressed_cols[p][row], now, scan_start);
+        }
+        matrix_engine_tick_end(e, scan_start, pads_interval);
+    }
+}
+
+bool matrix_pads_get_event(KeyEvent *event, uint8_t *pad_index) {
+    MatrixPad *oldest = NULL;
+    uint32_t oldest_us = 0;
+    
+    // Compare the head of every ring without taking it
+    for (uint8_t p = 0; p < pad_count; p++) {
+        void *span;
+        if (!matrix_ring_peek_span(&pads[p]->engine.event_queue, &span)) {
+            continue;
+        }
+        uint32_t confirm_us = ((const KeyEvent *)span)->confirm_us;
+        if (!oldest || (int32_t)(confirm_us - oldest_us) < 0) {
+            oldest = pads[p];
+            oldest_us = confirm_us;
+        }
+    }
+    
+    if (!oldest || !matrix_engine_get_event(&oldest->engine, event)) {
+        return false;
+    }
+    if (pad_index) {
+        *pad_index = oldest->index;
+    }
+    return true;
+}
+void matrix_pad_set_keymap(MatrixPad *pad, const uint8_t keymap[MATRIX_ROWS][MATRIX_COLS]) {
+    memcpy(pad->engine.keymap, keymap, sizeof(pad->engine.keymap));
+}
+
+bool matrix_pad_set_debounce(MatrixPad *pad, DebounceMode mode, uint32_t press_ms, uint32_t release_ms) {
+    if (pads_running) {
+        return false;
+    }
+    
+    pad->debounce_mode = mode;
+    pad->debounce_press_ms = press_ms;
+    pad->debounce_release_ms = release_ms;
+    configure_pad_debounce(pad);
+    return true;
+}
+
+bool matrix_pad_set_repeat(MatrixPad *pad, uint32_t delay_ms, uint32_t interval_ms,
+                           uint32_t min_interval_ms, uint32_t accel_ms) {
+    if (pads_running) {
+        return false;
+    }
+    
+    RepeatConfig config = {
+        .delay_ms = delay_ms,
+        .interval_ms = interval_ms,
+        .min_interval_ms = min_interval_ms,
+        .accel_ms = accel_ms
+    };
+    matrix_engine_configure_repeat(&pad->engine, &config);
+    return true;
+}
+
+bool matrix_pad_set_gestures(MatrixPad *pad, MatrixGestures *gestures) {
+    if (pads_running) {
+        return false;
+    }
+    
+    pad->engine.gestures = gestures;
+    return true;
+}
+
+void matrix_pad_set_key_callback(MatrixPad *pad, KeyEventCallback callback) {
+    pad->engine.key_callback = callback;
+}
+
+void matrix_pad_set_error_callback(MatrixPad *pad, ErrorCallback callback) {
+    pad->engine.error_callback = callback;
+}
+
+void matrix_pad_set_ghost_detection(MatrixPad *pad, bool enable) {
+    pad->engine.ghost_detection_enabled = enable;
+}
+
+void matrix_pad_set_stuck_detection(MatrixPad *pad, bool enable, uint32_t timeout_ms) {
+    pad->engine.stuck_detection_enabled = enable;
+    pad->engine.stuck_key_timeout = timeout_ms;
+}
+
+bool matrix_pad_get_event(MatrixPad *pad, KeyEvent *event) {
+    return matrix_engine_get_event(&pad->engine, event);
+}
+
+size_t matrix_pad_get_events(MatrixPad *pad, KeyEvent *events, size_t max) {
+    return matrix_engine_get_events(&pad->engine, events, max);
+}
+
+bool matrix_pad_get_error(MatrixPad *pad, ErrorEvent *error) {
+    return matrix_engine_get_error(&pad->engine, error);
+}
+
+bool matrix_pad_any_key_pressed(const MatrixPad *pad) {
+    return pad->engine.pressed_count != 0;
+}
+
+void matrix_pad_get_matrix(const MatrixPad *pad, matrix_row_t matrix[MATRIX_ROWS]) {
+    matrix_engine_get_matrix(&pad->engine, matrix);
+}
+
+void matrix_pad_get_statistics(const MatrixPad *pad, ScanStatistics *stats) {
+    matrix_engine_get_statistics(&pad->engine, stats);
+}
+
+void matrix_pad_reset_statistics(MatrixPad *pad) {
+    matrix_engine_reset_statistics(&pad->engine);
+}
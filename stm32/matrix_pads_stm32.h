@@ -0,0 +1,112 @@
+#ifndef MATRIX_PADS_STM32_H
+#define MATRIX_PADS_STM32_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "main.h"
+
+#include "matrix_config.h"
+#include "matrix_engine.h"        // KeyEvent, ErrorEvent, ScanStatistics
+#include "matrix_gather.h"        // MatrixGather
+#include "matrix_robust_stm32.h"  // GPIO_Pin_t
+
+// Several keypads on one controller (STM32)
+//
+// Each pad is a MatrixPad in caller storage (nothing is allocated) with
+// its own pins, key engine, event and error rings. Every registered pad is
+// scanned from one timer interrupt in one batched pass: a row strobe
+// drives row r of every pad with one BSRR write per row port, waits once
+// for the lines to settle and samples the columns with one IDR read per
+// column port. Three pads cost the same MATRIX_ROWS settles per tick as
+// one.
+//
+// All pads have the MATRIX_ROWS x MATRIX_COLS geometry and are scanned in
+// burst (full pass every tick). Each pad needs its rows on one port and
+// its columns on one port (pads may share ports); no pin may be shared
+// between pads or with the matrix_robust_* keypad, which keeps its own
+// timer and can run alongside. Key and error callbacks run in the timer
+// interrupt; auto idle and the DMA backend are not available.
+
+// Pads on the shared tick
+#ifndef MATRIX_PADS_MAX
+#define MATRIX_PADS_MAX 4
+#endif
+
+typedef struct {
+    // Key engine: debounce, detection, event queues, statistics
+    MatrixEngine engine;
+
+    // Debounce settings (the sample period is the shared tick)
+    DebounceMode debounce_mode;
+    uint32_t debounce_press_ms;
+    uint32_t debounce_release_ms;
+
+    // Pins: one row port, one column port
+    GPIO_TypeDef *row_port;
+    GPIO_TypeDef *col_port;
+    uint16_t row_mask;
+    MatrixGather col_gather;
+    uint8_t col_port_slot;  // Column port's sample in the batched pass
+
+    uint8_t index;  // Position on the shared tick (matrix_pads_get_event())
+} MatrixPad;
+
+// Set up a pad's pins and engine (default keymap and debounce, every key
+// released) and add it to the shared tick. The pad must stay valid while
+// registered. Call while the shared tick is stopped.
+// Returns false if scanning, MATRIX_PADS_MAX pads are registered already,
+// the rows or columns span two ports, or a pin is used by another pad
+bool matrix_pad_init(MatrixPad *pad, const GPIO_Pin_t row_pins[MATRIX_ROWS],
+                     const GPIO_Pin_t col_pins[MATRIX_COLS]);
+
+// Take every pad off the shared tick (call while stopped); their pins stay
+// configured
+void matrix_pads_clear(void);
+
+// Number of registered pads
+uint8_t matrix_pads_count(void);
+
+// Start the shared tick on htim (configured in CubeMX to interrupt at
+// scan_frequency_hz, like matrix_robust_init()); each interrupt gives all
+// registered pads one full pass
+// Returns true if scanning is running (or already was)
+bool matrix_pads_start(TIM_HandleTypeDef *htim, uint32_t scan_frequency_hz);
+
+// Stop the shared tick (rows are left HIGH)
+void matrix_pads_stop(void);
+
+// Timer interrupt callback - call from HAL_TIM_PeriodElapsedCallback
+void matrix_pads_timer_callback(TIM_HandleTypeDef *htim);
+
+// Merged event stream: the pad whose oldest queued event was confirmed
+// first hands it out, so presses on different pads keep their order.
+// pad_index (may be NULL) receives that pad's MatrixPad.index. Single
+// consumer, and not mixed with the per-pad getters below.
+// Returns true if an event was available
+bool matrix_pads_get_event(KeyEvent *event, uint8_t *pad_index);
+
+// Per-pad configuration (same meaning as the matrix_robust_* calls)
+void matrix_pad_set_keymap(MatrixPad *pad, const uint8_t keymap[MATRIX_ROWS][MATRIX_COLS]);
+bool matrix_pad_set_debounce(MatrixPad *pad, DebounceMode mode, uint32_t press_ms, uint32_t release_ms);
+bool matrix_pad_set_repeat(MatrixPad *pad, uint32_t delay_ms, uint32_t interval_ms,
+                           uint32_t min_interval_ms, uint32_t accel_ms);
+bool matrix_pad_set_gestures(MatrixPad *pad, MatrixGestures *gestures);
+void matrix_pad_set_key_callback(MatrixPad *pad, KeyEventCallback callback);
+void matrix_pad_set_error_callback(MatrixPad *pad, ErrorCallback callback);
+void matrix_pad_set_ghost_detection(MatrixPad *pad, bool enable);
+void matrix_pad_set_stuck_detection(MatrixPad *pad, bool enable, uint32_t timeout_ms);
+
+// Per-pad consumer side (single consumer per pad, lock-free)
+bool matrix_pad_get_event(MatrixPad *pad, KeyEvent *event);
+size_t matrix_pad_get_events(MatrixPad *pad, KeyEvent *events, size_t max);
+bool matrix_pad_get_error(MatrixPad *pad, ErrorEvent *error);
+bool matrix_pad_any_key_pressed(const MatrixPad *pad);
+void matrix_pad_get_matrix(const MatrixPad *pad, matrix_row_t matrix[MATRIX_ROWS]);
+
+// Per-pad statistics; isr_time_us runs from the start of the shared tick
+// to the end of this pad's share of it
+void matrix_pad_get_statistics(const MatrixPad *pad, ScanStatistics *stats);
+void matrix_pad_reset_statistics(MatrixPad *pad);
+
+#endif // MATRIX_PADS_STM32_H
@@ -1,76 +1,95 @@
 #include "matrix_robust_stm32.h"
-#include <stdio.h>
+#include "matrix_hal.h"
+#include "matrix_gather.h"
 #include <string.h>
 
-// Default keymap
-static const uint8_t DEFAULT_KEYMAP[4][4] = {
-    {0x1, 0x2, 0x3, 0xA},
-    {0x4, 0x5, 0x6, 0xB},
-    {0x7, 0x8, 0x9, 0xC},
-    {0x0, 0xF, 0xE, 0xD}
-};
-
 // Pin configuration
 static GPIO_Pin_t row_gpios[MATRIX_ROWS];
 static GPIO_Pin_t col_gpios[MATRIX_COLS];
 
-// Current keymap
-static uint8_t keymap[MATRIX_ROWS][MATRIX_COLS];
+// Single-register fast path, used when all rows share one port and all
+// columns share one port: one BSRR write per strobe, one IDR read per row
+static bool port_fast_path = false;
+static GPIO_TypeDef *row_port = NULL;
+static GPIO_TypeDef *col_port = NULL;
+static uint32_t row_mask = 0;                      // All row pins (BSRR set half)
+static uint32_t row_select_bsrr[MATRIX_ROWS];      // This row LOW, all others HIGH
+static MatrixGather col_gather;
+
+// Key engine: debounce, detection, event queues, statistics
+static MatrixEngine engine;
 
-// Scanning state (accessed in ISR)
-static volatile uint8_t current_row = 0;
-static volatile uint8_t key_state[MATRIX_ROWS][MATRIX_COLS];
-static volatile uint32_t key_timestamp[MATRIX_ROWS][MATRIX_COLS];
+// Debounce settings (the sample period follows the scan setup)
 static volatile uint32_t debounce_time_press = DEBOUNCE_PRESS_MS;
 static volatile uint32_t debounce_time_release = DEBOUNCE_RELEASE_MS;
-
-// Event queues (circular buffers)
-static KeyEvent event_queue[EVENT_QUEUE_SIZE];
-static volatile uint32_t event_queue_head = 0;
-static volatile uint32_t event_queue_tail = 0;
-
-static ErrorEvent error_queue[ERROR_QUEUE_SIZE];
-static volatile uint32_t error_queue_head = 0;
-static volatile uint32_t error_queue_tail = 0;
-
-// Callbacks
-static volatile KeyEventCallback key_callback = NULL;
-static volatile ErrorCallback error_callback = NULL;
+static DebounceMode debounce_mode = DEBOUNCE_DEFER_PRESS_EAGER_RELEASE;
 
 // Timer handle
 static TIM_HandleTypeDef *scan_timer = NULL;
 static volatile bool scanning_active = false;
-
-// Feature flags
-static volatile bool ghost_detection_enabled = true;
-static volatile bool stuck_detection_enabled = true;
-static volatile uint32_t stuck_key_timeout = STUCK_KEY_TIMEOUT_MS;
-
-// Statistics
-static volatile ScanStatistics stats = {0};
-
-// Ghost key detection buffer
-static volatile uint8_t pressed_keys[MATRIX_ROWS][MATRIX_COLS];
+static uint32_t scan_frequency = 1000;
+static ScanBackend scan_backend = SCAN_BACKEND_TIMER;
+
+// Adaptive scan rate (timer backend; slow frequency 0 = off): the CubeMX
+// period is the fast reload, the slow one is scaled from it
+static uint32_t adaptive_slow_hz = 0;
+static uint32_t adaptive_decay_ms = ADAPTIVE_DECAY_MS;
+static uint32_t fast_reload = 0;
+static uint32_t slow_reload = 0;
+static bool reload_adapted = false;
+
+// DMA backend: the timer's update event writes the next row pattern, its
+// compare event half a period later captures the column port. Captures come
+// in pass order (capture k is row k % MATRIX_ROWS), both halves of the
+// buffer hold whole passes.
+#define DMA_SCAN_HALF (DMA_SCAN_PASSES * MATRIX_ROWS)
+static MatrixDmaConfig dma_config;
+static uint32_t dma_capture_request = 0;           // TIM_DMA_CCx of the capture channel
+static uint32_t dma_batch_us = 1000;               // Time to fill half the capture buffer
+static volatile bool dma_running = false;
+static uint32_t dma_row_bsrr[MATRIX_ROWS];         // row_select_bsrr, one row ahead
+static uint16_t dma_col_samples[2 * DMA_SCAN_HALF];
+
+// Auto idle (scanning stopped until a column edge)
+static volatile bool auto_idle_enabled = false;
+static volatile uint32_t auto_idle_timeout = AUTO_IDLE_TIMEOUT_MS;
+static volatile bool idle_sleeping = false;
+static uint32_t last_activity = 0;
+
+// Deep sleep: the first start after a wake-up samples the matrix at once
+static bool wake_sample_pending = false;
 
 // Forward declarations
 static void scan_matrix(void);
-static bool enqueue_event(KeyEvent *event);
-static bool enqueue_error(ErrorEvent *error);
-static bool detect_ghost_key(uint8_t row, uint8_t col);
-static bool detect_stuck_key(uint8_t row, uint8_t col, uint32_t now);
+static uint32_t micros(void);
+static void update_debounce_config(void);
 static inline void delay_us(uint32_t us);
-
-void matrix_robust_init(const GPIO_Pin_t row_pins[4], const GPIO_Pin_t col_pins[4],
+static void setup_port_fast_path(void);
+static void set_all_rows(GPIO_PinState state);
+static bool any_column_low(void);
+static bool auto_idle_due(uint32_t now);
+static bool enter_auto_idle(void);
+static bool start_scanning(void);
+static void stop_scanning(void);
+static uint32_t setup_slow_reload(void);
+static uint32_t capture_dma_request(uint32_t channel);
+static bool dma_scan_begin(void);
+static void dma_scan_stop(void);
+static void dma_half_callback(DMA_HandleTypeDef *hdma);
+static void dma_full_callback(DMA_HandleTypeDef *hdma);
+
+void matrix_robust_init(const GPIO_Pin_t row_pins[MATRIX_ROWS], const GPIO_Pin_t col_pins[MATRIX_COLS],
                         TIM_HandleTypeDef *htim, uint32_t scan_frequency_hz) {
     // Copy pin assignments
     memcpy(row_gpios, row_pins, sizeof(GPIO_Pin_t) * MATRIX_ROWS);
     memcpy(col_gpios, col_pins, sizeof(GPIO_Pin_t) * MATRIX_COLS);
     
-    // Copy default keymap
-    memcpy(keymap, DEFAULT_KEYMAP, sizeof(keymap));
+    // Default keymap, empty queues, every key released, statistics cleared
+    matrix_engine_init(&engine);
     
     // Store timer handle
     scan_timer = htim;
+    scan_frequency = scan_frequency_hz ? scan_frequency_hz : 1;
     
     // Enable DWT cycle counter for microsecond delays
     CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
@@ -99,318 +118,590 @@ void matrix_robust_init(const GPIO_Pin_t row_pins[4], const GPIO_Pin_t col_pins[
         HAL_GPIO_Init(col_gpios[i].port, &GPIO_InitStruct);
     }
     
+    setup_port_fast_path();
+    
     // Configure timer for scanning
     // Timer should be configured in CubeMX to generate interrupt at scan_frequency_hz
     // For example: 1kHz = interrupt every 1ms
     
-    // Clear state arrays
-    memset((void*)key_state, KEY_IDLE, sizeof(key_state));
-    memset((void*)key_timestamp, 0, sizeof(key_timestamp));
-    memset((void*)pressed_keys, 0, sizeof(pressed_keys));
-    memset((void*)&stats, 0, sizeof(stats));
-    
-    printf("Robust matrix keypad initialized (scan rate: %lu Hz)\n", scan_frequency_hz);
+    update_debounce_config();
 }
 
-void matrix_robust_set_keymap(const uint8_t custom_keymap[4][4]) {
-    memcpy(keymap, custom_keymap, sizeof(keymap));
+void matrix_robust_set_keymap(const uint8_t custom_keymap[MATRIX_ROWS][MATRIX_COLS]) {
+    memcpy(engine.keymap, custom_keymap, sizeof(engine.keymap));
 }
 
-void matrix_robust_start(void) {
-    if (!scanning_active && scan_timer != NULL) {
-        HAL_TIM_Base_Start_IT(scan_timer);
-        scanning_active = true;
-        printf("Scanning started\n");
+bool matrix_robust_set_scan_strategy(ScanStrategy strategy) {
+    if (scanning_active) {
+        return false;
     }
+    
+    engine.strategy = strategy;
+    update_debounce_config();
+    return true;
 }
 
-void matrix_robust_stop(void) {
-    if (scanning_active && scan_timer != NULL) {
-        HAL_TIM_Base_Stop_IT(scan_timer);
-        scanning_active = false;
-        printf("Scanning stopped\n");
+bool matrix_robust_set_backend(ScanBackend backend, const MatrixDmaConfig *dma) {
+    if (scanning_active) {
+        return false;
+    }
+    
+    if (backend == SCAN_BACKEND_DMA) {
+        // One BSRR pattern per row and one IDR capture per row need both
+        // pin groups on a single port
+        if (!port_fast_path || dma == NULL || dma->htim == NULL ||
+            dma->hdma_rows == NULL || dma->hdma_cols == NULL || dma->row_rate_hz == 0) {
+            return false;
+        }
+        
+        uint32_t request = capture_dma_request(dma->capture_channel);
+        uint32_t batch_us = (uint32_t)((uint64_t)DMA_SCAN_HALF * 1000000u / dma->row_rate_hz);
+        if (request == 0 || batch_us == 0) {
+            return false;
+        }
+        
+        // Both streams must run forever on their own, at the widths the
+        // buffers are laid out for
+        const DMA_InitTypeDef *rows = &dma->hdma_rows->Init;
+        const DMA_InitTypeDef *cols = &dma->hdma_cols->Init;
+        if (rows->Mode != DMA_CIRCULAR || rows->Direction != DMA_MEMORY_TO_PERIPH ||
+            rows->MemDataAlignment != DMA_MDATAALIGN_WORD ||
+            cols->Mode != DMA_CIRCULAR || cols->Direction != DMA_PERIPH_TO_MEMORY ||
+            cols->MemDataAlignment != DMA_MDATAALIGN_HALFWORD) {
+            return false;
+        }
+        
+        dma_config = *dma;
+        dma_capture_request = request;
+        dma_batch_us = batch_us;
+        
+        // Row 0 is driven by hand before the timer starts, so the update at
+        // the end of each period selects the following row
+        for (int i = 0; i < MATRIX_ROWS; i++) {
+            dma_row_bsrr[i] = row_select_bsrr[(i + 1) % MATRIX_ROWS];
+        }
     }
+    
+    scan_backend = backend;
+    update_debounce_config();
+    return true;
 }
 
-void matrix_robust_set_key_callback(KeyEventCallback callback) {
-    key_callback = callback;
+bool matrix_robust_set_debounce(DebounceMode mode, uint32_t press_ms, uint32_t release_ms) {
+    if (scanning_active) {
+        return false;
+    }
+    
+    debounce_mode = mode;
+    debounce_time_press = press_ms;
+    debounce_time_release = release_ms;
+    update_debounce_config();
+    return true;
 }
 
-void matrix_robust_set_error_callback(ErrorCallback callback) {
-    error_callback = callback;
+bool matrix_robust_set_adaptive_rate(uint32_t slow_frequency_hz, uint32_t decay_ms) {
+    if (scanning_active) {
+        return false;
+    }
+    
+    // A slow rate that is not below the scan rate is no rate change
+    adaptive_slow_hz = (slow_frequency_hz < scan_frequency) ? slow_frequency_hz : 0;
+    adaptive_decay_ms = decay_ms;
+    return true;
 }
 
-// Timer interrupt callback - call from HAL_TIM_PeriodElapsedCallback
-void matrix_robust_timer_callback(TIM_HandleTypeDef *htim) {
-    if (htim == scan_timer) {
-        scan_matrix();
+bool matrix_robust_set_repeat(uint32_t delay_ms, uint32_t interval_ms,
+                              uint32_t min_interval_ms, uint32_t accel_ms) {
+    if (scanning_active) {
+        return false;
     }
+    
+    RepeatConfig config = {
+        .delay_ms = delay_ms,
+        .interval_ms = interval_ms,
+        .min_interval_ms = min_interval_ms,
+        .accel_ms = accel_ms
+    };
+    matrix_engine_configure_repeat(&engine, &config);
+    return true;
 }
 
-static void scan_matrix(void) {
-    uint32_t scan_start = DWT->CYCCNT;
-    stats.total_scans++;
+// Convert the debounce times into sample counts for the current scan setup
+static void update_debounce_config(void) {
+    uint32_t sample_period_us = 1000000 / scan_frequency;
     
-    // Set all rows HIGH first
-    for (int i = 0; i < MATRIX_ROWS; i++) {
-        HAL_GPIO_WritePin(row_gpios[i].port, row_gpios[i].pin, GPIO_PIN_SET);
+    if (scan_backend == SCAN_BACKEND_DMA) {
+        sample_period_us = dma_batch_us;  // One combined sample per batch
+    } else if (engine.strategy == SCAN_STRATEGY_INTERLEAVED) {
+        sample_period_us *= MATRIX_ROWS;
     }
     
-    // Activate current row (set LOW)
-    HAL_GPIO_WritePin(row_gpios[current_row].port, row_gpios[current_row].pin, GPIO_PIN_RESET);
-    
-    // Small delay for signal settling
-    delay_us(1);
+    matrix_engine_configure_debounce(&engine, debounce_mode,
+                                     debounce_time_press, debounce_time_release, sample_period_us);
+}
+
+bool matrix_robust_start(void) {
+    if (idle_sleeping) {
+        // Stopped by auto idle: the timer is already off
+        matrix_robust_disable_wake_interrupt();
+        idle_sleeping = false;
+    }
     
-    uint32_t now = HAL_GetTick();
+    if (!scanning_active) {
+        start_scanning();
+    }
     
-    // Read all columns for this row
-    for (int col = 0; col < MATRIX_COLS; col++) {
-        GPIO_PinState pin_state = HAL_GPIO_ReadPin(col_gpios[col].port, col_gpios[col].pin);
-        bool pressed = (pin_state == GPIO_PIN_RESET);  // LOW = pressed
-        uint8_t current_state = key_state[current_row][col];
-        uint32_t last_change = key_timestamp[current_row][col];
-        
-        // State machine with debouncing
-        if (pressed) {
-            if (current_state == KEY_IDLE && last_change == 0) {
-                // First detection of press - start debounce timer
-                key_timestamp[current_row][col] = now;
-                // Stay in IDLE state
-            } else if (current_state == KEY_IDLE && last_change != 0 && (now - last_change) >= debounce_time_press) {
-                // Debounced press confirmed
-                
-                // Ghost key detection
-                if (ghost_detection_enabled && detect_ghost_key(current_row, col)) {
-                    ErrorEvent error = {
-                        .error_code = ERROR_GHOST_KEY,
-                        .row = current_row,
-                        .col = col,
-                        .timestamp = now
-                    };
-                    enqueue_error(&error);
-                    continue;
-                }
-                
-                // Create press event
-                KeyEvent event = {
-                    .key = keymap[current_row][col],
-                    .state = KEY_PRESSED,
-                    .row = current_row,
-                    .col = col,
-                    .timestamp = now
-                };
-                
-                key_state[current_row][col] = KEY_PRESSED;
-                pressed_keys[current_row][col] = 1;
-                
-                // Enqueue or call callback
-                if (key_callback) {
-                    key_callback(&event);
-                } else {
-                    enqueue_event(&event);
-                }
-                
-                stats.total_events++;
-            } else if (current_state == KEY_PRESSED) {
-                // Key is held
-                key_state[current_row][col] = KEY_HELD;
-                
-                // Stuck key detection
-                if (stuck_detection_enabled && detect_stuck_key(current_row, col, now)) {
-                    ErrorEvent error = {
-                        .error_code = ERROR_STUCK_KEY,
-                        .row = current_row,
-                        .col = col,
-                        .timestamp = now
-                    };
-                    enqueue_error(&error);
-                }
-            }
-        } else {
-            // Key not pressed - immediate release (no debounce for now)
-            if (current_state == KEY_PRESSED || current_state == KEY_HELD) {
-                KeyEvent event = {
-                    .key = keymap[current_row][col],
-                    .state = KEY_RELEASED,
-                    .row = current_row,
-                    .col = col,
-                    .timestamp = now
-                };
-                
-                key_state[current_row][col] = KEY_IDLE;
-                pressed_keys[current_row][col] = 0;
-                key_timestamp[current_row][col] = 0;  // Reset timestamp
-                
-                // Enqueue or call callback
-                if (key_callback) {
-                    key_callback(&event);
-                } else {
-                    enqueue_event(&event);
-                }
-                
-                stats.total_events++;
-            }
+    return scanning_active;
+}
+
+void matrix_robust_stop(void) {
+    if (idle_sleeping) {
+        matrix_robust_disable_wake_interrupt();
+        idle_sleeping = false;
+    } else if (scanning_active) {
+        stop_scanning();
+    }
+}
+
+// Start the active backend (no logging, safe from interrupt context)
+static bool start_scanning(void) {
+    last_activity = HAL_GetTick();
+    
+    // The DMA backend scans without the CPU, only the timer tick adapts
+    AdaptiveRateConfig rate = {
+        .fast_us = 1000000 / scan_frequency,
+        .slow_us = 0,
+        .decay_ms = adaptive_decay_ms
+    };
+    if (scan_backend == SCAN_BACKEND_TIMER && scan_timer != NULL && adaptive_slow_hz) {
+        rate.slow_us = setup_slow_reload();
+    }
+    matrix_engine_configure_adaptive_rate(&engine, &rate);
+    matrix_engine_restart(&engine);
+    
+    // The key that ended a deep sleep is read now, not one tick later
+    // (the DMA backend captures it in its first half buffer)
+    if (wake_sample_pending) {
+        wake_sample_pending = false;
+        if (scan_backend == SCAN_BACKEND_TIMER) {
+            matrix_engine_scan_all(&engine, matrix_engine_tick_interval(&engine));
         }
     }
     
-    // Deactivate current row
-    HAL_GPIO_WritePin(row_gpios[current_row].port, row_gpios[current_row].pin, GPIO_PIN_SET);
+    if (scan_backend == SCAN_BACKEND_DMA) {
+        scanning_active = dma_scan_begin();
+    } else {
+        scanning_active = (scan_timer != NULL && HAL_TIM_Base_Start_IT(scan_timer) == HAL_OK);
+    }
+    return scanning_active;
+}
+
+static void stop_scanning(void) {
+    if (scan_backend == SCAN_BACKEND_DMA) {
+        dma_scan_stop();
+    } else {
+        HAL_TIM_Base_Stop_IT(scan_timer);
+    }
     
-    // Move to next row
-    current_row = (current_row + 1) % MATRIX_ROWS;
+    // Leave the timer at the period CubeMX gave it
+    if (reload_adapted) {
+        __HAL_TIM_SET_AUTORELOAD(scan_timer, fast_reload);
+        reload_adapted = false;
+    }
+    scanning_active = false;
     
-    // Update scan time statistics
-    uint32_t scan_time = (DWT->CYCCNT - scan_start) / (SystemCoreClock / 1000000);
-    if (scan_time > stats.max_scan_time_us) {
-        stats.max_scan_time_us = scan_time;
+    // Nothing ticks now, so hand out what the trace holds
+    if (engine.trace) {
+        matrix_trace_close(engine.trace);
     }
-    stats.avg_scan_time_us = ((stats.avg_scan_time_us * (stats.total_scans - 1)) + scan_time) / stats.total_scans;
 }
 
-static bool enqueue_event(KeyEvent *event) {
-    uint32_t primask = __get_PRIMASK();
-    __disable_irq();
+// Scale the timer period to the slow rate, clamped to the counter width
+// Returns the slow tick interval the clamped reload gives
+static uint32_t setup_slow_reload(void) {
+    fast_reload = __HAL_TIM_GET_AUTORELOAD(scan_timer);
     
-    uint32_t next_head = (event_queue_head + 1) % EVENT_QUEUE_SIZE;
-    
-    if (next_head == event_queue_tail) {
-        // Queue full
-        stats.queue_overflows++;
-        __set_PRIMASK(primask);
-        return false;
+    uint64_t counts = (uint64_t)(fast_reload + 1) * scan_frequency / adaptive_slow_hz;
+    uint64_t max_counts = IS_TIM_32B_COUNTER_INSTANCE(scan_timer->Instance) ? 0x100000000ull : 0x10000ull;
+    if (counts > max_counts) {
+        counts = max_counts;
     }
+    slow_reload = (uint32_t)(counts - 1);
+    reload_adapted = true;
     
-    event_queue[event_queue_head] = *event;
-    event_queue_head = next_head;
+    return (uint32_t)(counts * (1000000 / scan_frequency) / (fast_reload + 1));
+}
+
+void matrix_robust_set_auto_idle(bool enable, uint32_t idle_timeout_ms) {
+    auto_idle_timeout = idle_timeout_ms;
+    auto_idle_enabled = enable;
     
-    __set_PRIMASK(primask);
-    return true;
+    if (!enable && idle_sleeping) {
+        // Nothing but a keypress would wake us any more, resume now
+        matrix_robust_start();
+    }
 }
 
-static bool enqueue_error(ErrorEvent *error) {
-    uint32_t primask = __get_PRIMASK();
-    __disable_irq();
+bool matrix_robust_is_idle(void) {
+    return idle_sleeping;
+}
+
+void matrix_robust_set_key_callback(KeyEventCallback callback) {
+    engine.key_callback = callback;
+}
+
+void matrix_robust_set_error_callback(ErrorCallback callback) {
+    engine.error_callback = callback;
+}
+
+// Precompute BSRR patterns and the IDR gather if the pins allow it
+static void setup_port_fast_path(void) {
+    uint8_t col_bits[MATRIX_COLS];
     
-    uint32_t next_head = (error_queue_head + 1) % ERROR_QUEUE_SIZE;
+    port_fast_path = true;
+    row_port = row_gpios[0].port;
+    col_port = col_gpios[0].port;
     
-    if (next_head == error_queue_tail) {
-        __set_PRIMASK(primask);
-        return false;
+    row_mask = 0;
+    for (int i = 0; i < MATRIX_ROWS; i++) {
+        if (row_gpios[i].port != row_port) {
+            port_fast_path = false;
+        }
+        row_mask |= row_gpios[i].pin;
+    }
+    for (int i = 0; i < MATRIX_ROWS; i++) {
+        // BSRR: lower half sets pins, upper half resets them
+        row_select_bsrr[i] = (row_mask & ~(uint32_t)row_gpios[i].pin) | ((uint32_t)row_gpios[i].pin << 16);
     }
     
-    error_queue[error_queue_head] = *error;
-    error_queue_head = next_head;
-    stats.total_errors++;
+    for (int i = 0; i < MATRIX_COLS; i++) {
+        if (col_gpios[i].port != col_port) {
+            port_fast_path = false;
+        }
+        col_bits[i] = __builtin_ctz(col_gpios[i].pin);
+    }
+    matrix_gather_init(&col_gather, col_bits);
+}
+
+// Timer interrupt callback - call from HAL_TIM_PeriodElapsedCallback
+void matrix_robust_timer_callback(TIM_HandleTypeDef *htim) {
+    if (htim == scan_timer) {
+        scan_matrix();
+    }
+}
+
+// One timer tick: the engine walks the rows through the hooks below
+static void scan_matrix(void) {
+    uint32_t interval = matrix_engine_tick_interval(&engine);
+    matrix_engine_scan(&engine, interval);
+    
+    // Adaptive rate: the update event just fired, so the counter is still
+    // below either reload and the new period starts with this one
+    uint32_t next_interval = matrix_engine_tick_interval(&engine);
+    if (next_interval != interval) {
+        __HAL_TIM_SET_AUTORELOAD(scan_timer, next_interval > interval ? slow_reload : fast_reload);
+    }
+    
+    if (auto_idle_due(HAL_GetTick())) {
+        enter_auto_idle();
+    }
+}
+
+// TIM_DMA_CCx request of a capture channel (0 if it is not a channel)
+static uint32_t capture_dma_request(uint32_t channel) {
+    switch (channel) {
+    case TIM_CHANNEL_1: return TIM_DMA_CC1;
+    case TIM_CHANNEL_2: return TIM_DMA_CC2;
+    case TIM_CHANNEL_3: return TIM_DMA_CC3;
+    case TIM_CHANNEL_4: return TIM_DMA_CC4;
+    default:            return 0;
+    }
+}
+
+// Arm both streams and start the row timer (no logging, ISR safe)
+static bool dma_scan_begin(void) {
+    TIM_HandleTypeDef *htim = dma_config.htim;
     
-    __set_PRIMASK(primask);
+    // Sample the columns half way through each row period
+    HAL_TIM_Base_Stop(htim);
+    __HAL_TIM_SET_COUNTER(htim, 0);
+    __HAL_TIM_SET_COMPARE(htim, dma_config.capture_channel, (__HAL_TIM_GET_AUTORELOAD(htim) + 1) / 2);
     
-    if (error_callback) {
-        error_callback(error);
+    dma_config.hdma_cols->XferHalfCpltCallback = dma_half_callback;
+    dma_config.hdma_cols->XferCpltCallback = dma_full_callback;
+    if (HAL_DMA_Start(dma_config.hdma_rows, (uint32_t)dma_row_bsrr,
+                      (uint32_t)&row_port->BSRR, MATRIX_ROWS) != HAL_OK) {
+        return false;
+    }
+    if (HAL_DMA_Start_IT(dma_config.hdma_cols, (uint32_t)&col_port->IDR,
+                         (uint32_t)dma_col_samples, 2 * DMA_SCAN_HALF) != HAL_OK) {
+        HAL_DMA_Abort(dma_config.hdma_rows);
+        return false;
     }
     
-    return true;
+    row_port->BSRR = row_select_bsrr[0];
+    __HAL_TIM_ENABLE_DMA(htim, TIM_DMA_UPDATE | dma_capture_request);
+    dma_running = (HAL_TIM_Base_Start(htim) == HAL_OK);
+    if (!dma_running) {
+        __HAL_TIM_DISABLE_DMA(htim, TIM_DMA_UPDATE | dma_capture_request);
+        HAL_DMA_Abort(dma_config.hdma_cols);
+        HAL_DMA_Abort(dma_config.hdma_rows);
+        row_port->BSRR = row_mask;
+    }
+    return dma_running;
 }
 
-bool matrix_robust_get_event(KeyEvent *event) {
-    uint32_t primask = __get_PRIMASK();
-    __disable_irq();
+// Stop the row timer and both streams, rows back HIGH (idempotent)
+static void dma_scan_stop(void) {
+    if (!dma_running) {
+        return;
+    }
     
-    if (event_queue_head == event_queue_tail) {
-        __set_PRIMASK(primask);
-        return false;  // Queue empty
+    HAL_TIM_Base_Stop(dma_config.htim);
+    __HAL_TIM_DISABLE_DMA(dma_config.htim, TIM_DMA_UPDATE | dma_capture_request);
+    HAL_DMA_Abort(dma_config.hdma_cols);
+    HAL_DMA_Abort(dma_config.hdma_rows);
+    row_port->BSRR = row_mask;
+    dma_running = false;
+}
+
+// One half of the capture buffer is full: fold its passes into one sample
+// per row (matrix_engine_process_batch) while DMA fills the other half
+static void dma_scan_batch(const uint16_t *samples) {
+    uint32_t scan_start = micros();
+    uint32_t now = HAL_GetTick();
+    matrix_row_t any_pressed[MATRIX_ROWS] = {0};
+    matrix_row_t all_pressed[MATRIX_ROWS];
+    
+    matrix_engine_tick_begin(&engine, scan_start, dma_batch_us);
+    memset(all_pressed, 0xFF, sizeof(all_pressed));
+    
+    for (uint32_t pass = 0; pass < DMA_SCAN_HALF; pass += MATRIX_ROWS) {
+        for (int row = 0; row < MATRIX_ROWS; row++) {
+            // Column pins are active LOW
+            matrix_row_t pressed_cols = matrix_gather(&col_gather, ~(uint32_t)samples[pass + row]);
+            any_pressed[row] |= pressed_cols;
+            all_pressed[row] &= pressed_cols;
+        }
     }
+    engine.stats.total_scans += DMA_SCAN_HALF;
     
-    *event = event_queue[event_queue_tail];
-    event_queue_tail = (event_queue_tail + 1) % EVENT_QUEUE_SIZE;
+    for (int row = 0; row < MATRIX_ROWS; row++) {
+        matrix_engine_process_batch(&engine, row, any_pressed[row], all_pressed[row], now, scan_start);
+    }
     
-    __set_PRIMASK(primask);
-    return true;
+    matrix_engine_tick_end(&engine, scan_start, dma_batch_us);
+    
+    if (auto_idle_due(now)) {
+        dma_scan_stop();
+        if (!enter_auto_idle()) {
+            dma_scan_begin();
+        }
+    }
 }
 
-bool matrix_robust_get_error(ErrorEvent *error) {
-    uint32_t primask = __get_PRIMASK();
-    __disable_irq();
+// Capture stream callbacks, reached through HAL_DMA_IRQHandler
+static void dma_half_callback(DMA_HandleTypeDef *hdma) {
+    dma_scan_batch(&dma_col_samples[0]);
+}
+
+static void dma_full_callback(DMA_HandleTypeDef *hdma) {
+    dma_scan_batch(&dma_col_samples[DMA_SCAN_HALF]);
+}
+
+// True once auto idle is on and every key has been released (nothing
+// pressed, blocked or in debounce) for auto_idle_timeout
+static bool auto_idle_due(uint32_t now) {
+    if (!auto_idle_enabled) {
+        return false;
+    }
     
-    if (error_queue_head == error_queue_tail) {
-        __set_PRIMASK(primask);
+    if (!matrix_engine_quiet(&engine)) {
+        last_activity = now;
         return false;
     }
     
-    *error = error_queue[error_queue_tail];
-    error_queue_tail = (error_queue_tail + 1) % ERROR_QUEUE_SIZE;
+    return (now - last_activity) >= auto_idle_timeout;
+}
+
+// Stop the scan timer and park the matrix for EXTI wake (timer ISR context)
+static bool enter_auto_idle(void) {
+    matrix_robust_enable_wake_interrupt();
     
-    __set_PRIMASK(primask);
+    // A key that went down before EXTI was armed would never produce its
+    // edge, so keep scanning if any column is already LOW
+    delay_us(1);
+    if (any_column_low()) {
+        matrix_robust_disable_wake_interrupt();
+        return false;
+    }
+    
+    stop_scanning();
+    idle_sleeping = true;
+    matrix_engine_count_idle(&engine);
     return true;
 }
 
-bool matrix_robust_any_key_pressed(void) {
-    for (int row = 0; row < MATRIX_ROWS; row++) {
-        for (int col = 0; col < MATRIX_COLS; col++) {
-            if (key_state[row][col] != KEY_IDLE) {
-                return true;
-            }
+static void set_all_rows(GPIO_PinState state) {
+    if (port_fast_path) {
+        row_port->BSRR = (state == GPIO_PIN_SET) ? row_mask : (row_mask << 16);
+    } else {
+        for (int i = 0; i < MATRIX_ROWS; i++) {
+            HAL_GPIO_WritePin(row_gpios[i].port, row_gpios[i].pin, state);
+        }
+    }
+}
+
+static bool any_column_low(void) {
+    if (port_fast_path) {
+        return (col_port->IDR & col_gather.port_mask) != col_gather.port_mask;
+    }
+    
+    for (int i = 0; i < MATRIX_COLS; i++) {
+        if (HAL_GPIO_ReadPin(col_gpios[i].port, col_gpios[i].pin) == GPIO_PIN_RESET) {
+            return true;
         }
     }
     return false;
 }
 
-uint32_t matrix_robust_get_event_count(void) {
-    uint32_t primask = __get_PRIMASK();
-    __disable_irq();
+// Hardware hooks for the key engine (matrix_hal.h)
+uint32_t matrix_hal_time_us(void) {
+    return micros();
+}
+
+uint32_t matrix_hal_time_ms(void) {
+    return HAL_GetTick();
+}
+
+void matrix_hal_rows_idle(void) {
+    set_all_rows(GPIO_PIN_SET);
+}
+
+// Strobe one row and sample its columns (rows must all be HIGH on entry)
+matrix_row_t matrix_hal_read_row(uint8_t row) {
+    if (port_fast_path) {
+        // Activate row (set LOW), every other row HIGH, in one write
+        row_port->BSRR = row_select_bsrr[row];
+        delay_us(1);
+        
+        // Read all columns for this row in one read (LOW = pressed)
+        matrix_row_t pressed_cols = matrix_gather(&col_gather, ~col_port->IDR);
+        
+        // Deactivate row
+        row_port->BSRR = row_gpios[row].pin;
+        return pressed_cols;
+    }
     
-    uint32_t count;
-    if (event_queue_head >= event_queue_tail) {
-        count = event_queue_head - event_queue_tail;
-    } else {
-        count = EVENT_QUEUE_SIZE - event_queue_tail + event_queue_head;
+    // Activate row (set LOW)
+    HAL_GPIO_WritePin(row_gpios[row].port, row_gpios[row].pin, GPIO_PIN_RESET);
+    
+    // Small delay for signal settling
+    delay_us(1);
+    
+    // Read all columns for this row (LOW = pressed)
+    matrix_row_t pressed_cols = 0;
+    for (int col = 0; col < MATRIX_COLS; col++) {
+        if (HAL_GPIO_ReadPin(col_gpios[col].port, col_gpios[col].pin) == GPIO_PIN_RESET) {
+            pressed_cols |= (1u << col);
+        }
     }
     
-    __set_PRIMASK(primask);
-    return count;
+    // Deactivate row
+    HAL_GPIO_WritePin(row_gpios[row].port, row_gpios[row].pin, GPIO_PIN_SET);
+    
+    return pressed_cols;
+}
+
+bool matrix_robust_get_event(KeyEvent *event) {
+    return matrix_engine_get_event(&engine, event);
+}
+
+size_t matrix_robust_get_events(KeyEvent *events, size_t max) {
+    return matrix_engine_get_events(&engine, events, max);
+}
+
+size_t matrix_robust_peek_events(const KeyEvent **span) {
+    return matrix_engine_peek_events(&engine, span);
+}
+
+void matrix_robust_commit_events(size_t count) {
+    matrix_engine_commit_events(&engine, count);
+}
+
+bool matrix_robust_get_error(ErrorEvent *error) {
+    return matrix_engine_get_error(&engine, error);
+}
+
+bool matrix_robust_any_key_pressed(void) {
+    return engine.pressed_count != 0;
+}
+
+void matrix_robust_get_matrix(matrix_row_t matrix[MATRIX_ROWS]) {
+    matrix_engine_get_matrix(&engine, matrix);
+}
+
+uint32_t matrix_robust_get_event_count(void) {
+    return matrix_ring_count(&engine.event_queue);
 }
 
 void matrix_robust_clear_events(void) {
-    uint32_t primask = __get_PRIMASK();
-    __disable_irq();
-    
-    event_queue_head = 0;
-    event_queue_tail = 0;
-    
-    __set_PRIMASK(primask);
+    matrix_ring_clear(&engine.event_queue);
 }
 
 void matrix_robust_set_ghost_detection(bool enable) {
-    ghost_detection_enabled = enable;
+    engine.ghost_detection_enabled = enable;
 }
 
 void matrix_robust_set_stuck_detection(bool enable, uint32_t timeout_ms) {
-    stuck_detection_enabled = enable;
-    stuck_key_timeout = timeout_ms;
+    engine.stuck_detection_enabled = enable;
+    engine.stuck_key_timeout = timeout_ms;
 }
 
-static bool detect_ghost_key(uint8_t row, uint8_t col) {
-    // Ghost keys occur when 3+ keys form a rectangle
-    uint8_t keys_in_row = 0;
-    uint8_t keys_in_col = 0;
-    
-    // Count pressed keys in this row
-    for (int c = 0; c < MATRIX_COLS; c++) {
-        if (pressed_keys[row][c]) keys_in_row++;
+bool matrix_robust_apply_settings(const MatrixSettings *settings) {
+    if (scanning_active || !matrix_settings_valid(settings)) {
+        return false;
     }
     
-    // Count pressed keys in this column
-    for (int r = 0; r < MATRIX_ROWS; r++) {
-        if (pressed_keys[r][col]) keys_in_col++;
+    uint32_t press_ms, release_ms;
+    matrix_settings_debounce(settings, &press_ms, &release_ms);
+    matrix_robust_set_debounce((DebounceMode)settings->debounce_mode, press_ms, release_ms);
+    matrix_robust_set_keymap(settings->keymap);
+    matrix_robust_set_ghost_detection(settings->flags & MATRIX_SETTINGS_GHOST_DETECTION);
+    matrix_robust_set_stuck_detection(settings->flags & MATRIX_SETTINGS_STUCK_DETECTION,
+                                      settings->stuck_timeout_ms);
+    return true;
+}
+
+bool matrix_robust_set_trace(MatrixTrace *trace) {
+    if (scanning_active) {
+        return false;
     }
     
-    // Simple ghost detection: if 2+ keys in row AND 2+ keys in col, might be ghost
-    return (keys_in_row >= 2 && keys_in_col >= 2);
+    if (trace && scan_backend == SCAN_BACKEND_DMA) {
+        matrix_trace_init(trace, dma_batch_us, MATRIX_TRACE_FLAG_BURST);
+    } else if (trace) {
+        matrix_trace_init(trace, 1000000 / scan_frequency,
+                          engine.strategy == SCAN_STRATEGY_BURST ? MATRIX_TRACE_FLAG_BURST : 0);
+    }
+    engine.trace = trace;
+    return true;
+}
+
+void matrix_robust_trace_flush(void) {
+    MatrixTrace *trace = engine.trace;
+    if (trace) {
+        matrix_trace_request_flush(trace);
+    }
 }
 
-static bool detect_stuck_key(uint8_t row, uint8_t col, uint32_t now) {
-    uint32_t press_time = key_timestamp[row][col];
-    return ((now - press_time) > stuck_key_timeout);
+bool matrix_robust_set_gestures(MatrixGestures *gestures) {
+    if (scanning_active) {
+        return false;
+    }
+    
+    engine.gestures = gestures;
+    return true;
 }
 
 void matrix_robust_enable_wake_interrupt(void) {
@@ -423,6 +714,9 @@ void matrix_robust_enable_wake_interrupt(void) {
         GPIO_InitStruct.Pull = GPIO_PULLUP;
         HAL_GPIO_Init(col_gpios[i].port, &GPIO_InitStruct);
     }
+    
+    // All rows LOW, so any pressed key pulls its column down
+    set_all_rows(GPIO_PIN_RESET);
 }
 
 void matrix_robust_disable_wake_interrupt(void) {
@@ -436,6 +730,9 @@ void matrix_robust_disable_wake_interrupt(void) {
         GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
         HAL_GPIO_Init(col_gpios[i].port, &GPIO_InitStruct);
     }
+    
+    // Rows back to inactive
+    set_all_rows(GPIO_PIN_SET);
 }
 
 // EXTI interrupt callback - call from HAL_GPIO_EXTI_Callback
@@ -443,8 +740,13 @@ void matrix_robust_exti_callback(uint16_t GPIO_Pin) {
     // Check if it's one of our column pins
     for (int i = 0; i < MATRIX_COLS; i++) {
         if (GPIO_Pin == col_gpios[i].pin) {
-            // Wake from low power - start scanning
-            if (!scanning_active) {
+            if (idle_sleeping) {
+                // Wake from auto idle (quietly, this is interrupt context)
+                matrix_robust_disable_wake_interrupt();
+                idle_sleeping = false;
+                start_scanning();
+            } else if (!scanning_active) {
+                // Wake from low power - start scanning
                 matrix_robust_exit_low_power();
             }
             break;
@@ -453,29 +755,132 @@ void matrix_robust_exti_callback(uint16_t GPIO_Pin) {
 }
 
 void matrix_robust_get_statistics(ScanStatistics *stats_out) {
-    *stats_out = stats;
+    matrix_engine_get_statistics(&engine, stats_out);
 }
 
 void matrix_robust_reset_statistics(void) {
-    memset((void*)&stats, 0, sizeof(stats));
+    matrix_engine_reset_statistics(&engine);
+}
+
+bool matrix_robust_stream_hello(MatrixStream *stream) {
+    uint8_t payload[3];
+    uint8_t *p = payload;
+    p = matrix_stream_u8(p, MATRIX_STREAM_VERSION);
+    p = matrix_stream_u8(p, MATRIX_ROWS);
+    p = matrix_stream_u8(p, MATRIX_COLS);
+    return matrix_stream_put(stream, STREAM_REC_HELLO, payload, p - payload);
+}
+
+bool matrix_robust_stream_event(MatrixStream *stream, const KeyEvent *event) {
+    uint8_t payload[17];
+    uint8_t *p = payload;
+    p = matrix_stream_u8(p, event->key);
+    p = matrix_stream_u8(p, event->state);
+    p = matrix_stream_u8(p, event->row);
+    p = matrix_stream_u8(p, event->col);
+    p = matrix_stream_u8(p, event->gesture);
+    p = matrix_stream_u32(p, event->timestamp);
+    p = matrix_stream_u32(p, event->contact_us);
+    p = matrix_stream_u32(p, event->confirm_us);
+    return matrix_stream_put(stream, STREAM_REC_KEY, payload, p - payload);
+}
+
+bool matrix_robust_stream_error(MatrixStream *stream, const ErrorEvent *error) {
+    uint8_t payload[11];
+    uint8_t *p = payload;
+    p = matrix_stream_u8(p, error->error_code);
+    p = matrix_stream_u8(p, error->row);
+    p = matrix_stream_u8(p, error->col);
+    p = matrix_stream_u32(p, error->count);
+    p = matrix_stream_u32(p, error->timestamp);
+    return matrix_stream_put(stream, STREAM_REC_ERROR, payload, p - payload);
+}
+
+bool matrix_robust_stream_statistics(MatrixStream *stream) {
+    ScanStatistics s;
+    matrix_robust_get_statistics(&s);
+    
+    uint8_t payload[40];
+    uint8_t *p = payload;
+    p = matrix_stream_u32(p, s.total_scans);
+    p = matrix_stream_u32(p, s.total_events);
+    p = matrix_stream_u32(p, s.total_errors);
+    p = matrix_stream_u32(p, s.queue_overflows);
+    p = matrix_stream_u32(p, s.max_scan_time_us);
+    p = matrix_stream_u32(p, s.avg_scan_time_us);
+    p = matrix_stream_u32(p, s.missed_scans);
+    p = matrix_stream_u32(p, s.scan_overruns);
+    p = matrix_stream_u32(p, latency_hist_percentile(&s.contact_to_event_us, 99));
+    p = matrix_stream_u32(p, s.contact_to_event_us.max);
+    return matrix_stream_put(stream, STREAM_REC_STATS, payload, p - payload);
 }
 
 void matrix_robust_enter_low_power(void) {
     matrix_robust_stop();
     matrix_robust_enable_wake_interrupt();
-    printf("Entered low power mode (wake on keypress)\n");
     
-    // Optional: Enter STOP mode (uncomment if you want deep sleep)
-    // HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI);
+    // For STOP mode use matrix_robust_deep_sleep() instead
 }
 
 void matrix_robust_exit_low_power(void) {
-    // If using STOP mode, you may need to reconfigure clocks here
-    // SystemClock_Config();
-    
     matrix_robust_disable_wake_interrupt();
     matrix_robust_start();
-    printf("Exited low power mode\n");
+}
+
+bool matrix_robust_deep_sleep(void (*clock_config)(void)) {
+    bool was_scanning = scanning_active || idle_sleeping;
+    matrix_robust_stop();
+    matrix_robust_enable_wake_interrupt();
+    
+    // A key that is already down would never produce its edge
+    delay_us(1);
+    if (any_column_low()) {
+        matrix_robust_disable_wake_interrupt();
+        if (was_scanning) {
+            start_scanning();
+        }
+        return false;
+    }
+    
+    // With PRIMASK set the EXTI still ends WFI but its handler waits until
+    // the clocks and scanning are back, then finds nothing left to do
+    __disable_irq();
+    HAL_SuspendTick();
+    HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI);
+    
+    // Woken up on HSI: PLL back first, micros() is only right after that
+    if (clock_config != NULL) {
+        clock_config();
+    }
+    HAL_ResumeTick();
+    uint32_t wake_us = micros();
+    
+    matrix_robust_disable_wake_interrupt();
+    matrix_engine_wake(&engine, wake_us);
+    wake_sample_pending = true;
+    start_scanning();
+    __enable_irq();
+    return true;
+}
+
+// Microsecond timestamp from the HAL tick and the SysTick down-counter
+// (default 1 kHz SysTick time base). It wraps at 2^32 us like the Pico's
+// time_us_32(), so differences stay valid across the wrap. A SysTick reload
+// that is still pending (we are in a higher priority ISR) counts its ms.
+static uint32_t micros(void) {
+    uint32_t ms, val;
+    bool pending;
+    do {
+        ms = HAL_GetTick();
+        val = SysTick->VAL;
+        pending = (SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) != 0;
+    } while (ms != HAL_GetTick());
+    
+    uint32_t load = SysTick->LOAD + 1;
+    if (pending && val > load / 2) {
+        ms++;
+    }
+    return ms * 1000u + ((load - 1 - val) * 1000u) / load;
 }
 
 // Microsecond delay using DWT cycle counter
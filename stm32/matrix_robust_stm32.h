@@ -3,32 +3,20 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include "main.h"
 
-// Keypad configuration
-#define MATRIX_ROWS 4
-#define MATRIX_COLS 4
+// Keypad configuration (MATRIX_ROWS, MATRIX_COLS, matrix_row_t)
+#include "matrix_config.h"
+#include "matrix_engine.h"    // KeyEvent, ErrorEvent, ScanStatistics, ScanStrategy
+#include "matrix_stream.h"    // MatrixStream
+#include "matrix_settings.h"  // MatrixSettings
 
-// Key states
-#define KEY_IDLE       0
-#define KEY_PRESSED    1
-#define KEY_HELD       2
-#define KEY_RELEASED   3
+// Auto idle: time with every key released before scanning stops
+#define AUTO_IDLE_TIMEOUT_MS 100
 
-// Error states
-#define ERROR_NONE          0
-#define ERROR_STUCK_KEY     1
-#define ERROR_GHOST_KEY     2
-#define ERROR_SCAN_TIMEOUT  3
-
-// Debounce settings (in milliseconds)
-#define DEBOUNCE_PRESS_MS   5    // 5ms debounce for press (faster response)
-#define DEBOUNCE_RELEASE_MS 5    // 5ms debounce for release (faster response)
-#define STUCK_KEY_TIMEOUT_MS 5000  // 5 seconds = stuck key
-
-// Event queue configuration
-#define EVENT_QUEUE_SIZE 32
-#define ERROR_QUEUE_SIZE 8
+// Adaptive scan rate: quiet time before the tick drops to the slow rate
+#define ADAPTIVE_DECAY_MS 250
 
 // GPIO pin structure for STM32
 typedef struct {
@@ -36,51 +24,94 @@ typedef struct {
     uint16_t pin;
 } GPIO_Pin_t;
 
-// Key event structure
-typedef struct {
-    uint8_t key;         // Key value (0x0-0xF for hex keypad)
-    uint8_t state;       // KEY_PRESSED, KEY_HELD, or KEY_RELEASED
-    uint8_t row;         // Physical row (0-3)
-    uint8_t col;         // Physical column (0-3)
-    uint32_t timestamp;  // Timestamp in milliseconds
-} KeyEvent;
-
-// Error event structure
-typedef struct {
-    uint8_t error_code;
-    uint8_t row;
-    uint8_t col;
-    uint32_t timestamp;
-} ErrorEvent;
+// What drives the row strobes and column reads
+typedef enum {
+    SCAN_BACKEND_TIMER,  // Timer ISR strobes rows and reads columns (default)
+    SCAN_BACKEND_DMA     // Timer-triggered DMA strobes rows and captures columns,
+                         // the CPU only debounces finished batches
+} ScanBackend;
 
-// Callback function types
-typedef void (*KeyEventCallback)(KeyEvent *event);
-typedef void (*ErrorCallback)(ErrorEvent *error);
+// Row passes per half of the DMA capture buffer: each half-transfer and
+// transfer-complete interrupt debounces this many passes as one sample
+#ifndef DMA_SCAN_PASSES
+#define DMA_SCAN_PASSES 16
+#endif
 
-// Statistics structure
+// Timer and DMA set up for the DMA backend (CubeMX, left stopped)
 typedef struct {
-    uint32_t total_scans;
-    uint32_t total_events;
-    uint32_t total_errors;
-    uint32_t queue_overflows;
-    uint32_t max_scan_time_us;
-    uint32_t avg_scan_time_us;
-} ScanStatistics;
+    TIM_HandleTypeDef *htim;       // Row timer, one update event per row
+    uint32_t capture_channel;      // TIM_CHANNEL_x, output compare "frozen", samples the columns
+    DMA_HandleTypeDef *hdma_rows;  // TIMx_UP request: memory to peripheral, word, circular
+    DMA_HandleTypeDef *hdma_cols;  // TIMx_CHx request: peripheral to memory, half word, circular
+    uint32_t row_rate_hz;          // Update event rate of htim
+} MatrixDmaConfig;
 
 // Initialize the matrix keypad (robust version)
 // Uses hardware timer (TIM2 by default) for scanning at precise intervals
-// row_pins: array of 4 GPIO pins for rows (outputs)
-// col_pins: array of 4 GPIO pins for columns (inputs with pull-ups + EXTI)
+// row_pins: array of MATRIX_ROWS GPIO pins for rows (outputs)
+// col_pins: array of MATRIX_COLS GPIO pins for columns (inputs with pull-ups + EXTI)
 // htim: pointer to timer handle (e.g., &htim2)
 // scan_frequency_hz: scanning frequency in Hz (default: 1000 = 1kHz)
-void matrix_robust_init(const GPIO_Pin_t row_pins[4], const GPIO_Pin_t col_pins[4], 
+void matrix_robust_init(const GPIO_Pin_t row_pins[MATRIX_ROWS], const GPIO_Pin_t col_pins[MATRIX_COLS], 
                         TIM_HandleTypeDef *htim, uint32_t scan_frequency_hz);
 
+// Select the scan backend (call after init, while not scanning)
+// SCAN_BACKEND_DMA needs all rows on one port and all columns on one port.
+// dma->htim steps one row per update event: the update DMA request writes
+// the next row's BSRR pattern, the capture channel's compare request half a
+// period later copies the column IDR into a circular buffer. The CPU only
+// runs on the capture stream's half and full transfer interrupts (wire
+// HAL_DMA_IRQHandler as CubeMX generates it), each folding DMA_SCAN_PASSES
+// passes into one debounce sample, so debounce times are counted in units
+// of DMA_SCAN_PASSES * MATRIX_ROWS / row_rate_hz. The scan strategy does
+// not apply. dma is ignored for SCAN_BACKEND_TIMER.
+// Returns false if scanning is active or the pins or DMA setup do not fit
+bool matrix_robust_set_backend(ScanBackend backend, const MatrixDmaConfig *dma);
+
+// Select how the timer ISR walks the rows (call while not scanning)
+// INTERLEAVED: each timer tick scans one row, press latency is up to
+//              MATRIX_ROWS ticks plus debounce
+// BURST:       each timer tick scans the full matrix, press latency is
+//              bounded by one tick plus debounce
+// Returns false if scanning is active
+bool matrix_robust_set_scan_strategy(ScanStrategy strategy);
+
+// Select the debounce algorithm and its times (call while not scanning)
+// DEBOUNCE_DEFER_PRESS_EAGER_RELEASE: press after press_ms stable, release at once (default)
+// DEBOUNCE_EAGER_PRESS_LOCKOUT:       press on the first scan that sees it, then the key
+//                                     ignores chatter for press_ms; release after release_ms stable
+// DEBOUNCE_SYMMETRIC_DEFER:           press after press_ms stable, release after release_ms stable
+// Returns false if scanning is active
+bool matrix_robust_set_debounce(DebounceMode mode, uint32_t press_ms, uint32_t release_ms);
+
+// Adaptive scan rate (off by default, timer backend only): the timer runs
+// at scan_frequency_hz while any key is pressed or in debounce and drops to
+// slow_frequency_hz once none has been for decay_ms, by scaling its
+// auto-reload (clamped to 16 bits on 16-bit timers; leave auto-reload
+// preload off, the CubeMX default, so the change applies at once). The
+// first contact switches back at once, so only that contact can wait up
+// to one slow pass; debounce times are kept. The current interval and the
+// time at each rate are in ScanStatistics.
+// slow_frequency_hz = 0 (or not below scan_frequency_hz) turns it off.
+// Returns false if scanning is active
+bool matrix_robust_set_adaptive_rate(uint32_t slow_frequency_hz, uint32_t decay_ms);
+
+// Typematic repeat (off by default): the last pressed key is re-sent as
+// KEY_HELD events from the scan tick, first after delay_ms, then every
+// interval_ms, shortened by accel_ms per repeat down to min_interval_ms
+// (accel_ms = 0: constant rate). delay_ms = 0 turns repeat off. The main
+// loop needs no polling for it and can sleep until an event arrives.
+// Returns false if scanning is active
+bool matrix_robust_set_repeat(uint32_t delay_ms, uint32_t interval_ms,
+                              uint32_t min_interval_ms, uint32_t accel_ms);
+
 // Set custom key mapping
-void matrix_robust_set_keymap(const uint8_t keymap[4][4]);
+void matrix_robust_set_keymap(const uint8_t keymap[MATRIX_ROWS][MATRIX_COLS]);
 
 // Start scanning (enables timer interrupt)
-void matrix_robust_start(void);
+// Never prints, so it is safe from interrupt context
+// Returns true if scanning is running (or already was)
+bool matrix_robust_start(void);
 
 // Stop scanning (disables timer interrupt, saves power)
 void matrix_robust_stop(void);
@@ -91,20 +122,39 @@ void matrix_robust_set_key_callback(KeyEventCallback callback);
 // Register callback for error events
 void matrix_robust_set_error_callback(ErrorCallback callback);
 
-// Get next event from queue (thread-safe, non-blocking)
+// Get next event from queue (lock-free, non-blocking, no interrupt masking)
+// The queue is single-consumer: call from one context (main loop or one task)
 // Returns true if event was available
 bool matrix_robust_get_event(KeyEvent *event);
 
-// Get error event from queue
+// Drain up to max events into a caller buffer in one call
+// Returns the number of events copied (0 if the queue was empty)
+size_t matrix_robust_get_events(KeyEvent *events, size_t max);
+
+// Zero-copy drain: point span at the oldest queued events that are
+// contiguous in the ring and return how many there are. The events stay
+// valid until matrix_robust_commit_events() releases them. A burst that
+// wraps around the end of the ring comes back as two spans.
+size_t matrix_robust_peek_events(const KeyEvent **span);
+
+// Release the first count events of the last peeked span
+void matrix_robust_commit_events(size_t count);
+
+// Get error event from queue (lock-free, single consumer like get_event)
 bool matrix_robust_get_error(ErrorEvent *error);
 
 // Check if any key is currently pressed (thread-safe)
 bool matrix_robust_any_key_pressed(void);
 
+// Copy the debounced matrix: one bitmask per row, bit = column, set for
+// every key reported as pressed (suppressed ghosts excluded). Each row is
+// read in one access, so a row is never torn.
+void matrix_robust_get_matrix(matrix_row_t matrix[MATRIX_ROWS]);
+
 // Get number of events in queue
 uint32_t matrix_robust_get_event_count(void);
 
-// Clear all events from queue
+// Clear all events from queue (consumer side, never blocks the ISR)
 void matrix_robust_clear_events(void);
 
 // Enable/disable ghost key detection
@@ -113,20 +163,85 @@ void matrix_robust_set_ghost_detection(bool enable);
 // Enable/disable stuck key detection
 void matrix_robust_set_stuck_detection(bool enable, uint32_t timeout_ms);
 
+// Take keymap, debounce (with the per-key calibration), ghost and stuck
+// detection from a settings block, e.g. matrix_settings_flash_load().
+// Layer tables are the application's: keymap_set_layers(settings->layers,
+// settings->layer_count) uses them in place.
+// Returns false if scanning is active or the block is not valid
+bool matrix_robust_apply_settings(const MatrixSettings *settings);
+
+// Record raw row samples (before debounce) into a caller-owned trace, see
+// matrix_trace.h; NULL stops recording. Call while not scanning, after
+// choosing the scan strategy, so the trace header matches. Read it
+// out from the main loop with matrix_trace_read_block() or
+// matrix_trace_stream(), and replay it with host/matrix_replay. Read-out
+// includes the open block once it is closed: by matrix_robust_trace_flush(),
+// after MATRIX_TRACE_QUIET_MS without a record, or when scanning stops.
+// Returns false if scanning is active
+bool matrix_robust_set_trace(MatrixTrace *trace);
+
+// Have the next scan tick close the open trace block, so the samples just
+// before e.g. a reported fault can be read out right away. Safe to call from
+// the main loop while scanning; a stopped or idle scan has already closed it
+void matrix_robust_trace_flush(void);
+
+// Resolve combos and tap-hold keys in the scan tick, before events are
+// queued, with a caller-owned state set up by matrix_gestures_init() (see
+// matrix_gesture.h); NULL turns them off. Their timeouts run on the scan
+// tick. Events then carry KEY_GESTURE_* in gesture: for NONE look the key
+// up as usual (keymap_process_key()), the others already carry their
+// configured key code.
+// Returns false if scanning is active
+bool matrix_robust_set_gestures(MatrixGestures *gestures);
+
+// Automatic idle mode (off by default)
+// Once every key has been released for idle_timeout_ms, the scan timer
+// stops, all rows are driven LOW and the columns wait for an EXTI falling
+// edge (matrix_robust_exti_callback must be wired up). The first edge
+// resumes scanning; the press that caused it is debounced as usual.
+void matrix_robust_set_auto_idle(bool enable, uint32_t idle_timeout_ms);
+
+// True while auto idle has scanning stopped, waiting for a column edge
+bool matrix_robust_is_idle(void);
+
 // Enable EXTI interrupts for wake (columns trigger interrupt on key press)
+// Drives all rows LOW so any pressed key pulls its column down
 void matrix_robust_enable_wake_interrupt(void);
 
-// Disable EXTI wake interrupts
+// Disable EXTI wake interrupts (rows back HIGH)
 void matrix_robust_disable_wake_interrupt(void);
 
-// Get statistics
+// Get statistics (ScanStatistics: see matrix_engine.h)
+// Timestamps come from the HAL tick plus the SysTick counter (micros)
 void matrix_robust_get_statistics(ScanStatistics *stats);
 void matrix_robust_reset_statistics(void);
 
+// Binary stream records (see matrix_stream.h), for host software instead
+// of printf. Each frames one record into the stream's batch; call
+// matrix_stream_flush() once per USB frame or main loop pass.
+// Return false if the record was dropped (batch full, transport busy)
+bool matrix_robust_stream_hello(MatrixStream *stream);
+bool matrix_robust_stream_event(MatrixStream *stream, const KeyEvent *event);
+bool matrix_robust_stream_error(MatrixStream *stream, const ErrorEvent *error);
+bool matrix_robust_stream_statistics(MatrixStream *stream);
+
 // Power management
-void matrix_robust_enter_low_power(void);  // Stop scanning, enable wake EXTI, enter STOP mode
+void matrix_robust_enter_low_power(void);  // Stop scanning, enable wake EXTI
 void matrix_robust_exit_low_power(void);   // Resume scanning
 
+// Deep sleep in STOP mode until a key is pressed (call from the main loop)
+// Stops scanning, drives all rows LOW, arms the column EXTI lines and
+// enters STOP with the low-power regulator. On wake-up clock_config (e.g.
+// SystemClock_Config, may be NULL if the core runs from HSI) brings the
+// clocks back, then scanning restarts before this returns; the timer
+// backend reads the matrix at once, so the waking press is debounced and
+// reported like any other (lost only if released before wake-up plus
+// debounce). Contact and wake-to-event latency run from the clock restore
+// (SysTick is stopped in STOP): stats.wake_to_event_us, stats.deep_sleeps.
+// Returns false without sleeping if a key is held; scanning then carries
+// on as before
+bool matrix_robust_deep_sleep(void (*clock_config)(void));
+
 // Timer interrupt callback - call this from HAL_TIM_PeriodElapsedCallback
 void matrix_robust_timer_callback(TIM_HandleTypeDef *htim);
 
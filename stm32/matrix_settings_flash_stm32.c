@@ -0,0 +1,67 @@
+#include "matrix_settings_flash_stm32.h"
+#include <string.h>
+
+static const MatrixSettings *slot(int index) {
+    return (const MatrixSettings *)(uintptr_t)(index ? MATRIX_SETTINGS_FLASH_B : MATRIX_SETTINGS_FLASH_A);
+}
+
+static bool erase_slot(int index) {
+    FLASH_EraseInitTypeDef erase = {0};
+    uint32_t failed;
+    
+#if defined(FLASH_TYPEERASE_SECTORS)
+    erase.TypeErase = FLASH_TYPEERASE_SECTORS;
+    erase.Sector = index ? MATRIX_SETTINGS_SECTOR_B : MATRIX_SETTINGS_SECTOR_A;
+    erase.NbSectors = 1;
+    erase.VoltageRange = FLASH_VOLTAGE_RANGE_3;  // 2.7-3.6 V, 32-bit programming
+#else
+    uint32_t address = index ? MATRIX_SETTINGS_FLASH_B : MATRIX_SETTINGS_FLASH_A;
+    erase.TypeErase = FLASH_TYPEERASE_PAGES;
+    erase.Page = (address - FLASH_BASE) / FLASH_PAGE_SIZE;
+    erase.NbPages = MATRIX_SETTINGS_SLOT_BYTES / FLASH_PAGE_SIZE;
+#endif
+    
+    return HAL_FLASHEx_Erase(&erase, &failed) == HAL_OK;
+}
+
+// Program the record in the smallest unit the part takes (F4: 32-bit
+// words, G0: 64-bit double words), the last one padded with erased bytes
+static bool program_slot(int index, const MatrixSettings *s) {
+    uint32_t address = index ? MATRIX_SETTINGS_FLASH_B : MATRIX_SETTINGS_FLASH_A;
+    const uint8_t *data = (const uint8_t *)s;
+    
+#if defined(FLASH_TYPEERASE_SECTORS)
+    const uint32_t type = FLASH_TYPEPROGRAM_WORD;
+    uint32_t unit = 4;
+#else
+    const uint32_t type = FLASH_TYPEPROGRAM_DOUBLEWORD;
+    uint32_t unit = 8;
+#endif
+    
+    for (uint32_t offset = 0; offset < sizeof(MatrixSettings); offset += unit) {
+        uint64_t word = UINT64_MAX;
+        uint32_t len = sizeof(MatrixSettings) - offset;
+        memcpy(&word, data + offset, len < unit ? len : unit);
+        if (HAL_FLASH_Program(type, address + offset, word) != HAL_OK) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const MatrixSettings *matrix_settings_flash_load(void) {
+    return matrix_settings_newest(slot(0), slot(1));
+}
+
+bool matrix_settings_flash_save(MatrixSettings *s) {
+    const MatrixSettings *current = matrix_settings_flash_load();
+    int target = (current == slot(0)) ? 1 : 0;
+    
+    matrix_settings_seal(s, current != NULL ? current->sequence + 1 : 1);
+    
+    HAL_FLASH_Unlock();
+    bool written = erase_slot(target) && program_slot(target, s);
+    HAL_FLASH_Lock();
+    
+    return written && matrix_settings_valid(slot(target));
+}
@@ -0,0 +1,58 @@
+#ifndef MATRIX_SETTINGS_FLASH_STM32_H
+#define MATRIX_SETTINGS_FLASH_STM32_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "main.h"
+
+#include "matrix_settings.h"
+
+// Settings block in the STM32's internal flash
+//
+// Two copies, each in its own erase unit, read in place through the
+// memory-mapped flash: loading returns a pointer into flash and the layer
+// tables can be handed to keymap_set_layers() as they are. Keep the
+// linker's FLASH region below both copies.
+//
+// Defaults:
+//   STM32F401xE: sectors 6 and 7 (128 KB each, the top of 512 KB)
+//   STM32G0:     the last pages of flash (2 KB each)
+// Other parts: define MATRIX_SETTINGS_FLASH_A / _B (and, for sector
+// flash, MATRIX_SETTINGS_SECTOR_A / _B) for two free erase units.
+
+#if defined(FLASH_TYPEERASE_SECTORS)
+// Sector flash (F4): one sector per copy
+#if !defined(MATRIX_SETTINGS_FLASH_A) && defined(STM32F401xE)
+#define MATRIX_SETTINGS_FLASH_A  0x08040000u
+#define MATRIX_SETTINGS_FLASH_B  0x08060000u
+#define MATRIX_SETTINGS_SECTOR_A FLASH_SECTOR_6
+#define MATRIX_SETTINGS_SECTOR_B FLASH_SECTOR_7
+#endif
+#else
+// Page flash (G0): whole pages per copy, at the end of flash
+#define MATRIX_SETTINGS_SLOT_BYTES \
+    ((sizeof(MatrixSettings) + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE * FLASH_PAGE_SIZE)
+#ifndef MATRIX_SETTINGS_FLASH_A
+#define MATRIX_SETTINGS_FLASH_A (FLASH_BASE + FLASH_SIZE - 2 * MATRIX_SETTINGS_SLOT_BYTES)
+#define MATRIX_SETTINGS_FLASH_B (FLASH_BASE + FLASH_SIZE - MATRIX_SETTINGS_SLOT_BYTES)
+#endif
+#endif
+
+#ifndef MATRIX_SETTINGS_FLASH_A
+#error "Define MATRIX_SETTINGS_FLASH_A/_B and MATRIX_SETTINGS_SECTOR_A/_B for this part"
+#endif
+
+// The newest valid copy, read in place, or NULL if there is none (first
+// boot, or written by a firmware with another matrix size or version)
+const MatrixSettings *matrix_settings_flash_load(void);
+
+// Seal s with the next sequence number and write it over the older copy,
+// leaving the current one intact until the new one checks out. Call with
+// scanning stopped (matrix_robust_stop()): the CPU stalls on flash
+// fetches while a sector or page is erased (up to a few seconds for a
+// 128 KB F4 sector, tens of ms for G0 pages).
+// Returns false if erasing or programming failed or the copy does not
+// read back valid; the previous settings are still in place then
+bool matrix_settings_flash_save(MatrixSettings *s);
+
+#endif // MATRIX_SETTINGS_FLASH_STM32_H
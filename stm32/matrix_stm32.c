@@ -1,27 +1,34 @@
 #include "matrix_stm32.h"
+#include "matrix_debounce.h"
+#include "matrix_keymap.h"
+#include "matrix_gather.h"
 #include <stdio.h>
 #include <string.h>
 
-// Default keymap for 4x4 hex keypad
-static const uint8_t DEFAULT_KEYMAP[4][4] = {
-    {0x1, 0x2, 0x3, 0xA},
-    {0x4, 0x5, 0x6, 0xB},
-    {0x7, 0x8, 0x9, 0xC},
-    {0x0, 0xF, 0xE, 0xD}
-};
-
 // Pin configuration
 static GPIO_Pin_t row_gpios[MATRIX_ROWS];
 static GPIO_Pin_t col_gpios[MATRIX_COLS];
 
+// Single-register fast path, used when all rows share one port and all
+// columns share one port: one BSRR write per strobe, one IDR read per row
+static bool port_fast_path = false;
+static GPIO_TypeDef *row_port = NULL;
+static GPIO_TypeDef *col_port = NULL;
+static uint32_t row_mask = 0;                      // All row pins (BSRR set half)
+static uint32_t row_select_bsrr[MATRIX_ROWS];      // This row LOW, all others HIGH
+static MatrixGather col_gather;
+
 // Current keymap
 static uint8_t keymap[MATRIX_ROWS][MATRIX_COLS];
 
 // Scanning state
 static uint8_t current_row = 0;
-static uint8_t last_key_state[MATRIX_ROWS][MATRIX_COLS];
-static uint8_t debounce_counter[MATRIX_ROWS][MATRIX_COLS];
-static uint8_t current_key_state[MATRIX_ROWS][MATRIX_COLS];
+static DebounceRow debounce_rows[MATRIX_ROWS];     // Debounced state, bit c = column c
+static matrix_row_t reported_state[MATRIX_ROWS];  // State last handed out by matrix_scan()
+static const DebounceConfig debounce_config = {
+    .press_samples = DEBOUNCE_PRESS,
+    .release_samples = DEBOUNCE_RELEASE
+};
 
 // Last detected key for tracking
 static uint8_t last_pressed_row = 0xFF;
@@ -34,13 +41,42 @@ static void delay_us(uint32_t us) {
     while ((DWT->CYCCNT - start) < cycles);
 }
 
-void matrix_init(const GPIO_Pin_t row_pins[4], const GPIO_Pin_t col_pins[4]) {
+// Precompute BSRR patterns and the IDR gather if the pins allow it
+static void setup_port_fast_path(void) {
+    uint8_t col_bits[MATRIX_COLS];
+    
+    port_fast_path = true;
+    row_port = row_gpios[0].port;
+    col_port = col_gpios[0].port;
+    
+    row_mask = 0;
+    for (int i = 0; i < MATRIX_ROWS; i++) {
+        if (row_gpios[i].port != row_port) {
+            port_fast_path = false;
+        }
+        row_mask |= row_gpios[i].pin;
+    }
+    for (int i = 0; i < MATRIX_ROWS; i++) {
+        // BSRR: lower half sets pins, upper half resets them
+        row_select_bsrr[i] = (row_mask & ~(uint32_t)row_gpios[i].pin) | ((uint32_t)row_gpios[i].pin << 16);
+    }
+    
+    for (int i = 0; i < MATRIX_COLS; i++) {
+        if (col_gpios[i].port != col_port) {
+            port_fast_path = false;
+        }
+        col_bits[i] = __builtin_ctz(col_gpios[i].pin);
+    }
+    matrix_gather_init(&col_gather, col_bits);
+}
+
+void matrix_init(const GPIO_Pin_t row_pins[MATRIX_ROWS], const GPIO_Pin_t col_pins[MATRIX_COLS]) {
     // Copy pin assignments
     memcpy(row_gpios, row_pins, sizeof(GPIO_Pin_t) * MATRIX_ROWS);
     memcpy(col_gpios, col_pins, sizeof(GPIO_Pin_t) * MATRIX_COLS);
     
     // Copy default keymap
-    memcpy(keymap, DEFAULT_KEYMAP, sizeof(keymap));
+    matrix_default_keymap(keymap);
     
     // Enable DWT cycle counter for microsecond delays
     CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
@@ -69,91 +105,97 @@ void matrix_init(const GPIO_Pin_t row_pins[4], const GPIO_Pin_t col_pins[4]) {
         HAL_GPIO_Init(col_gpios[i].port, &GPIO_InitStruct);
     }
     
+    setup_port_fast_path();
+    
     // Clear state arrays
-    memset(last_key_state, KEY_IDLE, sizeof(last_key_state));
-    memset(current_key_state, KEY_IDLE, sizeof(current_key_state));
-    memset(debounce_counter, 0, sizeof(debounce_counter));
+    for (int row = 0; row < MATRIX_ROWS; row++) {
+        debounce_row_reset(&debounce_rows[row]);
+    }
+    memset(reported_state, 0, sizeof(reported_state));
 }
 
-void matrix_set_keymap(const uint8_t custom_keymap[4][4]) {
+void matrix_set_keymap(const uint8_t custom_keymap[MATRIX_ROWS][MATRIX_COLS]) {
     memcpy(keymap, custom_keymap, sizeof(keymap));
 }
 
-bool matrix_scan(KeyEvent *event) {
-    bool event_detected = false;
-    
-    // Set all rows HIGH first
-    for (int i = 0; i < MATRIX_ROWS; i++) {
-        HAL_GPIO_WritePin(row_gpios[i].port, row_gpios[i].pin, GPIO_PIN_SET);
+// Hand out one debounced change that has not been reported yet
+// Changes are kept until reported, so several keys changing in one scan
+// come out of consecutive matrix_scan() calls instead of being dropped
+static bool next_event(KeyEvent *event) {
+    if (!event) {
+        return false;
     }
     
-    // Activate current row (set LOW)
-    HAL_GPIO_WritePin(row_gpios[current_row].port, row_gpios[current_row].pin, GPIO_PIN_RESET);
+    for (int row = 0; row < MATRIX_ROWS; row++) {
+        matrix_row_t pending = debounce_rows[row].stable ^ reported_state[row];
+        if (pending) {
+            uint8_t col = __builtin_ctz(pending);
+            matrix_row_t bit = (matrix_row_t)(1u << col);
+            
+            reported_state[row] ^= bit;
+            event->key = keymap[row][col];
+            event->state = (debounce_rows[row].stable & bit) ? KEY_PRESSED : KEY_RELEASED;
+            event->row = row;
+            event->col = col;
+            
+            if (event->state == KEY_PRESSED) {
+                last_pressed_row = row;
+                last_pressed_col = col;
+            }
+            return true;
+        }
+    }
     
-    // Small delay for signal to settle (critical for fast scanning)
-    delay_us(1);
+    return false;
+}
+
+bool matrix_scan(KeyEvent *event) {
+    matrix_row_t pressed_cols = 0;
     
-    // Read all columns for this row
-    for (int col = 0; col < MATRIX_COLS; col++) {
-        GPIO_PinState pin_state = HAL_GPIO_ReadPin(col_gpios[col].port, col_gpios[col].pin);
-        bool pressed = (pin_state == GPIO_PIN_RESET);  // LOW = pressed (pulled down by keypress)
+    if (port_fast_path) {
+        // Activate current row (set LOW) with all other rows HIGH, in one write
+        row_port->BSRR = row_select_bsrr[current_row];
         
-        // Debouncing logic
-        if (pressed) {
-            if (debounce_counter[current_row][col] < DEBOUNCE_PRESS) {
-                debounce_counter[current_row][col]++;
-            }
-        } else {
-            if (debounce_counter[current_row][col] > 0) {
-                debounce_counter[current_row][col]--;
-            }
-        }
+        // Small delay for signal to settle (critical for fast scanning)
+        delay_us(1);
         
-        // Determine current state based on debounce counter
-        uint8_t new_state = KEY_IDLE;
-        if (debounce_counter[current_row][col] >= DEBOUNCE_PRESS) {
-            new_state = KEY_PRESSED;
+        // Read all columns for this row in one read (LOW = pressed)
+        pressed_cols = matrix_gather(&col_gather, ~col_port->IDR);
+    } else {
+        // Set all rows HIGH first
+        for (int i = 0; i < MATRIX_ROWS; i++) {
+            HAL_GPIO_WritePin(row_gpios[i].port, row_gpios[i].pin, GPIO_PIN_SET);
         }
         
-        // Detect state changes
-        if (new_state != last_key_state[current_row][col]) {
-            if (new_state == KEY_PRESSED && last_key_state[current_row][col] == KEY_IDLE) {
-                // Key press detected
-                if (event && !event_detected) {
-                    event->key = keymap[current_row][col];
-                    event->state = KEY_PRESSED;
-                    event->row = current_row;
-                    event->col = col;
-                    event_detected = true;
-                    last_pressed_row = current_row;
-                    last_pressed_col = col;
-                }
-                current_key_state[current_row][col] = KEY_PRESSED;
-            } else if (new_state == KEY_IDLE && last_key_state[current_row][col] == KEY_PRESSED) {
-                // Key release detected
-                if (event && !event_detected) {
-                    event->key = keymap[current_row][col];
-                    event->state = KEY_RELEASED;
-                    event->row = current_row;
-                    event->col = col;
-                    event_detected = true;
-                }
-                current_key_state[current_row][col] = KEY_IDLE;
+        // Activate current row (set LOW)
+        HAL_GPIO_WritePin(row_gpios[current_row].port, row_gpios[current_row].pin, GPIO_PIN_RESET);
+        
+        // Small delay for signal to settle (critical for fast scanning)
+        delay_us(1);
+        
+        // Read all columns for this row
+        for (int col = 0; col < MATRIX_COLS; col++) {
+            // LOW = pressed (pulled down by keypress)
+            if (HAL_GPIO_ReadPin(col_gpios[col].port, col_gpios[col].pin) == GPIO_PIN_RESET) {
+                pressed_cols |= (1u << col);
             }
-            last_key_state[current_row][col] = new_state;
-        } else if (new_state == KEY_PRESSED && last_key_state[current_row][col] == KEY_PRESSED) {
-            // Key held
-            current_key_state[current_row][col] = KEY_HELD;
         }
     }
     
+    // Debounce every key of the row at once
+    debounce_row_update(&debounce_rows[current_row], pressed_cols, &debounce_config);
+    
     // Deactivate current row
-    HAL_GPIO_WritePin(row_gpios[current_row].port, row_gpios[current_row].pin, GPIO_PIN_SET);
+    if (port_fast_path) {
+        row_port->BSRR = row_gpios[current_row].pin;
+    } else {
+        HAL_GPIO_WritePin(row_gpios[current_row].port, row_gpios[current_row].pin, GPIO_PIN_SET);
+    }
     
     // Move to next row
     current_row = (current_row + 1) % MATRIX_ROWS;
     
-    return event_detected;
+    return next_event(event);
 }
 
 uint8_t matrix_get_key(void) {
@@ -184,10 +226,8 @@ uint8_t matrix_get_key(void) {
 
 bool matrix_any_key_pressed(void) {
     for (int row = 0; row < MATRIX_ROWS; row++) {
-        for (int col = 0; col < MATRIX_COLS; col++) {
-            if (current_key_state[row][col] != KEY_IDLE) {
-                return true;
-            }
+        if (debounce_rows[row].stable) {
+            return true;
         }
     }
     return false;
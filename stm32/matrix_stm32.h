@@ -5,9 +5,8 @@
 #include <stdbool.h>
 #include "main.h"  // STM32 HAL includes
 
-// Keypad configuration
-#define MATRIX_ROWS 4
-#define MATRIX_COLS 4
+// Keypad configuration (MATRIX_ROWS, MATRIX_COLS, matrix_row_t)
+#include "matrix_config.h"
 
 // Key states
 #define KEY_IDLE       0
@@ -29,19 +28,20 @@ typedef struct {
 typedef struct {
     uint8_t key;      // Key value (0x0-0xF for hex keypad)
     uint8_t state;    // KEY_PRESSED, KEY_HELD, or KEY_RELEASED
-    uint8_t row;      // Physical row (0-3)
-    uint8_t col;      // Physical column (0-3)
+    uint8_t row;      // Physical row (0 to MATRIX_ROWS-1)
+    uint8_t col;      // Physical column (0 to MATRIX_COLS-1)
 } KeyEvent;
 
 // Initialize the matrix keypad
-// row_pins: array of 4 GPIO pins for rows (outputs)
-// col_pins: array of 4 GPIO pins for columns (inputs with pull-ups)
-void matrix_init(const GPIO_Pin_t row_pins[4], const GPIO_Pin_t col_pins[4]);
+// row_pins: array of MATRIX_ROWS GPIO pins for rows (outputs)
+// col_pins: array of MATRIX_COLS GPIO pins for columns (inputs with pull-ups)
+void matrix_init(const GPIO_Pin_t row_pins[MATRIX_ROWS], const GPIO_Pin_t col_pins[MATRIX_COLS]);
 
 // Set custom key mapping (optional)
-// keymap: 4x4 array defining what each position returns
+// keymap: MATRIX_ROWS x MATRIX_COLS array defining what each position returns
 // Default mapping is: 1,2,3,A / 4,5,6,B / 7,8,9,C / 0,F,E,D
-void matrix_set_keymap(const uint8_t keymap[4][4]);
+// (other sizes default to row-major key indices: row * MATRIX_COLS + col)
+void matrix_set_keymap(const uint8_t keymap[MATRIX_ROWS][MATRIX_COLS]);
 
 // Non-blocking scan function - call this frequently (e.g., in main loop or timer callback)
 // Returns true if a key event occurred
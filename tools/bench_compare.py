@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+"""Compare two benchmark runs (JSON lines from matrix_bench).
+
+Records are matched on their text fields and matrix size (bench, platform,
+strategy, load, backend, mode, profile, rows, cols); every numeric field
+present in both is printed with its change. Lines that are not JSON
+objects (console noise around a firmware capture) are skipped.
+
+    ./build-host/host/matrix_bench > before.jsonl
+    ... change something, rebuild ...
+    ./build-host/host/matrix_bench > after.jsonl
+    python3 tools/bench_compare.py before.jsonl after.jsonl --threshold 5
+
+With --threshold, exits 1 if any gated metric (mean cost, ISR time, p99
+latency, spurious events) got worse by more than that many percent. Max
+values are printed but not gated: they are single outliers, dominated by
+interrupts and scheduling on a PC.
+"""
+
+import argparse
+import json
+import sys
+
+KEY_NUMERIC = ("rows", "cols", "interval_us")
+
+GATED = (
+    "mean", "mean_ns",
+    "isr_mean_us", "isr_p99_us", "jitter_p99_us",
+    "press_mean_us", "press_p99_us", "release_mean_us", "release_p99_us",
+    "extra_events", "missed_scans", "scan_overruns",
+)
+
+SKIP = ("iterations", "per", "strokes")
+
+
+def load(path):
+    records = {}
+    with open(path) as f:
+        for line in f:
+            line = line.strip()
+            if not line.startswith("{"):
+                continue
+            try:
+                rec = json.loads(line)
+            except ValueError:
+                continue
+            key = tuple(sorted((k, v) for k, v in rec.items()
+                               if isinstance(v, str) or k in KEY_NUMERIC))
+            records[key] = rec
+    return records
+
+
+LABEL_ORDER = ("bench", "platform", "backend", "strategy", "load", "mode", "profile",
+               "rows", "cols", "interval_us")
+
+
+def label(key):
+    fields = dict(key)
+    names = [k for k in LABEL_ORDER if k in fields]
+    names += sorted(k for k in fields if k not in LABEL_ORDER and k != "unit")
+    return " ".join(f"{k}={fields[k]}" for k in names)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("before")
+    parser.add_argument("after")
+    parser.add_argument("--threshold", type=float, default=None,
+                        help="fail if a gated metric regresses by more than this percent")
+    args = parser.parse_args()
+
+    before = load(args.before)
+    after = load(args.after)
+    regressions = []
+
+    for key in sorted(before.keys() & after.keys()):
+        old, new = before[key], after[key]
+        print(label(key))
+        for field, value in old.items():
+            if (field in KEY_NUMERIC or field in SKIP or isinstance(value, str)
+                    or field not in new or isinstance(new[field], str)):
+                continue
+            change = 0.0
+            if value:
+                change = (new[field] - value) * 100.0 / value
+            elif new[field]:
+                change = float("inf")
+            mark = ""
+            if args.threshold is not None and field in GATED and change > args.threshold:
+                mark = "  REGRESSION"
+                regressions.append((label(key), field))
+            print(f"  {field:16} {value:>12} -> {new[field]:>12}  {change:+7.1f}%{mark}")
+
+    for key in sorted(before.keys() - after.keys()):
+        print(f"only in {args.before}: {label(key)}")
+    for key in sorted(after.keys() - before.keys()):
+        print(f"only in {args.after}: {label(key)}")
+
+    if regressions:
+        print(f"\n{len(regressions)} regression(s) above {args.threshold}%", file=sys.stderr)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,273 @@
+#!/usr/bin/env python3
+"""Decode the keypad's framed binary event stream (common/matrix_stream.h).
+
+Reads one or more serial ports (or files, or stdin with "-"), splits the
+byte stream on 0x00 frame delimiters, COBS-decodes and CRC-checks every
+frame and prints one line per record, tagged with its source. Gaps in the
+per-source sequence number are reported as dropped records.
+
+    python3 tools/matrix_stream_decode.py /dev/ttyACM0 /dev/ttyACM1 ...
+    python3 tools/matrix_stream_decode.py --json /dev/ttyACM0
+    python3 tools/matrix_stream_decode.py --trace field.trace /dev/ttyACM0
+
+--trace reassembles raw scan trace blocks (STREAM_REC_TRACE, see
+common/matrix_trace.h) into a file for host/matrix_replay instead of
+printing them; with several sources each gets its own file (FILE.1, ...).
+
+Serial ports need pyserial (pip install pyserial); files and stdin do not.
+"""
+
+import argparse
+import json
+import struct
+import sys
+import threading
+
+STREAM_VERSION = 2
+
+REC_HELLO = 0x01
+REC_KEY = 0x02
+REC_ERROR = 0x03
+REC_STATS = 0x04
+REC_MODE = 0x05
+REC_TRACE = 0x06
+REC_LAYERS = 0x07
+
+KEY_STATES = {0: "idle", 1: "pressed", 2: "held", 3: "released"}
+ERROR_CODES = {0: "none", 1: "stuck_key", 2: "ghost_key", 3: "scan_timeout", 4: "scan_overrun"}
+MODES = {0: "normal", 1: "function"}
+GESTURES = {0: "none", 1: "tap", 2: "hold", 3: "combo"}
+
+STATS_FIELDS = (
+    "total_scans", "total_events", "total_errors", "queue_overflows",
+    "max_scan_time_us", "avg_scan_time_us", "missed_scans", "scan_overruns",
+    "p99_latency_us", "max_latency_us",
+)
+
+
+def crc16_ccitt(data, crc=0xFFFF):
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if crc & 0x8000 else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def cobs_decode(frame):
+    out = bytearray()
+    i = 0
+    while i < len(frame):
+        code = frame[i]
+        if code == 0 or i + code > len(frame):
+            raise ValueError("bad COBS code")
+        out += frame[i + 1:i + code]
+        i += code
+        if code < 0xFF and i < len(frame):
+            out.append(0)
+    return bytes(out)
+
+
+def parse_payload(rec_type, payload):
+    if rec_type == REC_HELLO:
+        version, rows, cols = struct.unpack("<BBB", payload)
+        return {"type": "hello", "version": version, "rows": rows, "cols": cols}
+    if rec_type == REC_KEY:
+        if len(payload) == struct.calcsize("<BBBBIII"):
+            # Version 1 firmware: no gesture byte
+            key, state, row, col, ts, contact, confirm = struct.unpack("<BBBBIII", payload)
+            gesture = 0
+        else:
+            key, state, row, col, gesture, ts, contact, confirm = struct.unpack("<BBBBBIII", payload)
+        return {"type": "key", "key": key, "state": KEY_STATES.get(state, state),
+                "row": row, "col": col, "gesture": GESTURES.get(gesture, gesture), "timestamp_ms": ts,
+                "contact_us": contact, "confirm_us": confirm,
+                "latency_us": (confirm - contact) & 0xFFFFFFFF}
+    if rec_type == REC_ERROR:
+        code, row, col, count, ts = struct.unpack("<BBBII", payload)
+        return {"type": "error", "error": ERROR_CODES.get(code, code),
+                "row": row, "col": col, "count": count, "timestamp_ms": ts}
+    if rec_type == REC_STATS:
+        values = struct.unpack("<" + "I" * len(STATS_FIELDS), payload)
+        record = {"type": "stats"}
+        record.update(zip(STATS_FIELDS, values))
+        return record
+    if rec_type == REC_MODE:
+        mode, ts = struct.unpack("<BI", payload)
+        return {"type": "mode", "mode": MODES.get(mode, mode), "timestamp_ms": ts}
+    if rec_type == REC_TRACE:
+        block, block_len, offset = struct.unpack("<IHH", payload[:8])
+        return {"type": "trace", "block": block, "block_len": block_len,
+                "offset": offset, "data": payload[8:]}
+    if rec_type == REC_LAYERS:
+        active, ts = struct.unpack("<II", payload)
+        layers = [n for n in range(32) if active & (1 << n)]
+        return {"type": "layers", "active": layers, "timestamp_ms": ts}
+    return {"type": "unknown", "record_type": rec_type, "payload": payload.hex()}
+
+
+class StreamDecoder:
+    """Incremental decoder for one source: feed bytes, get records back."""
+
+    def __init__(self):
+        self.pending = bytearray()
+        self.next_seq = None
+        self.dropped = 0
+        self.bad_frames = 0
+
+    def feed(self, data):
+        records = []
+        self.pending += data
+        while True:
+            end = self.pending.find(0)
+            if end < 0:
+                break
+            frame = bytes(self.pending[:end])
+            del self.pending[:end + 1]
+            if frame:
+                record = self._decode_frame(frame)
+                if record is not None:
+                    records.append(record)
+        return records
+
+    def _decode_frame(self, frame):
+        try:
+            raw = cobs_decode(frame)
+        except ValueError:
+            self.bad_frames += 1
+            return None
+        if len(raw) < 4 or crc16_ccitt(raw[:-2]) != struct.unpack("<H", raw[-2:])[0]:
+            self.bad_frames += 1
+            return None
+
+        rec_type, seq = raw[0], raw[1]
+        if self.next_seq is not None and seq != self.next_seq:
+            self.dropped += (seq - self.next_seq) & 0xFF
+        self.next_seq = (seq + 1) & 0xFF
+
+        try:
+            record = parse_payload(rec_type, raw[2:-2])
+        except struct.error:
+            self.bad_frames += 1
+            return None
+        record["seq"] = seq
+        return record
+
+
+class TraceWriter:
+    """Reassembles trace blocks from their chunks and appends them to a file
+    as len:u16 + block (the format host/matrix_replay reads)."""
+
+    def __init__(self, path):
+        self.out = open(path, "wb")
+        self.block = None
+        self.data = bytearray()
+        self.blocks = 0
+        self.incomplete = 0
+
+    def add(self, record):
+        if record["block"] != self.block or record["offset"] != len(self.data):
+            if self.data:
+                self.incomplete += 1  # Chunks lost, the block cannot be used
+            self.block = record["block"]
+            self.data = bytearray()
+            if record["offset"] != 0:
+                return
+        self.data += record["data"]
+        if len(self.data) >= record["block_len"]:
+            block = bytes(self.data[:record["block_len"]])
+            self.out.write(struct.pack("<H", len(block)) + block)
+            self.out.flush()
+            self.blocks += 1
+            self.block = None
+            self.data = bytearray()
+
+
+def open_source(path, baud):
+    if path == "-":
+        return sys.stdin.buffer
+    if path.startswith("/dev/") or path.upper().startswith("COM"):
+        import serial  # pyserial
+        return serial.Serial(path, baud, timeout=0.1)
+    return open(path, "rb")
+
+
+def format_record(source, record, as_json):
+    if as_json:
+        return json.dumps(dict(record, source=source))
+    kind = record["type"]
+    if kind == "key":
+        gesture = "" if record["gesture"] == "none" else " %s" % record["gesture"]
+        return "%s key 0x%X%s %s (row=%d, col=%d) at %d ms, latency %d us" % (
+            source, record["key"], gesture, record["state"], record["row"], record["col"],
+            record["timestamp_ms"], record["latency_us"])
+    if kind == "error":
+        return "%s error %s (row=%d, col=%d, count=%d) at %d ms" % (
+            source, record["error"], record["row"], record["col"],
+            record["count"], record["timestamp_ms"])
+    if kind == "hello":
+        version = record["version"]
+        warn = "" if version == STREAM_VERSION else " (decoder expects %d)" % STREAM_VERSION
+        return "%s hello: protocol %d%s, %dx%d matrix" % (
+            source, version, warn, record["rows"], record["cols"])
+    fields = " ".join("%s=%s" % (k, v) for k, v in record.items() if k not in ("type", "seq"))
+    return "%s %s %s" % (source, kind, fields)
+
+
+def pump(path, args, lock, trace_path):
+    decoder = StreamDecoder()
+    trace = TraceWriter(trace_path) if trace_path else None
+    stream = open_source(path, args.baud)
+    while True:
+        data = stream.read(256) if hasattr(stream, "in_waiting") else stream.read1(256)
+        if not data:
+            if hasattr(stream, "in_waiting"):
+                continue  # serial timeout, keep listening
+            break
+        dropped_before = decoder.dropped
+        records = decoder.feed(data)
+        with lock:
+            if decoder.dropped != dropped_before:
+                print("%s: %d record(s) dropped" % (path, decoder.dropped - dropped_before),
+                      file=sys.stderr)
+            for record in records:
+                if record["type"] == "trace":
+                    if trace:
+                        trace.add(record)
+                    continue
+                print(format_record(path, record, args.json), flush=True)
+    with lock:
+        print("%s: done, %d dropped, %d bad frames" % (path, decoder.dropped, decoder.bad_frames),
+              file=sys.stderr)
+        if trace:
+            print("%s: %d trace blocks written to %s, %d incomplete" % (
+                path, trace.blocks, trace_path, trace.incomplete), file=sys.stderr)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("sources", nargs="+", help="serial ports, files, or - for stdin")
+    parser.add_argument("--baud", type=int, default=115200, help="serial baud rate (ignored by USB CDC)")
+    parser.add_argument("--json", action="store_true", help="print one JSON object per record")
+    parser.add_argument("--trace", metavar="FILE", help="write raw scan trace blocks to FILE")
+    args = parser.parse_args()
+
+    def trace_path(index):
+        if not args.trace or len(args.sources) == 1:
+            return args.trace
+        return "%s.%d" % (args.trace, index + 1)
+
+    lock = threading.Lock()
+    threads = [threading.Thread(target=pump, args=(path, args, lock, trace_path(i)), daemon=True)
+               for i, path in enumerate(args.sources)]
+    for thread in threads:
+        thread.start()
+    try:
+        for thread in threads:
+            thread.join()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,32 @@
+#ifndef TUSB_CONFIG_H
+#define TUSB_CONFIG_H
+
+// TinyUSB configuration for the keypad: CDC (stdio) + HID keyboard
+// Only on the include path when building with MATRIX_USB_HID=ON; the SDK
+// sets CFG_TUSB_MCU and CFG_TUSB_OS.
+
+#ifndef CFG_TUSB_RHPORT0_MODE
+#define CFG_TUSB_RHPORT0_MODE   OPT_MODE_DEVICE
+#endif
+
+#define CFG_TUD_ENABLED         1
+#define CFG_TUD_ENDPOINT0_SIZE  64
+
+#define CFG_TUSB_MEM_SECTION
+#define CFG_TUSB_MEM_ALIGN      __attribute__ ((aligned(4)))
+
+// Device classes
+#define CFG_TUD_CDC             1
+#define CFG_TUD_HID             1
+#define CFG_TUD_MSC             0
+#define CFG_TUD_MIDI            0
+#define CFG_TUD_VENDOR          0
+
+// CDC FIFOs (stdio and the binary event stream)
+#define CFG_TUD_CDC_RX_BUFSIZE  64
+#define CFG_TUD_CDC_TX_BUFSIZE  256
+
+// HID endpoint buffer (one NKRO report)
+#define CFG_TUD_HID_EP_BUFSIZE  32
+
+#endif // TUSB_CONFIG_H
@@ -0,0 +1,165 @@
+#include <string.h>
+#include "tusb.h"
+#include "pico/unique_id.h"
+#include "usb_hid_keyboard.h"
+
+// USB descriptors: CDC (stdio) + NKRO HID keyboard, full speed
+//
+// Replace the VID/PID with your own before shipping (0xCafe is TinyUSB's
+// test VID).
+
+#ifndef USB_HID_VID
+#define USB_HID_VID 0xCafe
+#endif
+#ifndef USB_HID_PID
+#define USB_HID_PID 0x4B01
+#endif
+
+// ============================================================================
+// Device descriptor
+// ============================================================================
+
+static const tusb_desc_device_t desc_device = {
+    .bLength            = sizeof(tusb_desc_device_t),
+    .bDescriptorType    = TUSB_DESC_DEVICE,
+    .bcdUSB             = 0x0200,
+
+    // Composite with an Interface Association Descriptor (CDC)
+    .bDeviceClass       = TUSB_CLASS_MISC,
+    .bDeviceSubClass    = MISC_SUBCLASS_COMMON,
+    .bDeviceProtocol    = MISC_PROTOCOL_IAD,
+    .bMaxPacketSize0    = CFG_TUD_ENDPOINT0_SIZE,
+
+    .idVendor           = USB_HID_VID,
+    .idProduct          = USB_HID_PID,
+    .bcdDevice          = 0x0100,
+
+    .iManufacturer      = 0x01,
+    .iProduct           = 0x02,
+    .iSerialNumber      = 0x03,
+
+    .bNumConfigurations = 0x01
+};
+
+const uint8_t *tud_descriptor_device_cb(void) {
+    return (const uint8_t *)&desc_device;
+}
+
+// ============================================================================
+// HID report descriptor: N-key rollover
+// ============================================================================
+
+// Modifier byte, then one bit per usage 0..USB_HID_NKRO_USAGES-1
+static const uint8_t desc_hid_report[] = {
+    HID_USAGE_PAGE   ( HID_USAGE_PAGE_DESKTOP ),
+    HID_USAGE        ( HID_USAGE_DESKTOP_KEYBOARD ),
+    HID_COLLECTION   ( HID_COLLECTION_APPLICATION ),
+        // Modifiers (Ctrl, Shift, Alt, GUI; left and right)
+        HID_USAGE_PAGE   ( HID_USAGE_PAGE_KEYBOARD ),
+        HID_USAGE_MIN    ( HID_KEY_CONTROL_LEFT ),
+        HID_USAGE_MAX    ( HID_KEY_GUI_RIGHT ),
+        HID_LOGICAL_MIN  ( 0 ),
+        HID_LOGICAL_MAX  ( 1 ),
+        HID_REPORT_COUNT ( 8 ),
+        HID_REPORT_SIZE  ( 1 ),
+        HID_INPUT        ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+        // Key bitmap
+        HID_USAGE_MIN    ( 0 ),
+        HID_USAGE_MAX    ( USB_HID_NKRO_USAGES - 1 ),
+        HID_REPORT_COUNT ( USB_HID_NKRO_USAGES ),
+        HID_REPORT_SIZE  ( 1 ),
+        HID_INPUT        ( HID_DATA | HID_VARIABLE | HID_ABSOLUTE ),
+    HID_COLLECTION_END
+};
+
+const uint8_t *tud_hid_descriptor_report_cb(uint8_t instance) {
+    return desc_hid_report;
+}
+
+// No feature or output reports: the host may ask, there is nothing to give
+uint16_t tud_hid_get_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type,
+                               uint8_t *buffer, uint16_t reqlen) {
+    return 0;
+}
+
+void tud_hid_set_report_cb(uint8_t instance, uint8_t report_id, hid_report_type_t report_type,
+                           const uint8_t *buffer, uint16_t bufsize) {
+}
+
+// ============================================================================
+// Configuration descriptor
+// ============================================================================
+
+enum {
+    ITF_NUM_CDC = 0,
+    ITF_NUM_CDC_DATA,
+    ITF_NUM_HID,
+    ITF_NUM_TOTAL
+};
+
+#define EPNUM_CDC_NOTIF  0x81
+#define EPNUM_CDC_OUT    0x02
+#define EPNUM_CDC_IN     0x82
+#define EPNUM_HID        0x83
+
+#define CONFIG_TOTAL_LEN (TUD_CONFIG_DESC_LEN + TUD_CDC_DESC_LEN + TUD_HID_DESC_LEN)
+
+// bInterval = 1: the host polls the keyboard every 1 ms (full speed)
+static const uint8_t desc_configuration[] = {
+    TUD_CONFIG_DESCRIPTOR(1, ITF_NUM_TOTAL, 0, CONFIG_TOTAL_LEN,
+                          TUSB_DESC_CONFIG_ATT_REMOTE_WAKEUP, 100),
+    TUD_CDC_DESCRIPTOR(ITF_NUM_CDC, 4, EPNUM_CDC_NOTIF, 8, EPNUM_CDC_OUT, EPNUM_CDC_IN, 64),
+    TUD_HID_DESCRIPTOR(ITF_NUM_HID, 5, HID_ITF_PROTOCOL_NONE, sizeof(desc_hid_report),
+                       EPNUM_HID, CFG_TUD_HID_EP_BUFSIZE, 1)
+};
+
+const uint8_t *tud_descriptor_configuration_cb(uint8_t index) {
+    return desc_configuration;
+}
+
+// ============================================================================
+// String descriptors
+// ============================================================================
+
+static const char *const string_desc[] = {
+    NULL,                  // 0: language (handled below)
+    "Matrix Keypad",       // 1: manufacturer
+    "Matrix Keypad NKRO",  // 2: product
+    NULL,                  // 3: serial (board unique ID)
+    "Keypad Console",      // 4: CDC interface
+    "Keypad Keyboard",     // 5: HID interface
+};
+
+static uint16_t desc_str[32 + 1];
+
+const uint16_t *tud_descriptor_string_cb(uint8_t index, uint16_t langid) {
+    char serial[2 * PICO_UNIQUE_BOARD_ID_SIZE_BYTES + 1];
+    const char *str;
+    uint8_t len;
+
+    if (index == 0) {
+        desc_str[1] = 0x0409;  // English
+        len = 1;
+    } else {
+        if (index >= sizeof(string_desc) / sizeof(string_desc[0])) {
+            return NULL;
+        }
+        if (index == 3) {
+            pico_get_unique_board_id_string(serial, sizeof(serial));
+            str = serial;
+        } else {
+            str = string_desc[index];
+        }
+
+        len = (uint8_t)strlen(str);
+        if (len > 32) {
+            len = 32;
+        }
+        for (uint8_t i = 0; i < len; i++) {
+            desc_str[1 + i] = (uint8_t)str[i];
+        }
+    }
+
+    desc_str[0] = (uint16_t)((TUSB_DESC_STRING << 8) | (2 * len + 2));
+    return desc_str;
+}
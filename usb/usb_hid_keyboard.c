@@ -0,0 +1,103 @@
+#include "usb_hid_keyboard.h"
+#include <string.h>
+#include "tusb.h"
+#include "matrix_robust.h"
+#include "matrix_keymap.h"
+
+// HID usage per key
+static uint8_t usage_map[MATRIX_ROWS][MATRIX_COLS];
+
+// Last report the host accepted
+static uint8_t last_report[USB_HID_NKRO_REPORT_BYTES];
+
+// Hex digit to HID usage (number row and letters, no NumLock dependency)
+static uint8_t hex_usage(uint8_t value) {
+    if (value == 0) {
+        return HID_KEY_0;
+    }
+    if (value < 10) {
+        return HID_KEY_1 + (value - 1);
+    }
+    if (value < 16) {
+        return HID_KEY_A + (value - 10);
+    }
+    return HID_KEY_NONE;
+}
+
+void usb_hid_keyboard_init(void) {
+    uint8_t keymap[MATRIX_ROWS][MATRIX_COLS];
+    matrix_default_keymap(keymap);
+    for (int row = 0; row < MATRIX_ROWS; row++) {
+        for (int col = 0; col < MATRIX_COLS; col++) {
+            usage_map[row][col] = hex_usage(keymap[row][col]);
+        }
+    }
+
+    memset(last_report, 0, sizeof(last_report));
+
+    // stdio_init_all() may already have started the stack
+    if (!tud_inited()) {
+        tusb_init();
+    }
+}
+
+void usb_hid_keyboard_set_usage_map(const uint8_t map[MATRIX_ROWS][MATRIX_COLS]) {
+    memcpy(usage_map, map, sizeof(usage_map));
+}
+
+bool usb_hid_keyboard_mounted(void) {
+    return tud_mounted();
+}
+
+// Build the NKRO report for a debounced matrix, per-key work only for keys
+// that are down
+static void build_report(const matrix_row_t matrix[MATRIX_ROWS], uint8_t report[USB_HID_NKRO_REPORT_BYTES]) {
+    memset(report, 0, USB_HID_NKRO_REPORT_BYTES);
+
+    for (int row = 0; row < MATRIX_ROWS; row++) {
+        matrix_row_t pressed = matrix[row];
+        while (pressed) {
+            uint8_t col = __builtin_ctz(pressed);
+            pressed &= pressed - 1;
+
+            uint8_t usage = usage_map[row][col];
+            if (usage >= HID_KEY_CONTROL_LEFT && usage <= HID_KEY_GUI_RIGHT) {
+                report[0] |= (uint8_t)(1u << (usage - HID_KEY_CONTROL_LEFT));
+            } else if (usage != HID_KEY_NONE && usage < USB_HID_NKRO_USAGES) {
+                report[1 + usage / 8] |= (uint8_t)(1u << (usage % 8));
+            }
+        }
+    }
+}
+
+void usb_hid_keyboard_task(void) {
+    tud_task();
+
+    matrix_row_t matrix[MATRIX_ROWS];
+    matrix_robust_get_matrix(matrix);
+
+    uint8_t report[USB_HID_NKRO_REPORT_BYTES];
+    build_report(matrix, report);
+
+    if (memcmp(report, last_report, sizeof(report)) == 0) {
+        return;
+    }
+
+    if (tud_suspended()) {
+        // A press wakes the host; the report goes out once it resumes
+        if (matrix_robust_any_key_pressed()) {
+            tud_remote_wakeup();
+        }
+        return;
+    }
+
+    // The previous report is still in flight: retry on the next call,
+    // last_report only follows what the host actually got
+    if (!tud_hid_ready()) {
+        return;
+    }
+
+    if (tud_hid_report(0, report, sizeof(report))) {
+        memcpy(last_report, report, sizeof(report));
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef USB_HID_KEYBOARD_H
+#define USB_HID_KEYBOARD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "matrix_config.h"
+
+// USB HID keyboard output for the robust driver (RP2350, TinyUSB)
+//
+// The device enumerates as CDC (stdio keeps working) + an N-key-rollover
+// keyboard polled every 1 ms at full speed. The debounced matrix from
+// matrix_robust_get_matrix() is turned straight into a report bitmap: one
+// bit per HID usage, so any number of keys can be down at once. A report
+// is only sent when it differs from the last one the host accepted.
+//
+// Linking TinyUSB directly means stdio_usb no longer runs USB by itself:
+// usb_hid_keyboard_init() starts the stack and usb_hid_keyboard_task()
+// services it, so call the task at least once per millisecond.
+
+// Report layout: modifier byte (usages 0xE0-0xE7) + bitmap of usages 0-127
+#define USB_HID_NKRO_USAGES       128
+#define USB_HID_NKRO_REPORT_BYTES (1 + USB_HID_NKRO_USAGES / 8)
+
+// Start the USB stack and load the default usage map (hex layout: 0-9 on
+// the number row, A-F on the letters; other keys send nothing)
+void usb_hid_keyboard_init(void);
+
+// Set the HID usage sent by each key (HID_KEY_* values, 0 = none)
+// Usages 0xE0-0xE7 act as modifiers (Ctrl, Shift, Alt, GUI)
+void usb_hid_keyboard_set_usage_map(const uint8_t usage_map[MATRIX_ROWS][MATRIX_COLS]);
+
+// Service USB and send a report if the matrix changed (main loop)
+// Also requests a remote wakeup if the host suspended the bus and a key
+// is down
+void usb_hid_keyboard_task(void);
+
+// True once the host has configured the device
+bool usb_hid_keyboard_mounted(void);
+
+#endif // USB_HID_KEYBOARD_H